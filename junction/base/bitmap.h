@@ -260,6 +260,183 @@ std::optional<size_t> dynamic_bitmap::find_next(size_t pos) const {
   return {};
 }
 
+// hierarchical_bitmap is a dynamically-sized set of bits that can find the
+// next set or clear bit in time proportional to size() / kBitsPerLong^2. A
+// summary level records which words are full and which are not empty, so
+// searches skip over runs of full (or empty) words 64 at a time.
+class hierarchical_bitmap {
+ public:
+  hierarchical_bitmap() noexcept = default;
+  explicit hierarchical_bitmap(size_t n) { resize(n); }
+  ~hierarchical_bitmap() = default;
+
+  // Move support
+  hierarchical_bitmap(hierarchical_bitmap &&b) noexcept = default;
+  hierarchical_bitmap &operator=(hierarchical_bitmap &&b) noexcept = default;
+
+  // Copy support
+  hierarchical_bitmap(const hierarchical_bitmap &b) = default;
+  hierarchical_bitmap &operator=(const hierarchical_bitmap &b) = default;
+
+  // size returns the number of bits
+  [[nodiscard]] size_t size() const { return size_; }
+
+  // test returns true if the bit @pos is set
+  [[nodiscard]] bool test(size_t pos) const {
+    assert(pos < size_);
+    return (bits_[detail::get_idx(pos)] & (1UL << detail::get_shift(pos))) != 0;
+  }
+
+  // resize the bitmap to a new number of bits (new bits are clear)
+  void resize(size_t n) {
+    const size_t words = DivideUp(n, detail::kBitsPerLong);
+    bits_.resize(words);
+    full_.resize(DivideUp(words, detail::kBitsPerLong));
+    nonempty_.resize(full_.size());
+    size_ = n;
+    if (!words) return;
+    // Bits past the end must stay clear (a shrink may have cut a word), and
+    // so must the summary bits of words past the end.
+    if (size_t shift = detail::get_shift(n))
+      bits_.back() &= (1UL << shift) - 1;
+    if (size_t shift = detail::get_shift(words)) {
+      full_.back() &= (1UL << shift) - 1;
+      nonempty_.back() &= (1UL << shift) - 1;
+    }
+    update_summary(words - 1);
+  }
+
+  // sets the bit at @pos
+  void set(size_t pos) {
+    assert(pos < size_);
+    size_t idx = detail::get_idx(pos);
+    bits_[idx] |= (1UL << detail::get_shift(pos));
+    update_summary(idx);
+  }
+
+  // clears the bit at @pos
+  void clear(size_t pos) {
+    assert(pos < size_);
+    size_t idx = detail::get_idx(pos);
+    bits_[idx] &= ~(1UL << detail::get_shift(pos));
+    update_summary(idx);
+  }
+
+  // clears all bits
+  void clear() {
+    std::fill(bits_.begin(), bits_.end(), 0);
+    std::fill(full_.begin(), full_.end(), 0);
+    std::fill(nonempty_.begin(), nonempty_.end(), 0);
+  }
+
+  // words returns the number of words that hold the bits
+  [[nodiscard]] size_t words() const { return bits_.size(); }
+
+  // word returns the word that holds bits [idx * kBitsPerLong, ...)
+  [[nodiscard]] unsigned long word(size_t idx) const { return bits_[idx]; }
+
+  // set_word sets the bits of word @idx that are set in @mask
+  void set_word(size_t idx, unsigned long mask) {
+    bits_[idx] |= mask;
+    update_summary(idx);
+  }
+
+  // clear_word clears the bits of word @idx that are set in @mask
+  void clear_word(size_t idx, unsigned long mask) {
+    bits_[idx] &= ~mask;
+    update_summary(idx);
+  }
+
+  // any checks if any bit is set
+  bool any() const {
+    for (const unsigned long val : nonempty_)
+      if (val != 0) return true;
+    return false;
+  }
+
+  // none checks if no bit is set
+  bool none() const { return !any(); }
+
+  // find_next_set finds the next set bit starting at @pos, if it exists
+  [[nodiscard]] std::optional<size_t> find_next_set(size_t pos) const {
+    if (pos >= size_) return {};
+    return find_next<false>(pos);
+  }
+
+  // find_next_clear finds the next clear bit starting at @pos, if it exists
+  [[nodiscard]] std::optional<size_t> find_next_clear(size_t pos) const {
+    if (pos >= size_) return {};
+    return find_next<true>(pos);
+  }
+
+  template <class Archive>
+  void save(Archive &ar) const {
+    ar(bits_, size_);
+  }
+
+  template <class Archive>
+  void load(Archive &ar) {
+    ar(bits_, size_);
+    full_.assign(DivideUp(bits_.size(), detail::kBitsPerLong), 0);
+    nonempty_.assign(full_.size(), 0);
+    for (size_t i = 0; i < bits_.size(); i++) update_summary(i);
+  }
+
+ private:
+  // Recomputes the summary bits for word @idx.
+  void update_summary(size_t idx) {
+    const size_t sidx = detail::get_idx(idx);
+    const unsigned long sbit = 1UL << detail::get_shift(idx);
+    if (bits_[idx] == ~0UL)
+      full_[sidx] |= sbit;
+    else
+      full_[sidx] &= ~sbit;
+    if (bits_[idx] != 0)
+      nonempty_[sidx] |= sbit;
+    else
+      nonempty_[sidx] &= ~sbit;
+  }
+
+  template <bool Invert>
+  std::optional<size_t> find_next(size_t pos) const;
+
+  size_t size_{0};
+  std::vector<unsigned long> bits_;
+  // Bit i is set if bits_[i] has every bit set.
+  std::vector<unsigned long> full_;
+  // Bit i is set if bits_[i] has any bit set.
+  std::vector<unsigned long> nonempty_;
+};
+
+template <bool Invert>
+std::optional<size_t> hierarchical_bitmap::find_next(size_t pos) const {
+  // Check the rest of the word that holds @pos.
+  size_t idx = detail::get_idx(pos);
+  unsigned long val = Invert ? ~bits_[idx] : bits_[idx];
+  val &= ~0UL << detail::get_shift(pos);
+
+  // Otherwise use the summary to find the next word with a match.
+  if (!val) {
+    const std::vector<unsigned long> &summary = Invert ? full_ : nonempty_;
+    size_t next = idx + 1;
+    unsigned long mask = ~0UL << detail::get_shift(next);
+    for (size_t s = detail::get_idx(next); s < summary.size(); s++) {
+      unsigned long sval = Invert ? ~summary[s] : summary[s];
+      sval &= mask;
+      mask = ~0UL;
+      if (!sval) continue;
+      idx = s * detail::kBitsPerLong + __builtin_ctzl(sval);
+      break;
+    }
+    if (idx < next || idx >= bits_.size()) return {};
+    val = Invert ? ~bits_[idx] : bits_[idx];
+  }
+
+  size_t ret = idx * detail::kBitsPerLong + __builtin_ctzl(val);
+  if (ret >= size_) return {};
+  return ret;
+}
+
 // IterableBitmap is the concept of a bitmap that can find set and cleared bits.
 template <typename T>
 concept IterableBitmap = requires(T t) {
@@ -269,7 +446,7 @@ concept IterableBitmap = requires(T t) {
 
 // for_each_set_bit invokes a function for each bit that is set.
 template <IterableBitmap B, typename F>
-void for_each_set_bit(B bitmap, F func) {
+void for_each_set_bit(const B &bitmap, F func) {
   std::optional<size_t> idx = bitmap.find_next_set(0);
   while (idx) {
     func(*idx);
@@ -279,7 +456,7 @@ void for_each_set_bit(B bitmap, F func) {
 
 // for_each_clear_bit invokes a function for each bit that is cleared.
 template <IterableBitmap B, typename F>
-void for_each_clear_bit(B bitmap, F func) {
+void for_each_clear_bit(const B &bitmap, F func) {
   std::optional<size_t> idx = bitmap.find_next_clear(0);
   while (idx) {
     func(*idx);
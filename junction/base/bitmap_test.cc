@@ -0,0 +1,73 @@
+#include "junction/base/bitmap.h"
+
+#include <gtest/gtest.h>
+
+#include <set>
+
+using namespace junction;
+
+class BitmapTest : public ::testing::Test {};
+
+TEST_F(BitmapTest, HierarchicalFindClear) {
+  constexpr size_t kSize = 100000;
+  hierarchical_bitmap b(kSize);
+  EXPECT_TRUE(b.none());
+  EXPECT_EQ(b.find_next_clear(0), 0);
+  EXPECT_FALSE(b.find_next_set(0));
+
+  // Allocating lowest-first fills the bitmap in order.
+  for (size_t i = 0; i < kSize; i++) {
+    std::optional<size_t> pos = b.find_next_clear(0);
+    ASSERT_EQ(pos, i);
+    b.set(*pos);
+  }
+  EXPECT_FALSE(b.find_next_clear(0));
+
+  // Holes are found across runs of full words.
+  for (size_t i : {70000UL, 5UL, 4097UL, kSize - 1}) b.clear(i);
+  EXPECT_EQ(b.find_next_clear(0), 5);
+  EXPECT_EQ(b.find_next_clear(6), 4097);
+  EXPECT_EQ(b.find_next_clear(4098), 70000);
+  EXPECT_EQ(b.find_next_clear(70001), kSize - 1);
+  EXPECT_FALSE(b.find_next_clear(kSize));
+}
+
+TEST_F(BitmapTest, HierarchicalFindSet) {
+  hierarchical_bitmap b(1 << 16);
+  const std::set<size_t> bits = {3, 63, 64, 4095, 4096, 40000, 65535};
+  for (size_t i : bits) b.set(i);
+
+  std::set<size_t> seen;
+  for_each_set_bit(b, [&](size_t i) { seen.insert(i); });
+  EXPECT_EQ(seen, bits);
+
+  b.clear_word(0, ~0UL);
+  EXPECT_EQ(b.find_next_set(0), 64);
+  b.set_word(1, 0xf0);
+  EXPECT_EQ(b.find_next_set(65), 68);
+  EXPECT_TRUE(b.test(64));
+}
+
+TEST_F(BitmapTest, HierarchicalResize) {
+  hierarchical_bitmap b(70);
+  for (size_t i = 0; i < 70; i++) b.set(i);
+  EXPECT_FALSE(b.find_next_clear(0));
+
+  // Grown bits start clear.
+  b.resize(200);
+  EXPECT_EQ(b.find_next_clear(0), 70);
+
+  // Shrinking drops the bits past the end.
+  b.resize(65);
+  b.resize(200);
+  EXPECT_EQ(b.find_next_clear(0), 65);
+  EXPECT_TRUE(b.test(64));
+
+  // The summary forgets the words that were cut off.
+  b.set(130);
+  b.set(199);
+  b.resize(65);
+  for (size_t i = 0; i < 65; i++) b.clear(i);
+  EXPECT_TRUE(b.none());
+  EXPECT_FALSE(b.find_next_set(0));
+}
@@ -2,6 +2,10 @@
 
 #pragma once
 
+extern "C" {
+#include <sys/uio.h>
+}
+
 #include <algorithm>
 #include <atomic>
 #include <bit>
@@ -43,6 +47,15 @@ class ByteChannel {
   // Writes bytes in to the channel. May return less than the bytes available.
   Status<size_t> Write(std::span<const std::byte> buf);
 
+  // Passes up to @len readable bytes to @func in place (as one or two iovecs,
+  // since the data may wrap around). @func returns how many bytes it consumed.
+  template <typename F>
+  Status<size_t> ReadFn(size_t len, F func, bool peek = false);
+  // Passes up to @len bytes of free space to @func in place (as one or two
+  // iovecs). @func returns how many bytes it filled in.
+  template <typename F>
+  Status<size_t> WriteFn(size_t len, F func);
+
   template <class Archive>
   void save(Archive& ar) const {
     size_t sz = in_ - out_;
@@ -128,4 +141,38 @@ inline Status<size_t> ByteChannel::Write(std::span<const std::byte> buf) {
   return n;
 }
 
+template <typename F>
+Status<size_t> ByteChannel::ReadFn(size_t len, F func, bool peek) {
+  size_t in = in_.load(std::memory_order_acquire);
+  size_t out = out_.load(std::memory_order_relaxed);
+  size_t n = std::min(in - out, len);
+  if (n == 0) return MakeError(EAGAIN);
+
+  // Handle the case where the buffer wraps around.
+  size_t n_to_end = std::min(size_ - (out & mask_), n);
+  iovec iov[2] = {{buf_.data() + (out & mask_), n_to_end},
+                  {buf_.data(), n - n_to_end}};
+  size_t ret = func(std::span<const iovec>(iov, n > n_to_end ? 2 : 1));
+  assert(ret <= n);
+  if (!peek) out_.store(out + ret, std::memory_order_release);
+  return ret;
+}
+
+template <typename F>
+Status<size_t> ByteChannel::WriteFn(size_t len, F func) {
+  size_t in = in_.load(std::memory_order_relaxed);
+  size_t out = out_.load(std::memory_order_acquire);
+  size_t n = std::min(size_ - (in - out), len);
+  if (n == 0) return MakeError(EAGAIN);
+
+  // Handle the case where the buffer wraps around.
+  size_t n_to_end = std::min(size_ - (in & mask_), n);
+  iovec iov[2] = {{buf_.data() + (in & mask_), n_to_end},
+                  {buf_.data(), n - n_to_end}};
+  size_t ret = func(std::span<iovec>(iov, n > n_to_end ? 2 : 1));
+  assert(ret <= n);
+  in_.store(in + ret, std::memory_order_release);
+  return ret;
+}
+
 }  // namespace junction
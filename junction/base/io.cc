@@ -6,10 +6,6 @@
 
 namespace junction {
 
-namespace {
-
-constexpr int kStackSlots = 16;
-
 size_t SumIOV(std::span<const iovec> iov) {
   size_t len = 0;
   for (const iovec &e : iov) {
@@ -32,6 +28,10 @@ std::span<iovec> PullIOV(std::span<iovec> iov, size_t n) {
   return {};
 }
 
+namespace {
+
+constexpr int kStackSlots = 16;
+
 template <typename T, auto func>
 Status<void> DoFull(T &io, std::span<const iovec> iov) {
   // first try to send without copying the vector
@@ -410,6 +410,13 @@ class StreamBufferWriter final : public std::streambuf {
   std::unique_ptr<std::byte[]> buf_;
 };
 
+// Returns the total length of @iov.
+size_t SumIOV(std::span<const iovec> iov);
+
+// Drops the first @n bytes from @iov, modifying it in place, and returns the
+// iovecs that are left.
+std::span<iovec> PullIOV(std::span<iovec> iov, size_t n);
+
 // VectoredReader is an interface for vector reads.
 class VectoredReader {
  public:
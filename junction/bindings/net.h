@@ -4,11 +4,14 @@
 
 extern "C" {
 #include <base/stddef.h>
+#include <runtime/reserve.h>
 #include <runtime/tcp.h>
 #include <runtime/udp.h>
 }
 
+#include <algorithm>
 #include <cstddef>
+#include <cstring>
 #include <span>
 
 #include "junction/base/error.h"
@@ -87,6 +90,45 @@ class UDPConn {
     return ret;
   }
 
+  // Reads a datagram into a vector of buffers and gets from remote address.
+  // The datagram is truncated if it doesn't fit.
+  Status<size_t> ReadvFrom(std::span<const iovec> iov, netaddr *raddr,
+                           bool peek = false) {
+    if (iov.size() == 1 || (!iov.empty() && iov[0].iov_len >= kMaxPayloadSize))
+      return ReadFrom(AsSpan(iov[0]), raddr, peek);
+
+    // Caladan only copies out of the mbuf into one buffer, so receive on the
+    // stack and scatter from there.
+    std::byte buf[kMaxPayloadSize];
+    Status<size_t> ret = ReadFrom(buf, raddr, peek);
+    if (!ret) return ret;
+    size_t off = 0;
+    for (const iovec &v : iov) {
+      if (off == *ret) break;
+      size_t n = std::min(v.iov_len, *ret - off);
+      std::memcpy(v.iov_base, buf + off, n);
+      off += n;
+    }
+    return off;
+  }
+  // Writes a datagram gathered from a vector of buffers and sets to remote
+  // address.
+  Status<size_t> WritevTo(std::span<const iovec> iov, const netaddr *raddr) {
+    if (iov.size() == 1) return WriteTo(AsSpan(iov[0]), raddr);
+
+    // Caladan only copies into the mbuf from one buffer, so gather the
+    // datagram on the stack first.
+    std::byte buf[kMaxPayloadSize];
+    size_t len = 0;
+    for (const iovec &v : iov) {
+      if (unlikely(v.iov_len > kMaxPayloadSize - len))
+        return MakeError(EMSGSIZE);
+      std::memcpy(buf + len, v.iov_base, v.iov_len);
+      len += v.iov_len;
+    }
+    return WriteTo({buf, len}, raddr);
+  }
+
   // Reads a datagram.
   Status<size_t> Read(std::span<std::byte> buf, bool peek = false) {
     ssize_t ret = udp_read_from(c_, buf.data(), buf.size_bytes(), NULL, peek);
@@ -115,6 +157,10 @@ class UDPConn {
  private:
   explicit UDPConn(udpconn_t *c) noexcept : c_(c) {}
 
+  static std::span<std::byte> AsSpan(const iovec &v) {
+    return {static_cast<std::byte *>(v.iov_base), v.iov_len};
+  }
+
   udpconn_t *c_{nullptr};
 };
 
@@ -303,4 +349,53 @@ class TCPQueue {
   tcpqueue_t *q_{nullptr};
 };
 
+// Gets this instance's own IP address.
+inline uint32_t LocalIP() { return net_local_addr(); }
+
+// A TCP flow claimed in Caladan's transport table without a connection, so
+// that Caladan never uses it for one of its own connections.
+class TCPReservation {
+ public:
+  TCPReservation() = default;
+  ~TCPReservation() {
+    if (is_valid()) tcp_release_port(r_);
+  }
+
+  // Move support.
+  TCPReservation(TCPReservation &&r) noexcept
+      : r_(std::exchange(r.r_, nullptr)), laddr_(r.laddr_) {}
+  TCPReservation &operator=(TCPReservation &&r) noexcept {
+    if (is_valid()) tcp_release_port(r_);
+    r_ = std::exchange(r.r_, nullptr);
+    laddr_ = r.laddr_;
+    return *this;
+  }
+
+  // disable copy.
+  TCPReservation(const TCPReservation &) = delete;
+  TCPReservation &operator=(const TCPReservation &) = delete;
+
+  // Claims the flow from @laddr to @raddr. If @laddr's port is zero, an
+  // ephemeral port is chosen.
+  static Status<TCPReservation> Reserve(netaddr laddr, netaddr raddr) {
+    port_reservation *r;
+    int ret = tcp_reserve_port(&laddr, raddr, &r);
+    if (ret) return MakeError(-ret);
+    return TCPReservation(r, laddr);
+  }
+
+  // Does this hold a valid reservation?
+  [[nodiscard]] bool is_valid() const { return r_ != nullptr; }
+
+  // Gets the reserved local address.
+  [[nodiscard]] netaddr LocalAddr() const { return laddr_; }
+
+ private:
+  TCPReservation(port_reservation *r, netaddr laddr) noexcept
+      : r_(r), laddr_(laddr) {}
+
+  port_reservation *r_{nullptr};
+  netaddr laddr_{0, 0};
+};
+
 }  // namespace junction::rt
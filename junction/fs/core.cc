@@ -289,6 +289,15 @@ Status<std::span<char>> IDir::GetFullPath(const FSRoot &fs,
   return out.span();
 }
 
+void IDir::IterateDents(off_t cookie, const DirIterFn &func) {
+  std::vector<dir_entry> ents = GetDents();
+  for (size_t i = std::max(cookie, off_t{0}); i < ents.size(); i++) {
+    const dir_entry &ent = ents[i];
+    if (!func({ent.name, ent.inum, ent.type}, static_cast<off_t>(i + 1)))
+      break;
+  }
+}
+
 //
 // System call implementation
 //
@@ -671,6 +680,25 @@ Status<void> LinuxFSMount(std::shared_ptr<IDir> pos,
 
   Status<std::shared_ptr<IDir>> mount = linuxfs::MountLinux(host_path);
   if (!mount) return MakeError(mount);
+  if (GetCfg().overlay_linux_fs()) {
+    mount = overlayfs::MountOverlay(std::move(*mount));
+    if (!mount) return MakeError(mount);
+  }
+  dir->Mount(std::string(name), std::move(*mount));
+  return {};
+}
+
+// Mounts the logfs configured on the command line at @mount_point.
+Status<void> LogFSMount(std::shared_ptr<IDir> pos,
+                        std::string_view mount_point) {
+  Status<Entry> tmp = SetupMountPoint(pos, mount_point);
+  if (!tmp) return MakeError(tmp);
+  auto &[dir, name, must_be_dir] = *tmp;
+
+  const JunctionCfg &cfg = GetCfg();
+  Status<std::shared_ptr<IDir>> mount = logfs::MountLogFS(
+      cfg.get_logfs_device(), cfg.get_logfs_size_mb() * 1024 * 1024);
+  if (!mount) return MakeError(mount);
   dir->Mount(std::string(name), std::move(*mount));
   return {};
 }
@@ -700,6 +728,12 @@ Status<void> InitFs(
   // Set the root to the linux FS mount point.
   Status<std::shared_ptr<IDir>> tmp = linuxfs::InitLinuxRoot();
   if (!tmp) return MakeError(tmp);
+
+  // Optionally keep all writes in an in-memory layer above the linux FS.
+  if (GetCfg().overlay_linux_fs()) {
+    tmp = overlayfs::MountOverlay(std::move(*tmp));
+    if (!tmp) return MakeError(tmp);
+  }
   IDir &linux_root = *tmp->get();
   linux_root.inc_nlink();
   // root's parent is itself.
@@ -726,6 +760,11 @@ Status<void> InitFs(
     if (Status<void> ret = MemFSMount(*tmp, p); !ret) return ret;
   }
 
+  // Mount the block device filesystem if one was configured.
+  if (!GetCfg().get_logfs_device().empty()) {
+    if (Status<void> ret = LogFSMount(*tmp, "/logfs"); !ret) return ret;
+  }
+
   FSRoot::InitFsRoot(std::move(*tmp));
 
   // Use the current cwd.
@@ -1,5 +1,6 @@
 extern "C" {
 #include <fcntl.h>
+#include <linux/memfd.h>
 #include <sys/ioctl.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
@@ -9,11 +10,15 @@ extern "C" {
 #include <algorithm>
 #include <bit>
 #include <cstring>
+#include <limits>
 #include <memory>
+#include <optional>
+#include <utility>
+#include <vector>
 
-#include "junction/base/finally.h"
 #include "junction/base/io.h"
 #include "junction/bindings/log.h"
+#include "junction/bindings/runtime.h"
 #include "junction/fs/file.h"
 #include "junction/fs/fs.h"
 #include "junction/junction.h"
@@ -27,6 +32,15 @@ namespace {
 constexpr size_t kInitialCap = 64;
 constexpr size_t kOversizeRatio = 2;
 
+// Readahead windows (the same defaults as Linux). The window starts small and
+// doubles with each sequential read up to the maximum, which is doubled again
+// for files advised with POSIX_FADV_SEQUENTIAL.
+constexpr size_t kMinReadahead = 128 * 1024;
+constexpr size_t kMaxReadahead = 2 * 1024 * 1024;
+
+// The longest name accepted by memfd_create() (excluding the "memfd:" prefix).
+constexpr size_t kMemFDNameMax = 249;
+
 }  // namespace
 
 namespace junction {
@@ -51,18 +65,56 @@ std::unique_ptr<file_array> CopyFileArray(const file_array &src, size_t cap) {
 
 }  // namespace detail
 
+namespace {
+
+// Returns the bits of bitmap word @idx that fall within [@low, @high].
+unsigned long RangeMask(size_t idx, size_t low, size_t high) {
+  constexpr size_t kBits = detail::kBitsPerLong;
+  const size_t first = idx * kBits;
+  unsigned long mask = ~0UL;
+  if (low > first) mask &= ~0UL << (low - first);
+  if (high < first + kBits - 1) mask &= ~0UL >> (first + kBits - 1 - high);
+  return mask;
+}
+
+}  // namespace
+
 FileTable::FileTable()
     : farr_(std::make_unique<FArr>(kInitialCap)),
       rcup_(farr_.get()),
-      close_on_exec_(kInitialCap) {}
+      used_(kInitialCap),
+      close_on_exec_(kInitialCap),
+      cache_(NewCache()) {}
 
 FileTable::FileTable(const FileTable &o)
     : farr_(CopyFileArray(*o.farr_, o.farr_->len)),
       rcup_(farr_.get()),
-      close_on_exec_(o.close_on_exec_) {}
+      used_(o.used_),
+      close_on_exec_(o.close_on_exec_),
+      cache_(NewCache()) {}
 
 FileTable::~FileTable() = default;
 
+std::unique_ptr<detail::fd_cache[]> FileTable::NewCache() {
+  return std::make_unique<detail::fd_cache[]>(rt::RuntimeMaxCores());
+}
+
+File *FileTable::GetSlow(int fd, detail::fd_cache::entry &e) {
+  assert(rt::RCURead::IsHeld());
+  // Read the generation first, so a concurrent change to the slot either is
+  // seen below or leaves the entry stale.
+  const uint64_t gen = gen_.load(std::memory_order_acquire);
+  const FArr *tbl = rcup_.get();
+  if (unlikely(static_cast<size_t>(fd) >= tbl->len)) return nullptr;
+  File *f = tbl->files[fd].get();
+  if (!f) return nullptr;
+  if (e.file != f) e.ref.reset();
+  e.fd = fd;
+  e.gen = gen;
+  e.file = f;
+  return f;
+}
+
 void FileTable::Resize(size_t len) {
   assert(lock_.IsHeld());
   size_t new_cap = std::bit_ceil(len) * kOversizeRatio;
@@ -72,45 +124,79 @@ void FileTable::Resize(size_t len) {
     rcup_.set(narr.get());
     rt::RCUFree(std::move(farr_));
     farr_ = std::move(narr);
+    used_.resize(new_cap);
     close_on_exec_.resize(new_cap);
   }
 }
 
+namespace {
+
+// Releases a biased reference's hold on the file's shared refcount.
+struct DropFileRef {
+  std::shared_ptr<File> ref;
+  void operator()(File *) { ref.reset(); }
+};
+
+}  // namespace
+
 std::shared_ptr<File> FileTable::Dup(int fd) {
+  if (unlikely(fd < 0)) return {};
   rt::RCURead l;
   rt::RCUReadGuard g(l);
+  detail::fd_cache::entry &e =
+      cache_[l.get_cpu()].ent[fd % detail::fd_cache::kEntries];
+  if (e.fd != fd || e.gen != gen_.load(std::memory_order_acquire)) {
+    if (!GetSlow(fd, e)) return {};
+  }
+
+  // Share a reference that is already outstanding on this kthread.
+  if (std::shared_ptr<File> f = e.ref.lock()) return f;
+
   const FArr *tbl = rcup_.get();
   if (unlikely(static_cast<size_t>(fd) >= tbl->len)) return {};
-  return tbl->files[fd];
+  std::shared_ptr<File> f = tbl->files[fd];
+  if (unlikely(f.get() != e.file)) return f;
+
+  // Otherwise take one reference from the table's file and hand out a new
+  // refcount for it. Later calls on this kthread only touch the new count
+  // until every reference has been dropped, and the entry never holds the
+  // file open by itself.
+  std::shared_ptr<File> biased(e.file, DropFileRef{std::move(f)});
+  e.ref = biased;
+  return biased;
 }
 
 int FileTable::Insert(std::shared_ptr<File> f, bool cloexec, size_t lowest) {
   rt::SpinGuard g(lock_);
-  size_t i;
-  auto fin = finally([this, cloexec, &i] {
-    if (cloexec) close_on_exec_.set(i);
-  });
 
-  // Find the first empty slot to insert the file.
-  for (i = lowest; i < farr_->len; ++i) {
-    if (!farr_->files[i]) {
-      farr_->files[i] = std::move(f);
-      return static_cast<int>(i);
-    }
+  // Find the first empty slot, or grow the table if there is none.
+  size_t i = used_.find_next_clear(lowest).value_or(
+      std::max(lowest, used_.size()));
+  if (i >= farr_->len) {
+    Resize(i + 1);
+    farr_->len = i + 1;
   }
-
-  // Otherwise grow the table.
-  Resize(i + 1);
-  farr_->len = i + 1;
   farr_->files[i] = std::move(f);
+  used_.set(i);
+  if (cloexec) close_on_exec_.set(i);
   return static_cast<int>(i);
 }
 
 void FileTable::InsertAt(int fd, std::shared_ptr<File> f, bool cloexec) {
+  std::shared_ptr<File> tmp;  // so destructor is called without lock held
   rt::SpinGuard g(lock_);
-  if (static_cast<size_t>(fd) >= farr_->len) Resize(fd);
-  farr_->files[fd] = std::move(f);
-  if (cloexec) close_on_exec_.set(fd);
+  const size_t i = static_cast<size_t>(fd);
+  if (i >= farr_->len) {
+    Resize(i + 1);
+    farr_->len = i + 1;
+  }
+  tmp = std::exchange(farr_->files[i], std::move(f));
+  if (tmp) BumpGenLocked();
+  used_.set(i);
+  if (cloexec)
+    close_on_exec_.set(i);
+  else
+    close_on_exec_.clear(i);
 }
 
 bool FileTable::Remove(int fd) {
@@ -124,6 +210,8 @@ bool FileTable::Remove(int fd) {
 
     // Remove the file.
     tmp = std::move(farr_->files[fd]);
+    BumpGenLocked();
+    used_.clear(fd);
 
     // Clear close-on-exec.
     close_on_exec_.clear(fd);
@@ -131,34 +219,45 @@ bool FileTable::Remove(int fd) {
   return true;
 }
 
-void FileTable::RemoveRange(int low, int high) {
-  assert(low >= 0 && high >= 0);
-  std::vector<std::shared_ptr<File>> tmp;
-  {
-    rt::SpinGuard g(lock_);
-    int max = farr_->len - 1;
-    low = std::min(low, max);
-    high = std::min(high, max);
-
-    tmp.reserve(high - low + 1);
-    for (int fd = low; fd <= high; fd++) {
-      if (!farr_->files[fd]) continue;
-      tmp.emplace_back(std::move(farr_->files[fd]));
-      close_on_exec_.clear(fd);
-    }
+void FileTable::RemoveWordLocked(size_t idx, unsigned long mask,
+                                 std::vector<std::shared_ptr<File>> &out) {
+  assert(lock_.IsHeld());
+  used_.clear_word(idx, mask);
+  close_on_exec_.clear_word(idx, mask);
+  if (!mask) return;
+  const size_t base = idx * detail::kBitsPerLong;
+  for (; mask; mask &= mask - 1) {
+    const size_t fd = base + __builtin_ctzl(mask);
+    out.emplace_back(std::move(farr_->files[fd]));
   }
+  BumpGenLocked();
 }
 
-void FileTable::SetCloseOnExecRange(int low, int high) {
-  assert(low >= 0 && high >= 0);
+void FileTable::RemoveRange(size_t low, size_t high) {
+  std::vector<std::shared_ptr<File>> tmp;  // released without lock held
   rt::SpinGuard g(lock_);
+  if (low > high || low >= farr_->len) return;
+  high = std::min(high, farr_->len - 1);
+
+  // Visit only the bitmap words that have open files in the range.
+  std::optional<size_t> pos = used_.find_next_set(low);
+  while (pos && *pos <= high) {
+    const size_t idx = detail::get_idx(*pos);
+    RemoveWordLocked(idx, used_.word(idx) & RangeMask(idx, low, high), tmp);
+    pos = used_.find_next_set((idx + 1) * detail::kBitsPerLong);
+  }
+}
 
-  int max = farr_->len;
-  low = std::min(low, max);
-  high = std::min(high, max);
-
-  for (int fd = low; fd <= high; fd++) {
-    if (farr_->files[fd]) close_on_exec_.set(fd);
+void FileTable::SetCloseOnExecRange(size_t low, size_t high) {
+  rt::SpinGuard g(lock_);
+  if (low > high || low >= farr_->len) return;
+  high = std::min(high, farr_->len - 1);
+
+  std::optional<size_t> pos = used_.find_next_set(low);
+  while (pos && *pos <= high) {
+    const size_t idx = detail::get_idx(*pos);
+    close_on_exec_.set_word(idx, used_.word(idx) & RangeMask(idx, low, high));
+    pos = used_.find_next_set((idx + 1) * detail::kBitsPerLong);
   }
 }
 
@@ -181,10 +280,14 @@ void FileTable::ClearCloseOnExec(int fd) {
 }
 
 void FileTable::DoCloseOnExec() {
+  std::vector<std::shared_ptr<File>> tmp;  // released without lock held
   rt::SpinGuard g(lock_);
-  for_each_set_bit(close_on_exec_,
-                   [this](size_t i) { farr_->files[i].reset(); });
-  close_on_exec_.clear();
+  std::optional<size_t> pos = close_on_exec_.find_next_set(0);
+  while (pos) {
+    const size_t idx = detail::get_idx(*pos);
+    RemoveWordLocked(idx, close_on_exec_.word(idx), tmp);
+    pos = close_on_exec_.find_next_set((idx + 1) * detail::kBitsPerLong);
+  }
 }
 
 //
@@ -200,11 +303,54 @@ long usys_ftruncate(int fd, off_t length) {
   return 0;
 }
 
+long usys_fallocate(int fd, int mode, off_t offset, off_t len) {
+  FileTable &ftbl = myproc().get_file_table();
+  File *f = ftbl.Get(fd);
+  if (unlikely(!f || !f->is_writeable())) return -EBADF;
+  Status<void> ret = f->Allocate(mode, offset, len);
+  if (!ret) return MakeCError(ret);
+  return 0;
+}
+
+long usys_fadvise64(int fd, off_t offset, off_t len, int advice) {
+  FileTable &ftbl = myproc().get_file_table();
+  File *f = ftbl.Get(fd);
+  if (unlikely(!f)) return -EBADF;
+  Status<void> ret = f->Advise(offset, len, advice);
+  if (!ret) return MakeCError(ret);
+  return 0;
+}
+
+ssize_t usys_readahead(int fd, off_t offset, size_t count) {
+  FileTable &ftbl = myproc().get_file_table();
+  File *f = ftbl.Get(fd);
+  if (unlikely(!f || !f->is_readable())) return -EBADF;
+  if (f->get_type() != FileType::kNormal) return -EINVAL;
+  off_t len = static_cast<off_t>(
+      std::min(count, static_cast<size_t>(std::numeric_limits<off_t>::max())));
+  Status<void> ret = f->Advise(offset, len, POSIX_FADV_WILLNEED);
+  if (!ret) return MakeCError(ret);
+  return 0;
+}
+
+namespace {
+
+// Updates the calling thread's I/O counters (see /proc/<pid>/io).
+void AccountRead(const Status<size_t> &ret) {
+  mythread().get_io_counters().AccountRead(ret ? *ret : 0);
+}
+void AccountWrite(const Status<size_t> &ret) {
+  mythread().get_io_counters().AccountWrite(ret ? *ret : 0);
+}
+
+}  // namespace
+
 ssize_t usys_read(int fd, char *buf, size_t len) {
   FileTable &ftbl = myproc().get_file_table();
   File *f = ftbl.Get(fd);
   if (unlikely(!f || !f->is_readable())) return -EBADF;
   Status<size_t> ret = f->Read(readable_span(buf, len), &f->get_off_ref());
+  AccountRead(ret);
   if (!ret) return MakeCError(ret);
   return static_cast<ssize_t>(*ret);
 }
@@ -215,6 +361,7 @@ ssize_t usys_readv(int fd, struct iovec *iov, int iovcnt) {
   if (unlikely(!f || !f->is_readable())) return -EBADF;
   Status<size_t> ret =
       f->Readv({iov, static_cast<size_t>(iovcnt)}, &f->get_off_ref());
+  AccountRead(ret);
   if (!ret) return MakeCError(ret);
   return static_cast<ssize_t>(*ret);
 }
@@ -224,6 +371,7 @@ ssize_t usys_write(int fd, const char *buf, size_t len) {
   File *f = ftbl.Get(fd);
   if (unlikely(!f || !f->is_writeable())) return -EBADF;
   Status<size_t> ret = f->Write(writable_span(buf, len), &f->get_off_ref());
+  AccountWrite(ret);
   if (!ret) return MakeCError(ret);
   return static_cast<ssize_t>(*ret);
 }
@@ -233,6 +381,7 @@ ssize_t usys_pread64(int fd, char *buf, size_t len, off_t offset) {
   File *f = ftbl.Get(fd);
   if (unlikely(!f || !f->is_readable())) return -EBADF;
   Status<size_t> ret = f->Read(readable_span(buf, len), &offset);
+  AccountRead(ret);
   if (!ret) return MakeCError(ret);
   return static_cast<ssize_t>(*ret);
 }
@@ -310,7 +459,8 @@ struct linux_dirent {
   char d_name[1];          /* Filename (null-terminated) plus 1 byte d_type */
 };
 
-size_t DirentToDent64(dir_entry &ent, std::span<std::byte> dirp, off_t off) {
+size_t DirentToDent64(const dir_entry_view &ent, std::span<std::byte> dirp,
+                      off_t off) {
   size_t ent_size = sizeof(linux_dirent64) + ent.name.size() + 1;
   ent_size = AlignUp(ent_size, alignof(linux_dirent64));
   if (ent_size > dirp.size()) return 0;
@@ -324,7 +474,8 @@ size_t DirentToDent64(dir_entry &ent, std::span<std::byte> dirp, off_t off) {
   return ent_size;
 }
 
-size_t DirentToDent(dir_entry &ent, std::span<std::byte> dirp, off_t off) {
+size_t DirentToDent(const dir_entry_view &ent, std::span<std::byte> dirp,
+                    off_t off) {
   size_t ent_size = sizeof(linux_dirent) + ent.name.size() + 1;
   ent_size = AlignUp(ent_size, alignof(linux_dirent));
   if (ent_size > dirp.size()) return 0;
@@ -341,18 +492,28 @@ size_t DirentToDent(dir_entry &ent, std::span<std::byte> dirp, off_t off) {
 template <typename ConvertFn>
 Status<long> DoDirent(IDir &dir, std::span<std::byte> dirp, off_t &off,
                       ConvertFn func) {
-  std::vector<dir_entry> ents = dir.GetDents();
-  std::span<std::byte> out = dirp;
-  while (static_cast<size_t>(off) < ents.size()) {
-    size_t sz = func(ents[off], out, off);
+  // Only a single reference is captured so that the callback stays small.
+  struct {
+    std::span<std::byte> out;
+    off_t &off;
+    ConvertFn &func;
+    bool full;
+  } st{dirp, off, func, false};
+
+  // Stop at the first entry that doesn't fit, and resume from it next time.
+  dir.IterateDents(off, [&st](const dir_entry_view &ent, off_t next) {
+    size_t sz = st.func(ent, st.out, next);
     if (!sz) {
-      if (out.size() == dirp.size()) return MakeError(EINVAL);
-      break;
+      st.full = true;
+      return false;
     }
-    out = out.subspan(sz);
-    off++;
-  }
-  return dirp.size() - out.size();
+    st.out = st.out.subspan(sz);
+    st.off = next;
+    return true;
+  });
+
+  if (st.full && st.out.size() == dirp.size()) return MakeError(EINVAL);
+  return dirp.size() - st.out.size();
 }
 
 DirectoryFile::DirectoryFile(unsigned int flags, FileMode mode,
@@ -381,6 +542,83 @@ Status<long> SoftLinkFile::ReadLink(std::span<std::byte> buf) {
   return copy;
 }
 
+Status<void> SeekableFile::Advise(off_t off, off_t len, int advice) {
+  if (unlikely(len < 0)) return MakeError(EINVAL);
+
+  // A zero length (or one that overflows) means the rest of the file.
+  off_t end;
+  if (!len || __builtin_add_overflow(off, len, &end))
+    end = std::numeric_limits<off_t>::max();
+
+  switch (advice) {
+    case POSIX_FADV_NORMAL:
+    case POSIX_FADV_SEQUENTIAL:
+    case POSIX_FADV_RANDOM: {
+      rt::SpinGuard g(ra_lock_);
+      if (advice == POSIX_FADV_SEQUENTIAL)
+        access_ = Access::kSequential;
+      else if (advice == POSIX_FADV_RANDOM)
+        access_ = Access::kRandom;
+      else
+        access_ = Access::kNormal;
+      ra_window_ = 0;
+      return {};
+    }
+    case POSIX_FADV_WILLNEED: {
+      off = std::max(off, off_t{0});
+      end = std::min(end, static_cast<off_t>(get_size()));
+      if (off < end) Prefetch(off, end - off);
+      return {};
+    }
+    case POSIX_FADV_DONTNEED:
+      if (off < 0) off = 0;
+      if (off >= end) return {};
+      return Evict(off, end - off);
+    case POSIX_FADV_NOREUSE:
+      return {};
+    default:
+      return MakeError(EINVAL);
+  }
+}
+
+void SeekableFile::NoteRead(off_t off, size_t len) {
+  if (!len) return;
+  const off_t end = off + static_cast<off_t>(len);
+  off_t start, stop;
+  {
+    rt::SpinGuard g(ra_lock_);
+    if (access_ == Access::kRandom) return;
+
+    // A read that doesn't continue the last one ends the sequential run.
+    if (off != ra_next_) {
+      ra_next_ = ra_end_ = end;
+      ra_window_ = 0;
+      return;
+    }
+    ra_next_ = end;
+
+    // Wait until half of the last prefetch has been consumed, so that the
+    // next one is issued well before the reader catches up with it.
+    if (ra_window_ && end + static_cast<off_t>(ra_window_ / 2) < ra_end_)
+      return;
+
+    const size_t max = access_ == Access::kSequential ? kMaxReadahead * 2
+                                                      : kMaxReadahead;
+    if (access_ == Access::kSequential)
+      ra_window_ = max;
+    else if (!ra_window_)
+      ra_window_ = std::min(std::max(kMinReadahead, len * 2), max);
+    else
+      ra_window_ = std::min(ra_window_ * 2, max);
+
+    start = std::max(ra_end_, end);
+    stop = ra_end_ = end + static_cast<off_t>(ra_window_);
+  }
+
+  stop = std::min(stop, static_cast<off_t>(get_size()));
+  if (start < stop) Prefetch(start, stop - start);
+}
+
 ssize_t usys_writev(int fd, const iovec *iov, int iovcnt) {
   if (iovcnt <= 0) return -EINVAL;
   FileTable &ftbl = myproc().get_file_table();
@@ -388,6 +626,7 @@ ssize_t usys_writev(int fd, const iovec *iov, int iovcnt) {
   if (unlikely(!f || !f->is_writeable())) return -EBADF;
   Status<size_t> ret =
       f->Writev({iov, static_cast<size_t>(iovcnt)}, &f->get_off_ref());
+  AccountWrite(ret);
   if (!ret) return MakeCError(ret);
   return static_cast<ssize_t>(*ret);
 }
@@ -398,6 +637,7 @@ ssize_t usys_pwritev(int fd, const iovec *iov, int iovcnt, off_t offset) {
   File *f = ftbl.Get(fd);
   if (unlikely(!f || !f->is_writeable())) return -EBADF;
   Status<size_t> ret = f->Writev({iov, static_cast<size_t>(iovcnt)}, &offset);
+  AccountWrite(ret);
   if (!ret) return MakeCError(ret);
   return static_cast<ssize_t>(*ret);
 }
@@ -411,6 +651,7 @@ ssize_t usys_pwritev2(int fd, const iovec *iov, int iovcnt, off_t offset,
   File *f = ftbl.Get(fd);
   if (unlikely(!f || !f->is_writeable())) return -EBADF;
   Status<size_t> ret = f->Writev({iov, static_cast<size_t>(iovcnt)}, &offset);
+  AccountWrite(ret);
   if (!ret) return MakeCError(ret);
   return static_cast<ssize_t>(*ret);
 }
@@ -420,24 +661,7 @@ ssize_t usys_pwrite64(int fd, const char *buf, size_t len, off_t offset) {
   File *f = ftbl.Get(fd);
   if (unlikely(!f || !f->is_writeable())) return -EBADF;
   Status<size_t> ret = f->Write(writable_span(buf, len), &offset);
-  if (!ret) return MakeCError(ret);
-  return static_cast<ssize_t>(*ret);
-}
-
-// TODO(girfan): Inefficient; extra copy can be removed?
-ssize_t usys_sendfile(int out_fd, int in_fd, off_t *offset, size_t count) {
-  FileTable &ftbl = myproc().get_file_table();
-  File *fout = ftbl.Get(out_fd);
-  if (unlikely(!fout || !fout->is_writeable())) return -EBADF;
-  File *fin = ftbl.Get(in_fd);
-  if (unlikely(!fin || !fin->is_readable() ||
-               fin->get_type() == FileType::kSocket))
-    return -EBADF;
-  std::vector<std::byte> buf(count);
-  off_t &off = offset ? *offset : fin->get_off_ref();
-  Status<size_t> ret = fin->Read(buf, &off);
-  if (!ret) return MakeCError(ret);
-  ret = fout->Write(buf, &fout->get_off_ref());
+  AccountWrite(ret);
   if (!ret) return MakeCError(ret);
   return static_cast<ssize_t>(*ret);
 }
@@ -462,6 +686,15 @@ long usys_fsync(int fd) {
   return 0;
 }
 
+long usys_fdatasync(int fd) {
+  FileTable &ftbl = myproc().get_file_table();
+  File *f = ftbl.Get(fd);
+  if (unlikely(!f)) return -EBADF;
+  Status<void> ret = f->DataSync();
+  if (!ret) return MakeCError(ret);
+  return 0;
+}
+
 long usys_dup(int oldfd) {
   FileTable &ftbl = myproc().get_file_table();
   std::shared_ptr<File> f = ftbl.Dup(oldfd);
@@ -581,6 +814,16 @@ long usys_fcntl(int fd, unsigned int cmd, unsigned long arg) {
       return 0;
     case F_GETFL:
       return ToFlags(f->get_mode()) | f->get_flags();
+    case F_ADD_SEALS: {
+      Status<void> ret = f->AddSeals(static_cast<unsigned int>(arg));
+      if (!ret) return MakeCError(ret);
+      return 0;
+    }
+    case F_GET_SEALS: {
+      Status<unsigned int> ret = f->GetSeals();
+      if (!ret) return MakeCError(ret);
+      return *ret;
+    }
     case F_SETFL:
       arg &= ~(O_RDONLY | O_WRONLY | O_RDWR | O_CREAT | O_EXCL | O_NOCTTY |
                O_TRUNC);
@@ -594,6 +837,25 @@ long usys_fcntl(int fd, unsigned int cmd, unsigned long arg) {
   }
 }
 
+long usys_memfd_create(const char *name, unsigned int flags) {
+  // Huge page backed files are approximated with memfs, which already uses
+  // transparent huge pages.
+  constexpr unsigned int kSupported = MFD_CLOEXEC | MFD_ALLOW_SEALING |
+                                      MFD_HUGETLB |
+                                      (MFD_HUGE_MASK << MFD_HUGE_SHIFT);
+  if (flags & ~kSupported) return -EINVAL;
+  if (!(flags & MFD_HUGETLB) && (flags & (MFD_HUGE_MASK << MFD_HUGE_SHIFT)))
+    return -EINVAL;
+  size_t len = strnlen(name, kMemFDNameMax + 1);
+  if (len > kMemFDNameMax) return -EINVAL;
+
+  Status<std::shared_ptr<File>> f =
+      memfs::CreateMemFD({name, len}, flags & MFD_ALLOW_SEALING);
+  if (!f) return MakeCError(f);
+  FileTable &ftbl = myproc().get_file_table();
+  return ftbl.Insert(std::move(*f), flags & MFD_CLOEXEC);
+}
+
 long usys_chown(const char *pathname, uid_t owner, gid_t group) {
   LOG_ONCE(WARN) << "chown: no-op";
   return 0;
@@ -604,8 +866,9 @@ long usys_chmod(const char *pathname, mode_t mode) {
   return 0;
 }
 
-long usys_close_range(int first, int last, unsigned int flags) {
-  if (unlikely(flags & ~CLOSE_RANGE_CLOEXEC)) return -EINVAL;
+long usys_close_range(unsigned int first, unsigned int last,
+                      unsigned int flags) {
+  if (unlikely(flags & ~CLOSE_RANGE_CLOEXEC || first > last)) return -EINVAL;
   FileTable &ftbl = myproc().get_file_table();
   if (flags & CLOSE_RANGE_CLOEXEC)
     ftbl.SetCloseOnExecRange(first, last);
@@ -8,9 +8,12 @@ extern "C" {
 #include <sys/statfs.h>
 }
 
+#include <atomic>
 #include <memory>
 #include <span>
+#include <vector>
 
+#include "junction/base/arch.h"
 #include "junction/base/bitmap.h"
 #include "junction/base/error.h"
 #include "junction/bindings/rcu.h"
@@ -30,6 +33,7 @@ enum class FileType : int {
   kSocket,
   kSpecial,
   kSymlink,
+  kPipe,
 };
 
 //
@@ -104,6 +108,8 @@ enum class SeekFrom : int {
   kStart = SEEK_SET,
   kEnd = SEEK_END,
   kCurrent = SEEK_CUR,
+  kData = SEEK_DATA,
+  kHole = SEEK_HOLE,
 };
 
 // Forward declaration
@@ -140,10 +146,15 @@ class File : public std::enable_shared_from_this<File> {
     return MakeError(EINVAL);
   }
   virtual Status<void> Truncate(off_t newlen) { return MakeError(EINVAL); }
+  virtual Status<void> Allocate(int mode, off_t off, off_t len) {
+    return MakeError(EOPNOTSUPP);
+  }
   virtual Status<off_t> Seek(off_t off, SeekFrom origin) {
     return MakeError(EINVAL);
   }
   virtual Status<void> Sync() { return MakeError(EINVAL); }
+  // Like Sync(), but may skip metadata not needed to read the data back.
+  virtual Status<void> DataSync() { return Sync(); }
   virtual Status<void *> MMap(void *addr, size_t length, int prot, int flags,
                               off_t off) {
     return MakeError(EINVAL);
@@ -170,6 +181,31 @@ class File : public std::enable_shared_from_this<File> {
   virtual Status<size_t> Writev(std::span<const iovec> vec, off_t *off);
   virtual Status<size_t> Readv(std::span<iovec> vec, off_t *off);
 
+  // Optional fast paths for TransferData(). SpliceTo() moves data from this
+  // file directly into @out, and SpliceFrom() fills this file directly from
+  // @in, in both cases without an intermediate buffer. Either returns
+  // EOPNOTSUPP if it can't handle the other file. @nonblocking makes a pipe
+  // end nonblocking for this call only (SPLICE_F_NONBLOCK).
+  virtual Status<size_t> SpliceTo(File &out, off_t *off, off_t *out_off,
+                                  size_t len, bool nonblocking) {
+    return MakeError(EOPNOTSUPP);
+  }
+  virtual Status<size_t> SpliceFrom(File &in, off_t *in_off, off_t *off,
+                                    size_t len, bool nonblocking) {
+    return MakeError(EOPNOTSUPP);
+  }
+
+  // Applies posix_fadvise() @advice to a range of the file. A @len of zero
+  // extends the range to the end of the file.
+  virtual Status<void> Advise(off_t off, off_t len, int advice) {
+    return MakeError(ESPIPE);
+  }
+  // Adds file seals (see F_ADD_SEALS in fcntl(2)).
+  virtual Status<void> AddSeals(unsigned int seals) {
+    return MakeError(EINVAL);
+  }
+  virtual Status<unsigned int> GetSeals() const { return MakeError(EINVAL); }
+
   // getters and setters
   [[nodiscard]] FileType get_type() const { return type_; }
   [[nodiscard]] unsigned int get_flags() const { return flags_; }
@@ -203,6 +239,10 @@ class File : public std::enable_shared_from_this<File> {
     return poll_;
   }
 
+  // Returns true if the file reports readiness through its poll source. Others
+  // (e.g., regular files) never set any poll events and are always ready.
+  [[nodiscard]] virtual bool has_poll_source() const { return false; }
+
   [[nodiscard]] const std::string &get_filename() const { return filename_; }
 
   // There is some limitation in cereal's polymorphic type registration that
@@ -256,12 +296,27 @@ class SeekableFile : public File {
         return get_off_ref() + off;
       case SeekFrom::kEnd:
         return get_size() + off;
+      case SeekFrom::kData:
+        return SeekHoleOrData(off, true);
+      case SeekFrom::kHole:
+        return SeekHoleOrData(off, false);
       default:
         return MakeError(EINVAL);
     }
   }
   [[nodiscard]] virtual size_t get_size() const = 0;
 
+  Status<void> Advise(off_t off, off_t len, int advice) final override;
+
+  // Finds the next offset at or after @off that holds data (or a hole). By
+  // default the whole file is data, followed by an implicit hole at the end.
+  virtual Status<off_t> SeekHoleOrData(off_t off, bool data) {
+    if (off < 0 || static_cast<size_t>(off) >= get_size())
+      return MakeError(ENXIO);
+    if (data) return off;
+    return static_cast<off_t>(get_size());
+  }
+
   template <class Archive>
   void load(Archive &ar) {
     ar(cereal::base_class<File>(this));
@@ -271,6 +326,30 @@ class SeekableFile : public File {
   void save(Archive &ar) const {
     ar(cereal::base_class<File>(this));
   }
+
+ protected:
+  // Readers call this after each read so that sequential access can be
+  // detected and the data that follows prefetched.
+  void NoteRead(off_t off, size_t len);
+
+  // Starts fetching a range into a cache without waiting for it. Files that
+  // have no slower backing store don't need to do anything.
+  virtual void Prefetch(off_t off, size_t len) {}
+  // Drops cached data for a range, writing it back first if it is dirty.
+  virtual Status<void> Evict(off_t off, size_t len) { return {}; }
+
+ private:
+  // The access pattern set by posix_fadvise().
+  enum class Access : int { kNormal, kSequential, kRandom };
+
+  rt::Spin ra_lock_;
+  Access access_{Access::kNormal};
+  // Where the next read starts if access is sequential.
+  off_t ra_next_{0};
+  // Data has been prefetched up to here.
+  off_t ra_end_{0};
+  // The size of the next prefetch (zero until reads look sequential).
+  size_t ra_window_{0};
 };
 
 // Class for a directory file, supports getdents and getdents64.
@@ -278,6 +357,12 @@ class DirectoryFile : public File {
  public:
   DirectoryFile(unsigned int flags, FileMode mode, std::shared_ptr<IDir> ino);
   Status<long> GetDents(std::span<std::byte> dirp, off_t *off) override;
+  // Offsets are cookies from IDir::IterateDents(), so only absolute seeks
+  // (e.g., from rewinddir() or seekdir()) are meaningful.
+  Status<off_t> Seek(off_t off, SeekFrom origin) override {
+    if (origin != SeekFrom::kStart || off < 0) return MakeError(EINVAL);
+    return off;
+  }
   Status<long> GetDents64(std::span<std::byte> dirp, off_t *off) override;
 };
 
@@ -289,6 +374,12 @@ class SoftLinkFile : public File {
   Status<long> ReadLink(std::span<std::byte> buf) override;
 };
 
+// Moves up to @len bytes from @in to @out, avoiding intermediate copies when
+// the files support it. Used by sendfile(), splice(), and copy_file_range().
+// If @nonblocking, pipe ends don't block (SPLICE_F_NONBLOCK).
+Status<size_t> TransferData(File &in, off_t *in_off, File &out, off_t *out_off,
+                            size_t len, bool nonblocking = false);
+
 namespace detail {
 
 struct file_array : public rt::RCUObject {
@@ -325,6 +416,22 @@ struct file_array : public rt::RCUObject {
 
 std::unique_ptr<file_array> CopyFileArray(const file_array &src, size_t cap);
 
+// A per-kthread cache of recent fd lookups, so hot fds can be resolved without
+// touching the table's shared cache lines. Entries are only accessed by the
+// owning kthread with preemption disabled, and are valid while the table's
+// generation matches the one they were filled at.
+struct alignas(kCacheLineSize) fd_cache {
+  static constexpr size_t kEntries = 4;
+  struct entry {
+    int fd = -1;
+    uint64_t gen = 0;
+    File *file = nullptr;
+    // A reference to @file biased toward this kthread (see FileTable::Dup()).
+    std::weak_ptr<File> ref;
+  };
+  entry ent[kEntries];
+};
+
 }  // namespace detail
 
 class FileTable {
@@ -338,29 +445,40 @@ class FileTable {
   FileTable(FileTable &&o)
       : farr_(std::move(o.farr_)),
         rcup_(farr_.get()),
-        close_on_exec_(std::move(o.close_on_exec_)) {}
+        used_(std::move(o.used_)),
+        close_on_exec_(std::move(o.close_on_exec_)),
+        cache_(std::move(o.cache_)),
+        gen_(o.gen_.load(std::memory_order_relaxed)) {}
   FileTable &operator=(FileTable &&o) {
     farr_ = std::move(o.farr_);
     rcup_.set(farr_.get());
+    used_ = std::move(o.used_);
     close_on_exec_ = std::move(o.close_on_exec_);
+    cache_ = std::move(o.cache_);
+    gen_.store(o.gen_.load(std::memory_order_relaxed),
+               std::memory_order_relaxed);
     return *this;
   }
 
   // Returns a raw pointer to a file for a given fd number. Returns nullptr
-  // if the file does not exist. This fast path does not refcount the file.
+  // if the file does not exist. This fast path does not refcount the file,
+  // and repeated lookups are usually served from a per-kthread cache.
   File *Get(int fd);
 
   // Returns a shared pointer to a file for a given fd number. Typically this
   // is used for dup() or clone() system calls. If the file does not exist,
-  // the shared pointer will be empty.
+  // the shared pointer will be empty. While a reference returned here is
+  // alive, further calls on the same kthread share its (kthread-local)
+  // refcount instead of the file's.
   std::shared_ptr<File> Dup(int fd);
 
-  // Inserts a file into the file table and refcounts it. Returns the fd number.
+  // Inserts a file into the file table and refcounts it. Returns the lowest
+  // free fd number that is at least @lowest.
   int Insert(std::shared_ptr<File> f, bool cloexec = false, size_t lowest = 0);
 
   // Inserts a file into the file table at a specific fd number and refcounts
   // it. If a file already exists for the fd number, it will be replaced
-  // atomically.
+  // atomically (and its close-on-exec flag is replaced too).
   void InsertAt(int fd, std::shared_ptr<File> f, bool cloexec = false);
 
   // Removes the file tied to an fd number and drops its refcount. Returns true
@@ -368,17 +486,20 @@ class FileTable {
   bool Remove(int fd);
 
   // Removes fds in the range low to high (inclusive).
-  void RemoveRange(int low, int high);
+  void RemoveRange(size_t low, size_t high);
 
   // Destroy a file table by dropping its file array. Called only when the
   // FileTable is no longer in use and will never be used again.
-  void Destroy() { farr_.reset(); }
+  void Destroy() {
+    farr_.reset();
+    cache_.reset();
+  }
 
   // Sets an fd as close-on-exec.
   void SetCloseOnExec(int fd);
 
   // Set close-on-exec for fds in range low to high (inclusive).
-  void SetCloseOnExecRange(int low, int high);
+  void SetCloseOnExecRange(size_t low, size_t high);
 
   // Tests if an fd is close-on-exec.
   bool TestCloseOnExec(int fd);
@@ -403,6 +524,10 @@ class FileTable {
   void load(Archive &ar) {
     ar(farr_, close_on_exec_);
     rcup_.set(farr_.get());
+    cache_ = NewCache();
+    used_.resize(farr_->cap);
+    for (size_t i = 0; i < farr_->len; i++)
+      if (farr_->files[i]) used_.set(i);
   }
 
  private:
@@ -411,18 +536,44 @@ class FileTable {
   // Adjust the file descriptor table's size if needed.
   void Resize(size_t len);
 
+  // Moves out the files whose bits are set in @mask, for word @idx of the
+  // bitmaps, so they can be released after the lock is dropped.
+  void RemoveWordLocked(size_t idx, unsigned long mask,
+                        std::vector<std::shared_ptr<File>> &out);
+
+  // Invalidates every cached lookup. Must be called after an occupied slot
+  // has been changed.
+  void BumpGenLocked() {
+    assert(lock_.IsHeld());
+    gen_.fetch_add(1, std::memory_order_release);
+  }
+
+  // Looks up @fd in the table and caches the result in @e.
+  File *GetSlow(int fd, detail::fd_cache::entry &e);
+
+  static std::unique_ptr<detail::fd_cache[]> NewCache();
+
   std::unique_ptr<FArr> farr_;
   rt::RCUPtr<FArr> rcup_;
-  dynamic_bitmap close_on_exec_;
-  rt::Spin lock_;
+  // Slots that hold a file, so free fds can be found without a linear scan.
+  hierarchical_bitmap used_;
+  hierarchical_bitmap close_on_exec_;
+  // Indexed by kthread.
+  std::unique_ptr<detail::fd_cache[]> cache_;
+  // Kept apart from the lock so that hits in the cache only read shared lines.
+  alignas(kCacheLineSize) std::atomic<uint64_t> gen_{0};
+  alignas(kCacheLineSize) rt::Spin lock_;
 };
 
 inline File *FileTable::Get(int fd) {
+  if (unlikely(fd < 0)) return nullptr;
   rt::RCURead l;
   rt::RCUReadGuard g(l);
-  const FArr *tbl = rcup_.get();
-  if (unlikely(static_cast<size_t>(fd) >= tbl->len)) return nullptr;
-  return tbl->files[fd].get();
+  detail::fd_cache::entry &e =
+      cache_[l.get_cpu()].ent[fd % detail::fd_cache::kEntries];
+  if (likely(e.fd == fd && e.gen == gen_.load(std::memory_order_acquire)))
+    return e.file;
+  return GetSlow(fd, e);
 }
 
 template <typename F>
@@ -8,6 +8,7 @@ extern "C" {
 }
 
 #include <atomic>
+#include <functional>
 #include <map>
 #include <memory>
 #include <string_view>
@@ -139,6 +140,18 @@ struct dir_entry {
   unsigned int type;
 };
 
+// A directory entry that is only valid during a call to IterateDents()'s
+// callback (avoids copying the name).
+struct dir_entry_view {
+  std::string_view name;
+  unsigned long inum;
+  unsigned int type;
+};
+
+// Called for each entry by IDir::IterateDents() along with the cookie that
+// resumes iteration after it. Returns false to stop iterating.
+using DirIterFn = std::function<bool(const dir_entry_view &ent, off_t next)>;
+
 // Backwards link for an IDir; contains a pointer to the parent and the name
 // of this IDir.
 struct ParentPointer : public rt::RCUObject {
@@ -154,6 +167,8 @@ class FSRoot;
 enum class IDirType {
   kUnknown = 0,
   kMem = 1,
+  kOverlay = 2,
+  kLogFS = 3,
 };
 
 // IDir is an inode type for directories
@@ -205,6 +220,11 @@ class IDir : public Inode {
                                                mode_t mode, FileMode fmode) = 0;
   // GetDents returns a vector of the current entries.
   virtual std::vector<dir_entry> GetDents() = 0;
+  // IterateDents visits the entries starting at @cookie (0 is the first
+  // entry) until @func returns false. Cookies are stable, so iteration can be
+  // resumed later even if entries were added or removed in the meantime. The
+  // default implementation uses the position in GetDents() as the cookie.
+  virtual void IterateDents(off_t cookie, const DirIterFn &func);
 
   virtual Status<void> GetStats(struct stat *buf) const override = 0;
 
@@ -324,10 +344,24 @@ Status<std::shared_ptr<IDir>> MountLinux(std::string_view path);
 Status<std::shared_ptr<IDir>> InitLinuxRoot();
 }  // namespace linuxfs
 
+namespace overlayfs {
+// Stacks an in-memory writeable layer on top of a (read-only) lower directory.
+Status<std::shared_ptr<IDir>> MountOverlay(std::shared_ptr<IDir> lower);
+}  // namespace overlayfs
+
+namespace logfs {
+// Mounts the logfs stored on @device (a host file of at least @size bytes, or
+// "storage" for the runtime's storage device), formatting it if needed.
+Status<std::shared_ptr<IDir>> MountLogFS(std::string_view device, size_t size);
+}  // namespace logfs
+
 namespace memfs {
 std::shared_ptr<IDir> MkFolder(mode_t mode = S_IRWXU,
                                std::string &&name = std::string{"."},
                                std::shared_ptr<IDir> parent = {});
+// Creates an anonymous in-memory file for memfd_create().
+Status<std::shared_ptr<File>> CreateMemFD(std::string_view name,
+                                          bool allow_sealing);
 }
 
 Status<void> InitFs(
@@ -156,7 +156,7 @@ Status<void> LinuxWrIDir::Unlink(std::string_view name) {
   rt::ScopedLock g(lock_);
   Status<void> ret = linux_root_fd.UnlinkAt(abspath);
   if (!ret) return ret;
-  if (auto it = entries_.find(name); it != entries_.end()) entries_.erase(it);
+  entries_.Remove(name);
   return {};
 }
 
@@ -165,7 +165,7 @@ Status<void> LinuxWrIDir::RmDir(std::string_view name) {
   rt::ScopedLock g(lock_);
   Status<void> ret = linux_root_fd.UnlinkAt(abspath, AT_REMOVEDIR);
   if (!ret) return ret;
-  if (auto it = entries_.find(name); it != entries_.end()) entries_.erase(it);
+  entries_.Remove(name);
   return {};
 }
 
@@ -198,13 +198,7 @@ Status<void> LinuxWrIDir::DoRename(LinuxWrIDir &src, std::string_view src_name,
   std::shared_ptr<Inode> ino;
 
   // Remove inode from source, if present.
-  if (src.is_initialized()) {
-    auto src_it = src.entries_.find(src_name);
-    if (src_it != src.entries_.end()) {
-      ino = std::move(src_it->second);
-      src.entries_.erase(src_it);
-    }
-  }
+  if (src.is_initialized()) ino = src.entries_.Remove(src_name);
 
   // Current directory is not initialized, let's leave it that way.
   if (!is_initialized()) return {};
@@ -215,7 +209,7 @@ Status<void> LinuxWrIDir::DoRename(LinuxWrIDir &src, std::string_view src_name,
       IDir &tdir = static_cast<IDir &>(*ino);
       tdir.SetParent(get_this(), std::string(dst_name));
     }
-    entries_[std::string(dst_name)] = std::move(ino);
+    entries_.Set(dst_name, std::move(ino));
     return {};
   }
 
@@ -292,9 +286,8 @@ Status<std::shared_ptr<File>> LinuxWrIDir::Create(std::string_view name,
     MarkInitialized();
   }
 
-  auto it = entries_.find(name);
-  if (it != entries_.end()) {
-    ino = CastToLinuxInode(it->second);
+  if (std::shared_ptr<Inode> in = entries_.Lookup(name)) {
+    ino = CastToLinuxInode(std::move(in));
   } else {
     Status<struct stat> stat = f->StatAt();
     if (unlikely(!stat)) LinuxFSPanic("bad stat after O_CREAT", stat.error());
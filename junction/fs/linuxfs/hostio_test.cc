@@ -0,0 +1,129 @@
+extern "C" {
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+}
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Must be run with --hostio_offload.
+class HostIOTest : public ::testing::Test {};
+
+std::string TestPath(const std::string &name) {
+  return "/tmp/hostio_test." + name + "." + std::to_string(getpid());
+}
+
+TEST_F(HostIOTest, Metadata) {
+  std::string dir = TestPath("dir");
+  ASSERT_EQ(mkdir(dir.c_str(), 0755), 0);
+  EXPECT_EQ(mkdir(dir.c_str(), 0755), -1);
+  EXPECT_EQ(errno, EEXIST);
+
+  std::string a = dir + "/a";
+  int fd = open(a.c_str(), O_WRONLY | O_CREAT | O_EXCL, 0644);
+  ASSERT_GE(fd, 0);
+  ASSERT_EQ(write(fd, "hello", 5), 5);
+  ASSERT_EQ(fsync(fd), 0);
+  ASSERT_EQ(close(fd), 0);
+
+  struct stat st;
+  ASSERT_EQ(stat(a.c_str(), &st), 0);
+  EXPECT_TRUE(S_ISREG(st.st_mode));
+  EXPECT_EQ(st.st_size, 5);
+
+  std::string b = dir + "/b";
+  ASSERT_EQ(link(a.c_str(), b.c_str()), 0);
+  std::string c = dir + "/c";
+  ASSERT_EQ(rename(b.c_str(), c.c_str()), 0);
+  EXPECT_EQ(stat(b.c_str(), &st), -1);
+  EXPECT_EQ(errno, ENOENT);
+  std::string l = dir + "/l";
+  ASSERT_EQ(symlink("a", l.c_str()), 0);
+
+  fd = open(l.c_str(), O_RDONLY);
+  ASSERT_GE(fd, 0);
+  char buf[8] = {};
+  ASSERT_EQ(read(fd, buf, sizeof(buf)), 5);
+  EXPECT_EQ(std::string(buf, 5), "hello");
+  ASSERT_EQ(close(fd), 0);
+
+  for (const std::string &p : {a, c, l}) ASSERT_EQ(unlink(p.c_str()), 0);
+  ASSERT_EQ(rmdir(dir.c_str()), 0);
+}
+
+TEST_F(HostIOTest, ProgressDuringIO) {
+  // Other threads must keep running while host file I/O is outstanding.
+  std::atomic_bool stop{false};
+  std::atomic_long ticks{0};
+  std::thread ticker([&] {
+    while (!stop) ticks++;
+  });
+
+  std::string path = TestPath("io");
+  int fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+  ASSERT_GE(fd, 0);
+  std::vector<char> data(1 << 20, 'x');
+  for (int i = 0; i < 32; i++) {
+    ASSERT_EQ(pwrite(fd, data.data(), data.size(), i * data.size()),
+              static_cast<ssize_t>(data.size()));
+    ASSERT_EQ(fdatasync(fd), 0);
+  }
+  std::vector<char> out(data.size());
+  for (int i = 0; i < 32; i++) {
+    ASSERT_EQ(pread(fd, out.data(), out.size(), i * out.size()),
+              static_cast<ssize_t>(out.size()));
+    ASSERT_EQ(out, data);
+  }
+
+  stop = true;
+  ticker.join();
+  EXPECT_GT(ticks, 0);
+  ASSERT_EQ(close(fd), 0);
+  ASSERT_EQ(unlink(path.c_str()), 0);
+}
+
+TEST_F(HostIOTest, Advise) {
+  std::string path = TestPath("advise");
+  int fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+  ASSERT_GE(fd, 0);
+  std::vector<char> data(4 << 20);
+  for (size_t i = 0; i < data.size(); i++) data[i] = static_cast<char>(i);
+  ASSERT_EQ(write(fd, data.data(), data.size()),
+            static_cast<ssize_t>(data.size()));
+  ASSERT_EQ(close(fd), 0);
+
+  fd = open(path.c_str(), O_RDONLY);
+  ASSERT_GE(fd, 0);
+  for (int advice : {POSIX_FADV_NORMAL, POSIX_FADV_RANDOM,
+                     POSIX_FADV_SEQUENTIAL, POSIX_FADV_WILLNEED,
+                     POSIX_FADV_DONTNEED, POSIX_FADV_NOREUSE})
+    EXPECT_EQ(posix_fadvise(fd, 0, 0, advice), 0);
+  EXPECT_EQ(posix_fadvise(fd, 0, 0, 1234), EINVAL);
+  EXPECT_EQ(posix_fadvise(fd, 0, -1, POSIX_FADV_WILLNEED), EINVAL);
+  EXPECT_EQ(readahead(fd, 0, data.size()), 0);
+
+  // Sequential reads (with readahead running ahead of them) see the data.
+  std::vector<char> out(data.size());
+  size_t pos = 0;
+  while (pos < out.size()) {
+    ssize_t ret = read(fd, out.data() + pos, 4096);
+    ASSERT_GT(ret, 0);
+    pos += ret;
+  }
+  EXPECT_EQ(out, data);
+  ASSERT_EQ(close(fd), 0);
+  ASSERT_EQ(unlink(path.c_str()), 0);
+
+  int fds[2];
+  ASSERT_EQ(pipe(fds), 0);
+  EXPECT_EQ(posix_fadvise(fds[0], 0, 0, POSIX_FADV_WILLNEED), ESPIPE);
+  EXPECT_EQ(readahead(fds[0], 0, 4096), -1);
+  EXPECT_EQ(errno, EINVAL);
+  close(fds[0]);
+  close(fds[1]);
+}
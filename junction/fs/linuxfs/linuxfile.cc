@@ -6,10 +6,13 @@ extern "C" {
 
 #include <memory>
 #include <string>
+#include <tuple>
 
+#include "junction/base/compiler.h"
 #include "junction/base/error.h"
 #include "junction/fs/linuxfs/linuxfile.h"
 #include "junction/fs/linuxfs/linuxfs.h"
+#include "junction/kernel/hostio.h"
 #include "junction/kernel/ksys.h"
 #include "junction/snapshot/cereal.h"
 #include "junction/syscall/strace.h"
@@ -33,13 +36,22 @@ LinuxFile::LinuxFile(KernelFile &&f, int flags, FileMode mode,
   f.Release();
 }
 
-LinuxFile::~LinuxFile() { ksys_close(fd_); }
+LinuxFile::~LinuxFile() {
+  if (wb_) std::ignore = wb_->Flush();
+  ksys_close(fd_);
+}
 
 [[nodiscard]] size_t LinuxFile::get_size() const {
   const LinuxInode &in = static_cast<const LinuxInode &>(get_inode_ref());
   return in.get_size();
 }
 
+std::shared_ptr<WriteBack> LinuxFile::GetWriteBack() const {
+  if (wb_ || !WriteBack::Enabled()) return wb_;
+  const LinuxInode &in = static_cast<const LinuxInode &>(get_inode_ref());
+  return WriteBack::Find(in.get_dev(), in.get_inum());
+}
+
 void TouchPages(std::span<std::byte> buf) {
   uintptr_t start = PageAlignDown(reinterpret_cast<uintptr_t>(buf.data()));
   char *pg = reinterpret_cast<char *>(start);
@@ -55,30 +67,105 @@ Status<size_t> LinuxFile::Read(std::span<std::byte> buf, off_t *off) {
   // TODO(jf): consider gating this with a compile flag.
   if (IsJunctionThread() && unlikely(myproc().get_mem_map().TraceEnabled()))
     TouchPages(buf);
-  ssize_t ret = ksys_pread(fd_, buf.data(), buf.size_bytes(), *off);
+  if (std::shared_ptr<WriteBack> wb = GetWriteBack()) {
+    Status<void> ret = wb->FlushRange(*off, buf.size_bytes());
+    if (!ret) return MakeError(ret);
+  }
+  ssize_t ret = hostio_pread(fd_, buf.data(), buf.size_bytes(), *off);
   if (ret < 0) {
     if (ret == -EINTR) return MakeError(ERESTARTSYS);
     return MakeError(-ret);
   }
+  NoteRead(*off, ret);
   *off += ret;
   return ret;
 }
 
 Status<size_t> LinuxFile::Write(std::span<const std::byte> buf, off_t *off) {
-  ssize_t ret = ksys_pwrite(fd_, buf.data(), buf.size_bytes(), *off);
+  if (wb_) {
+    Status<size_t> ret = wb_->Write(buf, *off);
+    if (ret) *off += *ret;
+    return ret;
+  }
+
+  // Another file may have buffered data that this write must land after.
+  // Appends go wherever the host's end of file is, so everything goes out.
+  if (std::shared_ptr<WriteBack> wb = GetWriteBack()) {
+    Status<void> fret = (get_flags() & kFlagAppend)
+                            ? wb->Flush()
+                            : wb->FlushRange(*off, buf.size_bytes());
+    if (!fret) return MakeError(fret);
+  }
+  ssize_t ret = hostio_pwrite(fd_, buf.data(), buf.size_bytes(), *off);
   if (ret < 0) return MakeError(-ret);
   *off += ret;
   return ret;
 }
 
+Status<size_t> LinuxFile::SpliceTo(File &out, off_t *off, off_t *out_off,
+                                   size_t len,
+                                   [[maybe_unused]] bool nonblocking) {
+  // Copies between host files can stay entirely in the host kernel.
+  LinuxFile *dst = most_derived_cast<LinuxFile>(&out);
+  if (!dst) return MakeError(EOPNOTSUPP);
+  for (LinuxFile *f : {this, dst}) {
+    std::shared_ptr<WriteBack> wb = f->GetWriteBack();
+    if (!wb) continue;
+    Status<void> ret = wb->Flush();
+    if (!ret) return MakeError(ret);
+  }
+  loff_t in_pos = *off, out_pos = *out_off;
+  long ret = ksyscall(__NR_copy_file_range, fd_, &in_pos, dst->fd_, &out_pos,
+                      len, 0);
+  if (ret == -EXDEV || ret == -ENOSYS) return MakeError(EOPNOTSUPP);
+  if (ret < 0) return MakeError(-ret);
+  *off = in_pos;
+  *out_off = out_pos;
+  return ret;
+}
+
 Status<void *> LinuxFile::MMap(void *addr, size_t length, int prot, int flags,
                                off_t off) {
   assert(!(flags & MAP_ANONYMOUS));
+  if (std::shared_ptr<WriteBack> wb = GetWriteBack()) {
+    Status<void> ret = wb->Flush();
+    if (!ret) return MakeError(ret);
+  }
   intptr_t ret = ksys_mmap(addr, length, prot, flags, fd_, off);
   if (ret < 0) return MakeError(-ret);
   return reinterpret_cast<void *>(ret);
 }
 
+void LinuxFile::Prefetch(off_t off, size_t len) {
+  hostio_readahead(fd_, off, static_cast<off_t>(len));
+}
+
+Status<void> LinuxFile::Evict(off_t off, size_t len) {
+  // The host only drops clean pages, so push out buffered writes first.
+  if (std::shared_ptr<WriteBack> wb = GetWriteBack()) {
+    Status<void> ret = wb->FlushRange(off, len);
+    if (!ret) return MakeError(ret);
+  }
+  int ret = hostio_fadvise(fd_, off, static_cast<off_t>(len),
+                           POSIX_FADV_DONTNEED);
+  if (ret < 0) return MakeError(-ret);
+  return {};
+}
+
+Status<void> LinuxFile::Sync() {
+  if (wb_) return wb_->Sync(false);
+  int ret = hostio_fsync(fd_, false);
+  if (ret < 0) return MakeError(-ret);
+  return {};
+}
+
+Status<void> LinuxFile::DataSync() {
+  if (wb_) return wb_->Sync(true);
+  int ret = hostio_fsync(fd_, true);
+  if (ret < 0) return MakeError(-ret);
+  return {};
+}
+
 }  // namespace junction::linuxfs
 
 CEREAL_REGISTER_TYPE(junction::linuxfs::LinuxFile);
@@ -13,6 +13,7 @@ extern "C" {
 #include "junction/bindings/log.h"
 #include "junction/fs/file.h"
 #include "junction/fs/linuxfs/linuxfs.h"
+#include "junction/fs/linuxfs/writeback.h"
 #include "junction/kernel/ksys.h"
 #include "junction/snapshot/cereal.h"
 
@@ -28,17 +29,31 @@ class LinuxFile : public SeekableFile {
 
   Status<size_t> Read(std::span<std::byte> buf, off_t *off) override;
   Status<size_t> Write(std::span<const std::byte> buf, off_t *off) override;
+  Status<size_t> SpliceTo(File &out, off_t *off, off_t *out_off, size_t len,
+                          bool nonblocking) override;
   Status<void *> MMap(void *addr, size_t length, int prot, int flags,
                       off_t off);
+  Status<void> Sync() override;
+  Status<void> DataSync() override;
 
   [[nodiscard]] size_t get_size() const override;
 
+ protected:
+  // Readahead is done by the host, in its page cache.
+  void Prefetch(off_t off, size_t len) override;
+  Status<void> Evict(off_t off, size_t len) override;
+
  private:
   friend class cereal::access;
   friend class LinuxInode;
 
+  // Returns the write-back state of the host file, if any. Only writable
+  // files hold a reference, but readers must still see buffered data.
+  [[nodiscard]] std::shared_ptr<WriteBack> GetWriteBack() const;
+
   template <class Archive>
   void save(Archive &ar) const {
+    // Buffered writes are flushed before snapshotting (see SnapshotPid()).
     ar(get_filename(), get_flags(), get_mode());
     ar(cereal::base_class<SeekableFile>(this));
   }
@@ -76,6 +91,8 @@ class LinuxFile : public SeekableFile {
   }
 
   int fd_;
+  // Write-back buffering, if enabled for this file (see WriteBack).
+  std::shared_ptr<WriteBack> wb_;
 };
 
 }  // namespace junction::linuxfs
@@ -2,6 +2,7 @@
 #include "junction/fs/linuxfs/linuxfs.h"
 
 #include "junction/fs/linuxfs/linuxfile.h"
+#include "junction/fs/linuxfs/writeback.h"
 
 namespace junction::linuxfs {
 
@@ -19,12 +20,35 @@ Status<std::shared_ptr<File>> LinuxInode::Open(uint32_t flags, FileMode mode) {
   if constexpr (!linux_fs_writeable()) mode = FileMode::kRead;
   Status<KernelFile> f = linux_root_fd.OpenAt(get_path(), linux_flags, mode);
   if (!f) return MakeError(f);
-  return std::make_shared<LinuxFile>(std::move(*f), flags, mode, get_path(),
-                                     shared_from_base<LinuxInode>());
+  auto file = std::make_shared<LinuxFile>(std::move(*f), flags, mode,
+                                          get_path(),
+                                          shared_from_base<LinuxInode>());
+
+  // Appends, synchronous and direct writes must go straight to the host.
+  constexpr unsigned int kDirectFlags = kFlagAppend | kFlagSync | O_DIRECT;
+  if (WriteBack::Enabled() && mode != FileMode::kRead &&
+      !(flags & kDirectFlags)) {
+    Status<std::shared_ptr<WriteBack>> wb =
+        WriteBack::Get(dev_, get_inum(), get_path());
+    if (wb) file->wb_ = std::move(*wb);
+  }
+  return file;
+}
+
+off_t LinuxInode::get_size() const {
+  if (!WriteBack::Enabled()) return size_;
+  std::shared_ptr<WriteBack> wb = WriteBack::Find(dev_, get_inum());
+  if (!wb) return size_;
+  Status<off_t> size = wb->GetSize();
+  return size ? *size : size_;
 }
 
 Status<void> LinuxInode::SetSize(size_t size) {
   if constexpr (!linux_fs_writeable()) return MakeError(EACCES);
+  if (std::shared_ptr<WriteBack> wb = WriteBack::Find(dev_, get_inum())) {
+    Status<void> ret = wb->Flush();
+    if (!ret) return MakeError(ret);
+  }
   long ret = ksyscall(__NR_truncate, path_.data(), 0);
   if (ret < 0) return MakeError(-ret);
   return {};
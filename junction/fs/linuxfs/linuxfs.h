@@ -19,7 +19,8 @@ class LinuxInode : public Inode {
   LinuxInode(const struct stat &stat, std::string path)
       : Inode(stat.st_mode, stat.st_ino),
         path_(std::move(path)),
-        size_(stat.st_size) {
+        size_(stat.st_size),
+        dev_(stat.st_dev) {
     assert(!is_symlink() && !is_dir());
   }
 
@@ -29,7 +30,7 @@ class LinuxInode : public Inode {
   // Get attributes.
   Status<void> GetStats(struct stat *buf) const override {
     InodeToStats(*this, buf);
-    buf->st_size = size_;
+    buf->st_size = get_size();
     buf->st_nlink = 1;
     return {};
   }
@@ -39,13 +40,16 @@ class LinuxInode : public Inode {
     return {};
   }
 
-  [[nodiscard]] off_t get_size() const { return size_; }
+  // Returns the file size, including writes still in a write-back buffer.
+  [[nodiscard]] off_t get_size() const;
   [[nodiscard]] std::string_view get_path() const { return path_; }
+  [[nodiscard]] dev_t get_dev() const { return dev_; }
   [[nodiscard]] Status<void> SetSize(size_t sz) override;
 
  private:
   const std::string path_;
   const off_t size_;
+  const dev_t dev_;
 };
 
 class LinuxIDir : public memfs::MemIDir {
@@ -0,0 +1,371 @@
+// writeback.cc - write-back buffering for Linux files
+
+extern "C" {
+#include <limits.h>
+#include <sys/uio.h>
+}
+
+#include <algorithm>
+#include <atomic>
+#include <tuple>
+#include <utility>
+
+#include "junction/base/time.h"
+#include "junction/bindings/log.h"
+#include "junction/bindings/thread.h"
+#include "junction/bindings/timer.h"
+#include "junction/fs/linuxfs/linuxfs.h"
+#include "junction/fs/linuxfs/writeback.h"
+#include "junction/junction.h"
+#include "junction/kernel/hostio.h"
+
+namespace junction::linuxfs {
+
+namespace {
+
+// Appends that directly follow a buffered range are copied into it (up to
+// this size) so that streams of small writes become a few large iovecs.
+constexpr size_t kMaxMergeSize = 64 * 1024;
+
+// How long the flusher waits for more writes before pushing data out.
+constexpr Duration kWriteBackDelay(1000);
+
+// All write-back state, keyed by host device and inode number. An expired
+// entry belongs to an instance whose destructor is still flushing; it is
+// erased (and registry_waiters woken) once that data reached the host.
+struct RegistryEntry {
+  std::weak_ptr<WriteBack> wb;
+  const WriteBack *owner;
+};
+rt::Spin registry_lock;
+rt::WaitQueue registry_waiters;
+std::map<std::pair<dev_t, ino_t>, RegistryEntry> registry;
+
+// Buffered and in-flight bytes across all files.
+std::atomic_size_t total_dirty;
+
+// Files with buffered data waiting for the flusher thread.
+rt::Mutex flusher_lock;
+rt::ConditionVariable flusher_cv;
+std::vector<std::shared_ptr<WriteBack>> flusher_queue;
+bool flusher_started;
+
+size_t FileDirtyLimit() {
+  return GetCfg().get_linux_fs_file_dirty_mb() * 1024 * 1024;
+}
+
+size_t TotalDirtyLimit() {
+  return GetCfg().get_linux_fs_dirty_mb() * 1024 * 1024;
+}
+
+void FlusherMain() {
+  while (true) {
+    {
+      rt::ScopedLock g(flusher_lock);
+      flusher_cv.Wait(flusher_lock, [] { return !flusher_queue.empty(); });
+    }
+
+    // Give writers a moment to add adjacent data before flushing.
+    rt::Sleep(kWriteBackDelay);
+
+    std::vector<std::shared_ptr<WriteBack>> work;
+    {
+      rt::ScopedLock g(flusher_lock);
+      work.swap(flusher_queue);
+    }
+
+    // Failures are recorded by each file and reported on its next Sync().
+    for (std::shared_ptr<WriteBack> &wb : work) std::ignore = wb->Flush();
+  }
+}
+
+void Enqueue(std::shared_ptr<WriteBack> wb) {
+  rt::ScopedLock g(flusher_lock);
+  if (!std::exchange(flusher_started, true)) rt::Spawn(FlusherMain);
+  flusher_queue.push_back(std::move(wb));
+  flusher_cv.Notify();
+}
+
+// Finds the live write-back state for a host file. Waits out an instance
+// that is being destroyed, so that a replacement can't write out newer data
+// before the old instance's final flush lands on top of it.
+std::shared_ptr<WriteBack> LookupLocked(dev_t dev, ino_t ino) {
+  assert(registry_lock.IsHeld());
+  while (true) {
+    auto it = registry.find({dev, ino});
+    if (it == registry.end()) return {};
+    if (std::shared_ptr<WriteBack> wb = it->second.wb.lock()) return wb;
+    rt::Wait(registry_lock, registry_waiters);
+  }
+}
+
+// Writes a contiguous file range described by @iov, retrying short writes.
+Status<void> WriteAll(int fd, std::span<iovec> iov, off_t off) {
+  while (!iov.empty()) {
+    ssize_t ret = hostio_pwritev(fd, iov.data(), iov.size(), off);
+    if (ret == -EINTR) continue;
+    if (ret < 0) return MakeError(-ret);
+    if (ret == 0) return MakeError(EIO);
+    off += ret;
+
+    size_t n = ret;
+    while (!iov.empty() && n >= iov.front().iov_len) {
+      n -= iov.front().iov_len;
+      iov = iov.subspan(1);
+    }
+    if (n) {
+      iov.front().iov_base = static_cast<std::byte *>(iov.front().iov_base) + n;
+      iov.front().iov_len -= n;
+    }
+  }
+  return {};
+}
+
+// Returns true if any range in @m overlaps [off, end).
+bool Overlaps(const std::map<off_t, std::vector<std::byte>> &m, off_t off,
+              off_t end) {
+  // Ranges are disjoint, so their ends are sorted like their starts.
+  auto it = m.lower_bound(end);
+  if (it == m.begin()) return false;
+  --it;
+  return it->first + static_cast<off_t>(it->second.size()) > off;
+}
+
+// Returns the end of the last range in @m, or zero if it is empty.
+off_t EndOf(const std::map<off_t, std::vector<std::byte>> &m) {
+  if (m.empty()) return 0;
+  auto it = std::prev(m.end());
+  return it->first + static_cast<off_t>(it->second.size());
+}
+
+}  // namespace
+
+WriteBack::~WriteBack() {
+  // No file refers to this object anymore; push out whatever is left.
+  if (Status<void> ret = Flush(); !ret)
+    LOG(WARN) << "linuxfs: lost buffered writes for inode " << ino_ << ": "
+              << ret.error();
+
+  rt::SpinGuard g(registry_lock);
+  auto it = registry.find({dev_, ino_});
+  if (it != registry.end() && it->second.owner == this) {
+    registry.erase(it);
+    registry_waiters.WakeAll();
+  }
+}
+
+bool WriteBack::Enabled() { return GetCfg().linux_fs_writeback(); }
+
+std::shared_ptr<WriteBack> WriteBack::Find(dev_t dev, ino_t ino) {
+  rt::SpinGuard g(registry_lock);
+  return LookupLocked(dev, ino);
+}
+
+Status<void> WriteBack::FlushAll() {
+  std::vector<std::shared_ptr<WriteBack>> all;
+  {
+    rt::SpinGuard g(registry_lock);
+    // Instances being destroyed flush on their own; wait for them.
+    rt::Wait(registry_lock, registry_waiters, [] {
+      return std::ranges::none_of(
+          registry, [](const auto &e) { return e.second.wb.expired(); });
+    });
+    for (auto &[key, entry] : registry)
+      all.push_back(entry.wb.lock());
+  }
+
+  Status<void> ret;
+  for (std::shared_ptr<WriteBack> &wb : all) {
+    Status<void> fret = wb->Flush();
+    if (!fret && ret) ret = std::move(fret);
+  }
+  return ret;
+}
+
+Status<std::shared_ptr<WriteBack>> WriteBack::Get(dev_t dev, ino_t ino,
+                                                  std::string_view path) {
+  if (std::shared_ptr<WriteBack> cur = Find(dev, ino)) return cur;
+
+  // Keep a private descriptor so buffered data can be written out after the
+  // files that produced it are closed.
+  Status<KernelFile> f = linux_root_fd.OpenAt(path, 0, FileMode::kWrite);
+  if (!f) return MakeError(f);
+  auto wb = std::make_shared<WriteBack>(std::move(*f), dev, ino);
+
+  // Another thread may have raced with us; the loser is released unlocked.
+  rt::SpinGuard g(registry_lock);
+  if (std::shared_ptr<WriteBack> cur = LookupLocked(dev, ino)) return cur;
+  registry[{dev, ino}] = {wb, wb.get()};
+  return wb;
+}
+
+void WriteBack::AccountLocked(ssize_t delta) {
+  assert(lock_.IsHeld());
+  dirty_bytes_ += delta;
+  total_dirty.fetch_add(delta, std::memory_order_relaxed);
+}
+
+void WriteBack::InsertLocked(std::span<const std::byte> buf, off_t off) {
+  assert(lock_.IsHeld());
+  const off_t end = off + static_cast<off_t>(buf.size());
+  auto it = dirty_.lower_bound(off);
+
+  // Handle a range that starts before the write.
+  if (it != dirty_.begin()) {
+    auto prev = std::prev(it);
+    std::vector<std::byte> &v = prev->second;
+    const off_t pend = prev->first + static_cast<off_t>(v.size());
+
+    // Fast path: extend a small range that ends exactly where we start.
+    if (pend == off && v.size() + buf.size() <= kMaxMergeSize &&
+        (it == dirty_.end() || it->first >= end)) {
+      v.insert(v.end(), buf.begin(), buf.end());
+      AccountLocked(buf.size());
+      return;
+    }
+
+    if (pend > off) {
+      // Split off the part of the range that extends past the write.
+      if (pend > end) {
+        it = dirty_.emplace_hint(
+            it, end,
+            std::vector<std::byte>(v.begin() + (end - prev->first), v.end()));
+        AccountLocked(-(end - off));
+      } else {
+        AccountLocked(-(pend - off));
+      }
+      v.resize(off - prev->first);
+    }
+  }
+
+  // Drop or trim ranges that start inside the write.
+  while (it != dirty_.end() && it->first < end) {
+    std::vector<std::byte> &v = it->second;
+    const off_t cend = it->first + static_cast<off_t>(v.size());
+    if (cend <= end) {
+      AccountLocked(-static_cast<ssize_t>(v.size()));
+      it = dirty_.erase(it);
+      continue;
+    }
+    std::vector<std::byte> tail(v.begin() + (end - it->first), v.end());
+    AccountLocked(-(end - it->first));
+    it = dirty_.erase(it);
+    it = dirty_.emplace_hint(it, end, std::move(tail));
+    break;
+  }
+
+  dirty_.emplace_hint(it, off, std::vector<std::byte>(buf.begin(), buf.end()));
+  AccountLocked(buf.size());
+}
+
+Status<size_t> WriteBack::Write(std::span<const std::byte> buf, off_t off) {
+  if (unlikely(off < 0)) return MakeError(EINVAL);
+  if (buf.empty()) return 0;
+
+  bool throttle, kick = false;
+  {
+    rt::ScopedLock g(lock_);
+    InsertLocked(buf, off);
+    throttle = dirty_bytes_ >= FileDirtyLimit() ||
+               total_dirty.load(std::memory_order_relaxed) >= TotalDirtyLimit();
+    if (!throttle) kick = !std::exchange(queued_, true);
+  }
+
+  // Writers that get too far ahead of the host flush synchronously. Errors
+  // are deferred to Sync(), as with the host's own page cache.
+  if (throttle)
+    std::ignore = Flush();
+  else if (kick)
+    Enqueue(shared_from_this());
+  return buf.size();
+}
+
+Status<void> WriteBack::Flush() {
+  rt::ScopedLock fg(flush_lock_);
+  size_t bytes;
+  {
+    rt::ScopedLock g(lock_);
+    queued_ = false;
+    if (dirty_.empty()) return {};
+    inflight_.swap(dirty_);
+    bytes = std::exchange(dirty_bytes_, 0);
+  }
+
+  // Adjacent ranges are written together with one pwritev().
+  Status<void> ret;
+  std::vector<iovec> iov;
+  iov.reserve(std::min(inflight_.size(), static_cast<size_t>(IOV_MAX)));
+  for (auto it = inflight_.begin(); it != inflight_.end() && ret;) {
+    const off_t start = it->first;
+    off_t end = start;
+    iov.clear();
+    for (; it != inflight_.end() && it->first == end && iov.size() < IOV_MAX;
+         ++it) {
+      iov.push_back({it->second.data(), it->second.size()});
+      end += static_cast<off_t>(it->second.size());
+    }
+    ret = WriteAll(f_.GetFd(), iov, start);
+  }
+  total_dirty.fetch_sub(bytes, std::memory_order_relaxed);
+
+  rt::ScopedLock g(lock_);
+  inflight_.clear();
+  if (!ret && !err_) err_ = ret.error().code();
+  return ret;
+}
+
+Status<void> WriteBack::FlushRange(off_t off, size_t len) {
+  {
+    rt::ScopedLock g(lock_);
+    const off_t end = off + static_cast<off_t>(len);
+    if (!Overlaps(dirty_, off, end) && !Overlaps(inflight_, off, end))
+      return {};
+  }
+  return Flush();
+}
+
+Status<off_t> WriteBack::GetSize() {
+  // Data leaves inflight_ only after it reached the host, so holding lock_
+  // across the stat keeps every buffered byte visible in one of the two.
+  rt::ScopedLock g(lock_);
+  Status<struct stat> st = f_.StatAt();
+  if (!st) return MakeError(st);
+  return std::max({st->st_size, EndOf(dirty_), EndOf(inflight_)});
+}
+
+Status<void> WriteBack::Sync(bool datasync) {
+  Status<void> ret = Flush();
+
+  // Group commit: one caller flushes the host file on behalf of everyone
+  // that arrived before it started; later arrivals wait for the next round.
+  rt::UniqueLock g(lock_);
+  if (!datasync) sync_full_ = true;
+  const uint64_t ticket = ++sync_requested_;
+  while (sync_done_ < ticket) {
+    if (syncing_) {
+      sync_cv_.Wait(lock_);
+      continue;
+    }
+    syncing_ = true;
+    const uint64_t target = sync_requested_;
+    const bool full = std::exchange(sync_full_, false);
+    g.Unlock();
+    int sret = hostio_fsync(f_.GetFd(), !full);
+    g.Lock();
+    syncing_ = false;
+    if (sret < 0) {
+      sync_failed_lo_ = sync_done_;
+      sync_failed_hi_ = target;
+      sync_err_ = -sret;
+    }
+    sync_done_ = target;
+    sync_cv_.NotifyAll();
+  }
+
+  if (unlikely(ticket > sync_failed_lo_ && ticket <= sync_failed_hi_))
+    return MakeError(sync_err_);
+  if (unlikely(err_)) return MakeError(std::exchange(err_, 0));
+  return ret;
+}
+
+}  // namespace junction::linuxfs
@@ -0,0 +1,99 @@
+// writeback.h - write-back buffering for Linux files
+
+#pragma once
+
+extern "C" {
+#include <sys/types.h>
+}
+
+#include <cstddef>
+#include <map>
+#include <memory>
+#include <span>
+#include <string_view>
+#include <vector>
+
+#include "junction/base/error.h"
+#include "junction/bindings/sync.h"
+#include "junction/kernel/ksys.h"
+
+namespace junction::linuxfs {
+
+// WriteBack buffers writes to a host file and pushes them to the host later
+// from a background thread. Adjacent buffered ranges go out together in one
+// pwritev() and concurrent Sync() callers share a single host flush (group
+// commit). Every LinuxFile opened on the same host file shares one instance.
+class WriteBack : public std::enable_shared_from_this<WriteBack> {
+ public:
+  WriteBack(KernelFile &&f, dev_t dev, ino_t ino) noexcept
+      : f_(std::move(f)), dev_(dev), ino_(ino) {}
+  ~WriteBack();
+
+  WriteBack(const WriteBack &) = delete;
+  WriteBack &operator=(const WriteBack &) = delete;
+
+  // Returns true if write-back buffering is enabled.
+  static bool Enabled();
+
+  // Gets (or creates) the write-back state for a host file.
+  static Status<std::shared_ptr<WriteBack>> Get(dev_t dev, ino_t ino,
+                                                std::string_view path);
+
+  // Finds the write-back state for a host file, if there is one.
+  static std::shared_ptr<WriteBack> Find(dev_t dev, ino_t ino);
+
+  // Writes the buffered data of every host file to the host.
+  static Status<void> FlushAll();
+
+  // Buffers a write at @off.
+  Status<size_t> Write(std::span<const std::byte> buf, off_t off);
+
+  // Writes all buffered data to the host.
+  Status<void> Flush();
+
+  // Writes buffered data to the host if any of it overlaps [off, off + len).
+  Status<void> FlushRange(off_t off, size_t len);
+
+  // Returns the size of the host file, counting buffered writes past its end.
+  Status<off_t> GetSize();
+
+  // Makes all buffered data durable (like fsync() or, if @datasync is set,
+  // fdatasync()).
+  Status<void> Sync(bool datasync);
+
+ private:
+  using DirtyMap = std::map<off_t, std::vector<std::byte>>;
+
+  void InsertLocked(std::span<const std::byte> buf, off_t off);
+  void AccountLocked(ssize_t delta);
+  void Kick();
+
+  rt::Mutex lock_;
+  // Serializes Flush() so that older data never lands after newer data.
+  rt::Mutex flush_lock_;
+  rt::ConditionVariable sync_cv_;
+  KernelFile f_;
+  const dev_t dev_;
+  const ino_t ino_;
+
+  // Buffered writes keyed by offset; ranges never overlap (protected by lock_).
+  DirtyMap dirty_;
+  // Writes being pushed to the host by Flush() (protected by flush_lock_).
+  DirtyMap inflight_;
+  size_t dirty_bytes_{0};
+  bool queued_{false};
+  // A deferred write-back error, reported by the next Sync().
+  int err_{0};
+
+  // Group commit state (protected by lock_).
+  uint64_t sync_requested_{0};
+  uint64_t sync_done_{0};
+  // The tickets covered by the last failed host flush: (lo, hi].
+  uint64_t sync_failed_lo_{0};
+  uint64_t sync_failed_hi_{0};
+  int sync_err_{0};
+  bool sync_full_{false};
+  bool syncing_{false};
+};
+
+}  // namespace junction::linuxfs
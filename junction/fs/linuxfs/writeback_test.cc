@@ -0,0 +1,178 @@
+extern "C" {
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+}
+
+#include <gtest/gtest.h>
+
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Must be run with --linux_fs_writeback.
+class WriteBackTest : public ::testing::Test {};
+
+std::string TestPath(const std::string &name) {
+  return "/tmp/writeback_test." + name + "." + std::to_string(getpid());
+}
+
+std::vector<char> Pattern(size_t len, char seed) {
+  std::vector<char> buf(len);
+  for (size_t i = 0; i < len; i++) buf[i] = static_cast<char>(seed + i % 251);
+  return buf;
+}
+
+TEST_F(WriteBackTest, ReadYourWrites) {
+  std::string path = TestPath("rw");
+  int fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+  ASSERT_GE(fd, 0);
+
+  // Many small appends, then overwrites that straddle earlier writes.
+  std::vector<char> model = Pattern(64 * 1024, 'a');
+  for (size_t off = 0; off < model.size(); off += 100) {
+    size_t len = std::min<size_t>(100, model.size() - off);
+    ASSERT_EQ(pwrite(fd, model.data() + off, len, off),
+              static_cast<ssize_t>(len));
+  }
+  std::vector<char> patch = Pattern(5000, 'x');
+  for (off_t off : {50, 20000, 61000}) {
+    size_t len = std::min(patch.size(), model.size() - off);
+    ASSERT_EQ(pwrite(fd, patch.data(), len, off), static_cast<ssize_t>(len));
+    std::memcpy(model.data() + off, patch.data(), len);
+  }
+
+  std::vector<char> out(model.size());
+  ASSERT_EQ(pread(fd, out.data(), out.size(), 0),
+            static_cast<ssize_t>(out.size()));
+  EXPECT_EQ(out, model);
+
+  // Other open files of the same host file see the data too.
+  int fd2 = open(path.c_str(), O_RDONLY);
+  ASSERT_GE(fd2, 0);
+  std::fill(out.begin(), out.end(), 0);
+  ASSERT_EQ(pread(fd2, out.data(), out.size(), 0),
+            static_cast<ssize_t>(out.size()));
+  EXPECT_EQ(out, model);
+
+  ASSERT_EQ(close(fd2), 0);
+  ASSERT_EQ(close(fd), 0);
+  ASSERT_EQ(unlink(path.c_str()), 0);
+}
+
+TEST_F(WriteBackTest, ReadOnlyReader) {
+  std::string path = TestPath("ro");
+  int wfd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  ASSERT_GE(wfd, 0);
+  int rfd = open(path.c_str(), O_RDONLY);
+  ASSERT_GE(rfd, 0);
+
+  // Data buffered by the writer is visible through a read-only descriptor.
+  std::vector<char> data = Pattern(10000, 'r');
+  ASSERT_EQ(write(wfd, data.data(), data.size()),
+            static_cast<ssize_t>(data.size()));
+  struct stat st;
+  ASSERT_EQ(fstat(rfd, &st), 0);
+  EXPECT_EQ(st.st_size, static_cast<off_t>(data.size()));
+  EXPECT_EQ(lseek(rfd, 0, SEEK_END), static_cast<off_t>(data.size()));
+  std::vector<char> out(data.size());
+  ASSERT_EQ(pread(rfd, out.data(), out.size(), 0),
+            static_cast<ssize_t>(out.size()));
+  EXPECT_EQ(out, data);
+
+  // Appends past the host file's end extend the reported size.
+  ASSERT_EQ(write(wfd, data.data(), data.size()),
+            static_cast<ssize_t>(data.size()));
+  ASSERT_EQ(fstat(wfd, &st), 0);
+  EXPECT_EQ(st.st_size, static_cast<off_t>(2 * data.size()));
+  EXPECT_EQ(lseek(rfd, 0, SEEK_END), static_cast<off_t>(2 * data.size()));
+  ASSERT_EQ(pread(rfd, out.data(), out.size(), data.size()),
+            static_cast<ssize_t>(out.size()));
+  EXPECT_EQ(out, data);
+
+  ASSERT_EQ(close(rfd), 0);
+  ASSERT_EQ(close(wfd), 0);
+  ASSERT_EQ(unlink(path.c_str()), 0);
+}
+
+TEST_F(WriteBackTest, CloseFlushes) {
+  std::string path = TestPath("close");
+  int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  ASSERT_GE(fd, 0);
+  std::vector<char> data = Pattern(10000, 'c');
+  ASSERT_EQ(write(fd, data.data(), data.size()),
+            static_cast<ssize_t>(data.size()));
+  ASSERT_EQ(close(fd), 0);
+
+  fd = open(path.c_str(), O_RDONLY);
+  ASSERT_GE(fd, 0);
+  struct stat st;
+  ASSERT_EQ(fstat(fd, &st), 0);
+  EXPECT_EQ(st.st_size, static_cast<off_t>(data.size()));
+  std::vector<char> out(data.size());
+  ASSERT_EQ(read(fd, out.data(), out.size()),
+            static_cast<ssize_t>(out.size()));
+  EXPECT_EQ(out, data);
+  ASSERT_EQ(close(fd), 0);
+  ASSERT_EQ(unlink(path.c_str()), 0);
+}
+
+TEST_F(WriteBackTest, DirtyLimit) {
+  // Writing more than the per-file limit forces writers to flush inline.
+  std::string path = TestPath("limit");
+  int fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+  ASSERT_GE(fd, 0);
+  constexpr size_t kChunk = 256 * 1024;
+  constexpr size_t kSize = 8 * 1024 * 1024;
+  for (size_t off = 0; off < kSize; off += kChunk) {
+    std::vector<char> data = Pattern(kChunk, 'a' + off / kChunk);
+    ASSERT_EQ(write(fd, data.data(), data.size()),
+              static_cast<ssize_t>(data.size()));
+  }
+  ASSERT_EQ(fdatasync(fd), 0);
+
+  std::vector<char> out(kChunk);
+  for (size_t off = 0; off < kSize; off += kChunk) {
+    ASSERT_EQ(pread(fd, out.data(), out.size(), off),
+              static_cast<ssize_t>(out.size()));
+    ASSERT_EQ(out, Pattern(kChunk, 'a' + off / kChunk)) << "offset " << off;
+  }
+  ASSERT_EQ(close(fd), 0);
+  ASSERT_EQ(unlink(path.c_str()), 0);
+}
+
+TEST_F(WriteBackTest, ConcurrentSync) {
+  std::string path = TestPath("sync");
+  int fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+  ASSERT_GE(fd, 0);
+
+  constexpr int kThreads = 8;
+  constexpr int kRecords = 200;
+  constexpr size_t kRecordSize = 512;
+  std::vector<std::thread> threads;
+  std::vector<int> failures(kThreads);
+  for (int t = 0; t < kThreads; t++) {
+    threads.emplace_back([&, t] {
+      std::vector<char> rec = Pattern(kRecordSize, 'a' + t);
+      for (int i = 0; i < kRecords; i++) {
+        off_t off = (static_cast<off_t>(i) * kThreads + t) * kRecordSize;
+        if (pwrite(fd, rec.data(), rec.size(), off) !=
+            static_cast<ssize_t>(rec.size()))
+          failures[t]++;
+        if ((i % 2 ? fdatasync(fd) : fsync(fd)) != 0) failures[t]++;
+      }
+    });
+  }
+  for (auto &th : threads) th.join();
+  for (int t = 0; t < kThreads; t++) EXPECT_EQ(failures[t], 0);
+
+  std::vector<char> out(kRecordSize);
+  for (int i = 0; i < kRecords * kThreads; i++) {
+    ASSERT_EQ(pread(fd, out.data(), out.size(), i * kRecordSize),
+              static_cast<ssize_t>(out.size()));
+    ASSERT_EQ(out, Pattern(kRecordSize, 'a' + i % kThreads)) << "record " << i;
+  }
+  ASSERT_EQ(close(fd), 0);
+  ASSERT_EQ(unlink(path.c_str()), 0);
+}
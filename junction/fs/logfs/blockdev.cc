@@ -0,0 +1,96 @@
+// blockdev.cc - block devices that logfs can be stored on
+
+extern "C" {
+#include <fcntl.h>
+}
+
+#include "junction/fs/logfs/blockdev.h"
+
+#include <algorithm>
+
+#include "junction/bindings/storage.h"
+
+namespace junction::logfs {
+
+namespace {
+
+// The largest request sent to the storage device at once.
+constexpr size_t kMaxStorageIO = 128 * 1024;
+
+}  // namespace
+
+Status<std::unique_ptr<StorageDevice>> StorageDevice::Open() {
+  uint32_t block_size = rt::Storage::get_block_size();
+  uint64_t num_blocks = rt::Storage::get_num_blocks();
+  if (block_size == 0 || num_blocks == 0) return MakeError(ENODEV);
+  return std::unique_ptr<StorageDevice>(
+      new StorageDevice(block_size, num_blocks));
+}
+
+Status<void> StorageDevice::Read(std::span<std::byte> dst, uint64_t off) {
+  const uint32_t bs = get_block_size();
+  assert(off % bs == 0 && dst.size() % bs == 0);
+  while (!dst.empty()) {
+    size_t n = std::min(dst.size(), kMaxStorageIO);
+    int ret = rt::Storage::Read(dst.data(), off / bs, n / bs);
+    if (ret < 0) return MakeError(-ret);
+    dst = dst.subspan(n);
+    off += n;
+  }
+  return {};
+}
+
+Status<void> StorageDevice::Write(std::span<const std::byte> src,
+                                  uint64_t off) {
+  const uint32_t bs = get_block_size();
+  assert(off % bs == 0 && src.size() % bs == 0);
+  while (!src.empty()) {
+    size_t n = std::min(src.size(), kMaxStorageIO);
+    int ret = rt::Storage::Write(src.data(), off / bs, n / bs);
+    if (ret < 0) return MakeError(-ret);
+    src = src.subspan(n);
+    off += n;
+  }
+  return {};
+}
+
+Status<std::unique_ptr<FileDevice>> FileDevice::Open(std::string_view path,
+                                                     uint64_t size) {
+  Status<KernelFile> f =
+      KernelFile::Open(path, O_CREAT | O_CLOEXEC, FileMode::kReadWrite, 0600);
+  if (!f) return MakeError(f);
+
+  Status<struct stat> stat = f->StatAt();
+  if (!stat) return MakeError(stat);
+  if (static_cast<uint64_t>(stat->st_size) < size) {
+    if (Status<void> ret = f->Truncate(size); !ret) return MakeError(ret);
+  } else {
+    size = stat->st_size;
+  }
+
+  size -= size % kSectorSize;
+  return std::unique_ptr<FileDevice>(new FileDevice(std::move(*f), size));
+}
+
+Status<void> FileDevice::Read(std::span<std::byte> dst, uint64_t off) {
+  while (!dst.empty()) {
+    ssize_t ret = ksys_pread(file_.GetFd(), dst.data(), dst.size(), off);
+    if (ret < 0) return MakeError(-ret);
+    if (ret == 0) return MakeError(EIO);
+    dst = dst.subspan(ret);
+    off += ret;
+  }
+  return {};
+}
+
+Status<void> FileDevice::Write(std::span<const std::byte> src, uint64_t off) {
+  while (!src.empty()) {
+    ssize_t ret = ksys_pwrite(file_.GetFd(), src.data(), src.size(), off);
+    if (ret < 0) return MakeError(-ret);
+    src = src.subspan(ret);
+    off += ret;
+  }
+  return {};
+}
+
+}  // namespace junction::logfs
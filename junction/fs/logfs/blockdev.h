@@ -0,0 +1,77 @@
+// blockdev.h - block devices that logfs can be stored on
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <string_view>
+
+#include "junction/base/error.h"
+#include "junction/kernel/ksys.h"
+
+namespace junction::logfs {
+
+// BlockDevice is a device that is read and written in whole blocks. Offsets
+// and sizes are in bytes but must be multiples of the block size.
+class BlockDevice {
+ public:
+  BlockDevice(uint32_t block_size, uint64_t num_blocks)
+      : block_size_(block_size), num_blocks_(num_blocks) {}
+  virtual ~BlockDevice() = default;
+
+  // Reads @dst.size() bytes starting at @off.
+  virtual Status<void> Read(std::span<std::byte> dst, uint64_t off) = 0;
+  // Writes @src.size() bytes starting at @off.
+  virtual Status<void> Write(std::span<const std::byte> src, uint64_t off) = 0;
+  // Waits until all completed writes are durable.
+  virtual Status<void> Flush() = 0;
+
+  // Returns the size of each block.
+  [[nodiscard]] uint32_t get_block_size() const { return block_size_; }
+  // Returns the capacity of the device in bytes.
+  [[nodiscard]] uint64_t get_size() const { return block_size_ * num_blocks_; }
+
+ private:
+  const uint32_t block_size_;
+  const uint64_t num_blocks_;
+};
+
+// StorageDevice is the kernel-bypass (NVMe) device managed by Caladan.
+class StorageDevice : public BlockDevice {
+ public:
+  // Fails if Caladan wasn't configured with a storage device.
+  static Status<std::unique_ptr<StorageDevice>> Open();
+
+  Status<void> Read(std::span<std::byte> dst, uint64_t off) override;
+  Status<void> Write(std::span<const std::byte> src, uint64_t off) override;
+  // Writes are complete (and durable) once Write() returns.
+  Status<void> Flush() override { return {}; }
+
+ private:
+  using BlockDevice::BlockDevice;
+};
+
+// FileDevice emulates a block device with a host file, so that logfs can be
+// used (and tested) on machines without a dedicated device.
+class FileDevice : public BlockDevice {
+ public:
+  // Opens (or creates) @path, growing it to at least @size bytes.
+  static Status<std::unique_ptr<FileDevice>> Open(std::string_view path,
+                                                  uint64_t size);
+
+  Status<void> Read(std::span<std::byte> dst, uint64_t off) override;
+  Status<void> Write(std::span<const std::byte> src, uint64_t off) override;
+  Status<void> Flush() override { return file_.DataSync(); }
+
+ private:
+  // Emulate the common sector size of flash devices.
+  static constexpr uint32_t kSectorSize = 512;
+
+  FileDevice(KernelFile &&file, uint64_t size)
+      : BlockDevice(kSectorSize, size / kSectorSize), file_(std::move(file)) {}
+
+  KernelFile file_;
+};
+
+}  // namespace junction::logfs
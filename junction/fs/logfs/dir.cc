@@ -0,0 +1,203 @@
+// dir.cc - directory support for logfs
+
+#include "junction/base/compiler.h"
+#include "junction/base/finally.h"
+#include "junction/fs/logfs/logfs.h"
+
+namespace junction::logfs {
+
+void LogIDir::AddEntryLocked(std::string_view name, std::shared_ptr<Inode> ino,
+                             LogNode &n) {
+  assert(lock_.IsHeld());
+  assert(fs_->lock_.IsHeldExclusive());
+  node_.dirents.insert_or_assign(std::string(name), n.id);
+  fs_->MarkDirtyLocked(node_);
+  InsertLockedNoCheck(name, std::move(ino));
+}
+
+void LogIDir::RemoveEntryLocked(std::string_view name, Inode &ino) {
+  assert(lock_.IsHeld());
+  assert(fs_->lock_.IsHeldExclusive());
+  if (auto it = node_.dirents.find(name); it != node_.dirents.end())
+    node_.dirents.erase(it);
+  fs_->MarkDirtyLocked(node_);
+  ino.dec_nlink();
+  if (LogNode *n = GetLogNode(ino); n && ino.is_stale()) fs_->ReleaseLocked(*n);
+}
+
+Status<void> LogIDir::MkNod(std::string_view name, mode_t mode, dev_t dev) {
+  // Device files can't be stored (yet).
+  return MakeError(EPERM);
+}
+
+Status<void> LogIDir::MkDir(std::string_view name, mode_t mode) {
+  rt::ScopedLock g(lock_);
+  if (is_stale()) return MakeError(ENOENT);
+  if (entries_.contains(name)) return MakeError(EEXIST);
+  rt::ScopedLock fg(fs_->lock_);
+  auto ino = std::make_shared<LogIDir>(fs_, fs_->AllocIdLocked(), mode,
+                                       std::string(name), get_this());
+  fs_->AddNodeLocked(ino, ino->node());
+  AddEntryLocked(name, ino, ino->node());
+  return {};
+}
+
+Status<void> LogIDir::Unlink(std::string_view name) {
+  rt::ScopedLock g(lock_);
+  std::shared_ptr<Inode> ino = entries_.Lookup(name);
+  if (!ino) return MakeError(ENOENT);
+  if (ino->is_dir()) return MakeError(EISDIR);
+  entries_.Remove(name);
+  rt::ScopedLock fg(fs_->lock_);
+  RemoveEntryLocked(name, *ino);
+  return {};
+}
+
+Status<void> LogIDir::RmDir(std::string_view name) {
+  rt::ScopedLock g(lock_);
+  std::shared_ptr<Inode> ino = entries_.Lookup(name);
+  if (!ino) return MakeError(ENOENT);
+  if (!ino->is_dir()) return MakeError(ENOTDIR);
+  auto *dir = most_derived_cast<LogIDir>(ino.get());
+  if (!dir) return MakeError(EBUSY);
+
+  // Confirm the directory is empty
+  rt::ScopedLock dg(dir->lock_);
+  if (!dir->entries_.empty()) return MakeError(ENOTEMPTY);
+
+  // Remove it
+  entries_.Remove(name);
+  rt::ScopedLock fg(fs_->lock_);
+  RemoveEntryLocked(name, *dir);
+  assert(dir->is_stale());
+  return {};
+}
+
+Status<void> LogIDir::SymLink(std::string_view name, std::string_view target) {
+  rt::ScopedLock g(lock_);
+  if (is_stale()) return MakeError(ENOENT);
+  if (entries_.contains(name)) return MakeError(EEXIST);
+  rt::ScopedLock fg(fs_->lock_);
+  auto ino = std::make_shared<LogSoftLink>(fs_, fs_->AllocIdLocked(), target);
+  fs_->AddNodeLocked(ino, ino->node());
+  AddEntryLocked(name, ino, ino->node());
+  return {};
+}
+
+Status<void> LogIDir::DoRename(LogIDir &src, std::string_view src_name,
+                               std::string_view dst_name, bool replace) {
+  assert(lock_.IsHeld());
+  assert(src.lock_.IsHeld());
+
+  // find the source inode
+  std::shared_ptr<Inode> ino = src.entries_.Lookup(src_name);
+  if (!ino) return MakeError(ENOENT);
+  LogNode *n = GetLogNode(*ino);
+  if (!n) return MakeError(EBUSY);
+
+  // make sure the destination can be replaced
+  std::shared_ptr<Inode> old = entries_.Lookup(dst_name);
+  if (old == ino) return {};
+  if (old) {
+    if (!replace) return MakeError(EEXIST);
+    if (ino->is_dir() && !old->is_dir()) return MakeError(ENOTDIR);
+    if (!ino->is_dir() && old->is_dir()) return MakeError(EISDIR);
+    if (old->is_dir()) {
+      auto *odir = most_derived_cast<LogIDir>(old.get());
+      if (!odir) return MakeError(EBUSY);
+      rt::ScopedSharedLock og(odir->lock_);
+      if (!odir->entries_.empty()) return MakeError(ENOTEMPTY);
+    }
+  }
+
+  // perform the actual rename
+  src.entries_.Remove(src_name);
+  if (ino->is_dir()) {
+    IDir &tdir = static_cast<IDir &>(*ino);
+    tdir.SetParent(get_this(), std::string(dst_name));
+  }
+  entries_.Set(dst_name, ino);
+
+  // update the persistent copies
+  rt::ScopedLock fg(fs_->lock_);
+  if (auto it = src.node_.dirents.find(src_name); it != src.node_.dirents.end())
+    src.node_.dirents.erase(it);
+  fs_->MarkDirtyLocked(src.node_);
+  node_.dirents.insert_or_assign(std::string(dst_name), n->id);
+  fs_->MarkDirtyLocked(node_);
+  if (old) {
+    old->dec_nlink();
+    if (LogNode *on = GetLogNode(*old); on && old->is_stale())
+      fs_->ReleaseLocked(*on);
+  }
+  return {};
+}
+
+Status<void> LogIDir::Rename(IDir &src, std::string_view src_name,
+                             std::string_view dst_name, bool replace) {
+  if (src.get_idir_type() != IDirType::kLogFS) return MakeError(EXDEV);
+  LogIDir *src_dir = static_cast<LogIDir *>(&src);
+  if (src_dir->fs_ != fs_) return MakeError(EXDEV);
+
+  // check if rename is in same directory
+  if (src_dir == this) {
+    rt::ScopedLock g(lock_);
+    return DoRename(*src_dir, src_name, dst_name, replace);
+  }
+
+  // otherwise rename is across different directories (to avoid deadlock)
+  auto fin = finally([this, &src_dir] {
+    src_dir->lock_.Unlock();
+    lock_.Unlock();
+  });
+  if (src_dir->get_inum() > this->get_inum()) {
+    src_dir->lock_.Lock();
+    lock_.Lock();
+  } else {
+    lock_.Lock();
+    src_dir->lock_.Lock();
+  }
+  return DoRename(*src_dir, src_name, dst_name, replace);
+}
+
+Status<void> LogIDir::Link(std::string_view name, std::shared_ptr<Inode> ino) {
+  LogNode *n = GetLogNode(*ino);
+  if (!n || &n->fs != fs_.get()) return MakeError(EXDEV);
+  if (ino->is_dir()) return MakeError(EPERM);
+
+  rt::ScopedLock g(lock_);
+  if (is_stale()) return MakeError(ESTALE);
+  if (entries_.contains(name)) return MakeError(EEXIST);
+  rt::ScopedLock fg(fs_->lock_);
+  if (n->released) return MakeError(ENOENT);
+  AddEntryLocked(name, std::move(ino), *n);
+  return {};
+}
+
+Status<std::shared_ptr<File>> LogIDir::Create(std::string_view name, int flags,
+                                              mode_t mode, FileMode fmode) {
+  rt::ScopedLock g(lock_);
+  std::shared_ptr<Inode> in = entries_.Lookup(name);
+  if (!in) {
+    if (is_stale()) return MakeError(ENOENT);
+    std::shared_ptr<LogInode> ino;
+    {
+      rt::ScopedLock fg(fs_->lock_);
+      ino = std::make_shared<LogInode>(fs_, fs_->AllocIdLocked(), mode);
+      fs_->AddNodeLocked(ino, ino->node());
+      AddEntryLocked(name, ino, ino->node());
+    }
+    return ino->Open(flags, fmode);
+  }
+
+  if (flags & kFlagExclusive) return MakeError(EEXIST);
+  return in->Open(flags, fmode);
+}
+
+Status<void> LogIDir::GetStats(struct stat *buf) const {
+  LogInodeToStats(*this, buf);
+  buf->st_size = kBlockSize;
+  return {};
+}
+
+}  // namespace junction::logfs
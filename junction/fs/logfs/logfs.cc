@@ -0,0 +1,936 @@
+// logfs.cc - the log, checkpoints, and cleaning for logfs
+
+#include "junction/fs/logfs/logfs.h"
+
+#include <algorithm>
+#include <cstring>
+#include <utility>
+
+#include "junction/base/bits.h"
+#include "junction/base/finally.h"
+
+namespace junction::logfs {
+
+namespace {
+
+inline constexpr uint32_t kVersion = 1;
+// Checkpoints alternate between these two blocks of segment 0.
+inline constexpr LogAddr kSuperblockAddr = 0;
+inline constexpr LogAddr kCheckpointAddr[2] = {1, 2};
+// The inode id of the root directory.
+inline constexpr uint64_t kRootId = 1;
+
+// Each block in the log is tagged with its kind (in the top two bits) and its
+// position within the owner.
+inline constexpr uint64_t kTagShift = 62;
+inline constexpr uint64_t kTagIndexMask = (1UL << kTagShift) - 1;
+enum TagKind : uint64_t {
+  kTagData = 0,    // file data (index is the file block)
+  kTagMap = 1,     // a chunk of a file's block map (index is the chunk)
+  kTagRecord = 2,  // an inode record (index is the block in the record)
+  kTagMeta = 3,    // the inode map of a checkpoint
+};
+
+constexpr uint64_t MakeTag(TagKind kind, uint64_t idx) {
+  return (static_cast<uint64_t>(kind) << kTagShift) | idx;
+}
+
+struct Superblock {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t block_size;
+  uint32_t segment_blocks;
+  uint64_t nr_segments;
+};
+
+struct SummaryEntry {
+  uint64_t id;   // the owning inode (or 0 for checkpoint metadata)
+  uint64_t tag;  // see TagKind
+};
+
+struct SegmentSummary {
+  uint32_t magic;
+  uint32_t nr_entries;
+  SummaryEntry entries[kSegmentBlocks - 1];
+};
+static_assert(sizeof(SegmentSummary) <= kBlockSize);
+
+inline constexpr size_t kMaxMetaBlocks = (kBlockSize - 40) / sizeof(LogAddr);
+
+struct Checkpoint {
+  uint32_t magic;
+  uint32_t nr_meta;
+  uint64_t seq;
+  uint64_t checksum;  // computed with this field set to zero
+  uint64_t next_id;
+  uint64_t nr_inodes;
+  LogAddr meta[kMaxMetaBlocks];
+};
+static_assert(sizeof(Checkpoint) == kBlockSize);
+
+struct MetaEntry {
+  uint64_t id;
+  LogAddr addr;
+};
+inline constexpr size_t kMetaEntriesPerBlock = kBlockSize / sizeof(MetaEntry);
+
+// An inode record is this header followed by the addresses of the block map
+// chunks and then the payload (directory entries or a link target).
+struct RecordHeader {
+  uint64_t id;
+  uint32_t mode;
+  uint32_t nr_chunks;
+  uint64_t size;
+  uint64_t payload_len;
+};
+
+// A directory entry in a record payload is the inode id (8 bytes) and the
+// name length (2 bytes), followed by the name.
+inline constexpr size_t kDirentHeaderSize = sizeof(uint64_t) + sizeof(uint16_t);
+
+// FNV-1a, used to detect torn checkpoint writes.
+uint64_t Checksum(std::span<const std::byte> buf) {
+  uint64_t hash = 0xcbf29ce484222325UL;
+  for (std::byte b : buf) {
+    hash ^= static_cast<uint64_t>(b);
+    hash *= 0x100000001b3UL;
+  }
+  return hash;
+}
+
+uint64_t ChecksumCheckpoint(const Checkpoint &ckpt) {
+  Checkpoint tmp = ckpt;
+  tmp.checksum = 0;
+  return Checksum(std::as_bytes(std::span{&tmp, 1}));
+}
+
+}  // namespace
+
+LogNode *GetLogNode(Inode &ino) {
+  if (auto *f = most_derived_cast<LogInode>(&ino)) return &f->node();
+  if (auto *d = most_derived_cast<LogIDir>(&ino)) return &d->node();
+  if (auto *l = most_derived_cast<LogSoftLink>(&ino)) return &l->node();
+  return nullptr;
+}
+
+LogInode::~LogInode() {
+  if (node_.released) fs_->DeferFree(node_.id, std::move(node_.blocks));
+}
+
+Status<std::shared_ptr<File>> LogInode::Open(uint32_t flags, FileMode fmode) {
+  return std::make_shared<LogFile>(flags, fmode, shared_from_base<LogInode>());
+}
+
+Status<void> LogInode::GetStats(struct stat *buf) const {
+  LogInodeToStats(*this, buf);
+  buf->st_size = fs_->GetSize(node_);
+  buf->st_blocks = fs_->GetBlocks(node_) * (kBlockSize / 512);
+  return {};
+}
+
+LogFS::LogFS(std::unique_ptr<BlockDevice> dev)
+    : dev_(std::move(dev)),
+      nr_segments_(dev_->get_size() / kSegmentSize),
+      seg_buf_(new std::byte[kSegmentSize]) {}
+
+LogFS::~LogFS() {
+  // Best effort; applications must call fsync() for durability.
+  rt::ScopedLock g(lock_);
+  FlushLocked();
+}
+
+void LogFS::DeferFree(uint64_t id, std::vector<LogAddr> &&blocks) {
+  rt::SpinGuard g(free_lock_);
+  pending_free_.emplace_back(id, std::move(blocks));
+}
+
+void LogFS::DrainFreesLocked() {
+  assert(lock_.IsHeldExclusive());
+  std::vector<PendingFree> frees;
+  {
+    rt::SpinGuard g(free_lock_);
+    frees.swap(pending_free_);
+  }
+  for (const PendingFree &f : frees) {
+    for (LogAddr addr : f.blocks) DeadLocked(addr);
+    nodes_.erase(f.id);
+  }
+}
+
+void LogFS::AddNodeLocked(std::shared_ptr<Inode> ino, LogNode &n) {
+  assert(lock_.IsHeldExclusive());
+  nodes_[n.id] = std::move(ino);
+  dirty_.insert(n.id);
+}
+
+void LogFS::ReleaseLocked(LogNode &n) {
+  assert(lock_.IsHeldExclusive());
+  n.released = true;
+  imap_.erase(n.id);
+  dirty_.erase(n.id);
+  for (size_t i = 0; i < n.record_blocks; i++) DeadLocked(n.record + i);
+  for (LogAddr addr : n.chunks) DeadLocked(addr);
+  n.record = 0;
+  n.record_blocks = 0;
+  n.chunks.clear();
+  n.dirty_chunks.clear();
+
+  // File data stays readable through open files until the inode is destroyed.
+  if (!n.ino.is_regular()) nodes_.erase(n.id);
+}
+
+std::pair<std::shared_ptr<Inode>, LogNode *> LogFS::FindNodeLocked(
+    uint64_t id) {
+  auto it = nodes_.find(id);
+  if (it == nodes_.end()) return {};
+  std::shared_ptr<Inode> ino = it->second.lock();
+  if (!ino) return {};
+  LogNode *n = GetLogNode(*ino);
+  return {std::move(ino), n};
+}
+
+//
+// The log
+//
+
+Status<LogAddr> LogFS::AppendRunLocked(uint64_t id, uint64_t tag, size_t n) {
+  assert(lock_.IsHeldExclusive());
+  if (n > kSegmentBlocks - 1) return MakeError(ENOSPC);
+  if (cur_blk_ + n > kSegmentBlocks) {
+    if (Status<void> ret = NextSegmentLocked(); !ret) return MakeError(ret);
+  }
+
+  auto *sum = reinterpret_cast<SegmentSummary *>(seg_buf_.get());
+  LogAddr addr = SegmentStart(cur_seg_) + cur_blk_;
+  for (size_t i = 0; i < n; i++) sum->entries[cur_blk_ + i - 1] = {id, tag + i};
+  cur_blk_ += n;
+  sum->nr_entries = cur_blk_ - 1;
+  return addr;
+}
+
+Status<LogAddr> LogFS::AppendLocked(uint64_t id, uint64_t tag) {
+  return AppendRunLocked(id, tag, 1);
+}
+
+Status<void> LogFS::FlushLocked() {
+  if (flushed_blk_ >= cur_blk_) return {};
+  std::span<const std::byte> buf(seg_buf_.get(), kSegmentSize);
+  uint64_t start = SegmentStart(cur_seg_) * kBlockSize;
+
+  // The summary changes as the segment fills, so it is rewritten every time.
+  size_t first = flushed_blk_;
+  if (first > 1) {
+    Status<void> ret = dev_->Write(buf.subspan(0, kBlockSize), start);
+    if (!ret) return ret;
+  } else {
+    first = 0;
+  }
+  size_t len = (cur_blk_ - first) * kBlockSize;
+  Status<void> ret = dev_->Write(buf.subspan(first * kBlockSize, len),
+                                 start + first * kBlockSize);
+  if (!ret) return ret;
+  flushed_blk_ = cur_blk_;
+  return {};
+}
+
+Status<void> LogFS::NextSegmentLocked() {
+  if (Status<void> ret = FlushLocked(); !ret) return ret;
+
+  // Cleaning appends to the log too, so it may start new segments itself.
+  if (!in_maintenance_ && nr_free_ < kCleanThreshold) {
+    if (Status<void> ret = CleanLocked(); !ret) return ret;
+  }
+
+  // Leave some segments so that the cleaner can always make progress.
+  if (nr_free_ == 0 || (!in_maintenance_ && nr_free_ <= kReservedSegments))
+    return MakeError(ENOSPC);
+
+  size_t seg = 1;
+  while (!segs_[seg].free) seg++;
+  segs_[seg].free = false;
+  nr_free_--;
+
+  cur_seg_ = seg;
+  cur_blk_ = 1;
+  flushed_blk_ = 1;
+  std::memset(seg_buf_.get(), 0, kBlockSize);
+  auto *sum = reinterpret_cast<SegmentSummary *>(seg_buf_.get());
+  sum->magic = LOGFS_MAGIC;
+  return {};
+}
+
+Status<void> LogFS::ReadBlocksLocked(LogAddr addr, size_t n, std::byte *dst) {
+  if (IsCurrentLocked(addr)) {
+    assert(IsCurrentLocked(addr + n - 1));
+    std::memcpy(dst, BufferedBlock(addr), n * kBlockSize);
+    return {};
+  }
+  return dev_->Read({dst, n * kBlockSize}, addr * kBlockSize);
+}
+
+Status<void> LogFS::WriteBlockLocked(LogNode &n, size_t blk, size_t off,
+                                     const std::byte *src, size_t len) {
+  assert(lock_.IsHeldExclusive());
+  assert(off + len <= kBlockSize);
+  LogAddr old = blk < n.blocks.size() ? n.blocks[blk] : 0;
+
+  // Blocks that haven't reached the device yet can be updated in place.
+  if (old && IsBufferedLocked(old)) {
+    std::byte *dst = BufferedBlock(old) + off;
+    if (src)
+      std::memcpy(dst, src, len);
+    else
+      std::memset(dst, 0, len);
+    return {};
+  }
+
+  Status<LogAddr> addr = AppendLocked(n.id, MakeTag(kTagData, blk));
+  if (!addr) return MakeError(addr);
+  std::byte *dst = BufferedBlock(*addr);
+
+  // Appending may have run the cleaner, which can move the old block.
+  old = blk < n.blocks.size() ? n.blocks[blk] : 0;
+  if (old && (off != 0 || len != kBlockSize)) {
+    if (Status<void> ret = ReadBlocksLocked(old, 1, dst); !ret) {
+      std::memset(dst, 0, kBlockSize);
+      return ret;
+    }
+  } else if (!old) {
+    std::memset(dst, 0, kBlockSize);
+  }
+  if (src)
+    std::memcpy(dst + off, src, len);
+  else
+    std::memset(dst + off, 0, len);
+
+  if (blk >= n.blocks.size()) n.blocks.resize(blk + 1);
+  n.blocks[blk] = *addr;
+  LiveLocked(*addr);
+  if (old)
+    DeadLocked(old);
+  else
+    n.nr_blocks++;
+  n.dirty_chunks.insert(blk / kMapChunkEntries);
+  MarkDirtyLocked(n);
+  return {};
+}
+
+//
+// File data
+//
+
+Status<size_t> LogFS::Read(LogNode &n, std::span<std::byte> buf, off_t off) {
+  if (off < 0) return MakeError(EINVAL);
+  if (buf.empty()) return 0;
+  rt::ScopedSharedLock g(lock_);
+  size_t pos = static_cast<size_t>(off);
+  if (pos >= n.size) return 0;
+  const size_t end = std::min(n.size, pos + buf.size());
+  std::unique_ptr<std::byte[]> tmp;
+
+  while (pos < end) {
+    size_t blk = pos / kBlockSize;
+    size_t boff = pos % kBlockSize;
+    size_t len = std::min(end - pos, kBlockSize - boff);
+    std::byte *dst = buf.data() + (pos - off);
+    LogAddr addr = blk < n.blocks.size() ? n.blocks[blk] : 0;
+
+    if (!addr) {
+      std::memset(dst, 0, len);
+    } else if (IsCurrentLocked(addr)) {
+      std::memcpy(dst, BufferedBlock(addr) + boff, len);
+    } else if (len != kBlockSize) {
+      if (!tmp) tmp.reset(new std::byte[kBlockSize]);
+      Status<void> ret = dev_->Read({tmp.get(), kBlockSize}, addr * kBlockSize);
+      if (!ret) break;
+      std::memcpy(dst, tmp.get() + boff, len);
+    } else {
+      // Read whole blocks that are contiguous in the log with one request.
+      size_t run = 1;
+      while (pos + (run + 1) * kBlockSize <= end &&
+             blk + run < n.blocks.size() &&
+             n.blocks[blk + run] == addr + run &&
+             !IsCurrentLocked(addr + run))
+        run++;
+      len = run * kBlockSize;
+      Status<void> ret = dev_->Read({dst, len}, addr * kBlockSize);
+      if (!ret) break;
+    }
+    pos += len;
+  }
+
+  if (pos == static_cast<size_t>(off)) return MakeError(EIO);
+  return pos - off;
+}
+
+Status<size_t> LogFS::Write(LogNode &n, std::span<const std::byte> buf,
+                            off_t off) {
+  if (off < 0) return MakeError(EINVAL);
+  size_t pos = static_cast<size_t>(off);
+  if (pos + buf.size() > kMaxFileSize) return MakeError(EFBIG);
+
+  rt::ScopedLock g(lock_);
+  const size_t end = pos + buf.size();
+  while (pos < end) {
+    size_t boff = pos % kBlockSize;
+    size_t len = std::min(end - pos, kBlockSize - boff);
+    Status<void> ret = WriteBlockLocked(n, pos / kBlockSize, boff,
+                                        buf.data() + (pos - off), len);
+    if (!ret) {
+      if (pos == static_cast<size_t>(off)) return MakeError(ret);
+      break;
+    }
+    pos += len;
+    n.size = std::max(n.size, pos);
+  }
+  MarkDirtyLocked(n);
+  return pos - off;
+}
+
+Status<void> LogFS::SetSize(LogNode &n, size_t size) {
+  if (size > kMaxFileSize) return MakeError(EFBIG);
+  rt::ScopedLock g(lock_);
+  if (size < n.size) {
+    size_t nr_blocks = DivideUp(size, kBlockSize);
+    for (size_t blk = nr_blocks; blk < n.blocks.size(); blk++) {
+      if (!n.blocks[blk]) continue;
+      DeadLocked(n.blocks[blk]);
+      n.nr_blocks--;
+    }
+    if (nr_blocks < n.blocks.size()) {
+      n.blocks.resize(nr_blocks);
+      size_t nr_chunks = DivideUp(nr_blocks, kMapChunkEntries);
+      for (size_t i = nr_chunks; i < n.chunks.size(); i++)
+        DeadLocked(n.chunks[i]);
+      if (nr_chunks < n.chunks.size()) n.chunks.resize(nr_chunks);
+      n.dirty_chunks.erase(n.dirty_chunks.lower_bound(nr_chunks),
+                           n.dirty_chunks.end());
+      if (nr_chunks) n.dirty_chunks.insert(nr_chunks - 1);
+    }
+
+    // Keep the tail of the last block zeroed in case the file grows again.
+    size_t boff = size % kBlockSize;
+    if (boff && nr_blocks <= n.blocks.size() && n.blocks[nr_blocks - 1]) {
+      Status<void> ret = WriteBlockLocked(n, nr_blocks - 1, boff, nullptr,
+                                          kBlockSize - boff);
+      if (!ret) return ret;
+    }
+  }
+  n.size = size;
+  MarkDirtyLocked(n);
+  return {};
+}
+
+size_t LogFS::GetSize(LogNode &n) {
+  rt::ScopedSharedLock g(lock_);
+  return n.size;
+}
+
+size_t LogFS::GetBlocks(LogNode &n) {
+  rt::ScopedSharedLock g(lock_);
+  return n.nr_blocks;
+}
+
+void LogFS::StatFS(struct statfs *buf) {
+  memset(buf, 0, sizeof(*buf));
+  buf->f_type = LOGFS_MAGIC;
+  buf->f_bsize = kBlockSize;
+  buf->f_frsize = kBlockSize;
+  buf->f_namelen = 255;
+
+  rt::ScopedSharedLock g(lock_);
+  size_t used = 0;
+  for (size_t seg = 1; seg < nr_segments_; seg++) used += segs_[seg].live;
+  size_t total = (nr_segments_ - 1) * (kSegmentBlocks - 1);
+  size_t reserved = kReservedSegments * (kSegmentBlocks - 1);
+  buf->f_blocks = total;
+  buf->f_bfree = total - std::min(used, total);
+  buf->f_bavail = buf->f_bfree - std::min<size_t>(buf->f_bfree, reserved);
+  buf->f_files = nodes_.size();
+}
+
+//
+// Checkpoints
+//
+
+Status<void> LogFS::WriteNodeLocked(LogNode &n) {
+  assert(lock_.IsHeldExclusive());
+  if (n.released) return {};
+
+  // Write the changed parts of the block map.
+  n.chunks.resize(DivideUp(n.blocks.size(), kMapChunkEntries));
+  while (!n.dirty_chunks.empty()) {
+    size_t idx = *n.dirty_chunks.begin();
+    if (idx >= n.chunks.size()) {
+      n.dirty_chunks.erase(idx);
+      continue;
+    }
+    Status<LogAddr> addr = AppendLocked(n.id, MakeTag(kTagMap, idx));
+    if (!addr) return MakeError(addr);
+    std::byte *dst = BufferedBlock(*addr);
+    std::memset(dst, 0, kBlockSize);
+    size_t start = idx * kMapChunkEntries;
+    size_t cnt = std::min(n.blocks.size() - start, kMapChunkEntries);
+    std::memcpy(dst, n.blocks.data() + start, cnt * sizeof(LogAddr));
+    DeadLocked(n.chunks[idx]);
+    LiveLocked(*addr);
+    n.chunks[idx] = *addr;
+    n.dirty_chunks.erase(idx);
+  }
+
+  // Serialize the record.
+  std::string payload;
+  if (n.ino.is_dir()) {
+    for (const auto &[name, id] : n.dirents) {
+      uint16_t len = name.size();
+      payload.append(reinterpret_cast<const char *>(&id), sizeof(id));
+      payload.append(reinterpret_cast<const char *>(&len), sizeof(len));
+      payload.append(name);
+    }
+  } else if (n.ino.is_symlink()) {
+    payload = n.target;
+  }
+  RecordHeader hdr{n.id, n.ino.get_mode(),
+                   static_cast<uint32_t>(n.chunks.size()), n.size,
+                   payload.size()};
+  size_t chunks_len = n.chunks.size() * sizeof(LogAddr);
+  size_t len = sizeof(hdr) + chunks_len + payload.size();
+  size_t nr_blocks = DivideUp(len, kBlockSize);
+
+  Status<LogAddr> addr =
+      AppendRunLocked(n.id, MakeTag(kTagRecord, 0), nr_blocks);
+  if (!addr) return MakeError(addr);
+  std::byte *dst = BufferedBlock(*addr);
+  std::memset(dst, 0, nr_blocks * kBlockSize);
+  std::memcpy(dst, &hdr, sizeof(hdr));
+  if (chunks_len) std::memcpy(dst + sizeof(hdr), n.chunks.data(), chunks_len);
+  std::memcpy(dst + sizeof(hdr) + chunks_len, payload.data(), payload.size());
+
+  for (size_t i = 0; i < n.record_blocks; i++) DeadLocked(n.record + i);
+  for (size_t i = 0; i < nr_blocks; i++) LiveLocked(*addr + i);
+  n.record = *addr;
+  n.record_blocks = nr_blocks;
+  imap_[n.id] = *addr;
+  return {};
+}
+
+Status<void> LogFS::CheckpointLocked() {
+  assert(lock_.IsHeldExclusive());
+  bool was_maintenance = std::exchange(in_maintenance_, true);
+  auto f = finally([this, was_maintenance] {
+    in_maintenance_ = was_maintenance;
+  });
+
+  DrainFreesLocked();
+
+  // Write out every changed inode.
+  while (!dirty_.empty()) {
+    uint64_t id = *dirty_.begin();
+    auto [ino, n] = FindNodeLocked(id);
+    if (n) {
+      if (Status<void> ret = WriteNodeLocked(*n); !ret) return ret;
+    }
+    dirty_.erase(id);
+  }
+
+  // Write the inode map.
+  size_t nr_meta = DivideUp(imap_.size(), kMetaEntriesPerBlock);
+  if (nr_meta > kMaxMetaBlocks) return MakeError(ENOSPC);
+  std::vector<LogAddr> meta;
+  meta.reserve(nr_meta);
+  auto it = imap_.begin();
+  for (size_t i = 0; i < nr_meta; i++) {
+    Status<LogAddr> addr = AppendLocked(0, MakeTag(kTagMeta, i));
+    if (!addr) {
+      for (LogAddr a : meta) DeadLocked(a);
+      return MakeError(addr);
+    }
+    LiveLocked(*addr);
+    meta.push_back(*addr);
+    auto *ents = reinterpret_cast<MetaEntry *>(BufferedBlock(*addr));
+    std::memset(ents, 0, kBlockSize);
+    for (size_t j = 0; j < kMetaEntriesPerBlock && it != imap_.end(); j++, it++)
+      ents[j] = {it->first, it->second};
+  }
+
+  // Everything the checkpoint refers to must be durable before it is.
+  if (Status<void> ret = FlushLocked(); !ret) return ret;
+  if (Status<void> ret = dev_->Flush(); !ret) return ret;
+
+  Checkpoint ckpt;
+  std::memset(&ckpt, 0, sizeof(ckpt));
+  ckpt.magic = LOGFS_MAGIC;
+  ckpt.nr_meta = nr_meta;
+  ckpt.seq = ckpt_seq_ + 1;
+  ckpt.next_id = next_id_;
+  ckpt.nr_inodes = imap_.size();
+  std::copy(meta.begin(), meta.end(), ckpt.meta);
+  ckpt.checksum = ChecksumCheckpoint(ckpt);
+  Status<void> ret =
+      dev_->Write(std::as_bytes(std::span{&ckpt, 1}),
+                  kCheckpointAddr[ckpt.seq % 2] * kBlockSize);
+  if (!ret) return ret;
+  if (Status<void> ret = dev_->Flush(); !ret) return ret;
+  ckpt_seq_ = ckpt.seq;
+
+  for (LogAddr addr : meta_addrs_) DeadLocked(addr);
+  meta_addrs_ = std::move(meta);
+
+  // Segments without live blocks can be reused now that no checkpoint needs
+  // them.
+  for (size_t seg = 1; seg < nr_segments_; seg++) {
+    Segment &s = segs_[seg];
+    if (s.free || s.live != 0 || seg == cur_seg_) continue;
+    s.free = true;
+    nr_free_++;
+  }
+  return {};
+}
+
+Status<void> LogFS::Sync() {
+  rt::ScopedLock g(lock_);
+  if (dirty_.empty()) return {};
+  return CheckpointLocked();
+}
+
+//
+// Cleaning
+//
+
+Status<void> LogFS::RelocateLocked(uint64_t id, uint64_t tag, LogAddr addr,
+                                   const std::byte *data) {
+  auto [ino, n] = FindNodeLocked(id);
+  if (!n) return {};
+  uint64_t idx = tag & kTagIndexMask;
+
+  switch (static_cast<TagKind>(tag >> kTagShift)) {
+    case kTagData: {
+      if (idx >= n->blocks.size() || n->blocks[idx] != addr) return {};
+      Status<LogAddr> naddr = AppendLocked(id, tag);
+      if (!naddr) return MakeError(naddr);
+      std::memcpy(BufferedBlock(*naddr), data, kBlockSize);
+      n->blocks[idx] = *naddr;
+      DeadLocked(addr);
+      LiveLocked(*naddr);
+      n->dirty_chunks.insert(idx / kMapChunkEntries);
+      break;
+    }
+    case kTagMap:
+      // Rewritten by the next checkpoint.
+      if (idx >= n->chunks.size() || n->chunks[idx] != addr) return {};
+      n->dirty_chunks.insert(idx);
+      break;
+    case kTagRecord:
+      if (addr < n->record || addr >= n->record + n->record_blocks) return {};
+      break;
+    default:
+      return {};
+  }
+
+  if (!n->released) MarkDirtyLocked(*n);
+  return {};
+}
+
+Status<void> LogFS::CleanLocked() {
+  assert(lock_.IsHeldExclusive());
+  bool was_maintenance = std::exchange(in_maintenance_, true);
+  auto f = finally([this, was_maintenance] {
+    in_maintenance_ = was_maintenance;
+  });
+
+  DrainFreesLocked();
+
+  // Segments without live blocks only need a checkpoint to be reclaimed.
+  // Otherwise, greedily pick the segments with the fewest live blocks.
+  size_t reclaimable = 0;
+  std::vector<size_t> victims;
+  for (size_t seg = 1; seg < nr_segments_; seg++) {
+    const Segment &s = segs_[seg];
+    if (s.free || seg == cur_seg_) continue;
+    if (s.live == 0)
+      reclaimable++;
+    else if (s.live < kSegmentBlocks - 1)
+      victims.push_back(seg);
+  }
+  std::sort(victims.begin(), victims.end(), [this](size_t a, size_t b) {
+    return segs_[a].live < segs_[b].live;
+  });
+
+  // Relocated blocks (and the checkpoint that follows) must fit in the
+  // remaining free segments.
+  size_t budget = nr_free_ > 1 ? (nr_free_ - 1) * (kSegmentBlocks - 1) : 0;
+  size_t needed = kSegmentBlocks;
+  size_t dead = 0;
+  size_t cnt = 0;
+  while (cnt < victims.size() && cnt < kCleanThreshold) {
+    const Segment &s = segs_[victims[cnt]];
+    if (needed + s.live > budget) break;
+    needed += s.live;
+    dead += kSegmentBlocks - 1 - s.live;
+    cnt++;
+  }
+
+  // Cleaning must free at least one segment more than it consumes, or it
+  // would eat into the reserve without making progress.
+  if (dead < kSegmentBlocks) cnt = 0;
+  victims.resize(cnt);
+  if (victims.empty() && reclaimable == 0) return {};
+
+  std::unique_ptr<std::byte[]> buf(new std::byte[kSegmentSize]);
+  for (size_t seg : victims) {
+    LogAddr start = SegmentStart(seg);
+    Status<void> ret =
+        dev_->Read({buf.get(), kSegmentSize}, start * kBlockSize);
+    if (!ret) return ret;
+    auto *sum = reinterpret_cast<const SegmentSummary *>(buf.get());
+    if (sum->magic != LOGFS_MAGIC) continue;
+    size_t nr = std::min<size_t>(sum->nr_entries, kSegmentBlocks - 1);
+    for (size_t i = 0; i < nr; i++) {
+      const SummaryEntry &e = sum->entries[i];
+      ret = RelocateLocked(e.id, e.tag, start + i + 1,
+                           buf.get() + (i + 1) * kBlockSize);
+      if (!ret) return ret;
+    }
+  }
+
+  return CheckpointLocked();
+}
+
+//
+// Mounting
+//
+
+Status<std::shared_ptr<IDir>> LogFS::Format() {
+  if (nr_segments_ < kReservedSegments + kCleanThreshold + 2)
+    return MakeError(ENOSPC);
+
+  std::unique_ptr<std::byte[]> buf(new std::byte[kBlockSize]());
+  auto *sb = reinterpret_cast<Superblock *>(buf.get());
+  *sb = {LOGFS_MAGIC, kVersion, kBlockSize, kSegmentBlocks, nr_segments_};
+  Status<void> ret =
+      dev_->Write({buf.get(), kBlockSize}, kSuperblockAddr * kBlockSize);
+  if (!ret) return MakeError(ret);
+
+  // Invalidate any stale checkpoints.
+  std::memset(buf.get(), 0, kBlockSize);
+  for (LogAddr addr : kCheckpointAddr) {
+    ret = dev_->Write({buf.get(), kBlockSize}, addr * kBlockSize);
+    if (!ret) return MakeError(ret);
+  }
+
+  segs_.assign(nr_segments_, Segment{});
+  segs_[0].free = false;
+  nr_free_ = nr_segments_ - 1;
+  next_id_ = kRootId + 1;
+
+  auto root = std::make_shared<LogIDir>(shared_from_this(), kRootId, 0777, ".",
+                                        nullptr);
+  AddNodeLocked(root, root->node());
+  if (Status<void> ret = CheckpointLocked(); !ret) return MakeError(ret);
+  return root;
+}
+
+Status<std::shared_ptr<Inode>> LogFS::LoadNode(uint64_t id, std::string name,
+                                               std::shared_ptr<IDir> parent) {
+  // Hard links share an inode.
+  if (auto [ino, n] = FindNodeLocked(id); ino) return std::move(ino);
+
+  auto it = imap_.find(id);
+  if (it == imap_.end()) return MakeError(EIO);
+  LogAddr addr = it->second;
+
+  std::vector<std::byte> rec(kBlockSize);
+  if (Status<void> ret = ReadBlocksLocked(addr, 1, rec.data()); !ret)
+    return MakeError(ret);
+  RecordHeader hdr;
+  std::memcpy(&hdr, rec.data(), sizeof(hdr));
+  size_t chunks_len = hdr.nr_chunks * sizeof(LogAddr);
+  size_t len = sizeof(hdr) + chunks_len + hdr.payload_len;
+  size_t nr_blocks = DivideUp(len, kBlockSize);
+  if (hdr.id != id || nr_blocks > kSegmentBlocks - 1) return MakeError(EIO);
+  if (nr_blocks > 1) {
+    rec.resize(nr_blocks * kBlockSize);
+    Status<void> ret = ReadBlocksLocked(addr + 1, nr_blocks - 1,
+                                        rec.data() + kBlockSize);
+    if (!ret) return MakeError(ret);
+  }
+  const std::byte *payload = rec.data() + sizeof(hdr) + chunks_len;
+  mode_t mode = hdr.mode & ~kTypeMask;
+
+  std::shared_ptr<Inode> ino;
+  LogNode *n;
+  std::shared_ptr<LogIDir> dir;
+  switch (hdr.mode & kTypeMask) {
+    case kTypeRegularFile: {
+      auto f = std::make_shared<LogInode>(shared_from_this(), id, mode);
+      n = &f->node();
+      ino = std::move(f);
+      break;
+    }
+    case kTypeDirectory:
+      dir = std::make_shared<LogIDir>(shared_from_this(), id, mode,
+                                      std::move(name), std::move(parent));
+      n = &dir->node();
+      ino = dir;
+      break;
+    case kTypeSymLink: {
+      std::string_view target(reinterpret_cast<const char *>(payload),
+                              hdr.payload_len);
+      auto l = std::make_shared<LogSoftLink>(shared_from_this(), id, target);
+      n = &l->node();
+      ino = std::move(l);
+      break;
+    }
+    default:
+      return MakeError(EIO);
+  }
+
+  nodes_[id] = ino;
+  n->size = hdr.size;
+  n->record = addr;
+  n->record_blocks = nr_blocks;
+  for (size_t i = 0; i < nr_blocks; i++) LiveLocked(addr + i);
+
+  // Load the block map.
+  n->chunks.resize(hdr.nr_chunks);
+  if (chunks_len)
+    std::memcpy(n->chunks.data(), rec.data() + sizeof(hdr), chunks_len);
+  n->blocks.resize(std::min(DivideUp(n->size, kBlockSize),
+                            n->chunks.size() * kMapChunkEntries));
+  for (size_t i = 0; i < n->chunks.size(); i++) {
+    LiveLocked(n->chunks[i]);
+    size_t start = i * kMapChunkEntries;
+    size_t cnt = std::min(n->blocks.size() - start, kMapChunkEntries);
+    std::vector<LogAddr> chunk(kMapChunkEntries);
+    Status<void> ret = ReadBlocksLocked(
+        n->chunks[i], 1, reinterpret_cast<std::byte *>(chunk.data()));
+    if (!ret) return MakeError(ret);
+    std::copy_n(chunk.begin(), cnt, n->blocks.begin() + start);
+  }
+  for (LogAddr blk : n->blocks) {
+    if (!blk) continue;
+    LiveLocked(blk);
+    n->nr_blocks++;
+  }
+
+  if (!dir) return ino;
+
+  // Load the directory entries.
+  size_t pos = 0;
+  while (pos + kDirentHeaderSize <= hdr.payload_len) {
+    uint64_t cid;
+    uint16_t len;
+    std::memcpy(&cid, payload + pos, sizeof(cid));
+    std::memcpy(&len, payload + pos + sizeof(cid), sizeof(len));
+    pos += kDirentHeaderSize;
+    if (pos + len > hdr.payload_len) return MakeError(EIO);
+    std::string cname(reinterpret_cast<const char *>(payload + pos), len);
+    pos += len;
+
+    Status<std::shared_ptr<Inode>> child = LoadNode(cid, cname, dir);
+    if (!child) return MakeError(child);
+    LogNode &cn = *GetLogNode(**child);
+    rt::ScopedLock g(dir->lock_);
+    dir->AddEntryLocked(cname, std::move(*child), cn);
+  }
+  return ino;
+}
+
+Status<std::shared_ptr<IDir>> LogFS::Recover() {
+  std::unique_ptr<std::byte[]> buf(new std::byte[kBlockSize]);
+  Status<void> ret =
+      dev_->Read({buf.get(), kBlockSize}, kSuperblockAddr * kBlockSize);
+  if (!ret) return MakeError(ret);
+  Superblock sb;
+  std::memcpy(&sb, buf.get(), sizeof(sb));
+  if (sb.version != kVersion || sb.block_size != kBlockSize ||
+      sb.segment_blocks != kSegmentBlocks || sb.nr_segments > nr_segments_)
+    return MakeError(EINVAL);
+  nr_segments_ = sb.nr_segments;
+
+  // Use the newest valid checkpoint.
+  Checkpoint ckpt{};
+  bool found = false;
+  for (LogAddr addr : kCheckpointAddr) {
+    Checkpoint tmp;
+    ret = dev_->Read(std::as_writable_bytes(std::span{&tmp, 1}),
+                     addr * kBlockSize);
+    if (!ret) return MakeError(ret);
+    if (tmp.magic != LOGFS_MAGIC || tmp.checksum != ChecksumCheckpoint(tmp) ||
+        tmp.nr_meta > kMaxMetaBlocks)
+      continue;
+    if (found && tmp.seq < ckpt.seq) continue;
+    ckpt = tmp;
+    found = true;
+  }
+  if (!found) return MakeError(EIO);
+
+  segs_.assign(nr_segments_, Segment{});
+  ckpt_seq_ = ckpt.seq;
+  next_id_ = ckpt.next_id;
+
+  // Load the inode map.
+  size_t remaining = ckpt.nr_inodes;
+  for (size_t i = 0; i < ckpt.nr_meta; i++) {
+    LogAddr addr = ckpt.meta[i];
+    ret = ReadBlocksLocked(addr, 1, buf.get());
+    if (!ret) return MakeError(ret);
+    LiveLocked(addr);
+    meta_addrs_.push_back(addr);
+    auto *ents = reinterpret_cast<const MetaEntry *>(buf.get());
+    for (size_t j = 0; j < kMetaEntriesPerBlock && remaining; j++, remaining--)
+      imap_[ents[j].id] = ents[j].addr;
+  }
+
+  Status<std::shared_ptr<Inode>> root = LoadNode(kRootId, ".", nullptr);
+  if (!root) return MakeError(root);
+  if (!(*root)->is_dir()) return MakeError(EIO);
+
+  // Nothing has changed since the checkpoint. Inodes that can't be reached
+  // from the root (if any) are dropped from the next one.
+  dirty_.clear();
+  std::erase_if(imap_, [this](const auto &ent) {
+    return !FindNodeLocked(ent.first).second;
+  });
+
+  segs_[0].free = false;
+  nr_free_ = 0;
+  for (size_t seg = 1; seg < nr_segments_; seg++) {
+    segs_[seg].free = segs_[seg].live == 0;
+    if (segs_[seg].free) nr_free_++;
+  }
+  return std::static_pointer_cast<IDir>(std::move(*root));
+}
+
+Status<std::shared_ptr<IDir>> LogFS::Mount(std::unique_ptr<BlockDevice> dev) {
+  if (kBlockSize % dev->get_block_size() != 0) return MakeError(EINVAL);
+  auto fs = std::make_shared<LogFS>(std::move(dev));
+
+  Superblock sb;
+  std::unique_ptr<std::byte[]> buf(new std::byte[kBlockSize]);
+  Status<void> ret =
+      fs->dev_->Read({buf.get(), kBlockSize}, kSuperblockAddr * kBlockSize);
+  if (!ret) return MakeError(ret);
+  std::memcpy(&sb, buf.get(), sizeof(sb));
+
+  rt::ScopedLock g(fs->lock_);
+  if (sb.magic != LOGFS_MAGIC) return fs->Format();
+  return fs->Recover();
+}
+
+Status<std::shared_ptr<IDir>> MountLogFS(std::string_view device,
+                                         size_t size) {
+  std::unique_ptr<BlockDevice> dev;
+  if (device == "storage") {
+    Status<std::unique_ptr<StorageDevice>> ret = StorageDevice::Open();
+    if (!ret) return MakeError(ret);
+    dev = std::move(*ret);
+  } else {
+    Status<std::unique_ptr<FileDevice>> ret = FileDevice::Open(device, size);
+    if (!ret) return MakeError(ret);
+    dev = std::move(*ret);
+  }
+  return LogFS::Mount(std::move(dev));
+}
+
+}  // namespace junction::logfs
@@ -0,0 +1,361 @@
+// logfs.h - a log-structured filesystem stored on a block device
+//
+// All changes are appended to the log, which is divided into fixed-size
+// segments. The first block of each segment is a summary that records which
+// inode (and which part of it) each of the other blocks belongs to, so the
+// cleaner can tell whether a block is still live. Every inode is kept in
+// memory; its on-device copy (the inode record) is rewritten at each
+// checkpoint. A checkpoint appends the inode map (inode id -> record address)
+// to the log and then points one of two alternating checkpoint blocks at it.
+// Mounting reads the newest valid checkpoint, so changes made after the last
+// sync are lost after a crash.
+
+#pragma once
+
+#include <map>
+#include <set>
+#include <unordered_map>
+#include <vector>
+
+#include "junction/bindings/sync.h"
+#include "junction/fs/file.h"
+#include "junction/fs/fs.h"
+#include "junction/fs/logfs/blockdev.h"
+#include "junction/fs/memfs/memfs.h"
+
+namespace junction::logfs {
+
+inline constexpr __fsword_t LOGFS_MAGIC = 0x4c4f4746;  // "LOGF"
+// The unit of allocation in the log.
+inline constexpr size_t kBlockSize = 4096;
+// The number of blocks in each segment (including the summary block).
+inline constexpr size_t kSegmentBlocks = 256;
+inline constexpr size_t kSegmentSize = kBlockSize * kSegmentBlocks;
+// The number of block addresses in each chunk of a file's block map.
+inline constexpr size_t kMapChunkEntries = kBlockSize / sizeof(uint64_t);
+// The cleaner runs when fewer segments than this are free.
+inline constexpr size_t kCleanThreshold = 8;
+// Segments that only the cleaner and checkpoints may use.
+inline constexpr size_t kReservedSegments = 4;
+// The largest file that can be stored.
+inline constexpr size_t kMaxFileSize = (1UL << 40);  // 1 TB
+
+// The address of a block in the log (in units of kBlockSize). Zero is never a
+// valid address for file data, so it marks a hole.
+using LogAddr = uint64_t;
+
+class LogFS;
+
+// LogNode is the logfs state of an inode. All fields (except the constant
+// ones) are protected by the filesystem lock.
+struct LogNode {
+  LogNode(Inode &ino, LogFS &fs, uint64_t id) : ino(ino), fs(fs), id(id) {}
+
+  Inode &ino;
+  LogFS &fs;
+  const uint64_t id;  // persistent inode id
+  size_t size{0};
+  size_t nr_blocks{0};                // blocks holding data
+  LogAddr record{0};                  // the latest inode record
+  size_t record_blocks{0};            // the length of the record
+  std::vector<LogAddr> blocks;        // file block -> address (0 for holes)
+  std::vector<LogAddr> chunks;        // block map chunk -> address
+  std::set<size_t> dirty_chunks;      // chunks that must be rewritten
+  std::map<std::string, uint64_t, std::less<>> dirents;  // directories only
+  std::string target;                                    // soft links only
+  bool released{false};  // the last link was removed
+};
+
+// LogFS is an instance of the filesystem (one per device).
+class LogFS : public std::enable_shared_from_this<LogFS> {
+ public:
+  explicit LogFS(std::unique_ptr<BlockDevice> dev);
+  ~LogFS();
+
+  // disable copy and move.
+  LogFS(const LogFS &) = delete;
+  LogFS &operator=(const LogFS &) = delete;
+  LogFS(LogFS &&) = delete;
+  LogFS &operator=(LogFS &&) = delete;
+
+  // Mounts the filesystem stored on @dev (formatting it first if it doesn't
+  // hold one) and returns its root directory.
+  static Status<std::shared_ptr<IDir>> Mount(std::unique_ptr<BlockDevice> dev);
+
+  // File data.
+  Status<size_t> Read(LogNode &n, std::span<std::byte> buf, off_t off);
+  Status<size_t> Write(LogNode &n, std::span<const std::byte> buf, off_t off);
+  Status<void> SetSize(LogNode &n, size_t size);
+  [[nodiscard]] size_t GetSize(LogNode &n);
+  [[nodiscard]] size_t GetBlocks(LogNode &n);
+
+  // Writes a checkpoint, making all changes so far durable.
+  Status<void> Sync();
+  void StatFS(struct statfs *buf);
+
+  // Called when an unlinked inode is destroyed; the blocks are released at
+  // the next checkpoint or cleaning pass. Doesn't take the filesystem lock.
+  void DeferFree(uint64_t id, std::vector<LogAddr> &&blocks);
+
+ private:
+  friend class LogIDir;
+
+  // Segment usage.
+  struct Segment {
+    uint32_t live{0};  // blocks that are still referenced
+    bool free{true};   // can be reused for new writes
+  };
+
+  // Inodes released by DeferFree().
+  struct PendingFree {
+    uint64_t id;
+    std::vector<LogAddr> blocks;
+  };
+
+  // Namespace support (called by LogIDir with the lock held).
+  uint64_t AllocIdLocked() { return next_id_++; }
+  void AddNodeLocked(std::shared_ptr<Inode> ino, LogNode &n);
+  void MarkDirtyLocked(LogNode &n) { dirty_.insert(n.id); }
+  // Drops the on-device state of an inode whose last link was removed.
+  void ReleaseLocked(LogNode &n);
+  // Finds a live inode by id.
+  std::pair<std::shared_ptr<Inode>, LogNode *> FindNodeLocked(uint64_t id);
+
+  // Log management.
+  [[nodiscard]] LogAddr SegmentStart(size_t seg) const {
+    return seg * kSegmentBlocks;
+  }
+  // Is the block in the segment being filled (and thus in seg_buf_)?
+  [[nodiscard]] bool IsCurrentLocked(LogAddr addr) const {
+    return cur_seg_ != 0 && addr > SegmentStart(cur_seg_) &&
+           addr < SegmentStart(cur_seg_) + cur_blk_;
+  }
+  // Is the block in seg_buf_ and not yet written to the device?
+  [[nodiscard]] bool IsBufferedLocked(LogAddr addr) const {
+    return addr >= SegmentStart(cur_seg_) + flushed_blk_ &&
+           addr < SegmentStart(cur_seg_) + cur_blk_;
+  }
+  [[nodiscard]] std::byte *BufferedBlock(LogAddr addr) {
+    return seg_buf_.get() + (addr - SegmentStart(cur_seg_)) * kBlockSize;
+  }
+  // Reserves the next block in the log, recording @tag for the cleaner.
+  Status<LogAddr> AppendLocked(uint64_t id, uint64_t tag);
+  // Reserves @n contiguous blocks in the log.
+  Status<LogAddr> AppendRunLocked(uint64_t id, uint64_t tag, size_t n);
+  // Writes the buffered part of the current segment to the device.
+  Status<void> FlushLocked();
+  // Seals the current segment and starts a new one.
+  Status<void> NextSegmentLocked();
+  // Marks a block as no longer referenced.
+  void DeadLocked(LogAddr addr) {
+    if (addr) segs_[addr / kSegmentBlocks].live--;
+  }
+  void LiveLocked(LogAddr addr) { segs_[addr / kSegmentBlocks].live++; }
+  Status<void> ReadBlocksLocked(LogAddr addr, size_t n, std::byte *dst);
+  // Writes part of one file block (zeros if @src is nullptr).
+  Status<void> WriteBlockLocked(LogNode &n, size_t blk, size_t off,
+                                const std::byte *src, size_t len);
+  void DrainFreesLocked();
+
+  // Checkpoints and cleaning.
+  Status<void> WriteNodeLocked(LogNode &n);
+  Status<void> CheckpointLocked();
+  Status<void> CleanLocked();
+  Status<void> RelocateLocked(uint64_t id, uint64_t tag, LogAddr addr,
+                              const std::byte *data);
+
+  // Mounting. Both return the root directory.
+  Status<std::shared_ptr<IDir>> Format();
+  Status<std::shared_ptr<IDir>> Recover();
+  Status<std::shared_ptr<Inode>> LoadNode(uint64_t id, std::string name,
+                                          std::shared_ptr<IDir> parent);
+
+  const std::unique_ptr<BlockDevice> dev_;
+  size_t nr_segments_;
+
+  // Readers of file data hold this shared; everything else holds it
+  // exclusively. Directory locks must be acquired before this lock.
+  rt::SharedMutex lock_;
+
+  // The segment being filled.
+  std::unique_ptr<std::byte[]> seg_buf_;
+  size_t cur_seg_{0};
+  size_t cur_blk_{kSegmentBlocks};      // the next free block
+  size_t flushed_blk_{kSegmentBlocks};  // blocks before this are on disk
+
+  std::vector<Segment> segs_;
+  size_t nr_free_{0};
+  // True while cleaning or checkpointing (which may use reserved segments).
+  bool in_maintenance_{false};
+
+  uint64_t next_id_{0};
+  uint64_t ckpt_seq_{0};
+  std::vector<LogAddr> meta_addrs_;  // blocks of the latest checkpoint
+  std::unordered_map<uint64_t, LogAddr> imap_;
+  std::unordered_map<uint64_t, std::weak_ptr<Inode>> nodes_;
+  std::set<uint64_t> dirty_;
+
+  rt::Spin free_lock_;  // protects pending_free_
+  std::vector<PendingFree> pending_free_;
+};
+
+// Generate file attributes. Does not set st_size or st_blocks.
+inline void LogInodeToStats(const Inode &ino, struct stat *buf) {
+  InodeToStats(ino, buf);
+  buf->st_blksize = kBlockSize;
+  buf->st_dev = MakeDevice(259, 0);  // NVMe (blkext) device
+}
+
+// LogInode is a regular file.
+class LogInode : public Inode {
+ public:
+  LogInode(std::shared_ptr<LogFS> fs, uint64_t id, mode_t mode)
+      : Inode(kTypeRegularFile | mode, AllocateInodeNumber()),
+        fs_(std::move(fs)),
+        node_(*this, *fs_, id) {}
+  ~LogInode() override;
+
+  Status<std::shared_ptr<File>> Open(uint32_t flags, FileMode fmode) override;
+  Status<void> GetStats(struct stat *buf) const override;
+  Status<void> GetStatFS(struct statfs *buf) const override {
+    fs_->StatFS(buf);
+    return {};
+  }
+  Status<void> SetSize(size_t sz) override { return fs_->SetSize(node_, sz); }
+
+  Status<size_t> Read(std::span<std::byte> buf, off_t *off) {
+    Status<size_t> ret = fs_->Read(node_, buf, *off);
+    if (ret) *off += *ret;
+    return ret;
+  }
+  Status<size_t> Write(std::span<const std::byte> buf, off_t *off) {
+    Status<size_t> ret = fs_->Write(node_, buf, *off);
+    if (ret) *off += *ret;
+    return ret;
+  }
+  Status<void> Sync() { return fs_->Sync(); }
+  [[nodiscard]] size_t get_size() const { return fs_->GetSize(node_); }
+
+  [[nodiscard]] LogNode &node() { return node_; }
+
+ private:
+  const std::shared_ptr<LogFS> fs_;
+  mutable LogNode node_;
+};
+
+// LogSoftLink is a soft link.
+class LogSoftLink : public ISoftLink {
+ public:
+  LogSoftLink(std::shared_ptr<LogFS> fs, uint64_t id, std::string_view target)
+      : ISoftLink(0, AllocateInodeNumber()),
+        fs_(std::move(fs)),
+        node_(*this, *fs_, id) {
+    node_.target = target;
+  }
+
+  // The target never changes, so no lock is needed.
+  std::string ReadLink() override { return node_.target; }
+  Status<void> GetStats(struct stat *buf) const override {
+    LogInodeToStats(*this, buf);
+    buf->st_size = node_.target.size();
+    return {};
+  }
+  Status<void> GetStatFS(struct statfs *buf) const override {
+    fs_->StatFS(buf);
+    return {};
+  }
+
+  [[nodiscard]] LogNode &node() { return node_; }
+
+ private:
+  const std::shared_ptr<LogFS> fs_;
+  LogNode node_;
+};
+
+// LogIDir is a directory. The entries are served from memory (like memfs);
+// the copy in its LogNode is what gets persisted.
+class LogIDir : public memfs::MemIDir {
+ public:
+  LogIDir(std::shared_ptr<LogFS> fs, uint64_t id, mode_t mode, std::string name,
+          std::shared_ptr<IDir> parent)
+      : MemIDir(mode, std::move(name), IDirType::kLogFS, std::move(parent)),
+        fs_(std::move(fs)),
+        node_(*this, *fs_, id) {}
+
+  // Directory ops
+  Status<void> MkNod(std::string_view name, mode_t mode, dev_t dev) override;
+  Status<void> MkDir(std::string_view name, mode_t mode) override;
+  Status<void> Unlink(std::string_view name) override;
+  Status<void> RmDir(std::string_view name) override;
+  Status<void> SymLink(std::string_view name, std::string_view target) override;
+  Status<void> Rename(IDir &src, std::string_view src_name,
+                      std::string_view dst_name, bool replace) override;
+  Status<void> Link(std::string_view name, std::shared_ptr<Inode> ino) override;
+  Status<std::shared_ptr<File>> Create(std::string_view name, int flags,
+                                       mode_t mode, FileMode fmode) override;
+
+  // Inode ops
+  Status<void> GetStats(struct stat *buf) const override;
+  Status<void> GetStatFS(struct statfs *buf) const override {
+    fs_->StatFS(buf);
+    return {};
+  }
+
+  [[nodiscard]] LogNode &node() { return node_; }
+
+ private:
+  friend class LogFS;
+
+  // Adds an entry for a new or existing inode (both locks must be held).
+  void AddEntryLocked(std::string_view name, std::shared_ptr<Inode> ino,
+                      LogNode &n);
+  // Removes an entry, releasing the inode if it was the last link.
+  void RemoveEntryLocked(std::string_view name, Inode &ino);
+  // Helper routine for renaming.
+  Status<void> DoRename(LogIDir &src, std::string_view src_name,
+                        std::string_view dst_name, bool replace);
+
+  const std::shared_ptr<LogFS> fs_;
+  LogNode node_;
+};
+
+// Returns the logfs state of @ino (or nullptr if it isn't a logfs inode).
+LogNode *GetLogNode(Inode &ino);
+
+class LogFile : public SeekableFile {
+ public:
+  LogFile(unsigned int flags, FileMode mode, std::shared_ptr<LogInode> ino)
+      : SeekableFile(FileType::kNormal, flags, mode, std::move(ino)) {}
+
+  Status<size_t> Read(std::span<std::byte> buf, off_t *off) override {
+    return get_log_inode().Read(buf, off);
+  }
+  Status<size_t> Write(std::span<const std::byte> buf, off_t *off) override {
+    return get_log_inode().Write(buf, off);
+  }
+  Status<void> Truncate(off_t newlen) override {
+    if (newlen < 0) return MakeError(EINVAL);
+    return get_log_inode().SetSize(static_cast<size_t>(newlen));
+  }
+  Status<void> Sync() override { return get_log_inode().Sync(); }
+
+  [[nodiscard]] size_t get_size() const override {
+    return get_log_inode().get_size();
+  }
+  Status<void> Stat(struct stat *statbuf) const override {
+    return get_log_inode().GetStats(statbuf);
+  }
+  Status<void> StatFS(struct statfs *buf) const override {
+    return get_log_inode().GetStatFS(buf);
+  }
+
+ private:
+  [[nodiscard]] LogInode &get_log_inode() {
+    return static_cast<LogInode &>(get_inode_ref());
+  }
+  [[nodiscard]] const LogInode &get_log_inode() const {
+    return static_cast<const LogInode &>(get_inode_ref());
+  }
+};
+
+}  // namespace junction::logfs
@@ -0,0 +1,95 @@
+// Compares logfs with the host filesystem (through linuxfs).
+//
+// Must be run with a logfs mounted (see the --logfs_device option). The linuxfs
+// baseline uses the working directory, which the test runs from the build tree
+// (/tmp and other test paths may be mounted as memfs).
+
+extern "C" {
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+}
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+const size_t kSeqSize = 64 * 1024 * 1024;
+const size_t kSeqChunk = 1024 * 1024;
+const size_t kSyncSize = 4096;
+const int kSyncCount = 2000;
+
+class LogFSBench : public ::testing::TestWithParam<const char *> {};
+
+double Now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+std::string BenchPath(const char *dir) {
+  return std::string(dir) + "/logfs_bench." + std::to_string(getpid());
+}
+
+TEST_P(LogFSBench, Sequential) {
+  std::string path = BenchPath(GetParam());
+  int fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+  ASSERT_GE(fd, 0);
+  std::vector<char> buf(kSeqChunk, 'a');
+
+  double start = Now();
+  for (size_t off = 0; off < kSeqSize; off += kSeqChunk)
+    ASSERT_EQ(write(fd, buf.data(), buf.size()),
+              static_cast<ssize_t>(buf.size()));
+  ASSERT_EQ(fsync(fd), 0);
+  double write_tm = Now() - start;
+
+  start = Now();
+  for (size_t off = 0; off < kSeqSize; off += kSeqChunk)
+    ASSERT_EQ(pread(fd, buf.data(), buf.size(), off),
+              static_cast<ssize_t>(buf.size()));
+  double read_tm = Now() - start;
+
+  printf("%s: sequential write %.0fMB/s, read %.0fMB/s\n", GetParam(),
+         kSeqSize / (write_tm * 1024 * 1024),
+         kSeqSize / (read_tm * 1024 * 1024));
+  close(fd);
+  unlink(path.c_str());
+}
+
+TEST_P(LogFSBench, SyncLatency) {
+  std::string path = BenchPath(GetParam());
+  int fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+  ASSERT_GE(fd, 0);
+  std::vector<char> buf(kSyncSize, 'b');
+  std::vector<double> lat;
+  lat.reserve(kSyncCount);
+
+  for (int i = 0; i < kSyncCount; i++) {
+    double start = Now();
+    ASSERT_EQ(pwrite(fd, buf.data(), buf.size(), i * kSyncSize),
+              static_cast<ssize_t>(buf.size()));
+    ASSERT_EQ(fsync(fd), 0);
+    lat.push_back(Now() - start);
+  }
+
+  std::sort(lat.begin(), lat.end());
+  printf("%s: 4KB write+fsync p50 %.1fus p99 %.1fus\n", GetParam(),
+         lat[lat.size() / 2] * 1e6, lat[lat.size() * 99 / 100] * 1e6);
+  close(fd);
+  unlink(path.c_str());
+}
+
+const char *LinuxFSDir() {
+  static char buf[PATH_MAX];
+  if (!getcwd(buf, sizeof(buf))) return ".";
+  return buf;
+}
+
+INSTANTIATE_TEST_SUITE_P(Filesystems, LogFSBench,
+                         ::testing::Values("/logfs", LinuxFSDir()));
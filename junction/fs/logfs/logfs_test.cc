@@ -0,0 +1,193 @@
+extern "C" {
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/statfs.h>
+#include <unistd.h>
+}
+
+#include <gtest/gtest.h>
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+// Must be run with a logfs mounted (see the --logfs_device option).
+constexpr char kRoot[] = "/logfs";
+constexpr long kLogFSMagic = 0x4c4f4746;
+
+class LogFSTest : public ::testing::Test {};
+
+std::string Path(const std::string &name) {
+  return std::string(kRoot) + "/" + name;
+}
+
+std::vector<char> Pattern(size_t len, char seed) {
+  std::vector<char> buf(len);
+  for (size_t i = 0; i < len; i++) buf[i] = static_cast<char>(seed + i % 251);
+  return buf;
+}
+
+TEST_F(LogFSTest, StatFS) {
+  struct statfs buf;
+  ASSERT_EQ(statfs(kRoot, &buf), 0);
+  EXPECT_EQ(buf.f_type, kLogFSMagic);
+  EXPECT_EQ(buf.f_bsize, 4096);
+  EXPECT_GT(buf.f_bfree, 0);
+}
+
+TEST_F(LogFSTest, ReadWrite) {
+  std::string path = Path("rw");
+  int fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+  ASSERT_GE(fd, 0);
+
+  // Unaligned writes that straddle block boundaries.
+  std::vector<char> data = Pattern(3 * 4096 + 123, 'a');
+  ASSERT_EQ(pwrite(fd, data.data(), 1000, 0), 1000);
+  ASSERT_EQ(pwrite(fd, data.data() + 1000, data.size() - 1000, 1000),
+            static_cast<ssize_t>(data.size() - 1000));
+  ASSERT_EQ(fsync(fd), 0);
+
+  std::vector<char> out(data.size());
+  ASSERT_EQ(pread(fd, out.data(), out.size(), 0),
+            static_cast<ssize_t>(out.size()));
+  EXPECT_EQ(out, data);
+
+  // Overwrite part of the file after it has been synced.
+  std::vector<char> patch = Pattern(5000, 'x');
+  ASSERT_EQ(pwrite(fd, patch.data(), patch.size(), 2000),
+            static_cast<ssize_t>(patch.size()));
+  std::memcpy(data.data() + 2000, patch.data(), patch.size());
+  ASSERT_EQ(pread(fd, out.data(), out.size(), 0),
+            static_cast<ssize_t>(out.size()));
+  EXPECT_EQ(out, data);
+
+  struct stat st;
+  ASSERT_EQ(fstat(fd, &st), 0);
+  EXPECT_EQ(st.st_size, static_cast<off_t>(data.size()));
+  EXPECT_EQ(st.st_blocks, 4 * 8);
+
+  ASSERT_EQ(close(fd), 0);
+  ASSERT_EQ(unlink(path.c_str()), 0);
+}
+
+TEST_F(LogFSTest, HolesAndTruncate) {
+  std::string path = Path("holes");
+  int fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+  ASSERT_GE(fd, 0);
+
+  char c = 'z';
+  ASSERT_EQ(pwrite(fd, &c, 1, 1 << 20), 1);
+  struct stat st;
+  ASSERT_EQ(fstat(fd, &st), 0);
+  EXPECT_EQ(st.st_size, (1 << 20) + 1);
+  EXPECT_EQ(st.st_blocks, 8);
+
+  std::vector<char> out(4096, 'q');
+  ASSERT_EQ(pread(fd, out.data(), out.size(), 4096), 4096);
+  EXPECT_EQ(out, std::vector<char>(4096, 0));
+
+  // Shrinking must zero the tail of the last block.
+  std::vector<char> data = Pattern(8192, 'a');
+  ASSERT_EQ(pwrite(fd, data.data(), data.size(), 0), 8192);
+  ASSERT_EQ(ftruncate(fd, 100), 0);
+  ASSERT_EQ(ftruncate(fd, 8192), 0);
+  ASSERT_EQ(pread(fd, out.data(), out.size(), 0), 4096);
+  EXPECT_EQ(std::memcmp(out.data(), data.data(), 100), 0);
+  EXPECT_EQ(std::vector<char>(out.begin() + 100, out.end()),
+            std::vector<char>(4096 - 100, 0));
+
+  ASSERT_EQ(close(fd), 0);
+  ASSERT_EQ(unlink(path.c_str()), 0);
+}
+
+TEST_F(LogFSTest, Namespace) {
+  std::string dir = Path("dir");
+  ASSERT_EQ(mkdir(dir.c_str(), 0755), 0);
+  EXPECT_EQ(mkdir(dir.c_str(), 0755), -1);
+  EXPECT_EQ(errno, EEXIST);
+
+  std::string a = dir + "/a";
+  int fd = open(a.c_str(), O_WRONLY | O_CREAT, 0644);
+  ASSERT_GE(fd, 0);
+  ASSERT_EQ(write(fd, "hello", 5), 5);
+  ASSERT_EQ(close(fd), 0);
+
+  std::string b = dir + "/b";
+  ASSERT_EQ(link(a.c_str(), b.c_str()), 0);
+  struct stat st;
+  ASSERT_EQ(stat(b.c_str(), &st), 0);
+  EXPECT_EQ(st.st_nlink, 2);
+
+  std::string c = Path("c");
+  ASSERT_EQ(rename(b.c_str(), c.c_str()), 0);
+  ASSERT_EQ(symlink("dir/a", Path("l").c_str()), 0);
+  char buf[64] = {};
+  ASSERT_EQ(readlink(Path("l").c_str(), buf, sizeof(buf)), 5);
+  EXPECT_STREQ(buf, "dir/a");
+
+  fd = open(Path("l").c_str(), O_RDONLY);
+  ASSERT_GE(fd, 0);
+  ASSERT_EQ(read(fd, buf, sizeof(buf)), 5);
+  EXPECT_EQ(std::string(buf, 5), "hello");
+  ASSERT_EQ(fsync(fd), 0);
+  ASSERT_EQ(close(fd), 0);
+
+  EXPECT_EQ(rmdir(dir.c_str()), -1);
+  EXPECT_EQ(errno, ENOTEMPTY);
+  ASSERT_EQ(unlink(a.c_str()), 0);
+  ASSERT_EQ(rmdir(dir.c_str()), 0);
+  ASSERT_EQ(stat(c.c_str(), &st), 0);
+  EXPECT_EQ(st.st_nlink, 1);
+  ASSERT_EQ(unlink(c.c_str()), 0);
+  ASSERT_EQ(unlink(Path("l").c_str()), 0);
+}
+
+TEST_F(LogFSTest, UnlinkedOpenFile) {
+  std::string path = Path("tmpfile");
+  int fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+  ASSERT_GE(fd, 0);
+  std::vector<char> data = Pattern(64 * 1024, 'u');
+  ASSERT_EQ(write(fd, data.data(), data.size()),
+            static_cast<ssize_t>(data.size()));
+  ASSERT_EQ(unlink(path.c_str()), 0);
+  ASSERT_EQ(fsync(fd), 0);
+
+  std::vector<char> out(data.size());
+  ASSERT_EQ(pread(fd, out.data(), out.size(), 0),
+            static_cast<ssize_t>(out.size()));
+  EXPECT_EQ(out, data);
+  ASSERT_EQ(close(fd), 0);
+}
+
+TEST_F(LogFSTest, Cleaning) {
+  struct statfs sfs;
+  ASSERT_EQ(statfs(kRoot, &sfs), 0);
+  const size_t total = sfs.f_blocks * sfs.f_bsize;
+
+  // Rewrite a file many times so that the log wraps around the device more
+  // than once, forcing the cleaner to reclaim dead blocks.
+  const size_t file_size = total / 4;
+  constexpr size_t kChunk = 1 << 20;
+  std::string path = Path("big");
+  int fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+  ASSERT_GE(fd, 0);
+  for (int pass = 0; pass < 12; pass++) {
+    std::vector<char> data = Pattern(kChunk, 'a' + pass);
+    for (size_t off = 0; off < file_size; off += kChunk) {
+      ASSERT_EQ(pwrite(fd, data.data(), kChunk, off),
+                static_cast<ssize_t>(kChunk))
+          << "pass " << pass << " offset " << off;
+    }
+    if (pass % 4 == 0) ASSERT_EQ(fsync(fd), 0);
+  }
+
+  std::vector<char> expected = Pattern(kChunk, 'a' + 11);
+  std::vector<char> out(kChunk);
+  for (size_t off = 0; off < file_size; off += kChunk) {
+    ASSERT_EQ(pread(fd, out.data(), kChunk, off),
+              static_cast<ssize_t>(kChunk));
+    ASSERT_EQ(out, expected) << "offset " << off;
+  }
+  ASSERT_EQ(close(fd), 0);
+  ASSERT_EQ(unlink(path.c_str()), 0);
+}
@@ -1,7 +1,5 @@
 // dir.cc - directory support for memfs
 
-#include <map>
-
 #include "junction/base/compiler.h"
 #include "junction/base/finally.h"
 #include "junction/fs/memfs/memfs.h"
@@ -10,8 +8,7 @@ namespace junction::memfs {
 
 Status<std::shared_ptr<Inode>> MemIDir::Lookup(std::string_view name) {
   DoInitCheck();
-  rt::ScopedSharedLock g(lock_);
-  if (auto it = entries_.find(name); it != entries_.end()) return it->second;
+  if (std::shared_ptr<Inode> ino = entries_.Lookup(name)) return ino;
   return MakeError(ENOENT);
 }
 
@@ -31,20 +28,20 @@ Status<void> MemIDir::MkDir(std::string_view name, mode_t mode) {
 Status<void> MemIDir::Unlink(std::string_view name) {
   DoInitCheck();
   rt::ScopedLock g(lock_);
-  auto it = entries_.find(name);
-  if (it == entries_.end()) return MakeError(ENOENT);
-  if (it->second->is_dir()) return MakeError(EISDIR);
-  it->second->dec_nlink();
-  entries_.erase(it);
+  std::shared_ptr<Inode> ino = entries_.Lookup(name);
+  if (!ino) return MakeError(ENOENT);
+  if (ino->is_dir()) return MakeError(EISDIR);
+  ino->dec_nlink();
+  entries_.Remove(name);
   return {};
 }
 
 Status<void> MemIDir::RmDir(std::string_view name) {
   DoInitCheck();
   rt::ScopedLock g(lock_);
-  auto it = entries_.find(name);
-  if (it == entries_.end()) return MakeError(ENOENT);
-  auto *dir = most_derived_cast<MemIDir>(it->second.get());
+  std::shared_ptr<Inode> ino = entries_.Lookup(name);
+  if (!ino) return MakeError(ENOENT);
+  auto *dir = most_derived_cast<MemIDir>(ino.get());
   if (!dir) return MakeError(ENOTDIR);
 
   // Confirm the directory is empty
@@ -56,7 +53,7 @@ Status<void> MemIDir::RmDir(std::string_view name) {
   }
 
   // Remove it
-  entries_.erase(it);
+  entries_.Remove(name);
   return {};
 }
 
@@ -71,25 +68,20 @@ Status<void> MemIDir::DoRename(MemIDir &src, std::string_view src_name,
   assert(src.lock_.IsHeld());
 
   // find the source inode
-  auto src_it = src.entries_.find(src_name);
-  if (src_it == src.entries_.end()) return MakeError(ENOENT);
+  if (!src.entries_.contains(src_name)) return MakeError(ENOENT);
 
   // make sure the destination name doesn't exist already
-  if (!replace) {
-    auto dst_it = entries_.find(dst_name);
-    if (dst_it != entries_.end()) return MakeError(EEXIST);
-  }
+  if (!replace && entries_.contains(dst_name)) return MakeError(EEXIST);
 
   // perform the actual rename
-  std::shared_ptr<Inode> ino = std::move(src_it->second);
-  src.entries_.erase(src_it);
+  std::shared_ptr<Inode> ino = src.entries_.Remove(src_name);
 
   if (ino->is_dir()) {
     IDir &tdir = static_cast<IDir &>(*ino);
     tdir.SetParent(get_this(), std::string(dst_name));
   }
 
-  entries_[std::string(dst_name)] = std::move(ino);
+  entries_.Set(dst_name, std::move(ino));
   return {};
 }
 
@@ -133,26 +125,37 @@ Status<std::shared_ptr<File>> MemIDir::Create(std::string_view name, int flags,
                                               mode_t mode, FileMode fmode) {
   DoInitCheck();
   rt::ScopedLock g_(lock_);
-  auto it = entries_.find(name);
-  if (it == entries_.end()) {
+  std::shared_ptr<Inode> in = entries_.Lookup(name);
+  if (!in) {
     auto ino = std::make_shared<MemInode>(mode);
     InsertLockedNoCheck(name, ino);
     return ino->Open(flags, fmode);
   }
 
   if (flags & kFlagExclusive) return MakeError(EEXIST);
-  return it->second->Open(flags, fmode);
+  return in->Open(flags, fmode);
 }
 
 std::vector<dir_entry> MemIDir::GetDents() {
   DoInitCheck();
   std::vector<dir_entry> result;
   rt::ScopedSharedLock g(lock_);
-  for (const auto &[name, ino] : entries_)
-    result.emplace_back(name, ino->get_inum(), ino->get_type());
+  result.reserve(entries_.size());
+  entries_.ForEach([&result](std::string_view name, const auto &ino) {
+    result.emplace_back(std::string(name), ino->get_inum(), ino->get_type());
+  });
   return result;
 }
 
+void MemIDir::IterateDents(off_t cookie, const DirIterFn &func) {
+  DoInitCheck();
+  rt::ScopedSharedLock g(lock_);
+  entries_.IterateFrom(
+      cookie, [&func](std::string_view name, const auto &ino, off_t next) {
+        return func({name, ino->get_inum(), ino->get_type()}, next);
+      });
+}
+
 Status<void> MemIDir::GetStats(struct stat *buf) const {
   MemInodeToStats(*this, buf);
   return {};
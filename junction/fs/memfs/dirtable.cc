@@ -0,0 +1,126 @@
+// dirtable.cc - a hash table of directory entries with lock-free lookups
+
+#include "junction/fs/memfs/dirtable.h"
+
+#include <algorithm>
+#include <bit>
+
+namespace junction::memfs {
+
+DirTable::Entry::Entry(std::string_view name, uint64_t hash,
+                       std::shared_ptr<Inode> ino)
+    : hash(hash), ino(std::move(ino)), name_len(name.size()) {
+  char *buf = inline_name;
+  if (name_len > kInlineNameLen) buf = long_name = new char[name_len];
+  std::memcpy(buf, name.data(), name_len);
+}
+
+DirTable::Entry::~Entry() {
+  if (name_len > kInlineNameLen) delete[] long_name;
+}
+
+DirTable::~DirTable() {
+  // The directory is gone, so there can't be any readers left.
+  for (Entry *e : order_) delete e;
+  delete table_.get_locked();
+}
+
+std::shared_ptr<Inode> DirTable::Lookup(std::string_view name) const {
+  uint64_t hash = Hash(name);
+  rt::RCURead l;
+  rt::RCUReadGuard g(l);
+  const Table *t = table_.get();
+  if (!t) return {};
+  for (size_t i = hash & t->mask;; i = (i + 1) & t->mask) {
+    const Slot &s = t->slots[i];
+    Entry *e = s.entry.load(std::memory_order_acquire);
+    if (!e) return {};
+    if (e == kTombstone || s.hash.load(std::memory_order_relaxed) != hash)
+      continue;
+    if (e->get_name() == name) return e->ino;
+  }
+}
+
+DirTable::Slot *DirTable::FindSlot(std::string_view name, uint64_t hash) const {
+  Table *t = table_.get_locked();
+  if (!t) return nullptr;
+  for (size_t i = hash & t->mask;; i = (i + 1) & t->mask) {
+    Slot &s = t->slots[i];
+    Entry *e = s.entry.load(std::memory_order_relaxed);
+    if (!e) return nullptr;
+    if (e == kTombstone || s.hash.load(std::memory_order_relaxed) != hash)
+      continue;
+    if (e->get_name() == name) return &s;
+  }
+}
+
+bool DirTable::PlaceEntry(Table &t, Entry *e) {
+  for (size_t i = e->hash & t.mask;; i = (i + 1) & t.mask) {
+    Slot &s = t.slots[i];
+    Entry *cur = s.entry.load(std::memory_order_relaxed);
+    if (cur && cur != kTombstone) continue;
+    s.hash.store(e->hash, std::memory_order_relaxed);
+    s.entry.store(e, std::memory_order_release);
+    return cur == kTombstone;
+  }
+}
+
+void DirTable::ReserveOne() {
+  // Keep the table at most 3/4 full (counting tombstones) so probes stay
+  // short and always end at an empty slot.
+  Table *t = table_.get_locked();
+  size_t cap = t ? t->mask + 1 : 0;
+  if ((used_slots_ + 1) * 4 <= cap * 3) return;
+
+  // Rehash into a table sized for the live entries, which also drops the
+  // tombstones.
+  cap = std::max(kMinCapacity, std::bit_ceil((order_.size() + 1) * 2));
+  auto nt = std::make_unique<Table>(cap);
+  for (Entry *e : order_) PlaceEntry(*nt, e);
+  used_slots_ = order_.size();
+  table_.set(nt.release());
+  if (t) rt::RCUFree(t);
+}
+
+bool DirTable::Insert(std::string_view name, std::shared_ptr<Inode> ino) {
+  uint64_t hash = Hash(name);
+  if (FindSlot(name, hash)) return false;
+  ReserveOne();
+  auto *e = new Entry(name, hash, std::move(ino));
+  if (!PlaceEntry(*table_.get_locked(), e)) used_slots_++;
+  order_.insert(e);
+  return true;
+}
+
+std::shared_ptr<Inode> DirTable::Set(std::string_view name,
+                                     std::shared_ptr<Inode> ino) {
+  uint64_t hash = Hash(name);
+  Slot *s = FindSlot(name, hash);
+  if (!s) {
+    Insert(name, std::move(ino));
+    return {};
+  }
+
+  // Entries are immutable (for readers), so swap in a new one.
+  Entry *old = s->entry.load(std::memory_order_relaxed);
+  auto *e = new Entry(name, hash, std::move(ino));
+  s->entry.store(e, std::memory_order_release);
+  order_.erase(old);
+  order_.insert(e);
+  std::shared_ptr<Inode> ret = old->ino;
+  rt::RCUFree(old);
+  return ret;
+}
+
+std::shared_ptr<Inode> DirTable::Remove(std::string_view name) {
+  Slot *s = FindSlot(name, Hash(name));
+  if (!s) return {};
+  Entry *old = s->entry.load(std::memory_order_relaxed);
+  s->entry.store(kTombstone, std::memory_order_release);
+  order_.erase(old);
+  std::shared_ptr<Inode> ret = old->ino;
+  rt::RCUFree(old);
+  return ret;
+}
+
+}  // namespace junction::memfs
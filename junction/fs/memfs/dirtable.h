@@ -0,0 +1,145 @@
+// dirtable.h - a hash table of directory entries with lock-free lookups
+
+#pragma once
+
+#include <atomic>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <set>
+#include <string_view>
+
+#include "junction/bindings/rcu.h"
+#include "junction/fs/fs.h"
+
+namespace junction::memfs {
+
+// The cookie returned after the last entry of a directory.
+inline constexpr off_t kDirEndCookie = std::numeric_limits<off_t>::max();
+
+// DirTable maps names to inodes for an in-memory directory.
+//
+// Entries live in an open-addressing hash table. Lookup() reads it under RCU,
+// so it never takes the directory lock. All other methods must be called with
+// the directory lock held (exclusively if they modify the table). A second
+// index orders entries by cookie for getdents(). An entry's cookie comes from
+// the hash of its name, so cookies stay valid as other entries come and go.
+class DirTable {
+ public:
+  DirTable() noexcept = default;
+  ~DirTable();
+
+  // disable copy and move.
+  DirTable(const DirTable &) = delete;
+  DirTable &operator=(const DirTable &) = delete;
+  DirTable(DirTable &&) = delete;
+  DirTable &operator=(DirTable &&) = delete;
+
+  // Finds an entry (or returns nullptr). Safe to call without the lock.
+  [[nodiscard]] std::shared_ptr<Inode> Lookup(std::string_view name) const;
+
+  [[nodiscard]] bool contains(std::string_view name) const {
+    return FindSlot(name, Hash(name)) != nullptr;
+  }
+  [[nodiscard]] bool empty() const { return order_.empty(); }
+  [[nodiscard]] size_t size() const { return order_.size(); }
+
+  // Adds an entry. Returns false if the name is already taken.
+  bool Insert(std::string_view name, std::shared_ptr<Inode> ino);
+  // Adds or replaces an entry. Returns the replaced inode (if any).
+  std::shared_ptr<Inode> Set(std::string_view name, std::shared_ptr<Inode> ino);
+  // Removes an entry. Returns its inode (or nullptr if there was none).
+  std::shared_ptr<Inode> Remove(std::string_view name);
+
+  // Calls @func(name, ino) for each entry.
+  template <typename F>
+  void ForEach(F func) const {
+    for (const Entry *e : order_) func(e->get_name(), e->ino);
+  }
+
+  // Calls @func(name, ino, next_cookie) for each entry in cookie order,
+  // starting at @cookie (0 is the first entry), until @func returns false.
+  template <typename F>
+  void IterateFrom(off_t cookie, F func) const {
+    for (auto it = order_.lower_bound(cookie); it != order_.end();) {
+      const Entry *e = *it;
+      ++it;
+      off_t next = it != order_.end() ? (*it)->get_cookie() : kDirEndCookie;
+      if (!func(e->get_name(), e->ino, next)) break;
+    }
+  }
+
+ private:
+  // Names up to this length are stored inside the entry.
+  static constexpr size_t kInlineNameLen = 40;
+  static constexpr size_t kMinCapacity = 16;
+
+  struct Entry : public rt::RCUObject {
+    Entry(std::string_view name, uint64_t hash, std::shared_ptr<Inode> ino);
+    ~Entry();
+
+    [[nodiscard]] std::string_view get_name() const {
+      return {name_len > kInlineNameLen ? long_name : inline_name, name_len};
+    }
+    [[nodiscard]] off_t get_cookie() const {
+      return static_cast<off_t>(hash >> 2) + 1;
+    }
+
+    const uint64_t hash;
+    const std::shared_ptr<Inode> ino;
+    const size_t name_len;
+    union {
+      char inline_name[kInlineNameLen];
+      char *long_name;
+    };
+  };
+
+  // Orders entries by cookie, then by name (in case the cookies collide).
+  struct CookieOrder {
+    using is_transparent = void;
+    bool operator()(const Entry *a, const Entry *b) const {
+      if (a->get_cookie() != b->get_cookie())
+        return a->get_cookie() < b->get_cookie();
+      return a->get_name() < b->get_name();
+    }
+    bool operator()(const Entry *a, off_t cookie) const {
+      return a->get_cookie() < cookie;
+    }
+    bool operator()(off_t cookie, const Entry *b) const {
+      return cookie < b->get_cookie();
+    }
+  };
+
+  struct Slot {
+    // Cached so that most mismatches don't have to touch the entry.
+    std::atomic<uint64_t> hash{0};
+    // nullptr if the slot was never used, or kTombstone if it was emptied.
+    std::atomic<Entry *> entry{nullptr};
+  };
+
+  struct Table : public rt::RCUObject {
+    explicit Table(size_t cap)
+        : mask(cap - 1), slots(std::make_unique<Slot[]>(cap)) {}
+    const size_t mask;
+    std::unique_ptr<Slot[]> slots;
+  };
+
+  static inline Entry *const kTombstone = reinterpret_cast<Entry *>(1);
+
+  static uint64_t Hash(std::string_view name) {
+    return std::hash<std::string_view>{}(name);
+  }
+
+  // Finds the slot holding @name (writer side).
+  [[nodiscard]] Slot *FindSlot(std::string_view name, uint64_t hash) const;
+  // Places an entry in the first free slot of its probe sequence.
+  static bool PlaceEntry(Table &t, Entry *e);
+  // Makes room for one more entry, rehashing into a new table if needed.
+  void ReserveOne();
+
+  rt::RCUPtr<Table> table_{nullptr};
+  size_t used_slots_{0};  // live entries plus tombstones
+  std::set<Entry *, CookieOrder> order_;
+};
+
+}  // namespace junction::memfs
@@ -2,12 +2,27 @@
 
 #include "junction/fs/memfs/memfs.h"
 
+extern "C" {
+#include <linux/falloc.h>
+#include <sys/mman.h>
+}
+
+#include <bit>
+#include <cstring>
+
+#include "junction/base/bits.h"
 #include "junction/fs/memfs/memfsfile.h"
 
 namespace junction::memfs {
 
 namespace {
 
+// The most iovecs passed to the destination in one SpliceTo() call.
+constexpr size_t kMaxSpliceIovecs = 64;
+
+// Holes are sent from this page rather than from the backing memfd.
+alignas(kPageSize) const std::byte kZeroPage[kPageSize]{};
+
 // MemIDevice is an inode type for character and block devices
 class MemIDevice : public Inode {
  public:
@@ -33,17 +48,365 @@ class MemIDevice : public Inode {
 
 }  // namespace
 
+Status<void> MemInode::CreateBackingLocked() {
+  assert(lock_.IsHeld());
+  if (memfd_.GetFd() >= 0) return {};
+  Status<KernelFile> f =
+      KernelFile::MemFDCreate("memfs", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+  if (!f) return MakeError(f);
+  memfd_ = std::move(*f);
+  return {};
+}
+
+Status<void> MemInode::GrowMappingLocked(size_t len) {
+  assert(lock_.IsHeld());
+
+  // Reserve an oversized region, then trim it so the start is aligned.
+  Status<void *> tmp =
+      KernelMMap(nullptr, len + kChunkSize, PROT_NONE, MAP_NORESERVE);
+  if (!tmp) return MakeError(tmp);
+  uintptr_t raw = reinterpret_cast<uintptr_t>(*tmp);
+  uintptr_t addr = AlignUp(raw, kChunkSize);
+  if (addr != raw) KernelMUnmap(*tmp, addr - raw);
+  KernelMUnmap(reinterpret_cast<void *>(addr + len), raw + kChunkSize - addr);
+
+  // Move the old mapping unless a splice is still reading from it. New
+  // references are only taken under a shared lock, so the count can't grow.
+  const bool in_place = map_ && map_.use_count() == 1;
+  intptr_t ret;
+  if (in_place) {
+    ret = ksys_mremap(map_->addr, map_->len, len, MREMAP_MAYMOVE | MREMAP_FIXED,
+                      reinterpret_cast<void *>(addr));
+  } else {
+    ret = ksys_mmap(reinterpret_cast<void *>(addr), len, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_FIXED, memfd_.GetFd(), 0);
+  }
+  if (ret < 0) {
+    KernelMUnmap(reinterpret_cast<void *>(addr), len);
+    return MakeError(-ret);
+  }
+
+  // Best effort; fails harmlessly if transparent huge pages are disabled.
+  KernelMAdvise(reinterpret_cast<void *>(addr), len, MADV_HUGEPAGE);
+  if (in_place) {
+    map_->addr = reinterpret_cast<std::byte *>(addr);
+    map_->len = len;
+  } else {
+    map_ = std::make_shared<Mapping>(reinterpret_cast<std::byte *>(addr), len);
+  }
+  return {};
+}
+
+Status<void> MemInode::ResizeLocked(size_t newlen) {
+  assert(lock_.IsHeld());
+  if (unlikely(newlen > kMaxSizeBytes)) return MakeError(EFBIG);
+
+  // Empty files don't need a backing memfd.
+  if (newlen == 0 && memfd_.GetFd() < 0) return {};
+  if (Status<void> ret = CreateBackingLocked(); !ret) return ret;
+  if (newlen < size_) WaitForSplicesLocked();
+  if (Status<void> ret = memfd_.Truncate(newlen); !ret) return ret;
+
+  // Truncation already released the memory past the new end.
+  if (newlen < size_) RemoveExtentsLocked(AlignUp(newlen, kChunkSize), size_);
+
+  // Grow the mapping geometrically to amortize the cost of remapping.
+  if (!map_ || newlen > map_->len) {
+    size_t len = std::bit_ceil(AlignUp(newlen, kChunkSize));
+    if (Status<void> ret = GrowMappingLocked(len); !ret) return ret;
+  }
+
+  size_ = newlen;
+  return {};
+}
+
+bool MemInode::IsAllocatedLocked(size_t start, size_t end) const {
+  auto it = extents_.upper_bound(start);
+  if (it == extents_.begin()) return false;
+  --it;
+  return it->second >= end;
+}
+
+void MemInode::AddExtentLocked(size_t start, size_t end) {
+  assert(lock_.IsHeld());
+  start = AlignDown(start, kChunkSize);
+  end = AlignUp(end, kChunkSize);
+
+  // Merge with any overlapping or adjacent extents.
+  auto it = extents_.upper_bound(start);
+  if (it != extents_.begin() && std::prev(it)->second >= start) --it;
+  while (it != extents_.end() && it->first <= end) {
+    start = std::min(start, it->first);
+    end = std::max(end, it->second);
+    it = extents_.erase(it);
+  }
+  extents_.emplace(start, end);
+}
+
+void MemInode::RemoveExtentsLocked(size_t start, size_t end) {
+  assert(lock_.IsHeld());
+  start = AlignUp(start, kChunkSize);
+  // Nothing lives past the end of the file, so a range reaching it also
+  // covers the partial chunk at EOF.
+  end = end >= size_ ? AlignUp(size_, kChunkSize) : AlignDown(end, kChunkSize);
+  if (start >= end) return;
+
+  auto it = extents_.upper_bound(start);
+  if (it != extents_.begin() && std::prev(it)->second > start) --it;
+  while (it != extents_.end() && it->first < end) {
+    auto [ext_start, ext_end] = *it;
+    it = extents_.erase(it);
+    if (ext_start < start) extents_.emplace(ext_start, start);
+    if (ext_end > end) it = extents_.emplace(end, ext_end).first;
+  }
+}
+
+Status<void> MemInode::PunchHoleLocked(size_t start, size_t end) {
+  assert(lock_.IsHeld());
+  end = std::min(end, size_);
+  if (start >= end) return {};
+  WaitForSplicesLocked();
+  Status<void> ret = memfd_.Allocate(FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+                                     start, end - start);
+  if (!ret) return ret;
+  RemoveExtentsLocked(start, end);
+  return {};
+}
+
+Status<size_t> MemInode::Read(std::span<std::byte> buf, off_t *off) {
+  rt::ScopedSharedLock g_(lock_);
+  size_t pos = *off;
+  if (pos >= size_) return 0;
+  const size_t n = std::min(buf.size(), size_ - pos);
+  const size_t end = pos + n;
+  std::byte *dst = buf.data();
+
+  // Copy each extent and zero-fill the holes between them (without touching,
+  // and thus allocating, the memfd pages behind the holes).
+  auto it = extents_.upper_bound(pos);
+  if (it != extents_.begin() && std::prev(it)->second > pos) --it;
+  while (pos < end) {
+    size_t data_start = it != extents_.end() ? std::min(it->first, end) : end;
+    if (pos < data_start) {
+      std::memset(dst, 0, data_start - pos);
+      dst += data_start - pos;
+      pos = data_start;
+      continue;
+    }
+    size_t data_end = std::min(it->second, end);
+    std::memcpy(dst, map_->addr + pos, data_end - pos);
+    dst += data_end - pos;
+    pos = data_end;
+    ++it;
+  }
+
+  *off = end;
+  return n;
+}
+
+Status<size_t> MemInode::Write(std::span<const std::byte> buf, off_t *off) {
+  if (unlikely(buf.empty())) return 0;
+  const size_t start = *off;
+  const size_t end = start + buf.size();
+  if (unlikely(end > kMaxSizeBytes)) return MakeError(EFBIG);
+
+  rt::ScopedSharedLock g_(lock_);
+  if (unlikely(seals_ & kWriteSeals)) return MakeError(EPERM);
+  if (unlikely(size_ < end && (seals_ & F_SEAL_GROW))) return MakeError(EPERM);
+  if (size_ < end || !IsAllocatedLocked(start, end)) {
+    lock_.UpgradeLock();
+    Status<void> ret;
+    if (size_ < end) ret = ResizeLocked(end);
+    if (ret) AddExtentLocked(start, end);
+    lock_.DowngradeLock();
+    if (unlikely(!ret)) return MakeError(ret);
+  }
+  std::memcpy(map_->addr + start, buf.data(), buf.size());
+  *off = end;
+  return buf.size();
+}
+
+void MemInode::WaitForSplicesLocked() {
+  assert(lock_.IsHeld());
+  rt::SpinGuard g(splice_lock_);
+  rt::Wait(splice_lock_, splice_waiters_, [this] { return splicing_ == 0; });
+}
+
+Status<size_t> MemInode::SpliceTo(File &out, off_t *off, off_t *out_off,
+                                  size_t len) {
+  iovec iov[kMaxSpliceIovecs];
+  size_t cnt = 0;
+  std::shared_ptr<Mapping> map;
+  {
+    rt::ScopedSharedLock g_(lock_);
+    size_t pos = *off;
+    if (pos >= size_) return 0;
+    const size_t end = pos + std::min(len, size_ - pos);
+
+    // Point the iovecs at the mapping for extents and at the zero page for
+    // holes.
+    auto it = extents_.upper_bound(pos);
+    if (it != extents_.begin() && std::prev(it)->second > pos) --it;
+    while (pos < end && cnt < kMaxSpliceIovecs) {
+      size_t data_start = it != extents_.end() ? std::min(it->first, end) : end;
+      if (pos < data_start) {
+        size_t n = std::min(data_start - pos, kPageSize);
+        iov[cnt++] = {const_cast<std::byte *>(kZeroPage), n};
+        pos += n;
+        continue;
+      }
+      size_t data_end = std::min(it->second, end);
+      iov[cnt++] = {map_->addr + pos, data_end - pos};
+      pos = data_end;
+      ++it;
+    }
+
+    // Keep the mapping and its pages alive once the lock is dropped.
+    map = map_;
+    rt::SpinGuard g(splice_lock_);
+    splicing_++;
+  }
+
+  // Write out without the lock, so a slow destination doesn't stall writers.
+  Status<size_t> ret = out.Writev({iov, cnt}, out_off);
+  {
+    rt::SpinGuard g(splice_lock_);
+    if (--splicing_ == 0) splice_waiters_.WakeAll();
+  }
+  if (!ret) return ret;
+  *off += static_cast<off_t>(*ret);
+  return ret;
+}
+
+Status<void> MemInode::Allocate(int mode, off_t off, off_t len) {
+  constexpr int kSupported =
+      FALLOC_FL_KEEP_SIZE | FALLOC_FL_PUNCH_HOLE | FALLOC_FL_ZERO_RANGE;
+  if (mode & ~kSupported) return MakeError(EOPNOTSUPP);
+  if (off < 0 || len <= 0) return MakeError(EINVAL);
+  // Hole punching must keep the size and can't be combined with zeroing.
+  if ((mode & FALLOC_FL_PUNCH_HOLE) &&
+      mode != (FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE))
+    return MakeError(EINVAL);
+  const size_t start = off;
+  const size_t end = start + len;
+  if (end > kMaxSizeBytes) return MakeError(EFBIG);
+
+  rt::ScopedLock g_(lock_);
+  if ((mode & (FALLOC_FL_PUNCH_HOLE | FALLOC_FL_ZERO_RANGE)) &&
+      (seals_ & kWriteSeals))
+    return MakeError(EPERM);
+  if (!(mode & FALLOC_FL_KEEP_SIZE) && end > size_ && (seals_ & F_SEAL_GROW))
+    return MakeError(EPERM);
+
+  // Punching a hole releases the memory and never changes the size.
+  if (mode & FALLOC_FL_PUNCH_HOLE) return PunchHoleLocked(start, end);
+
+  // Extend the file unless asked not to. Space past the end of the file is
+  // never preallocated.
+  if (!(mode & FALLOC_FL_KEEP_SIZE) && end > size_) {
+    if (Status<void> ret = ResizeLocked(end); !ret) return ret;
+  }
+  const size_t alloc_end = std::min(end, size_);
+  if (start >= alloc_end) return {};
+
+  if (mode & FALLOC_FL_ZERO_RANGE) {
+    // Freed memory reads as zeros; keep the range marked as allocated.
+    if (Status<void> ret = PunchHoleLocked(start, alloc_end); !ret) return ret;
+  } else {
+    Status<void> ret = memfd_.Allocate(0, start, alloc_end - start);
+    if (!ret) return ret;
+  }
+  AddExtentLocked(start, alloc_end);
+  return {};
+}
+
+Status<off_t> MemInode::SeekHoleOrData(off_t off, bool data) {
+  rt::ScopedSharedLock g_(lock_);
+  if (off < 0 || static_cast<size_t>(off) >= size_) return MakeError(ENXIO);
+  const size_t pos = off;
+
+  // Find the first extent that ends after pos.
+  auto it = extents_.upper_bound(pos);
+  if (it != extents_.begin() && std::prev(it)->second > pos) --it;
+  bool in_extent = it != extents_.end() && it->first <= pos;
+
+  if (data) {
+    if (in_extent) return off;
+    if (it == extents_.end() || it->first >= size_) return MakeError(ENXIO);
+    return static_cast<off_t>(it->first);
+  }
+
+  // There is always an implicit hole at the end of the file.
+  if (!in_extent) return off;
+  return static_cast<off_t>(std::min(it->second, size_));
+}
+
 Status<void> MemInode::SetSize(size_t newlen) {
   if (unlikely(newlen > kMaxSizeBytes)) return MakeError(EINVAL);
   rt::ScopedLock g_(lock_);
-  buf_.Resize(newlen);
+  if ((newlen < size_ && (seals_ & F_SEAL_SHRINK)) ||
+      (newlen > size_ && (seals_ & F_SEAL_GROW)))
+    return MakeError(EPERM);
+  return ResizeLocked(newlen);
+}
+
+Status<void *> MemInode::MMap(void *addr, size_t length, int prot, int flags,
+                              off_t off) {
+  assert(!(flags & MAP_ANONYMOUS));
+  rt::ScopedLock g_(lock_);
+  if ((flags & MAP_SHARED) && (prot & PROT_WRITE) && (seals_ & kWriteSeals))
+    return MakeError(EPERM);
+  if (Status<void> ret = CreateBackingLocked(); !ret) return MakeError(ret);
+  intptr_t ret = ksys_mmap(addr, length, prot, flags, memfd_.GetFd(), off);
+  if (ret < 0) return MakeError(-ret);
+
+  // Stores through a shared mapping bypass Write(), so conservatively treat
+  // the mapped part of the file as data.
+  if ((flags & MAP_SHARED) && (prot & PROT_WRITE)) {
+    size_t end = std::min(static_cast<size_t>(off) + length, size_);
+    if (static_cast<size_t>(off) < end) AddExtentLocked(off, end);
+  }
+  return reinterpret_cast<void *>(ret);
+}
+
+Status<void> MemInode::AddSeals(unsigned int seals) {
+  constexpr unsigned int kSupported =
+      F_SEAL_SEAL | F_SEAL_SHRINK | F_SEAL_GROW | kWriteSeals;
+  if (seals & ~kSupported) return MakeError(EINVAL);
+
+  rt::ScopedLock g_(lock_);
+  if (seals_ & F_SEAL_SEAL) return MakeError(EPERM);
+
+  // Let the host memfd enforce write seals on mappings, so that shared
+  // read-only mappings can never be made writable with mprotect(). Our own
+  // writable mapping must exist before then; later growth only remaps it.
+  //
+  // Unlike Linux, adding F_SEAL_WRITE does not fail with EBUSY if writable
+  // shared mappings still exist, since they aren't tracked per inode.
+  if ((seals & kWriteSeals) && !(seals_ & kWriteSeals)) {
+    if (Status<void> ret = CreateBackingLocked(); !ret) return ret;
+    if (!map_) {
+      if (Status<void> ret = GrowMappingLocked(kChunkSize); !ret) return ret;
+    }
+    Status<void> ret = memfd_.AddSeals(F_SEAL_FUTURE_WRITE);
+    if (!ret) return ret;
+  }
+  seals_ |= seals;
   return {};
 }
 
 Status<void> MemInode::GetStats(struct stat *buf) const {
   MemInodeToStats(*this, buf);
-  buf->st_size = buf_.size();
+  rt::ScopedSharedLock g_(lock_);
+  buf->st_size = size_;
+  // Extents are tracked per chunk, so ask the host how many pages of the
+  // memfd are actually backed.
   buf->st_blocks = 0;
+  if (memfd_.GetFd() >= 0) {
+    Status<struct stat> st = memfd_.StatAt();
+    if (!st) return MakeError(st);
+    buf->st_blocks = st->st_blocks;
+  }
   return {};
 }
 
@@ -51,6 +414,15 @@ Status<std::shared_ptr<File>> MemInode::Open(uint32_t flags, FileMode mode) {
   return std::make_shared<MemFSFile>(flags, mode, shared_from_base<MemInode>());
 }
 
+Status<std::shared_ptr<File>> CreateMemFD(std::string_view name,
+                                          bool allow_sealing) {
+  auto ino = std::make_shared<MemInode>(S_IRWXU | S_IRWXG | S_IRWXO,
+                                        allow_sealing ? 0 : F_SEAL_SEAL);
+  std::string filename = "/memfd:" + std::string(name) + " (deleted)";
+  return std::make_shared<MemFSFile>(0, FileMode::kReadWrite,
+                                     std::move(filename), std::move(ino));
+}
+
 std::shared_ptr<ISoftLink> CreateISoftLink(std::string_view path) {
   return std::make_shared<MemISoftLink>(path);
 }
@@ -2,16 +2,22 @@
 
 #pragma once
 
-#include "junction/base/slab_list.h"
+#include <map>
+
 #include "junction/fs/dev.h"
 #include "junction/fs/file.h"
 #include "junction/fs/fs.h"
+#include "junction/fs/memfs/dirtable.h"
+#include "junction/kernel/ksys.h"
 
 namespace junction::memfs {
 
 inline constexpr __fsword_t TMPFS_MAGIC = 0x01021994;
-inline constexpr size_t kBlockSize = 4096;
-inline constexpr size_t kMaxSizeBytes = (1UL << 33);  // 8 GB
+inline constexpr size_t kMaxSizeBytes = (1UL << 40);  // 1 TB
+// The granularity at which file data is tracked (one huge page).
+inline constexpr size_t kChunkSize = kLargePageSize;
+// Seals that forbid modifying the file contents.
+inline constexpr unsigned int kWriteSeals = F_SEAL_WRITE | F_SEAL_FUTURE_WRITE;
 
 inline void StatFs(struct statfs *buf) {
   buf->f_type = TMPFS_MAGIC;
@@ -31,32 +37,40 @@ std::shared_ptr<ISoftLink> CreateISoftLink(std::string_view path);
 // Create a character or block device inode.
 std::shared_ptr<Inode> CreateIDevice(dev_t dev, mode_t mode);
 
+// MemInode is a regular file stored in memory.
+//
+// The contents live in a host memfd, which is mapped (huge page aligned) for
+// Read() and Write() and can be mapped directly by applications. The parts of
+// the file that hold data are tracked as extents of whole chunks; everything
+// else is a hole that reads as zeros without consuming memory.
+//
+// Only files made by memfd_create() can be sealed; all others start out with
+// F_SEAL_SEAL, as on Linux.
 class MemInode : public Inode {
  public:
-  MemInode(mode_t mode)
-      : Inode(kTypeRegularFile | mode, AllocateInodeNumber()) {}
+  MemInode(mode_t mode, unsigned int seals = F_SEAL_SEAL)
+      : Inode(kTypeRegularFile | mode, AllocateInodeNumber()), seals_(seals) {}
+
   Status<void> SetSize(size_t newlen) override;
   Status<void> GetStats(struct stat *buf) const override;
 
-  Status<size_t> Read(std::span<std::byte> buf, off_t *off) {
-    rt::ScopedSharedLock g_(lock_);
-    const size_t n = std::min(buf.size(), buf_.size() - *off);
-    std::copy_n(buf_.cbegin() + *off, n, buf.begin());
-    *off += n;
-    return n;
-  }
+  // Reads from the file, filling holes with zeros.
+  Status<size_t> Read(std::span<std::byte> buf, off_t *off);
+  // Writes to the file, allocating chunks and extending it as needed.
+  Status<size_t> Write(std::span<const std::byte> buf, off_t *off);
+  // Preallocates, punches, or zeroes a range of the file (see fallocate(2)).
+  Status<void> Allocate(int mode, off_t off, off_t len);
+  // Finds the next data (or hole) offset at or after @off (see lseek(2)).
+  Status<off_t> SeekHoleOrData(off_t off, bool data);
+  // Writes the file contents to @out straight from the backing pages.
+  Status<size_t> SpliceTo(File &out, off_t *off, off_t *out_off, size_t len);
 
-  Status<size_t> Write(std::span<const std::byte> buf, off_t *off) {
-    rt::ScopedSharedLock g_(lock_);
-    if (buf_.size() - *off < buf.size()) {
-      lock_.UpgradeLock();
-      if (buf_.size() - *off < buf.size()) buf_.Resize(buf.size() + *off);
-      lock_.DowngradeLock();
-    }
-    std::copy_n(buf.begin(), buf.size(), buf_.begin() + *off);
-    *off += buf.size();
-    return buf.size();
-  }
+  // Maps the contents of this inode. Shared mappings are coherent with Read()
+  // and Write() since they use the same physical pages.
+  Status<void *> MMap(void *addr, size_t length, int prot, int flags,
+                      off_t off);
+  // Adds seals that restrict further changes to the file.
+  Status<void> AddSeals(unsigned int seals);
 
   // Open a file for this inode.
   Status<std::shared_ptr<File>> Open(uint32_t flags, FileMode mode) override;
@@ -66,14 +80,62 @@ class MemInode : public Inode {
     return {};
   }
 
-  [[nodiscard]] size_t get_size() const { return buf_.size(); }
+  [[nodiscard]] size_t get_size() const { return size_; }
+  [[nodiscard]] unsigned int get_seals() const { return seals_; }
 
  private:
-  // Protects modifications to buf_. A reader lock holder can read/write to buf_
-  // but a writer lock must be used to resize buf_.
-  rt::SharedMutex lock_;
-  // File contents.
-  SlabList<kBlockSize> buf_;
+  // A shared mapping of the memfd.
+  struct Mapping {
+    Mapping(std::byte *addr, size_t len) : addr(addr), len(len) {}
+    ~Mapping() { KernelMUnmap(addr, len); }
+    Mapping(const Mapping &) = delete;
+    Mapping &operator=(const Mapping &) = delete;
+
+    std::byte *addr;
+    size_t len;
+  };
+
+  // Creates the memfd that backs this inode (if it doesn't exist yet).
+  Status<void> CreateBackingLocked();
+  // Changes the size of the file, growing the mapping if needed.
+  Status<void> ResizeLocked(size_t newlen);
+  // Replaces the mapping with a larger one, aligned to a huge page.
+  Status<void> GrowMappingLocked(size_t len);
+  // Returns true if [@start, @end) is inside one extent.
+  [[nodiscard]] bool IsAllocatedLocked(size_t start, size_t end) const;
+  // Marks the chunks overlapping [@start, @end) as holding data.
+  void AddExtentLocked(size_t start, size_t end);
+  // Marks the chunks inside [@start, @end) as holes. A range that reaches
+  // the end of the file includes the last, partial chunk.
+  void RemoveExtentsLocked(size_t start, size_t end);
+  // Frees the memory in [@start, @end) so that it reads as zeros.
+  Status<void> PunchHoleLocked(size_t start, size_t end);
+  // Waits for splices that are still reading from a mapping.
+  void WaitForSplicesLocked();
+
+  // Protects the fields below. A reader lock holder can read/write the file
+  // contents inside allocated extents, but a writer lock must be used to
+  // resize the file or change the extents.
+  mutable rt::SharedMutex lock_;
+  // Host memfd holding the file contents (created on first use).
+  KernelFile memfd_;
+  // The mapping of memfd_ used for Read() and Write(). SpliceTo() holds a
+  // reference while it writes out without lock_, so growing the file
+  // replaces the mapping instead of moving it.
+  std::shared_ptr<Mapping> map_;
+  // The size of the file.
+  size_t size_{0};
+  // Chunk-aligned ranges that hold data, as a map of start -> end. Adjacent
+  // ranges are always merged.
+  std::map<size_t, size_t> extents_;
+  // F_SEAL_* flags.
+  unsigned int seals_;
+
+  // Counts splices still reading from a mapping after dropping lock_. Memory
+  // can't be released under them, since touching a truncated page faults.
+  rt::Spin splice_lock_;
+  rt::WaitQueue splice_waiters_;
+  int splicing_{0};
 };
 
 class MemIDir : public IDir {
@@ -98,6 +160,7 @@ class MemIDir : public IDir {
   Status<std::shared_ptr<File>> Create(std::string_view name, int flags,
                                        mode_t mode, FileMode fmode) override;
   std::vector<dir_entry> GetDents() override;
+  void IterateDents(off_t cookie, const DirIterFn &func) override;
 
   // Inode ops
   Status<void> GetStats(struct stat *buf) const override;
@@ -117,6 +180,15 @@ class MemIDir : public IDir {
   }
 
  protected:
+  // Constructors for subclasses that provide a different directory type.
+  MemIDir(mode_t mode, std::string name, IDirType type,
+          std::shared_ptr<IDir> parent)
+      : IDir(mode, AllocateInodeNumber(), std::move(name), type,
+             std::move(parent)) {}
+  MemIDir(const struct stat &stat, std::string name, IDirType type,
+          std::shared_ptr<IDir> parent)
+      : IDir(stat, std::move(name), type, std::move(parent)) {}
+
   // Subclasses override this to add custom logic run on the first access of
   // this directory.
   virtual void DoInitialize(){};
@@ -129,20 +201,20 @@ class MemIDir : public IDir {
   __always_inline void DoInitCheck() {
     if (unlikely(!is_initialized())) RunInitialize();
   }
-  std::map<std::string, std::shared_ptr<Inode>, std::less<>> entries_;
+  // Lookups are lock-free; everything else requires lock_.
+  DirTable entries_;
 
   void InsertLockedNoCheck(std::string_view name, std::shared_ptr<Inode> ino) {
     assert(lock_.IsHeld());
     ino->inc_nlink();
-    entries_[std::string(name)] = std::move(ino);
+    entries_.Set(name, std::move(ino));
   }
 
   [[nodiscard]] Status<void> InsertLocked(std::string name,
                                           std::shared_ptr<Inode> ino) {
     assert(lock_.IsHeld());
-    auto [it, okay] = entries_.try_emplace(std::move(name), std::move(ino));
-    if (!okay) return MakeError(EEXIST);
-    it->second->inc_nlink();
+    if (!entries_.Insert(name, ino)) return MakeError(EEXIST);
+    ino->inc_nlink();
     return {};
   }
 
@@ -1,9 +1,15 @@
 extern "C" {
+#include <dirent.h>
 #include <fcntl.h>
+#include <linux/falloc.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 }
 
 #include <gtest/gtest.h>
 
+#include <cstring>
 #include <memory>
 #include <string>
 #include <vector>
@@ -54,3 +60,216 @@ TEST_F(MemFSTest, OpenCreateReadWriteTest) {
   ret = close(fd);
   EXPECT_EQ(ret, 0);
 }
+
+TEST_F(MemFSTest, MMapTest) {
+  int fd = open("/memfs/mmap.txt", O_RDWR | O_CREAT, S_IRWXU);
+  ASSERT_GE(fd, 0);
+  ASSERT_EQ(ftruncate(fd, 2 * 4096), 0);
+
+  char *shared = static_cast<char *>(
+      mmap(nullptr, 2 * 4096, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0));
+  ASSERT_NE(shared, MAP_FAILED);
+  char *priv = static_cast<char *>(
+      mmap(nullptr, 2 * 4096, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0));
+  ASSERT_NE(priv, MAP_FAILED);
+
+  // Writes through the shared mapping are visible to read().
+  const char txt[] = "hello, mmap!";
+  memcpy(shared + 4096, txt, sizeof(txt));
+  char content[sizeof(txt)];
+  EXPECT_EQ(pread(fd, content, sizeof(content), 4096), sizeof(txt));
+  EXPECT_EQ(memcmp(content, txt, sizeof(txt)), 0);
+
+  // Writes through write() are visible to the shared mapping.
+  EXPECT_EQ(pwrite(fd, txt, sizeof(txt), 0), sizeof(txt));
+  EXPECT_EQ(memcmp(shared, txt, sizeof(txt)), 0);
+
+  // Writes to a private mapping don't change the file.
+  priv[0] = 'X';
+  EXPECT_EQ(pread(fd, content, 1, 0), 1);
+  EXPECT_EQ(content[0], 'h');
+  EXPECT_EQ(shared[0], 'h');
+
+  EXPECT_EQ(munmap(shared, 2 * 4096), 0);
+  EXPECT_EQ(munmap(priv, 2 * 4096), 0);
+  EXPECT_EQ(close(fd), 0);
+}
+
+TEST_F(MemFSTest, SparseTest) {
+  constexpr off_t kChunk = 2 * 1024 * 1024;
+  int fd = open("/memfs/sparse.txt", O_RDWR | O_CREAT, S_IRWXU);
+  ASSERT_GE(fd, 0);
+
+  // Writing far past the end leaves a hole in front of the data.
+  const char txt[] = "sparse";
+  EXPECT_EQ(pwrite(fd, txt, sizeof(txt), 4 * kChunk), sizeof(txt));
+  struct stat buf;
+  ASSERT_EQ(fstat(fd, &buf), 0);
+  EXPECT_EQ(buf.st_size, 4 * kChunk + sizeof(txt));
+  EXPECT_GT(buf.st_blocks, 0);
+  EXPECT_LE(buf.st_blocks, kChunk / 512);
+  EXPECT_EQ(lseek(fd, 0, SEEK_DATA), 4 * kChunk);
+  EXPECT_EQ(lseek(fd, 0, SEEK_HOLE), 0);
+  EXPECT_EQ(lseek(fd, 4 * kChunk, SEEK_HOLE), buf.st_size);
+
+  // Holes read as zeros.
+  char content[sizeof(txt)] = {1};
+  EXPECT_EQ(pread(fd, content, sizeof(content), kChunk), sizeof(txt));
+  for (char c : content) EXPECT_EQ(c, 0);
+
+  // Punching a hole frees the data but keeps the size.
+  EXPECT_EQ(fallocate(fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+                      4 * kChunk, kChunk),
+            0);
+  ASSERT_EQ(fstat(fd, &buf), 0);
+  EXPECT_EQ(buf.st_size, 4 * kChunk + sizeof(txt));
+  EXPECT_EQ(buf.st_blocks, 0);
+  EXPECT_EQ(lseek(fd, 0, SEEK_DATA), -1);
+  EXPECT_EQ(errno, ENXIO);
+  EXPECT_EQ(pread(fd, content, sizeof(content), 4 * kChunk), sizeof(txt));
+  for (char c : content) EXPECT_EQ(c, 0);
+
+  // Truncating frees everything past the new end, including the partial
+  // chunk at the old end.
+  EXPECT_EQ(pwrite(fd, txt, sizeof(txt), 4 * kChunk), sizeof(txt));
+  ASSERT_EQ(fstat(fd, &buf), 0);
+  EXPECT_GT(buf.st_blocks, 0);
+  EXPECT_EQ(ftruncate(fd, 0), 0);
+  EXPECT_EQ(ftruncate(fd, 4 * kChunk + sizeof(txt)), 0);
+  ASSERT_EQ(fstat(fd, &buf), 0);
+  EXPECT_EQ(buf.st_blocks, 0);
+  EXPECT_EQ(lseek(fd, 0, SEEK_DATA), -1);
+  EXPECT_EQ(errno, ENXIO);
+
+  EXPECT_EQ(close(fd), 0);
+}
+
+TEST_F(MemFSTest, SpliceTest) {
+  int fd = open("/memfs/splice.txt", O_RDWR | O_CREAT, S_IRWXU);
+  ASSERT_GE(fd, 0);
+  const char txt[] = "moved without a bounce buffer";
+  ASSERT_EQ(write(fd, txt, sizeof(txt)), sizeof(txt));
+
+  // File to pipe, then pipe to file.
+  int pipefd[2];
+  ASSERT_EQ(pipe(pipefd), 0);
+  loff_t off = 0;
+  EXPECT_EQ(splice(fd, &off, pipefd[1], nullptr, sizeof(txt), 0),
+            sizeof(txt));
+  EXPECT_EQ(off, sizeof(txt));
+  off = sizeof(txt);
+  EXPECT_EQ(splice(pipefd[0], nullptr, fd, &off, sizeof(txt), 0),
+            sizeof(txt));
+
+  // File to file.
+  int fd2 = open("/memfs/splice2.txt", O_RDWR | O_CREAT, S_IRWXU);
+  ASSERT_GE(fd2, 0);
+  loff_t in_off = sizeof(txt);
+  EXPECT_EQ(copy_file_range(fd, &in_off, fd2, nullptr, sizeof(txt), 0),
+            sizeof(txt));
+
+  char content[sizeof(txt)];
+  EXPECT_EQ(pread(fd2, content, sizeof(content), 0), sizeof(txt));
+  EXPECT_EQ(memcmp(content, txt, sizeof(txt)), 0);
+
+  EXPECT_EQ(close(pipefd[0]), 0);
+  EXPECT_EQ(close(pipefd[1]), 0);
+  EXPECT_EQ(close(fd2), 0);
+  EXPECT_EQ(close(fd), 0);
+}
+
+TEST_F(MemFSTest, GetDentsTest) {
+  constexpr int kNumFiles = 1000;
+  ASSERT_EQ(mkdir("/memfs/dents", S_IRWXU), 0);
+  for (int i = 0; i < kNumFiles; i++) {
+    std::string path = "/memfs/dents/" + std::to_string(i);
+    int fd = open(path.c_str(), O_RDWR | O_CREAT, S_IRWXU);
+    ASSERT_GE(fd, 0);
+    EXPECT_EQ(close(fd), 0);
+  }
+
+  // Read the directory in small chunks while removing entries that were
+  // already returned; every remaining entry must still be seen exactly once.
+  DIR *d = opendir("/memfs/dents");
+  ASSERT_NE(d, nullptr);
+  std::vector<bool> seen(kNumFiles);
+  int count = 0;
+  while (struct dirent *ent = readdir(d)) {
+    int i = std::stoi(ent->d_name);
+    EXPECT_FALSE(seen[i]);
+    seen[i] = true;
+    count++;
+    std::string path = "/memfs/dents/" + std::string(ent->d_name);
+    EXPECT_EQ(unlink(path.c_str()), 0);
+  }
+  EXPECT_EQ(count, kNumFiles);
+  EXPECT_EQ(closedir(d), 0);
+  EXPECT_EQ(rmdir("/memfs/dents"), 0);
+}
+
+TEST_F(MemFSTest, MemFDSealTest) {
+  int fd = memfd_create("seal", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+  ASSERT_GE(fd, 0);
+  ASSERT_EQ(ftruncate(fd, 4096), 0);
+  EXPECT_EQ(fcntl(fd, F_GET_SEALS), 0);
+
+  char *shared = static_cast<char *>(
+      mmap(nullptr, 4096, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0));
+  ASSERT_NE(shared, MAP_FAILED);
+  const char txt[] = "hello, memfd!";
+  memcpy(shared, txt, sizeof(txt));
+  EXPECT_EQ(munmap(shared, 4096), 0);
+
+  // Size seals.
+  ASSERT_EQ(fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW), 0);
+  EXPECT_EQ(ftruncate(fd, 8192), -1);
+  EXPECT_EQ(errno, EPERM);
+  EXPECT_EQ(ftruncate(fd, 0), -1);
+  EXPECT_EQ(errno, EPERM);
+  EXPECT_EQ(pwrite(fd, txt, sizeof(txt), 4096), -1);
+  EXPECT_EQ(errno, EPERM);
+  EXPECT_EQ(ftruncate(fd, 4096), 0);
+
+  // Write seals.
+  ASSERT_EQ(fcntl(fd, F_ADD_SEALS, F_SEAL_WRITE), 0);
+  EXPECT_EQ(pwrite(fd, txt, sizeof(txt), 0), -1);
+  EXPECT_EQ(errno, EPERM);
+  EXPECT_EQ(mmap(nullptr, 4096, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0),
+            MAP_FAILED);
+  EXPECT_EQ(errno, EPERM);
+  char *ro = static_cast<char *>(
+      mmap(nullptr, 4096, PROT_READ, MAP_SHARED, fd, 0));
+  ASSERT_NE(ro, MAP_FAILED);
+  EXPECT_EQ(memcmp(ro, txt, sizeof(txt)), 0);
+  EXPECT_EQ(mprotect(ro, 4096, PROT_READ | PROT_WRITE), -1);
+  EXPECT_EQ(munmap(ro, 4096), 0);
+
+  // Private mappings can still be written.
+  char *priv = static_cast<char *>(
+      mmap(nullptr, 4096, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0));
+  ASSERT_NE(priv, MAP_FAILED);
+  priv[0] = 'X';
+  EXPECT_EQ(munmap(priv, 4096), 0);
+
+  ASSERT_EQ(fcntl(fd, F_ADD_SEALS, F_SEAL_SEAL), 0);
+  EXPECT_EQ(fcntl(fd, F_ADD_SEALS, F_SEAL_FUTURE_WRITE), -1);
+  EXPECT_EQ(errno, EPERM);
+  EXPECT_EQ(fcntl(fd, F_GET_SEALS),
+            F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL);
+
+  char content[sizeof(txt)];
+  EXPECT_EQ(pread(fd, content, sizeof(content), 0), sizeof(txt));
+  EXPECT_EQ(memcmp(content, txt, sizeof(txt)), 0);
+  EXPECT_EQ(close(fd), 0);
+
+  // Without MFD_ALLOW_SEALING the file is sealed from the start.
+  fd = memfd_create("noseal", 0);
+  ASSERT_GE(fd, 0);
+  EXPECT_EQ(fcntl(fd, F_GET_SEALS), F_SEAL_SEAL);
+  EXPECT_EQ(fcntl(fd, F_ADD_SEALS, F_SEAL_WRITE), -1);
+  EXPECT_EQ(errno, EPERM);
+  EXPECT_EQ(close(fd), 0);
+
+  EXPECT_EQ(memfd_create("bad", ~0U), -1);
+  EXPECT_EQ(errno, EINVAL);
+}
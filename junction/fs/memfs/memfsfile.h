@@ -10,12 +10,35 @@ class MemFSFile : public SeekableFile {
  public:
   MemFSFile(unsigned int flags, FileMode mode, std::shared_ptr<MemInode> ino)
       : SeekableFile(FileType::kNormal, flags, mode, std::move(ino)) {}
+  MemFSFile(unsigned int flags, FileMode mode, std::string &&filename,
+            std::shared_ptr<MemInode> ino)
+      : SeekableFile(FileType::kNormal, flags, mode, std::move(filename),
+                     std::move(ino)) {}
 
   Status<void> Truncate(off_t newlen) override {
     MemInode &ino = static_cast<MemInode &>(get_inode_ref());
     return ino.SetSize(static_cast<size_t>(newlen));
   }
 
+  Status<void> Allocate(int mode, off_t off, off_t len) override {
+    MemInode &ino = static_cast<MemInode &>(get_inode_ref());
+    return ino.Allocate(mode, off, len);
+  }
+
+  Status<off_t> SeekHoleOrData(off_t off, bool data) override {
+    MemInode &ino = static_cast<MemInode &>(get_inode_ref());
+    return ino.SeekHoleOrData(off, data);
+  }
+
+  Status<size_t> SpliceTo(File &out, off_t *off, off_t *out_off, size_t len,
+                          [[maybe_unused]] bool nonblocking) override {
+    // Sockets take the pages directly. Pipes fill themselves through their
+    // own SpliceFrom(), which honours SPLICE_F_NONBLOCK.
+    if (out.get_type() != FileType::kSocket) return MakeError(EOPNOTSUPP);
+    MemInode &ino = static_cast<MemInode &>(get_inode_ref());
+    return ino.SpliceTo(out, off, out_off, len);
+  }
+
   Status<size_t> Read(std::span<std::byte> buf, off_t *off) override {
     MemInode &ino = static_cast<MemInode &>(get_inode_ref());
     return ino.Read(buf, off);
@@ -26,6 +49,26 @@ class MemFSFile : public SeekableFile {
     return ino.Write(buf, off);
   }
 
+  Status<void *> MMap(void *addr, size_t length, int prot, int flags,
+                      off_t off) override {
+    // Shared writeable mappings need write access to the file.
+    if ((flags & MAP_SHARED) && (prot & PROT_WRITE) && !is_writeable())
+      return MakeError(EACCES);
+    MemInode &ino = static_cast<MemInode &>(get_inode_ref());
+    return ino.MMap(addr, length, prot, flags, off);
+  }
+
+  Status<void> AddSeals(unsigned int seals) override {
+    if (!is_writeable()) return MakeError(EPERM);
+    MemInode &ino = static_cast<MemInode &>(get_inode_ref());
+    return ino.AddSeals(seals);
+  }
+
+  Status<unsigned int> GetSeals() const override {
+    const MemInode &ino = static_cast<const MemInode &>(get_inode_ref());
+    return ino.get_seals();
+  }
+
   [[nodiscard]] size_t get_size() const override {
     const MemInode &ino = static_cast<const MemInode &>(get_inode_ref());
     return ino.get_size();
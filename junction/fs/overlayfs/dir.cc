@@ -0,0 +1,259 @@
+// dir.cc - directory support for overlayfs
+
+#include "junction/base/compiler.h"
+#include "junction/base/finally.h"
+#include "junction/fs/overlayfs/overlayfs.h"
+
+namespace junction::overlayfs {
+
+Status<std::shared_ptr<Inode>> OverlayIDir::FindLocked(std::string_view name) {
+  assert(lock_.IsHeld());
+  if (std::shared_ptr<Inode> ino = entries_.Lookup(name)) return ino;
+  if (!lower_ || whiteouts_.contains(name)) return MakeError(ENOENT);
+
+  Status<std::shared_ptr<Inode>> in = lower_->Lookup(name);
+  if (!in) return MakeError(in);
+
+  // Wrap the lower inode so that modifications stay in the upper layer.
+  std::shared_ptr<Inode> ino;
+  if ((*in)->is_dir()) {
+    struct stat buf;
+    if (Status<void> ret = (*in)->GetStats(&buf); !ret) return MakeError(ret);
+    ino = std::make_shared<OverlayIDir>(
+        buf, std::string(name), get_this(),
+        std::static_pointer_cast<IDir>(std::move(*in)));
+  } else if ((*in)->is_regular()) {
+    ino = std::make_shared<OverlayInode>(std::move(*in));
+  } else {
+    // Other types (e.g., soft links) are immutable and can be shared.
+    ino = std::move(*in);
+  }
+  InsertLockedNoCheck(name, ino);
+  return ino;
+}
+
+void OverlayIDir::WhiteoutLocked(std::string_view name) {
+  assert(lock_.IsHeld());
+  copied_up_.store(true, std::memory_order_release);
+  if (lower_ && lower_->Lookup(name)) whiteouts_.emplace(name);
+}
+
+void OverlayIDir::ClearWhiteoutLocked(std::string_view name) {
+  assert(lock_.IsHeld());
+  copied_up_.store(true, std::memory_order_release);
+  if (auto it = whiteouts_.find(name); it != whiteouts_.end())
+    whiteouts_.erase(it);
+}
+
+bool OverlayIDir::IsEmptyLocked() {
+  assert(lock_.IsHeld());
+  if (!entries_.empty()) return false;
+  if (!lower_) return true;
+  for (const dir_entry &ent : lower_->GetDents())
+    if (!whiteouts_.contains(ent.name)) return false;
+  return true;
+}
+
+Status<std::shared_ptr<Inode>> OverlayIDir::Lookup(std::string_view name) {
+  if (std::shared_ptr<Inode> ino = entries_.Lookup(name)) return ino;
+  {
+    rt::ScopedSharedLock g(lock_);
+    if (!lower_ || whiteouts_.contains(name)) return MakeError(ENOENT);
+  }
+
+  // Slow path: the entry has to be pulled up from the lower layer.
+  rt::ScopedLock g(lock_);
+  return FindLocked(name);
+}
+
+Status<void> OverlayIDir::MkNod(std::string_view name, mode_t mode, dev_t dev) {
+  if ((mode & (kTypeCharacter | kTypeBlock)) == 0) return MakeError(EINVAL);
+  rt::ScopedLock g(lock_);
+  if (FindLocked(name)) return MakeError(EEXIST);
+  InsertLockedNoCheck(name, memfs::CreateIDevice(dev, mode));
+  ClearWhiteoutLocked(name);
+  return {};
+}
+
+Status<void> OverlayIDir::MkDir(std::string_view name, mode_t mode) {
+  rt::ScopedLock g(lock_);
+  if (FindLocked(name)) return MakeError(EEXIST);
+  // The new directory has no lower layer, so it is opaque (any lower directory
+  // with the same name that was removed earlier stays hidden).
+  auto ino = std::make_shared<OverlayIDir>(mode, std::string(name), get_this());
+  InsertLockedNoCheck(name, std::move(ino));
+  ClearWhiteoutLocked(name);
+  return {};
+}
+
+Status<void> OverlayIDir::Unlink(std::string_view name) {
+  rt::ScopedLock g(lock_);
+  Status<std::shared_ptr<Inode>> in = FindLocked(name);
+  if (!in) return MakeError(in);
+  if ((*in)->is_dir()) return MakeError(EISDIR);
+  (*in)->dec_nlink();
+  entries_.Remove(name);
+  WhiteoutLocked(name);
+  return {};
+}
+
+Status<void> OverlayIDir::RmDir(std::string_view name) {
+  rt::ScopedLock g(lock_);
+  Status<std::shared_ptr<Inode>> in = FindLocked(name);
+  if (!in) return MakeError(in);
+  auto *dir = most_derived_cast<OverlayIDir>(in->get());
+  if (!dir) return MakeError(ENOTDIR);
+
+  // Confirm the (merged) directory is empty
+  {
+    rt::ScopedLock g(dir->lock_);
+    if (!dir->IsEmptyLocked()) return MakeError(ENOTEMPTY);
+    dir->dec_nlink();
+    assert(dir->is_stale());
+  }
+
+  // Remove it
+  entries_.Remove(name);
+  WhiteoutLocked(name);
+  return {};
+}
+
+Status<void> OverlayIDir::SymLink(std::string_view name,
+                                  std::string_view target) {
+  rt::ScopedLock g(lock_);
+  if (FindLocked(name)) return MakeError(EEXIST);
+  InsertLockedNoCheck(name, memfs::CreateISoftLink(target));
+  ClearWhiteoutLocked(name);
+  return {};
+}
+
+Status<void> OverlayIDir::DoRename(OverlayIDir &src, std::string_view src_name,
+                                   std::string_view dst_name, bool replace) {
+  assert(lock_.IsHeld());
+  assert(src.lock_.IsHeld());
+
+  // find the source inode
+  Status<std::shared_ptr<Inode>> in = src.FindLocked(src_name);
+  if (!in) return MakeError(in);
+
+  // Like Linux's overlayfs (without redirect_dir), directories that merge a
+  // lower layer can't be moved; callers are expected to fall back to copying.
+  auto *src_dir = most_derived_cast<OverlayIDir>(in->get());
+  if (src_dir && src_dir->lower_) return MakeError(EXDEV);
+
+  // check the destination name
+  if (Status<std::shared_ptr<Inode>> dst = FindLocked(dst_name); dst) {
+    if (!replace) return MakeError(EEXIST);
+    if (dst->get() == in->get()) return {};
+    if ((*dst)->is_dir()) {
+      if (!(*in)->is_dir()) return MakeError(EISDIR);
+      auto *dst_dir = most_derived_cast<OverlayIDir>(dst->get());
+      if (!dst_dir) return MakeError(EBUSY);
+      rt::ScopedLock g(dst_dir->lock_);
+      if (!dst_dir->IsEmptyLocked()) return MakeError(ENOTEMPTY);
+    } else if ((*in)->is_dir()) {
+      return MakeError(ENOTDIR);
+    }
+    (*dst)->dec_nlink();
+    entries_.Remove(dst_name);
+  }
+
+  // perform the actual rename
+  std::shared_ptr<Inode> ino = src.entries_.Remove(src_name);
+  src.WhiteoutLocked(src_name);
+
+  if (ino->is_dir()) {
+    IDir &tdir = static_cast<IDir &>(*ino);
+    tdir.SetParent(get_this(), std::string(dst_name));
+  }
+
+  entries_.Set(dst_name, std::move(ino));
+  ClearWhiteoutLocked(dst_name);
+  return {};
+}
+
+Status<void> OverlayIDir::Rename(IDir &src, std::string_view src_name,
+                                 std::string_view dst_name, bool replace) {
+  if (src.get_idir_type() != IDirType::kOverlay) return MakeError(EXDEV);
+  OverlayIDir *src_dir = static_cast<OverlayIDir *>(&src);
+
+  // check if rename is in same directory
+  if (src_dir == this) {
+    rt::ScopedLock g(lock_);
+    return DoRename(*src_dir, src_name, dst_name, replace);
+  }
+
+  // otherwise rename is across different directories (to avoid deadlock)
+  auto fin = finally([this, &src_dir] {
+    src_dir->lock_.Unlock();
+    lock_.Unlock();
+  });
+  if (src_dir->get_inum() > this->get_inum()) {
+    src_dir->lock_.Lock();
+    lock_.Lock();
+  } else {
+    lock_.Lock();
+    src_dir->lock_.Lock();
+  }
+  return DoRename(*src_dir, src_name, dst_name, replace);
+}
+
+Status<void> OverlayIDir::Link(std::string_view name,
+                               std::shared_ptr<Inode> ino) {
+  rt::ScopedLock g(lock_);
+  if (is_stale()) return MakeError(ESTALE);
+  if (FindLocked(name)) return MakeError(EEXIST);
+  InsertLockedNoCheck(name, std::move(ino));
+  ClearWhiteoutLocked(name);
+  return {};
+}
+
+Status<std::shared_ptr<File>> OverlayIDir::Create(std::string_view name,
+                                                  int flags, mode_t mode,
+                                                  FileMode fmode) {
+  rt::ScopedLock g(lock_);
+  Status<std::shared_ptr<Inode>> in = FindLocked(name);
+  if (!in) {
+    auto ino = std::make_shared<memfs::MemInode>(mode);
+    InsertLockedNoCheck(name, ino);
+    ClearWhiteoutLocked(name);
+    return ino->Open(flags, fmode);
+  }
+
+  if (flags & kFlagExclusive) return MakeError(EEXIST);
+  if ((flags & kFlagTruncate) && (*in)->is_regular()) {
+    if (Status<void> ret = (*in)->SetSize(0); !ret) return MakeError(ret);
+  }
+  return (*in)->Open(flags, fmode);
+}
+
+std::vector<dir_entry> OverlayIDir::GetDents() {
+  std::vector<dir_entry> result;
+  rt::ScopedSharedLock g(lock_);
+  entries_.ForEach([&result](std::string_view name, const auto &ino) {
+    result.emplace_back(std::string(name), ino->get_inum(), ino->get_type());
+  });
+  if (!lower_) return result;
+
+  // Merge in lower entries that are neither shadowed nor whited out.
+  for (dir_entry &ent : lower_->GetDents()) {
+    if (entries_.contains(ent.name) || whiteouts_.contains(ent.name)) continue;
+    result.emplace_back(std::move(ent));
+  }
+  return result;
+}
+
+Status<void> OverlayIDir::GetStats(struct stat *buf) const {
+  if (lower_ && !copied_up_.load(std::memory_order_acquire))
+    return lower_->GetStats(buf);
+  memfs::MemInodeToStats(*this, buf);
+  return {};
+}
+
+Status<void> OverlayIDir::GetStatFS(struct statfs *buf) const {
+  if (lower_) return lower_->GetStatFS(buf);
+  memfs::StatFs(buf);
+  return {};
+}
+
+}  // namespace junction::overlayfs
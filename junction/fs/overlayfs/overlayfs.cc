@@ -0,0 +1,75 @@
+// overlayfs.cc - copy-up support for overlayfs
+
+#include "junction/fs/overlayfs/overlayfs.h"
+
+#include <vector>
+
+namespace junction::overlayfs {
+
+Status<void> OverlayInode::CopyUp(bool copy_data) {
+  rt::MutexGuard g(copy_lock_);
+  if (copied_up_.load(std::memory_order_relaxed)) return {};
+
+  auto upper = std::make_shared<memfs::MemInode>(get_mode() & ~kTypeMask);
+  if (copy_data) {
+    struct stat buf;
+    if (Status<void> ret = lower_->GetStats(&buf); !ret) return ret;
+    if (Status<void> ret = upper->SetSize(buf.st_size); !ret) return ret;
+
+    Status<std::shared_ptr<File>> f = lower_->Open(0, FileMode::kRead);
+    if (!f) return MakeError(f);
+    std::vector<std::byte> chunk(kCopyUpChunkSize);
+    off_t in_off = 0, out_off = 0;
+    while (true) {
+      Status<size_t> n = (*f)->Read(chunk, &in_off);
+      if (!n) return MakeError(n);
+      if (*n == 0) break;
+      Status<size_t> ret = upper->Write({chunk.data(), *n}, &out_off);
+      if (!ret) return MakeError(ret);
+    }
+  }
+
+  // The upper inode is only reachable through this inode.
+  upper->inc_nlink();
+  upper_ = std::move(upper);
+  copied_up_.store(true, std::memory_order_release);
+  return {};
+}
+
+Status<std::shared_ptr<File>> OverlayInode::Open(uint32_t flags,
+                                                 FileMode fmode) {
+  if (fmode != FileMode::kRead) {
+    if (Status<void> ret = CopyUp(); !ret) return MakeError(ret);
+  }
+  if (is_copied_up()) return upper_->Open(flags, fmode);
+  return lower_->Open(flags, fmode);
+}
+
+Status<void> OverlayInode::GetStats(struct stat *buf) const {
+  Status<void> ret =
+      is_copied_up() ? upper_->GetStats(buf) : lower_->GetStats(buf);
+  if (!ret) return ret;
+  buf->st_ino = get_inum();
+  buf->st_nlink = get_nlink();
+  return {};
+}
+
+Status<void> OverlayInode::GetStatFS(struct statfs *buf) const {
+  if (is_copied_up()) return upper_->GetStatFS(buf);
+  return lower_->GetStatFS(buf);
+}
+
+Status<void> OverlayInode::SetSize(size_t sz) {
+  // No need to copy data that is about to be discarded.
+  if (Status<void> ret = CopyUp(sz != 0); !ret) return ret;
+  return upper_->SetSize(sz);
+}
+
+Status<std::shared_ptr<IDir>> MountOverlay(std::shared_ptr<IDir> lower) {
+  struct stat buf;
+  if (Status<void> ret = lower->GetStats(&buf); !ret) return MakeError(ret);
+  return std::make_shared<OverlayIDir>(buf, std::string{},
+                                       std::shared_ptr<IDir>{}, std::move(lower));
+}
+
+}  // namespace junction::overlayfs
@@ -0,0 +1,104 @@
+// overlayfs.h - an in-memory writeable layer stacked over a read-only lower
+// directory (usually linuxfs)
+
+#pragma once
+
+#include <set>
+
+#include "junction/bindings/sync.h"
+#include "junction/fs/fs.h"
+#include "junction/fs/memfs/memfs.h"
+
+namespace junction::overlayfs {
+
+// The size of each chunk copied from the lower file during copy-up.
+inline constexpr size_t kCopyUpChunkSize = 64 * 1024;
+
+// OverlayInode wraps a regular file from the lower layer. The file is read
+// from the lower layer until the first modification, at which point its
+// contents are copied into a memfs inode (copy-up) and all later accesses go
+// there instead.
+class OverlayInode : public Inode {
+ public:
+  OverlayInode(std::shared_ptr<Inode> lower)
+      : Inode(lower->get_mode(), lower->get_inum()), lower_(std::move(lower)) {}
+
+  Status<std::shared_ptr<File>> Open(uint32_t flags, FileMode fmode) override;
+  Status<void> GetStats(struct stat *buf) const override;
+  Status<void> GetStatFS(struct statfs *buf) const override;
+  Status<void> SetSize(size_t sz) override;
+
+  // Has this file been copied into the upper layer?
+  [[nodiscard]] bool is_copied_up() const {
+    return copied_up_.load(std::memory_order_acquire);
+  }
+
+ private:
+  // Copies the lower file into the upper layer (if not done already). If
+  // @copy_data is false, the upper file starts out empty.
+  Status<void> CopyUp(bool copy_data = true);
+
+  const std::shared_ptr<Inode> lower_;
+  rt::Mutex copy_lock_;  // serializes copy-up
+  std::atomic_bool copied_up_{false};
+  std::shared_ptr<memfs::MemInode> upper_;  // immutable once copied_up_ is set
+};
+
+// OverlayIDir merges an upper memfs directory with an optional lower directory.
+// Entries in the upper layer hide entries with the same name in the lower
+// layer, and whiteouts hide lower entries that were removed. The lower layer is
+// never modified.
+class OverlayIDir : public memfs::MemIDir {
+ public:
+  // Creates a directory that only exists in the upper layer.
+  OverlayIDir(mode_t mode, std::string name, std::shared_ptr<IDir> parent)
+      : MemIDir(mode, std::move(name), IDirType::kOverlay, std::move(parent)) {}
+  // Creates a directory that merges in the entries of @lower.
+  OverlayIDir(const struct stat &stat, std::string name,
+              std::shared_ptr<IDir> parent, std::shared_ptr<IDir> lower)
+      : MemIDir(stat, std::move(name), IDirType::kOverlay, std::move(parent)),
+        lower_(std::move(lower)) {}
+
+  // Directory ops
+  Status<std::shared_ptr<Inode>> Lookup(std::string_view name) override;
+  Status<void> MkNod(std::string_view name, mode_t mode, dev_t dev) override;
+  Status<void> MkDir(std::string_view name, mode_t mode) override;
+  Status<void> Unlink(std::string_view name) override;
+  Status<void> RmDir(std::string_view name) override;
+  Status<void> SymLink(std::string_view name, std::string_view target) override;
+  Status<void> Rename(IDir &src, std::string_view src_name,
+                      std::string_view dst_name, bool replace) override;
+  Status<void> Link(std::string_view name, std::shared_ptr<Inode> ino) override;
+  Status<std::shared_ptr<File>> Create(std::string_view name, int flags,
+                                       mode_t mode, FileMode fmode) override;
+  std::vector<dir_entry> GetDents() override;
+  // The merged entries come from GetDents(), so use its positional cookies.
+  void IterateDents(off_t cookie, const DirIterFn &func) override {
+    IDir::IterateDents(cookie, func);
+  }
+
+  // Inode ops
+  Status<void> GetStats(struct stat *buf) const override;
+  Status<void> GetStatFS(struct statfs *buf) const override;
+
+ private:
+  // Finds a visible entry, pulling it up from the lower layer if needed.
+  Status<std::shared_ptr<Inode>> FindLocked(std::string_view name);
+  // Hides the lower entry @name (if there is one).
+  void WhiteoutLocked(std::string_view name);
+  // Makes the lower entry @name visible again (if it was hidden).
+  void ClearWhiteoutLocked(std::string_view name);
+  // Returns true if the merged directory has no entries.
+  [[nodiscard]] bool IsEmptyLocked();
+  // Helper routine for renaming.
+  Status<void> DoRename(OverlayIDir &src, std::string_view src_name,
+                        std::string_view dst_name, bool replace);
+
+  const std::shared_ptr<IDir> lower_;
+  std::set<std::string, std::less<>> whiteouts_;
+  // Set once the entries have been modified, after which the upper layer
+  // holds the directory's attributes.
+  std::atomic_bool copied_up_{false};
+};
+
+}  // namespace junction::overlayfs
@@ -0,0 +1,93 @@
+extern "C" {
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+}
+
+#include <gtest/gtest.h>
+
+#include <cerrno>
+#include <cstring>
+#include <string>
+
+// These tests must run with --overlay_linux_fs so the linux filesystem is
+// read-only underneath an in-memory layer.
+class OverlayFSTest : public ::testing::Test {};
+
+bool DirHasEntry(const char *path, const char *name) {
+  DIR *d = opendir(path);
+  if (!d) return false;
+  bool found = false;
+  while (struct dirent *ent = readdir(d)) {
+    if (strcmp(ent->d_name, name) == 0) found = true;
+  }
+  closedir(d);
+  return found;
+}
+
+TEST_F(OverlayFSTest, CreateUnlinkTest) {
+  int fd = open("/etc/overlay_test.txt", O_RDWR | O_CREAT | O_EXCL, S_IRWXU);
+  ASSERT_GE(fd, 0);
+
+  const char txt[] = "hello, overlay!";
+  ssize_t n = write(fd, txt, sizeof(txt));
+  EXPECT_EQ(n, sizeof(txt));
+
+  char content[sizeof(txt)];
+  n = pread(fd, content, sizeof(content), 0);
+  EXPECT_EQ(n, sizeof(txt));
+  EXPECT_EQ(memcmp(content, txt, sizeof(txt)), 0);
+  EXPECT_EQ(close(fd), 0);
+
+  EXPECT_TRUE(DirHasEntry("/etc", "overlay_test.txt"));
+  EXPECT_TRUE(DirHasEntry("/etc", "passwd"));
+
+  EXPECT_EQ(unlink("/etc/overlay_test.txt"), 0);
+  EXPECT_FALSE(DirHasEntry("/etc", "overlay_test.txt"));
+  struct stat buf;
+  EXPECT_EQ(stat("/etc/overlay_test.txt", &buf), -1);
+  EXPECT_EQ(errno, ENOENT);
+}
+
+TEST_F(OverlayFSTest, CopyUpTest) {
+  char orig[64];
+  int fd = open("/etc/passwd", O_RDONLY);
+  ASSERT_GE(fd, 0);
+  ssize_t len = read(fd, orig, sizeof(orig));
+  ASSERT_GT(len, 1);
+  EXPECT_EQ(close(fd), 0);
+
+  // Writing to a lower file copies it into memory first.
+  fd = open("/etc/passwd", O_RDWR);
+  ASSERT_GE(fd, 0);
+  EXPECT_EQ(write(fd, "X", 1), 1);
+  EXPECT_EQ(close(fd), 0);
+
+  char cur[64];
+  fd = open("/etc/passwd", O_RDONLY);
+  ASSERT_GE(fd, 0);
+  EXPECT_EQ(read(fd, cur, sizeof(cur)), len);
+  EXPECT_EQ(close(fd), 0);
+  EXPECT_EQ(cur[0], 'X');
+  EXPECT_EQ(memcmp(cur + 1, orig + 1, len - 1), 0);
+}
+
+TEST_F(OverlayFSTest, WhiteoutTest) {
+  EXPECT_EQ(mkdir("/etc/overlay_dir", S_IRWXU), 0);
+  int fd = open("/etc/overlay_dir/a", O_RDWR | O_CREAT, S_IRWXU);
+  ASSERT_GE(fd, 0);
+  EXPECT_EQ(close(fd), 0);
+  EXPECT_EQ(rmdir("/etc/overlay_dir"), -1);
+  EXPECT_EQ(errno, ENOTEMPTY);
+  EXPECT_EQ(rename("/etc/overlay_dir/a", "/etc/overlay_dir/b"), 0);
+  EXPECT_TRUE(DirHasEntry("/etc/overlay_dir", "b"));
+  EXPECT_FALSE(DirHasEntry("/etc/overlay_dir", "a"));
+  EXPECT_EQ(unlink("/etc/overlay_dir/b"), 0);
+  EXPECT_EQ(rmdir("/etc/overlay_dir"), 0);
+
+  // Removing a lower file hides it.
+  EXPECT_EQ(unlink("/etc/passwd"), 0);
+  EXPECT_FALSE(DirHasEntry("/etc", "passwd"));
+  EXPECT_EQ(access("/etc/passwd", F_OK), -1);
+}
@@ -0,0 +1,92 @@
+// genfile.h - support for files whose contents are generated on demand.
+
+#pragma once
+
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <string>
+
+#include "junction/bindings/sync.h"
+#include "junction/fs/file.h"
+
+namespace junction {
+
+// GenFile renders its contents lazily, one record at a time, as reads reach
+// them. Only the record(s) overlapping the current read window are kept in
+// memory. Reading from offset 0 (or seeking backwards) starts a new pass, so a
+// poller can keep the file open and re-read it without reopening it.
+class GenFile : public File {
+ public:
+  // Appends the next record to @out. Returns false once there are no more.
+  using RecordFn = std::function<bool(std::string &out)>;
+  // Starts a new pass over the contents. The returned function typically
+  // captures a snapshot of the state it renders.
+  using StartFn = std::function<RecordFn()>;
+
+  GenFile(unsigned int flags, std::shared_ptr<Inode> ino, StartFn start)
+      : File(FileType::kNormal, flags, FileMode::kRead, std::move(ino)),
+        start_(std::move(start)) {}
+  ~GenFile() = default;
+
+  Status<size_t> Read(std::span<std::byte> buf, off_t *off) override {
+    if (*off < 0) return MakeError(EINVAL);
+    size_t pos = static_cast<size_t>(*off);
+
+    rt::MutexGuard g(lock_);
+    if (pos == 0 || pos < buf_off_ || !next_) Restart();
+
+    size_t n = 0;
+    while (n < buf.size()) {
+      // Render records until @pos falls inside the buffer.
+      if (pos >= buf_off_ + buf_.size()) {
+        if (done_) break;
+        buf_off_ += buf_.size();
+        buf_.clear();
+        done_ = !next_(buf_);
+        continue;
+      }
+      size_t start = pos - buf_off_;
+      size_t len = std::min(buf.size() - n, buf_.size() - start);
+      std::memcpy(buf.data() + n, buf_.data() + start, len);
+      n += len;
+      pos += len;
+    }
+
+    *off = static_cast<off_t>(pos);
+    return n;
+  }
+
+  Status<off_t> Seek(off_t off, SeekFrom origin) override {
+    // Like Linux's seq_file, the size isn't known ahead of time.
+    if (origin == SeekFrom::kCurrent)
+      off += get_off_ref();
+    else if (origin != SeekFrom::kStart)
+      return MakeError(EINVAL);
+    if (off < 0) return MakeError(EINVAL);
+    return off;
+  }
+
+  Status<void> Stat(struct stat *statbuf) const override {
+    if (!get_inode()) return MakeError(EINVAL);
+    return get_inode()->GetStats(statbuf);
+  }
+
+ private:
+  void Restart() {
+    assert(lock_.IsHeld());
+    next_ = start_();
+    buf_.clear();
+    buf_off_ = 0;
+    done_ = false;
+  }
+
+  const StartFn start_;
+  rt::Mutex lock_;     // serializes readers sharing this file
+  RecordFn next_;      // renders the next record of the current pass
+  std::string buf_;    // the most recently rendered record(s)
+  size_t buf_off_{0};  // the file offset of the start of @buf_
+  bool done_{false};   // true once the pass has rendered every record
+};
+
+}  // namespace junction
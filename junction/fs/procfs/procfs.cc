@@ -1,13 +1,16 @@
 
 #include "junction/fs/procfs/procfs.h"
 
+#include <array>
 #include <charconv>
 #include <iomanip>
 
 #include "junction/fs/file.h"
 #include "junction/fs/fs.h"
 #include "junction/fs/memfs/memfs.h"
+#include "junction/fs/procfs/genfile.h"
 #include "junction/fs/procfs/seqfile.h"
+#include "junction/kernel/ksys.h"
 #include "junction/kernel/proc.h"
 
 namespace junction::procfs {
@@ -68,6 +71,283 @@ class ProcFSInode : public Inode {
   std::shared_ptr<IDir> parent_;
 };
 
+// An inode whose files are rendered lazily, a record at a time, by @Start.
+template <GenFile::RecordFn (*Start)(IDir *)>
+class ProcFSGenInode : public Inode {
+ public:
+  ProcFSGenInode(mode_t mode, std::shared_ptr<IDir> parent = {})
+      : Inode(kTypeRegularFile | mode, AllocateInodeNumber()),
+        parent_(std::move(parent)) {}
+
+  Status<void> GetStats(struct stat *buf) const override {
+    InodeToStats(*this, buf);
+    return {};
+  }
+
+  // Open a file for this inode.
+  Status<std::shared_ptr<File>> Open(uint32_t flags, FileMode mode) override {
+    return std::make_shared<GenFile>(
+        flags, get_this(), [parent = parent_] { return Start(parent.get()); });
+  }
+
+ private:
+  std::shared_ptr<IDir> parent_;
+};
+
+// A pass that renders nothing.
+GenFile::RecordFn EmptyRecord() {
+  return [](std::string &) { return false; };
+}
+
+// A pass that consists of a single, already rendered record.
+GenFile::RecordFn SingleRecord(std::string record) {
+  return [record = std::move(record), done = false](std::string &out) mutable {
+    if (done) return false;
+    out.swap(record);
+    done = true;
+    return true;
+  };
+}
+
+// Returns the number of bytes of [start, end) that are resident in memory.
+size_t ResidentBytes(uintptr_t start, uintptr_t end) {
+  constexpr size_t kChunkPages = 512;
+  std::array<unsigned char, kChunkPages> vec;
+  size_t pages = 0;
+  for (uintptr_t addr = start; addr < end;) {
+    size_t len = std::min(kChunkPages * kPageSize, end - addr);
+    Status<void> ret =
+        KernelMInCore(reinterpret_cast<void *>(addr), len, vec.data());
+    if (ret) {
+      for (size_t i = 0; i < len / kPageSize; i++) pages += vec[i] & 1;
+    }
+    addr += len;
+  }
+  return pages * kPageSize;
+}
+
+// Memory usage of one or more VMAs.
+struct MemUsage {
+  size_t size{0};  // mapped bytes
+  size_t rss{0};   // resident bytes
+  size_t anon{0};  // resident bytes that aren't backed by a file
+
+  void Add(const VMArea &vma) {
+    size_t resident = ResidentBytes(vma.start, vma.end);
+    size += vma.Length();
+    rss += resident;
+    if (vma.type != VMType::kFile) anon += resident;
+  }
+};
+
+// How long a process's memory usage is reused before the mappings are
+// scanned again. Readers like top open status, stat and statm back to back.
+constexpr Duration kMemUsageMaxAge(100 * kMilliseconds);
+
+// Process memory usage broken down the way /proc/<pid>/status reports it.
+struct ProcMemUsage {
+  MemUsage total;
+  size_t data{0};   // private writeable mappings, excluding the stack
+  size_t stack{0};  // the stack
+  size_t exe{0};    // executable file mappings
+
+  explicit ProcMemUsage(Process &p) {
+    for (const VMArea &vma : p.get_mem_map().get_vmas()) {
+      total.Add(vma);
+      if (vma.type == VMType::kStack)
+        stack += vma.Length();
+      else if (vma.type == VMType::kFile && (vma.prot & PROT_EXEC))
+        exe += vma.Length();
+      else if (vma.type != VMType::kFile && (vma.prot & PROT_WRITE))
+        data += vma.Length();
+    }
+  }
+};
+
+// The command name (at most 15 characters, as in Linux's comm).
+std::string GetComm(Process &p) {
+  std::string_view path = p.get_bin_path();
+  if (size_t pos = path.rfind('/'); pos != std::string_view::npos)
+    path.remove_prefix(pos + 1);
+  return std::string(path.substr(0, 15));
+}
+
+char GetStateChar(Process &p) {
+  if (p.exited()) return 'Z';
+  if (p.is_stopped()) return 'T';
+  if (IsJunctionThread() && &p == &myproc()) return 'R';
+  return 'S';
+}
+
+std::string_view GetStateName(char state) {
+  switch (state) {
+    case 'R':
+      return "R (running)";
+    case 'T':
+      return "T (stopped)";
+    case 'Z':
+      return "Z (zombie)";
+    default:
+      return "S (sleeping)";
+  }
+}
+
+// /proc/<pid>/status
+GenFile::RecordFn GenStatus(Process &p, const ProcMemUsage &mem) {
+  char state = GetStateChar(p);
+  std::stringstream ss;
+  ss << "Name:\t" << GetComm(p) << "\n";
+  ss << "Umask:\t" << std::oct << std::setfill('0') << std::setw(4)
+     << p.get_fs().get_umask() << std::dec << std::setfill(' ') << "\n";
+  ss << "State:\t" << GetStateName(state) << "\n";
+  ss << "Tgid:\t" << p.get_pid() << "\n";
+  ss << "Pid:\t" << p.get_pid() << "\n";
+  ss << "PPid:\t" << p.get_ppid() << "\n";
+  ss << "TracerPid:\t0\n";
+  ss << "Uid:\t0\t0\t0\t0\n";
+  ss << "Gid:\t0\t0\t0\t0\n";
+  ss << "VmSize:\t" << std::setw(8) << mem.total.size / 1024 << " kB\n";
+  ss << "VmRSS:\t" << std::setw(8) << mem.total.rss / 1024 << " kB\n";
+  ss << "RssAnon:\t" << std::setw(8) << mem.total.anon / 1024 << " kB\n";
+  ss << "RssFile:\t" << std::setw(8)
+     << (mem.total.rss - mem.total.anon) / 1024 << " kB\n";
+  ss << "VmData:\t" << std::setw(8) << mem.data / 1024 << " kB\n";
+  ss << "VmStk:\t" << std::setw(8) << mem.stack / 1024 << " kB\n";
+  ss << "VmExe:\t" << std::setw(8) << mem.exe / 1024 << " kB\n";
+  ss << "Threads:\t" << p.get_thread_count() << "\n";
+  return SingleRecord(ss.str());
+}
+
+// /proc/<pid>/stat
+GenFile::RecordFn GenStat(Process &p, const ProcMemUsage &mem) {
+  // Clock ticks are microseconds (see AT_CLKTCK in exec.cc).
+  int64_t utime = p.GetRuntime().Microseconds();
+  std::stringstream ss;
+  // pid (comm) state ppid pgrp session tty_nr tpgid flags
+  ss << p.get_pid() << " (" << GetComm(p) << ") " << GetStateChar(p) << " "
+     << p.get_ppid() << " " << p.get_pgid() << " " << p.get_pgid()
+     << " 0 -1 0";
+  // minflt cminflt majflt cmajflt utime stime cutime cstime
+  ss << " 0 0 0 0 " << utime << " 0 0 0";
+  // priority nice num_threads itrealvalue starttime vsize rss rsslim
+  ss << " 20 0 " << p.get_thread_count() << " 0 0 " << mem.total.size << " "
+     << mem.total.rss / kPageSize << " " << RLIM_INFINITY;
+  // startcode ... cnswap (unknown), exit_signal, processor ... exit_code
+  for (int i = 0; i < 12; i++) ss << " 0";
+  ss << " " << SIGCHLD;
+  for (int i = 0; i < 14; i++) ss << " 0";
+  ss << "\n";
+  return SingleRecord(ss.str());
+}
+
+// /proc/<pid>/statm
+GenFile::RecordFn GenStatm([[maybe_unused]] Process &p,
+                           const ProcMemUsage &mem) {
+  std::stringstream ss;
+  // size resident shared text lib data dt (in pages)
+  ss << mem.total.size / kPageSize << " " << mem.total.rss / kPageSize << " "
+     << (mem.total.rss - mem.total.anon) / kPageSize << " "
+     << mem.exe / kPageSize << " 0 " << (mem.data + mem.stack) / kPageSize
+     << " 0\n";
+  return SingleRecord(ss.str());
+}
+
+// Renders the smaps counters for @usage.
+void RenderSmapsCounters(std::stringstream &ss, const MemUsage &usage) {
+  auto kb = [&ss](std::string_view name, size_t bytes) {
+    ss << name << std::setw(28 - static_cast<int>(name.size()))
+       << bytes / 1024 << " kB\n";
+  };
+  // There's no sharing between processes and no swap, so every resident page
+  // is private; anonymous pages are assumed to be dirty.
+  kb("Rss:", usage.rss);
+  kb("Pss:", usage.rss);
+  kb("Shared_Clean:", 0);
+  kb("Shared_Dirty:", 0);
+  kb("Private_Clean:", usage.rss - usage.anon);
+  kb("Private_Dirty:", usage.anon);
+  kb("Referenced:", usage.rss);
+  kb("Anonymous:", usage.anon);
+  kb("Swap:", 0);
+  kb("SwapPss:", 0);
+  kb("Locked:", 0);
+}
+
+// Renders the maps-style header line for a VMA.
+void RenderVMAHeader(std::stringstream &ss, const VMArea &vma) {
+  off_t offset = vma.type == VMType::kFile ? vma.offset : 0;
+  ss << std::hex << std::setfill('0') << std::setw(8) << vma.start << "-"
+     << std::setw(8) << vma.end << " " << vma.ProtString() << " "
+     << std::setw(8) << offset << std::dec << std::setfill(' ')
+     << " 00:00 0";
+  std::string name = vma.TypeString();
+  if (!name.empty()) ss << std::string(26, ' ') << name;
+  ss << "\n";
+}
+
+// /proc/<pid>/smaps (one record per VMA)
+GenFile::RecordFn GenSmaps(Process &p) {
+  return [vmas = p.get_mem_map().get_vmas(),
+          idx = size_t{0}](std::string &out) mutable {
+    if (idx >= vmas.size()) return false;
+    const VMArea &vma = vmas[idx++];
+    MemUsage usage;
+    usage.Add(vma);
+
+    std::stringstream ss;
+    RenderVMAHeader(ss, vma);
+    ss << "Size:" << std::setw(23) << usage.size / 1024 << " kB\n";
+    ss << "KernelPageSize:" << std::setw(13) << kPageSize / 1024 << " kB\n";
+    ss << "MMUPageSize:" << std::setw(16) << kPageSize / 1024 << " kB\n";
+    RenderSmapsCounters(ss, usage);
+    ss << "VmFlags:";
+    if (vma.prot & PROT_READ) ss << " rd";
+    if (vma.prot & PROT_WRITE) ss << " wr";
+    if (vma.prot & PROT_EXEC) ss << " ex";
+    ss << "\n";
+    out = ss.str();
+    return true;
+  };
+}
+
+// /proc/<pid>/smaps_rollup
+GenFile::RecordFn GenSmapsRollup(Process &p, const ProcMemUsage &mem) {
+  std::vector<VMArea> vmas = p.get_mem_map().get_vmas();
+  std::stringstream ss;
+  uintptr_t start = vmas.empty() ? 0 : vmas.front().start;
+  uintptr_t end = vmas.empty() ? 0 : vmas.back().end;
+  ss << std::hex << std::setfill('0') << std::setw(8) << start << "-"
+     << std::setw(8) << end << std::dec << std::setfill(' ')
+     << " ---p 00000000 00:00 0" << std::string(26, ' ') << "[rollup]\n";
+  RenderSmapsCounters(ss, mem.total);
+  return SingleRecord(ss.str());
+}
+
+// /proc/<pid>/io
+GenFile::RecordFn GenIO(Process &p) {
+  const IOStats io = p.GetIOStats();
+  std::stringstream ss;
+  ss << "rchar: " << io.rchar << "\n";
+  ss << "wchar: " << io.wchar << "\n";
+  ss << "syscr: " << io.syscr << "\n";
+  ss << "syscw: " << io.syscw << "\n";
+  // Nothing here reaches a block device.
+  ss << "read_bytes: 0\n";
+  ss << "write_bytes: 0\n";
+  ss << "cancelled_write_bytes: 0\n";
+  return SingleRecord(ss.str());
+}
+
+// Junction-specific; Linux only counts busy polled packets system-wide.
+GenFile::RecordFn GenBusyPoll(Process &p) {
+  const BusyPollCounters &bp = p.get_busy_poll_counters();
+  std::stringstream ss;
+  ss << "polls: " << bp.polls.load(std::memory_order_relaxed) << "\n";
+  ss << "hits: " << bp.hits.load(std::memory_order_relaxed) << "\n";
+  ss << "parks: " << bp.parks.load(std::memory_order_relaxed) << "\n";
+  return SingleRecord(ss.str());
+}
+
 std::optional<pid_t> ParsePid(std::string_view s) {
   pid_t result;
   if (std::from_chars(s.data(), s.data() + s.size(), result).ec == std::errc{})
@@ -133,6 +413,11 @@ class TaskDir : public memfs::MemIDir {
     return result;
   }
 
+  // The dynamic entries come from GetDents(), so use its positional cookies.
+  void IterateDents(off_t cookie, const DirIterFn &func) override {
+    IDir::IterateDents(cookie, func);
+  }
+
  protected:
   void DoInitialize() override {}
 
@@ -169,15 +454,65 @@ class ProcessDir : public memfs::MemIDir {
 
   bool is_dead() const { return proc_.use_count() == 0; }
 
+  // Returns the process's memory usage. Finding the resident pages takes a
+  // mincore() per mapping, so a recent result is reused.
+  ProcMemUsage GetMemUsage(Process &p) {
+    rt::ScopedLock g(usage_lock_);
+    if (!usage_ || Duration::Since(usage_time_) >= kMemUsageMaxAge) {
+      usage_.emplace(p);
+      usage_time_ = Time::Now();
+    }
+    return *usage_;
+  }
+
  protected:
   void DoInitialize() override {
     if (is_dead()) return;
     InsertLockedNoCheck("exe",
                         std::make_shared<ProcFSLink<GetExe>>(0777, get_this()));
     InsertLockedNoCheck("task", std::make_shared<TaskDir>(get_this()));
+    InsertGenFile<GenStatus>("status");
+    InsertGenFile<GenStat>("stat");
+    InsertGenFile<GenStatm>("statm");
+    InsertGenFile<GenSmaps>("smaps");
+    InsertGenFile<GenSmapsRollup>("smaps_rollup");
+    InsertGenFile<GenIO>("io");
+    InsertGenFile<GenBusyPoll>("busy_poll");
   }
 
  private:
+  // Starts a pass over a file that @Gen renders from the process's state.
+  template <GenFile::RecordFn (*Gen)(Process &)>
+  static GenFile::RecordFn StartGen(IDir *parent) {
+    assert(parent);
+    ProcessDir &dir = static_cast<ProcessDir &>(*parent);
+    std::shared_ptr<Process> p = dir.proc_.lock();
+    if (!p) return EmptyRecord();
+    return Gen(*p);
+  }
+
+  // Same as above, but @Gen also reports the process's memory usage.
+  template <GenFile::RecordFn (*Gen)(Process &, const ProcMemUsage &)>
+  static GenFile::RecordFn StartGen(IDir *parent) {
+    assert(parent);
+    ProcessDir &dir = static_cast<ProcessDir &>(*parent);
+    std::shared_ptr<Process> p = dir.proc_.lock();
+    if (!p) return EmptyRecord();
+    return Gen(*p, dir.GetMemUsage(*p));
+  }
+
+  template <GenFile::RecordFn (*Gen)(Process &)>
+  void InsertGenFile(std::string_view name) {
+    InsertLockedNoCheck(name, std::make_shared<ProcFSGenInode<StartGen<Gen>>>(
+                                  0444, get_this()));
+  }
+
+  template <GenFile::RecordFn (*Gen)(Process &, const ProcMemUsage &)>
+  void InsertGenFile(std::string_view name) {
+    InsertLockedNoCheck(name, std::make_shared<ProcFSGenInode<StartGen<Gen>>>(
+                                  0444, get_this()));
+  }
+
   static std::string GetExe(IDir *parent) {
     assert(parent);
     ProcessDir &dir = static_cast<ProcessDir &>(*parent);
@@ -187,6 +522,9 @@ class ProcessDir : public memfs::MemIDir {
   }
 
   std::weak_ptr<Process> proc_;
+  rt::Mutex usage_lock_;
+  std::optional<ProcMemUsage> usage_;
+  Time usage_time_;
 };
 
 // /proc
@@ -224,6 +562,11 @@ class ProcRootDir : public memfs::MemIDir {
     return result;
   }
 
+  // The dynamic entries come from GetDents(), so use its positional cookies.
+  void IterateDents(off_t cookie, const DirIterFn &func) override {
+    IDir::IterateDents(cookie, func);
+  }
+
  protected:
   void DoInitialize() override {
     InsertLockedNoCheck("self",
@@ -0,0 +1,96 @@
+extern "C" {
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+}
+
+#include <gtest/gtest.h>
+
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <string_view>
+
+class ProcFSTest : public ::testing::Test {};
+
+// Reads the rest of @fd, @chunk bytes at a time.
+std::string ReadAll(int fd, size_t chunk = 4096) {
+  std::string out;
+  std::string buf(chunk, '\0');
+  while (true) {
+    ssize_t n = read(fd, buf.data(), buf.size());
+    if (n <= 0) break;
+    out.append(buf.data(), n);
+  }
+  return out;
+}
+
+std::string ReadFile(const char *path, size_t chunk = 4096) {
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) return {};
+  std::string out = ReadAll(fd, chunk);
+  close(fd);
+  return out;
+}
+
+// Returns the value following "@key:" in @text (or -1 if it's missing).
+long FindField(std::string_view text, std::string_view key) {
+  size_t pos = text.find(std::string(key) + ":");
+  if (pos == std::string_view::npos) return -1;
+  return std::strtol(text.data() + pos + key.size() + 1, nullptr, 10);
+}
+
+TEST_F(ProcFSTest, StatusTest) {
+  std::string status = ReadFile("/proc/self/status");
+  ASSERT_FALSE(status.empty());
+  EXPECT_EQ(FindField(status, "Pid"), getpid());
+  EXPECT_GE(FindField(status, "PPid"), 0);
+  EXPECT_GT(FindField(status, "VmSize"), 0);
+  EXPECT_GE(FindField(status, "Threads"), 1);
+
+  std::string stat = ReadFile("/proc/self/stat");
+  EXPECT_EQ(std::strtol(stat.c_str(), nullptr, 10), getpid());
+  EXPECT_NE(stat.find(") R "), std::string::npos);
+}
+
+TEST_F(ProcFSTest, SmapsTest) {
+  constexpr size_t kLen = 64 * 4096;
+  void *p = mmap(nullptr, kLen, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  ASSERT_NE(p, MAP_FAILED);
+  std::memset(p, 1, kLen);
+
+  // Reading a byte at a time must give the same result as one big read.
+  std::string smaps = ReadFile("/proc/self/smaps", 1);
+  EXPECT_NE(smaps.find("Rss:"), std::string::npos);
+  EXPECT_NE(smaps.find("VmFlags:"), std::string::npos);
+
+  std::string rollup = ReadFile("/proc/self/smaps_rollup");
+  EXPECT_NE(rollup.find("[rollup]"), std::string::npos);
+  EXPECT_GE(FindField(rollup, "Rss"), static_cast<long>(kLen / 1024));
+
+  EXPECT_EQ(munmap(p, kLen), 0);
+}
+
+TEST_F(ProcFSTest, PollIOTest) {
+  int fd = open("/proc/self/io", O_RDONLY);
+  ASSERT_GE(fd, 0);
+  std::string before = ReadAll(fd);
+  long wchar = FindField(before, "wchar");
+  ASSERT_GE(wchar, 0);
+
+  int fds[2];
+  ASSERT_EQ(pipe(fds), 0);
+  char buf[128] = {};
+  ASSERT_EQ(write(fds[1], buf, sizeof(buf)), sizeof(buf));
+
+  // Rewinding starts a fresh pass with up-to-date counters.
+  ASSERT_EQ(lseek(fd, 0, SEEK_SET), 0);
+  std::string after = ReadAll(fd);
+  EXPECT_GE(FindField(after, "wchar"), wchar + static_cast<long>(sizeof(buf)));
+  EXPECT_GT(FindField(after, "syscw"), FindField(before, "syscw"));
+
+  close(fds[0]);
+  close(fds[1]);
+  close(fd);
+}
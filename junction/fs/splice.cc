@@ -0,0 +1,134 @@
+// splice.cc - moving data between files (sendfile, splice, copy_file_range)
+
+extern "C" {
+#include <fcntl.h>
+}
+
+#include <algorithm>
+#include <vector>
+
+#include "junction/fs/file.h"
+#include "junction/kernel/proc.h"
+#include "junction/kernel/usys.h"
+
+namespace junction {
+
+namespace {
+
+// The most data moved in one step. This also bounds the size of the bounce
+// buffer used when neither file has a fast path.
+constexpr size_t kTransferChunkSize = 128 * 1024;
+
+Status<size_t> TransferChunk(File &in, off_t *in_off, File &out,
+                             off_t *out_off, size_t len, bool nonblocking,
+                             std::vector<std::byte> &buf) {
+  // Try the fast paths first.
+  Status<size_t> ret = in.SpliceTo(out, in_off, out_off, len, nonblocking);
+  if (ret || ret.error() != EOPNOTSUPP) return ret;
+  ret = out.SpliceFrom(in, in_off, out_off, len, nonblocking);
+  if (ret || ret.error() != EOPNOTSUPP) return ret;
+
+  // Otherwise copy through a buffer.
+  if (buf.size() < len) buf.resize(len);
+  off_t start = *in_off;
+  Status<size_t> n = in.Read({buf.data(), len}, in_off);
+  if (!n || *n == 0) return n;
+  ret = out.Write({buf.data(), *n}, out_off);
+
+  // Rewind the input past anything that wasn't written.
+  *in_off = start + static_cast<off_t>(ret ? *ret : 0);
+  return ret;
+}
+
+// Uses the caller's offset if provided, otherwise the file's own offset.
+off_t &PickOffset(File &f, off_t *off) { return off ? *off : f.get_off_ref(); }
+
+}  // namespace
+
+Status<size_t> TransferData(File &in, off_t *in_off, File &out, off_t *out_off,
+                            size_t len, bool nonblocking) {
+  std::vector<std::byte> buf;
+  size_t done = 0;
+  while (done < len) {
+    size_t n = std::min(len - done, kTransferChunkSize);
+    Status<size_t> ret =
+        TransferChunk(in, in_off, out, out_off, n, nonblocking, buf);
+    if (!ret) {
+      if (done) break;
+      return MakeError(ret);
+    }
+    done += *ret;
+    if (*ret < n) break;
+  }
+  return done;
+}
+
+ssize_t usys_sendfile(int out_fd, int in_fd, off_t *offset, size_t count) {
+  FileTable &ftbl = myproc().get_file_table();
+  File *fout = ftbl.Get(out_fd);
+  if (unlikely(!fout || !fout->is_writeable())) return -EBADF;
+  File *fin = ftbl.Get(in_fd);
+  if (unlikely(!fin || !fin->is_readable() ||
+               fin->get_type() == FileType::kSocket))
+    return -EBADF;
+  Status<size_t> ret = TransferData(*fin, &PickOffset(*fin, offset), *fout,
+                                    &fout->get_off_ref(), count);
+  if (!ret) return MakeCError(ret);
+  return static_cast<ssize_t>(*ret);
+}
+
+ssize_t usys_splice(int fd_in, off_t *off_in, int fd_out, off_t *off_out,
+                    size_t len, unsigned int flags) {
+  FileTable &ftbl = myproc().get_file_table();
+  File *fin = ftbl.Get(fd_in);
+  if (unlikely(!fin || !fin->is_readable())) return -EBADF;
+  File *fout = ftbl.Get(fd_out);
+  if (unlikely(!fout || !fout->is_writeable())) return -EBADF;
+
+  // At least one side must be a pipe, and pipes can't be seeked.
+  bool in_pipe = fin->get_type() == FileType::kPipe;
+  bool out_pipe = fout->get_type() == FileType::kPipe;
+  if (!in_pipe && !out_pipe) return -EINVAL;
+  if ((in_pipe && off_in) || (out_pipe && off_out)) return -ESPIPE;
+
+  // Like Linux, SPLICE_F_NONBLOCK only applies to the pipe side.
+  Status<size_t> ret =
+      TransferData(*fin, &PickOffset(*fin, off_in), *fout,
+                   &PickOffset(*fout, off_out), len, flags & SPLICE_F_NONBLOCK);
+  if (!ret) return MakeCError(ret);
+  return static_cast<ssize_t>(*ret);
+}
+
+ssize_t usys_copy_file_range(int fd_in, off_t *off_in, int fd_out,
+                             off_t *off_out, size_t len, unsigned int flags) {
+  if (flags) return -EINVAL;
+  FileTable &ftbl = myproc().get_file_table();
+  File *fin = ftbl.Get(fd_in);
+  if (unlikely(!fin || !fin->is_readable())) return -EBADF;
+  File *fout = ftbl.Get(fd_out);
+  if (unlikely(!fout || !fout->is_writeable() ||
+               (fout->get_flags() & kFlagAppend)))
+    return -EBADF;
+  if (fin->get_type() == FileType::kDirectory ||
+      fout->get_type() == FileType::kDirectory)
+    return -EISDIR;
+  if (fin->get_type() != FileType::kNormal ||
+      fout->get_type() != FileType::kNormal)
+    return -EINVAL;
+
+  off_t &in_pos = PickOffset(*fin, off_in);
+  off_t &out_pos = PickOffset(*fout, off_out);
+  if (in_pos < 0 || out_pos < 0) return -EINVAL;
+
+  // Overlapping ranges within the same file are not allowed.
+  if (fin->get_inode() && fin->get_inode() == fout->get_inode() &&
+      in_pos < out_pos + static_cast<off_t>(len) &&
+      out_pos < in_pos + static_cast<off_t>(len))
+    return -EINVAL;
+
+  Status<size_t> ret = TransferData(*fin, &in_pos, *fout, &out_pos, len);
+  if (!ret) return MakeCError(ret);
+  return static_cast<ssize_t>(*ret);
+}
+
+}  // namespace junction
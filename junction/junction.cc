@@ -13,6 +13,7 @@ extern "C" {
 #include "junction/bindings/log.h"
 #include "junction/fs/fs.h"
 #include "junction/junction.h"
+#include "junction/kernel/hostio.h"
 #include "junction/kernel/proc.h"
 #include "junction/kernel/signal.h"
 #include "junction/shim/backend/init.h"
@@ -91,7 +92,22 @@ po::options_description GetOptions() {
       "madv_remap", po::bool_switch()->default_value(false),
       "zero memory when MADV_DONTNEED is used (intended for profiling)")(
       "cache_linux_fs", po::bool_switch()->default_value(false),
-      "cache directory structure of the linux filesystem");
+      "cache directory structure of the linux filesystem")(
+      "overlay_linux_fs", po::bool_switch()->default_value(false),
+      "keep the linux filesystem read-only and store writes in memory")(
+      "logfs_device", po::value<std::string>()->default_value(""),
+      "mount a logfs at /logfs stored on this host file (or \"storage\" for "
+      "the runtime's NVMe device)")(
+      "logfs_size", po::value<size_t>()->default_value(1024),
+      "the size (in MB) of the logfs host file")(
+      "linux_fs_writeback", po::bool_switch()->default_value(false),
+      "buffer writes to linux files and write them back in batches")(
+      "linux_fs_dirty_mb", po::value<size_t>()->default_value(64),
+      "the most buffered data (in MB) across all linux files")(
+      "linux_fs_file_dirty_mb", po::value<size_t>()->default_value(16),
+      "the most buffered data (in MB) for a single linux file")(
+      "hostio_offload", po::bool_switch()->default_value(false),
+      "run blocking host file I/O on an io_uring instead of on kthreads");
   ;
   return desc;
 }
@@ -128,6 +144,13 @@ Status<void> JunctionCfg::FillFromArgs(int argc, char *argv[]) {
   restore = vm["restore"].as<bool>();
   snapshot_prefix_ = vm["snapshot-prefix"].as<std::string>();
   cache_linux_fs_ = vm["cache_linux_fs"].as<bool>();
+  overlay_linux_fs_ = vm["overlay_linux_fs"].as<bool>();
+  logfs_device_ = vm["logfs_device"].as<std::string>();
+  logfs_size_mb_ = vm["logfs_size"].as<size_t>();
+  linux_fs_writeback_ = vm["linux_fs_writeback"].as<bool>();
+  linux_fs_dirty_mb_ = vm["linux_fs_dirty_mb"].as<size_t>();
+  linux_fs_file_dirty_mb_ = vm["linux_fs_file_dirty_mb"].as<size_t>();
+  hostio_offload_ = vm["hostio_offload"].as<bool>();
   snapshot_timeout_s_ = vm["snapshot-timeout"].as<int>();
   port_ = vm["port"].as<int>();
   if (snapshot_timeout_s_ && snapshot_prefix_.empty()) {
@@ -192,6 +215,9 @@ Status<void> init() {
   ret = InitFs(linux_mount_points, GetFsMounts());
   if (unlikely(!ret)) return ret;
 
+  ret = InitHostIO();
+  if (unlikely(!ret)) return ret;
+
   ret = ShimJmpInit();
   if (unlikely(!ret)) return ret;
 
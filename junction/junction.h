@@ -53,6 +53,19 @@ class alignas(kCacheLineSize) JunctionCfg {
   [[nodiscard]] bool stack_switch_enabled() const { return stack_switching; }
   [[nodiscard]] bool madv_dontneed_remap() const { return madv_remap; }
   [[nodiscard]] bool cache_linux_fs() const { return cache_linux_fs_; }
+  [[nodiscard]] bool overlay_linux_fs() const { return overlay_linux_fs_; }
+  [[nodiscard]] const std::string &get_logfs_device() const {
+    return logfs_device_;
+  }
+  [[nodiscard]] size_t get_logfs_size_mb() const { return logfs_size_mb_; }
+  [[nodiscard]] bool linux_fs_writeback() const { return linux_fs_writeback_; }
+  [[nodiscard]] size_t get_linux_fs_dirty_mb() const {
+    return linux_fs_dirty_mb_;
+  }
+  [[nodiscard]] size_t get_linux_fs_file_dirty_mb() const {
+    return linux_fs_file_dirty_mb_;
+  }
+  [[nodiscard]] bool hostio_offload() const { return hostio_offload_; }
 
   [[nodiscard]] int snapshot_timeout() const { return snapshot_timeout_s_; }
   [[nodiscard]] uint16_t port() const { return port_; }
@@ -85,6 +98,13 @@ class alignas(kCacheLineSize) JunctionCfg {
   bool restore;
   bool stack_switching;
   bool cache_linux_fs_;
+  bool overlay_linux_fs_;
+  std::string logfs_device_;
+  size_t logfs_size_mb_;
+  bool linux_fs_writeback_;
+  size_t linux_fs_dirty_mb_;
+  size_t linux_fs_file_dirty_mb_;
+  bool hostio_offload_;
   int snapshot_timeout_s_;
   std::string snapshot_prefix_;
   static JunctionCfg singleton_;
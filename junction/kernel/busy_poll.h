@@ -0,0 +1,105 @@
+// busy_poll.h - adaptive busy polling before blocking waits
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <optional>
+
+#include "junction/base/arch.h"
+#include "junction/base/time.h"
+#include "junction/bindings/thread.h"
+
+namespace junction {
+
+// Per-process busy polling counters (reported in /proc/<pid>/busy_poll).
+struct alignas(kCacheLineSize) BusyPollCounters {
+  std::atomic<uint64_t> polls{0};  // waits that busy polled
+  std::atomic<uint64_t> hits{0};   // ... and became ready while polling
+  std::atomic<uint64_t> parks{0};  // waits with a budget that blocked anyway
+};
+
+// Busy polling state for a socket (SO_BUSY_POLL) or an epoll set
+// (EPIOCSPARAMS). Parking and waking a thread costs a few microseconds, so a
+// wait that is likely to end sooner than that spins instead, yielding to other
+// runnable threads between checks. How long recent waits lasted (the gap
+// between arrivals as seen by the waiter) decides whether that is likely: the
+// spin window is about twice the recent gap, capped at the budget, and waits
+// skip spinning entirely while arrivals are further apart than the budget.
+class BusyPoll {
+ public:
+  BusyPoll() noexcept = default;
+  BusyPoll(const BusyPoll &) = delete;
+  BusyPoll &operator=(const BusyPoll &) = delete;
+
+  // Sets the budget in microseconds; zero disables busy polling.
+  void set_budget(uint32_t us) {
+    budget_us_.store(us, std::memory_order_relaxed);
+    // Start out spinning for the whole budget.
+    gap_us_.store(us / 2, std::memory_order_relaxed);
+  }
+  [[nodiscard]] uint32_t get_budget() const {
+    return budget_us_.load(std::memory_order_relaxed);
+  }
+  [[nodiscard]] bool enabled() const { return get_budget() != 0; }
+
+  // Spins until @ready returns true or the window closes, returning true if
+  // it did. Either way, the time spent spinning since @start is deducted from
+  // @timeout, so a caller that still has to block (e.g., because another
+  // waiter consumed the event) waits only for the rest of it. Callers report
+  // waits that deliver an event with Arrived().
+  template <typename Predicate>
+  bool Spin(Time start, Predicate ready, BusyPollCounters &c,
+            std::optional<Duration> &timeout) {
+    Duration window(Window());
+    if (timeout) window = std::min(window, *timeout);
+    if (window.IsZero()) {
+      c.parks.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+
+    c.polls.fetch_add(1, std::memory_order_relaxed);
+    bool hit;
+    while (!(hit = ready()) && Duration::Since(start) < window) rt::Yield();
+
+    (hit ? c.hits : c.parks).fetch_add(1, std::memory_order_relaxed);
+    if (timeout)
+      *timeout = Duration(std::max<int64_t>(
+          timeout->Microseconds() - Duration::Since(start).Microseconds(), 0));
+    return hit;
+  }
+
+  // Records that a wait that began at @start has ended with an event.
+  void Arrived(Time start) {
+    // Long idle periods are clamped so the average recovers quickly once
+    // arrivals speed up again.
+    int64_t limit = kMaxGapScale * get_budget();
+    uint64_t sample =
+        std::clamp<int64_t>(Duration::Since(start).Microseconds(), 0, limit);
+    uint64_t gap = gap_us_.load(std::memory_order_relaxed);
+    // Concurrent waiters may lose an update, which only slows adaptation.
+    gap_us_.store(static_cast<uint32_t>((gap * 7 + sample) / 8),
+                  std::memory_order_relaxed);
+  }
+
+ private:
+  static constexpr int64_t kMaxGapScale = 4;
+  // Even back-to-back arrivals get a short window to catch the next one.
+  static constexpr uint64_t kMinWindowUs = 2;
+
+  // How long to spin before blocking, in microseconds.
+  [[nodiscard]] int64_t Window() const {
+    uint64_t budget = get_budget();
+    uint64_t gap = gap_us_.load(std::memory_order_relaxed);
+    if (gap > budget) return 0;
+    return static_cast<int64_t>(
+        std::min(budget, std::max(gap * 2, kMinWindowUs)));
+  }
+
+  std::atomic<uint32_t> budget_us_{0};
+  // Moving average of recent gaps between arrivals, in microseconds.
+  std::atomic<uint32_t> gap_us_{0};
+};
+
+}  // namespace junction
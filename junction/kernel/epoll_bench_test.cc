@@ -0,0 +1,166 @@
+// Measures event delivery with several threads waiting on one epoll set that
+// watches many file descriptors, and the cost of short-lived epoll sets in a
+// process with many open files.
+
+extern "C" {
+#include <errno.h>
+#include <stdio.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <unistd.h>
+}
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+namespace {
+
+constexpr int kConns = 10000;
+constexpr int kRounds = 10;
+constexpr int kMaxEvents = 64;
+constexpr int kShortLivedSets = 10000;
+constexpr int kShortLivedFds = 4;
+constexpr uint64_t kStopData = ~0ULL;
+
+double GetElapsed(const timeval &begin, const timeval &end) {
+  return (end.tv_sec - begin.tv_sec) + (end.tv_usec - begin.tv_usec) / 1e6;
+}
+
+// Raises the open file limit as far as allowed and returns how many
+// connections fit under it.
+int ConnLimit() {
+  rlimit rl;
+  if (getrlimit(RLIMIT_NOFILE, &rl)) return 0;
+  rl.rlim_cur = rl.rlim_max;
+  setrlimit(RLIMIT_NOFILE, &rl);
+  if (getrlimit(RLIMIT_NOFILE, &rl)) return 0;
+  // Leave room for the epoll fd, the stop fd and stdio.
+  return static_cast<int>(std::min<rlim_t>(kConns, rl.rlim_cur - 64));
+}
+
+// Runs @nthreads waiters on one epoll set over @conns eventfds, each signaled
+// @kRounds times. Every event is edge-triggered, so it reaches one waiter.
+void RunBench(int nthreads, int conns) {
+  int epfd = epoll_create1(0);
+  ASSERT_GE(epfd, 0);
+
+  std::vector<int> fds(conns);
+  for (int i = 0; i < conns; i++) {
+    fds[i] = eventfd(0, EFD_NONBLOCK);
+    ASSERT_GE(fds[i], 0);
+    epoll_event ev = {};
+    ev.events = EPOLLIN | EPOLLET;
+    ev.data.u64 = i;
+    ASSERT_EQ(epoll_ctl(epfd, EPOLL_CTL_ADD, fds[i], &ev), 0);
+  }
+
+  // A level-triggered stop event wakes every waiter.
+  int stopfd = eventfd(0, EFD_NONBLOCK);
+  ASSERT_GE(stopfd, 0);
+  epoll_event ev = {};
+  ev.events = EPOLLIN;
+  ev.data.u64 = kStopData;
+  ASSERT_EQ(epoll_ctl(epfd, EPOLL_CTL_ADD, stopfd, &ev), 0);
+
+  const uint64_t total = static_cast<uint64_t>(conns) * kRounds;
+  std::atomic<uint64_t> received{0};
+  std::atomic<uint64_t> wakeups{0};
+
+  std::vector<std::thread> waiters;
+  for (int t = 0; t < nthreads; t++) {
+    waiters.emplace_back([&] {
+      epoll_event events[kMaxEvents];
+      while (true) {
+        int n = epoll_wait(epfd, events, kMaxEvents, -1);
+        if (n < 0 && errno == EINTR) continue;
+        ASSERT_GT(n, 0);
+        wakeups.fetch_add(1, std::memory_order_relaxed);
+        for (int i = 0; i < n; i++) {
+          if (events[i].data.u64 == kStopData) return;
+          uint64_t val;
+          if (read(fds[events[i].data.u64], &val, sizeof(val)) == sizeof(val))
+            received.fetch_add(val, std::memory_order_relaxed);
+        }
+      }
+    });
+  }
+
+  timeval begin, end;
+  gettimeofday(&begin, nullptr);
+  uint64_t one = 1;
+  for (int r = 0; r < kRounds; r++)
+    for (int fd : fds) ASSERT_EQ(write(fd, &one, sizeof(one)), sizeof(one));
+  while (received.load(std::memory_order_relaxed) < total) usleep(100);
+  gettimeofday(&end, nullptr);
+
+  ASSERT_EQ(write(stopfd, &one, sizeof(one)), sizeof(one));
+  for (std::thread &t : waiters) t.join();
+  EXPECT_EQ(received.load(), total);
+
+  double elapsed = GetElapsed(begin, end);
+  printf("threads: %d, conns: %d, events: %lu, wakeups: %lu, %.0f events/s\n",
+         nthreads, conns, total, wakeups.load(), total / elapsed);
+
+  close(stopfd);
+  for (int fd : fds) close(fd);
+  close(epfd);
+}
+
+}  // namespace
+
+TEST(EPollBenchTest, ManyWaiters) {
+  int conns = ConnLimit();
+  ASSERT_GT(conns, 0);
+  for (int nthreads : {1, 2, 4, 8}) RunBench(nthreads, conns);
+}
+
+TEST(EPollBenchTest, ShortLivedSets) {
+  int conns = ConnLimit();
+  ASSERT_GT(conns, kShortLivedFds);
+
+  // Lots of open files that the epoll sets don't watch.
+  std::vector<int> fds(conns);
+  for (int &fd : fds) {
+    fd = eventfd(0, EFD_NONBLOCK);
+    ASSERT_GE(fd, 0);
+  }
+
+  timeval begin, end;
+  gettimeofday(&begin, nullptr);
+  for (int i = 0; i < kShortLivedSets; i++) {
+    int epfd = epoll_create1(0);
+    ASSERT_GE(epfd, 0);
+    for (int j = 0; j < kShortLivedFds; j++) {
+      epoll_event ev = {};
+      ev.events = EPOLLIN;
+      ev.data.u64 = j;
+      ASSERT_EQ(epoll_ctl(epfd, EPOLL_CTL_ADD, fds[j], &ev), 0);
+    }
+    close(epfd);
+  }
+  gettimeofday(&end, nullptr);
+
+  // A file closed while watched leaves the set.
+  int epfd = epoll_create1(0);
+  ASSERT_GE(epfd, 0);
+  int efd = eventfd(1, EFD_NONBLOCK);
+  ASSERT_GE(efd, 0);
+  epoll_event ev = {};
+  ev.events = EPOLLIN;
+  ASSERT_EQ(epoll_ctl(epfd, EPOLL_CTL_ADD, efd, &ev), 0);
+  close(efd);
+  EXPECT_EQ(epoll_wait(epfd, &ev, 1, 0), 0);
+  close(epfd);
+
+  double elapsed = GetElapsed(begin, end);
+  printf("open files: %d, %.2f us per epoll set\n", conns,
+         elapsed * 1e6 / kShortLivedSets);
+
+  for (int fd : fds) close(fd);
+}
@@ -32,6 +32,8 @@ class EventFDFile : public File {
   }
 
   ~EventFDFile() = default;
+
+  [[nodiscard]] bool has_poll_source() const override { return true; }
   Status<size_t> Read(std::span<std::byte> buf,
                       [[maybe_unused]] off_t *off) override;
   Status<size_t> Write(std::span<const std::byte> buf,
@@ -0,0 +1,491 @@
+// hostio.cc - offloads blocking host file operations to a host io_uring
+//
+// Submissions are made directly by the calling uthread, which then parks until
+// a reaper uthread finds its completion. The reaper polls the completion queue
+// while operations are outstanding, sleeping for exponentially longer periods
+// while nothing completes, and parks when the ring is idle.
+
+extern "C" {
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <runtime/preempt.h>
+#include <runtime/thread.h>
+#include <sys/sysmacros.h>
+#include <syscall.h>
+}
+
+#include <algorithm>
+#include <atomic>
+#include <bitset>
+#include <cstring>
+#include <optional>
+#include <vector>
+
+#include "junction/base/time.h"
+#include "junction/bindings/log.h"
+#include "junction/bindings/sync.h"
+#include "junction/bindings/thread.h"
+#include "junction/bindings/timer.h"
+#include "junction/junction.h"
+#include "junction/kernel/hostio.h"
+#include "junction/kernel/ksys.h"
+
+namespace junction {
+
+namespace {
+
+constexpr unsigned int kRingEntries = 256;
+// The largest transfer Linux performs in a single read or write.
+constexpr size_t kMaxRWCount = 0x7ffff000;
+// The longest range that fits in an IORING_OP_FADVISE request.
+constexpr off_t kMaxAdviseLen = UINT32_MAX;
+// Empty polls of the completion queue before the reaper starts sleeping.
+constexpr int kReaperSpins = 64;
+// How long the reaper sleeps between polls of a quiet completion queue. The
+// sleep doubles up to the maximum while nothing completes, so that a long
+// blocking operation (e.g., a read from a terminal) costs little to wait for.
+// The cap bounds how late a completion behind such an operation is noticed.
+constexpr Duration kReaperMinSleep(20);
+constexpr Duration kReaperMaxSleep(500);
+
+// An operation waiting for its completion.
+struct Request {
+  rt::ThreadWaker waker;
+  int res;
+  bool done{false};
+};
+
+class HostIORing {
+ public:
+  Status<void> Init();
+
+  // Returns true if an operation can be offloaded from the running thread.
+  [[nodiscard]] bool CanOffload(unsigned int opcode) const {
+    return fd_ >= 0 && supported_.test(opcode) && thread_self() &&
+           preempt_enabled();
+  }
+
+  // Runs an operation on the ring and returns its result, or nothing if the
+  // ring has no room for it.
+  std::optional<long> Run(io_uring_sqe &sqe, bool interruptible);
+
+  // Submits an operation without waiting for (or reporting) its result.
+  // Returns false if the ring has no room for it.
+  bool Post(io_uring_sqe &sqe);
+
+  [[noreturn]] void ReaperMain();
+
+ private:
+  bool PushLocked(const io_uring_sqe &sqe);
+  void Submit();
+  bool ReapLocked();
+
+  int fd_{-1};
+  unsigned int *sq_head_, *sq_tail_, *sq_mask_, *sq_array_;
+  unsigned int *cq_head_, *cq_tail_, *cq_mask_;
+  io_uring_sqe *sqes_;
+  io_uring_cqe *cqes_;
+  unsigned int sq_entries_, cq_entries_;
+  std::bitset<IORING_OP_LAST> supported_;
+
+  rt::Spin lock_;
+  // Submitted but not yet completed operations (protected by lock_).
+  unsigned int inflight_{0};
+  // Queued but not yet accepted by the host (protected by lock_).
+  unsigned int unsubmitted_{0};
+  // Set when operations are queued while the reaper sleeps (protected by
+  // lock_).
+  bool kicked_{false};
+  rt::ThreadWaker reaper_;
+};
+
+HostIORing ring;
+
+template <typename T>
+T *RingPtr(intptr_t base, unsigned int off) {
+  return reinterpret_cast<T *>(base + off);
+}
+
+Status<void> HostIORing::Init() {
+  io_uring_params p{};
+  int fd = ksys_io_uring_setup(kRingEntries, &p);
+  if (fd < 0) return MakeError(-fd);
+
+  size_t sq_len = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+  size_t cq_len = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+  const bool single_mmap = p.features & IORING_FEAT_SINGLE_MMAP;
+  if (single_mmap) sq_len = cq_len = std::max(sq_len, cq_len);
+
+  constexpr int kProt = PROT_READ | PROT_WRITE;
+  constexpr int kFlags = MAP_SHARED | MAP_POPULATE;
+  const size_t sqes_len = p.sq_entries * sizeof(io_uring_sqe);
+  intptr_t sq =
+      ksys_mmap(nullptr, sq_len, kProt, kFlags, fd, IORING_OFF_SQ_RING);
+  intptr_t cq = single_mmap ? sq
+                            : ksys_mmap(nullptr, cq_len, kProt, kFlags, fd,
+                                        IORING_OFF_CQ_RING);
+  intptr_t sqes =
+      ksys_mmap(nullptr, sqes_len, kProt, kFlags, fd, IORING_OFF_SQES);
+
+  // Releases the ring on failure.
+  auto fail = [&](int err) -> Status<void> {
+    if (sq >= 0) ksys_munmap(reinterpret_cast<void *>(sq), sq_len);
+    if (!single_mmap && cq >= 0)
+      ksys_munmap(reinterpret_cast<void *>(cq), cq_len);
+    if (sqes >= 0) ksys_munmap(reinterpret_cast<void *>(sqes), sqes_len);
+    ksys_close(fd);
+    return MakeError(err);
+  };
+  for (intptr_t ret : {sq, cq, sqes}) {
+    if (ret < 0) return fail(-ret);
+  }
+
+  sq_head_ = RingPtr<unsigned int>(sq, p.sq_off.head);
+  sq_tail_ = RingPtr<unsigned int>(sq, p.sq_off.tail);
+  sq_mask_ = RingPtr<unsigned int>(sq, p.sq_off.ring_mask);
+  sq_array_ = RingPtr<unsigned int>(sq, p.sq_off.array);
+  cq_head_ = RingPtr<unsigned int>(cq, p.cq_off.head);
+  cq_tail_ = RingPtr<unsigned int>(cq, p.cq_off.tail);
+  cq_mask_ = RingPtr<unsigned int>(cq, p.cq_off.ring_mask);
+  cqes_ = RingPtr<io_uring_cqe>(cq, p.cq_off.cqes);
+  sqes_ = reinterpret_cast<io_uring_sqe *>(sqes);
+  sq_entries_ = p.sq_entries;
+  cq_entries_ = p.cq_entries;
+
+  // Only offload operations that the host kernel knows about.
+  std::vector<std::byte> buf(sizeof(io_uring_probe) +
+                             IORING_OP_LAST * sizeof(io_uring_probe_op));
+  auto *probe = reinterpret_cast<io_uring_probe *>(buf.data());
+  int ret = ksys_io_uring_register(fd, IORING_REGISTER_PROBE, probe,
+                                   IORING_OP_LAST);
+  if (ret < 0) return fail(-ret);
+  unsigned int nr_ops = std::min<unsigned int>(probe->ops_len, IORING_OP_LAST);
+  for (unsigned int i = 0; i < nr_ops; i++) {
+    if (probe->ops[i].flags & IO_URING_OP_SUPPORTED)
+      supported_.set(probe->ops[i].op);
+  }
+
+  fd_ = fd;
+  return {};
+}
+
+void HostIORing::Submit() {
+  unsigned int n;
+  {
+    rt::SpinGuard g(lock_);
+    n = unsubmitted_;
+  }
+  if (!n) return;
+
+  // The host may run operations inline here, so lock_ can't be held. The
+  // host takes at most the entries that are still queued, so concurrent
+  // callers can't over-count.
+  int ret = ksys_io_uring_enter(fd_, n, 0, 0, nullptr, 0);
+  // On failure (e.g., EAGAIN), the reaper tries again later.
+  if (ret <= 0) return;
+  rt::SpinGuard g(lock_);
+  unsubmitted_ -= ret;
+}
+
+bool HostIORing::PushLocked(const io_uring_sqe &sqe) {
+  assert(lock_.IsHeld());
+  if (inflight_ >= cq_entries_) return false;
+  unsigned int tail = *sq_tail_;
+  unsigned int head =
+      std::atomic_ref(*sq_head_).load(std::memory_order_acquire);
+  if (tail - head >= sq_entries_) return false;
+
+  unsigned int idx = tail & *sq_mask_;
+  sqes_[idx] = sqe;
+  sq_array_[idx] = idx;
+  std::atomic_ref(*sq_tail_).store(tail + 1, std::memory_order_release);
+  unsubmitted_++;
+  inflight_++;
+  kicked_ = true;
+  reaper_.Wake();
+  return true;
+}
+
+bool HostIORing::ReapLocked() {
+  assert(lock_.IsHeld());
+  unsigned int head = *cq_head_;
+  unsigned int tail =
+      std::atomic_ref(*cq_tail_).load(std::memory_order_acquire);
+  if (head == tail) return false;
+
+  for (; head != tail; head++) {
+    const io_uring_cqe &cqe = cqes_[head & *cq_mask_];
+    inflight_--;
+    // Cancellation requests and posted operations have no waiter.
+    if (!cqe.user_data) continue;
+    Request *req = reinterpret_cast<Request *>(cqe.user_data);
+    req->res = cqe.res;
+    req->done = true;
+    req->waker.Wake();
+  }
+  std::atomic_ref(*cq_head_).store(head, std::memory_order_release);
+  return true;
+}
+
+std::optional<long> HostIORing::Run(io_uring_sqe &sqe, bool interruptible) {
+  Request req;
+  sqe.user_data = reinterpret_cast<uintptr_t>(&req);
+
+  {
+    rt::SpinGuard g(lock_);
+    if (!PushLocked(sqe)) return std::nullopt;
+  }
+  Submit();
+
+  // Operations that the host finished inline (e.g., page cache hits) don't
+  // need to wait for the reaper.
+  rt::UniqueLock g(lock_);
+  ReapLocked();
+
+  auto done = [&req] { return req.done; };
+  if (interruptible && !rt::WaitInterruptible(lock_, req.waker, done)) {
+    // A signal is pending, try to cancel (the reaper submits the request).
+    // The operation may still complete. A full ring frees up as completions
+    // are reaped, so keep trying until the cancel fits or isn't needed.
+    io_uring_sqe cancel{};
+    cancel.opcode = IORING_OP_ASYNC_CANCEL;
+    cancel.fd = -1;
+    cancel.addr = reinterpret_cast<uintptr_t>(&req);
+    while (!req.done && !PushLocked(cancel)) {
+      g.Unlock();
+      rt::Yield();
+      g.Lock();
+      ReapLocked();
+    }
+  }
+  rt::Wait(lock_, req.waker, done);
+
+  if (interruptible && req.res == -ECANCELED) return -EINTR;
+  return req.res;
+}
+
+bool HostIORing::Post(io_uring_sqe &sqe) {
+  sqe.user_data = 0;
+  {
+    rt::SpinGuard g(lock_);
+    if (!PushLocked(sqe)) return false;
+  }
+  Submit();
+  return true;
+}
+
+void HostIORing::ReaperMain() {
+  int idle = 0;
+  Duration sleep = kReaperMinSleep;
+  while (true) {
+    Submit();
+    {
+      rt::SpinGuard g(lock_);
+      if (ReapLocked()) {
+        idle = 0;
+        sleep = kReaperMinSleep;
+        continue;
+      }
+      if (!inflight_) {
+        rt::Wait(lock_, reaper_, [this] { return inflight_ > 0; });
+        kicked_ = false;
+        idle = 0;
+        sleep = kReaperMinSleep;
+        continue;
+      }
+      kicked_ = false;
+    }
+
+    // Operations are outstanding; poll, then back off to sleeps that double
+    // while nothing completes. New submissions cut a sleep short.
+    if (++idle < kReaperSpins) {
+      rt::Yield();
+      continue;
+    }
+    rt::WakeOnTimeout timeout(lock_, reaper_, sleep);
+    rt::SpinGuard g(lock_);
+    rt::Wait(lock_, reaper_, [&] { return timeout || kicked_; });
+    if (kicked_)
+      sleep = kReaperMinSleep;
+    else
+      sleep = std::min(sleep + sleep, kReaperMaxSleep);
+  }
+}
+
+// Runs @sqe on the ring if possible, or calls @fallback otherwise.
+template <typename F>
+long Offload(io_uring_sqe &sqe, F fallback, bool interruptible = false) {
+  if (ring.CanOffload(sqe.opcode)) {
+    if (std::optional<long> ret = ring.Run(sqe, interruptible)) return *ret;
+  }
+  return fallback();
+}
+
+io_uring_sqe PrepRW(unsigned int op, int fd, const void *addr, unsigned int len,
+                    uint64_t off) {
+  io_uring_sqe sqe{};
+  sqe.opcode = op;
+  sqe.fd = fd;
+  sqe.addr = reinterpret_cast<uintptr_t>(addr);
+  sqe.len = len;
+  sqe.off = off;
+  return sqe;
+}
+
+void StatxToStat(const struct statx &sx, struct stat *st) {
+  std::memset(st, 0, sizeof(*st));
+  st->st_dev = makedev(sx.stx_dev_major, sx.stx_dev_minor);
+  st->st_ino = sx.stx_ino;
+  st->st_mode = sx.stx_mode;
+  st->st_nlink = sx.stx_nlink;
+  st->st_uid = sx.stx_uid;
+  st->st_gid = sx.stx_gid;
+  st->st_rdev = makedev(sx.stx_rdev_major, sx.stx_rdev_minor);
+  st->st_size = sx.stx_size;
+  st->st_blksize = sx.stx_blksize;
+  st->st_blocks = sx.stx_blocks;
+  st->st_atim = {sx.stx_atime.tv_sec, sx.stx_atime.tv_nsec};
+  st->st_mtim = {sx.stx_mtime.tv_sec, sx.stx_mtime.tv_nsec};
+  st->st_ctim = {sx.stx_ctime.tv_sec, sx.stx_ctime.tv_nsec};
+}
+
+}  // namespace
+
+Status<void> InitHostIO() {
+  if (!GetCfg().hostio_offload()) return {};
+  Status<void> ret = ring.Init();
+  if (!ret) {
+    LOG(WARN) << "hostio: io_uring unavailable, host file I/O will block "
+              << "kthreads: " << ret.error();
+    return {};
+  }
+  rt::Spawn([] { ring.ReaperMain(); });
+  return {};
+}
+
+ssize_t hostio_read(int fd, void *buf, size_t count, bool interruptible) {
+  count = std::min(count, kMaxRWCount);
+  io_uring_sqe sqe = PrepRW(IORING_OP_READ, fd, buf, count, -1);
+  return Offload(
+      sqe, [&] { return ksys_read(fd, buf, count); }, interruptible);
+}
+
+ssize_t hostio_write(int fd, const void *buf, size_t count) {
+  count = std::min(count, kMaxRWCount);
+  io_uring_sqe sqe = PrepRW(IORING_OP_WRITE, fd, buf, count, -1);
+  return Offload(sqe, [&] { return ksys_write(fd, buf, count); });
+}
+
+ssize_t hostio_pread(int fd, void *buf, size_t count, off_t offset) {
+  count = std::min(count, kMaxRWCount);
+  io_uring_sqe sqe = PrepRW(IORING_OP_READ, fd, buf, count, offset);
+  return Offload(sqe, [&] { return ksys_pread(fd, buf, count, offset); });
+}
+
+ssize_t hostio_pwrite(int fd, const void *buf, size_t count, off_t offset) {
+  count = std::min(count, kMaxRWCount);
+  io_uring_sqe sqe = PrepRW(IORING_OP_WRITE, fd, buf, count, offset);
+  return Offload(sqe, [&] { return ksys_pwrite(fd, buf, count, offset); });
+}
+
+ssize_t hostio_pwritev(int fd, const struct iovec *iov, int iovcnt,
+                       off_t offset) {
+  io_uring_sqe sqe = PrepRW(IORING_OP_WRITEV, fd, iov, iovcnt, offset);
+  return Offload(sqe,
+                 [&] { return ksys_pwritev(fd, iov, iovcnt, offset, 0); });
+}
+
+int hostio_fsync(int fd, bool datasync) {
+  io_uring_sqe sqe = PrepRW(IORING_OP_FSYNC, fd, nullptr, 0, 0);
+  if (datasync) sqe.fsync_flags = IORING_FSYNC_DATASYNC;
+  return Offload(sqe, [&] {
+    return datasync ? ksys_fdatasync(fd) : ksys_fsync(fd);
+  });
+}
+
+int hostio_fadvise(int fd, off_t offset, off_t len, int advice) {
+  auto fallback = [&] {
+    return ksyscall(__NR_fadvise64, fd, offset, len, advice);
+  };
+  // The ring only takes 32-bit lengths.
+  if (len > kMaxAdviseLen) return fallback();
+  io_uring_sqe sqe = PrepRW(IORING_OP_FADVISE, fd, nullptr, len, offset);
+  sqe.fadvise_advice = advice;
+  return Offload(sqe, fallback);
+}
+
+void hostio_readahead(int fd, off_t offset, off_t len) {
+  len = std::min(len, kMaxAdviseLen);
+  io_uring_sqe sqe = PrepRW(IORING_OP_FADVISE, fd, nullptr, len, offset);
+  sqe.fadvise_advice = POSIX_FADV_WILLNEED;
+  if (ring.CanOffload(sqe.opcode) && ring.Post(sqe)) return;
+  // Readahead is only a hint, so errors are ignored.
+  ksyscall(__NR_fadvise64, fd, offset, len, POSIX_FADV_WILLNEED);
+}
+
+int hostio_openat(int dirfd, const char *pathname, int flags, mode_t mode) {
+  io_uring_sqe sqe = PrepRW(IORING_OP_OPENAT, dirfd, pathname, mode, 0);
+  sqe.open_flags = flags;
+  return Offload(sqe,
+                 [&] { return ksys_openat(dirfd, pathname, flags, mode); });
+}
+
+int hostio_newfstatat(int dirfd, const char *pathname, struct stat *statbuf,
+                      int flags) {
+  struct statx sx;
+  io_uring_sqe sqe =
+      PrepRW(IORING_OP_STATX, dirfd, pathname, STATX_BASIC_STATS,
+             reinterpret_cast<uintptr_t>(&sx));
+  sqe.statx_flags = flags;
+  if (ring.CanOffload(sqe.opcode)) {
+    if (std::optional<long> ret = ring.Run(sqe, false)) {
+      if (*ret == 0) StatxToStat(sx, statbuf);
+      return *ret;
+    }
+  }
+  return ksys_newfstatat(dirfd, pathname, statbuf, flags);
+}
+
+int hostio_unlinkat(int dirfd, const char *pathname, int flags) {
+  io_uring_sqe sqe = PrepRW(IORING_OP_UNLINKAT, dirfd, pathname, 0, 0);
+  sqe.unlink_flags = flags;
+  return Offload(
+      sqe, [&] { return ksyscall(__NR_unlinkat, dirfd, pathname, flags); });
+}
+
+int hostio_mkdirat(int dirfd, const char *pathname, mode_t mode) {
+  io_uring_sqe sqe = PrepRW(IORING_OP_MKDIRAT, dirfd, pathname, mode, 0);
+  return Offload(sqe,
+                 [&] { return ksyscall(__NR_mkdirat, dirfd, pathname, mode); });
+}
+
+int hostio_symlinkat(const char *target, int newdirfd, const char *linkpath) {
+  io_uring_sqe sqe = PrepRW(IORING_OP_SYMLINKAT, newdirfd, target, 0,
+                            reinterpret_cast<uintptr_t>(linkpath));
+  return Offload(sqe, [&] {
+    return ksyscall(__NR_symlinkat, target, newdirfd, linkpath);
+  });
+}
+
+int hostio_renameat2(int olddirfd, const char *oldpath, int newdirfd,
+                     const char *newpath, unsigned int flags) {
+  io_uring_sqe sqe = PrepRW(IORING_OP_RENAMEAT, olddirfd, oldpath, newdirfd,
+                            reinterpret_cast<uintptr_t>(newpath));
+  sqe.rename_flags = flags;
+  return Offload(sqe, [&] {
+    return ksyscall(__NR_renameat2, olddirfd, oldpath, newdirfd, newpath,
+                    flags);
+  });
+}
+
+int hostio_linkat(int olddirfd, const char *oldpath, int newdirfd,
+                  const char *newpath, int flags) {
+  io_uring_sqe sqe = PrepRW(IORING_OP_LINKAT, olddirfd, oldpath, newdirfd,
+                            reinterpret_cast<uintptr_t>(newpath));
+  sqe.hardlink_flags = flags;
+  return Offload(sqe, [&] {
+    return ksyscall(__NR_linkat, olddirfd, oldpath, newdirfd, newpath, flags);
+  });
+}
+
+}  // namespace junction
@@ -0,0 +1,54 @@
+// hostio.h - offloads blocking host file operations from kthreads
+
+#pragma once
+
+extern "C" {
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+}
+
+#include "junction/base/error.h"
+
+namespace junction {
+
+// Sets up the host I/O ring when offloading is enabled (--hostio_offload).
+// Must be called before the seccomp filter is installed.
+Status<void> InitHostIO();
+
+// The hostio_* calls behave like the host syscalls of the same name and return
+// a negative error code on failure. When offloading is enabled, the operation
+// is submitted to a host io_uring and only the calling uthread blocks until it
+// completes, so the kthread can keep running other uthreads in the meantime.
+// Otherwise, or if the operation can't be offloaded right now (e.g., the ring
+// is full or the caller can't park), the plain host syscall is made instead.
+
+// Reads at the file's current position. If @interruptible is set, an offloaded
+// read is canceled and returns -EINTR when a signal is delivered.
+ssize_t hostio_read(int fd, void *buf, size_t count,
+                    bool interruptible = false);
+// Writes at the file's current position.
+ssize_t hostio_write(int fd, const void *buf, size_t count);
+ssize_t hostio_pread(int fd, void *buf, size_t count, off_t offset);
+ssize_t hostio_pwrite(int fd, const void *buf, size_t count, off_t offset);
+ssize_t hostio_pwritev(int fd, const struct iovec *iov, int iovcnt,
+                       off_t offset);
+// Like fsync() or, if @datasync is set, fdatasync().
+int hostio_fsync(int fd, bool datasync);
+// Like posix_fadvise(), but returns a negative error code on failure.
+int hostio_fadvise(int fd, off_t offset, off_t len, int advice);
+// Starts host readahead of a file range. When offloaded, this returns without
+// waiting for the host to start the I/O.
+void hostio_readahead(int fd, off_t offset, off_t len);
+int hostio_openat(int dirfd, const char *pathname, int flags, mode_t mode);
+int hostio_newfstatat(int dirfd, const char *pathname, struct stat *statbuf,
+                      int flags);
+int hostio_unlinkat(int dirfd, const char *pathname, int flags);
+int hostio_mkdirat(int dirfd, const char *pathname, mode_t mode);
+int hostio_symlinkat(const char *target, int newdirfd, const char *linkpath);
+int hostio_renameat2(int olddirfd, const char *oldpath, int newdirfd,
+                     const char *newpath, unsigned int flags);
+int hostio_linkat(int olddirfd, const char *oldpath, int newdirfd,
+                  const char *newpath, int flags);
+
+}  // namespace junction
@@ -0,0 +1,1188 @@
+// io_uring.cc - support for io_uring
+//
+// The submission and completion rings live in a memfd that the guest maps with
+// mmap(), using the same offsets as the host kernel. Junction keeps its own
+// mapping of that memory and consumes SQEs when the guest calls
+// io_uring_enter(), or from a polling uthread if the ring was created with
+// IORING_SETUP_SQPOLL. Requests run against the File interface. Those that may
+// block run in their own uthread and post a CQE when they finish.
+
+extern "C" {
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+}
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstring>
+#include <deque>
+#include <map>
+#include <memory>
+#include <optional>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+
+#include "junction/base/arch.h"
+#include "junction/base/compiler.h"
+#include "junction/base/time.h"
+#include "junction/bindings/sync.h"
+#include "junction/bindings/thread.h"
+#include "junction/bindings/timer.h"
+#include "junction/fs/file.h"
+#include "junction/kernel/ksys.h"
+#include "junction/kernel/poll.h"
+#include "junction/kernel/proc.h"
+#include "junction/kernel/signal.h"
+#include "junction/kernel/usys.h"
+#include "junction/net/socket.h"
+#include "junction/net/unix_socket.h"
+
+namespace junction {
+
+namespace {
+
+// Size limits (the same as the host kernel's).
+constexpr unsigned int kMaxEntries = 32768;
+constexpr unsigned int kMaxCQEntries = 2 * kMaxEntries;
+constexpr unsigned int kMaxFixedFiles = 1U << 20;
+constexpr unsigned int kMaxFixedBuffers = 1U << 14;
+
+constexpr unsigned int kSetupFlags =
+    IORING_SETUP_SQPOLL | IORING_SETUP_SQ_AFF | IORING_SETUP_CQSIZE |
+    IORING_SETUP_CLAMP | IORING_SETUP_SUBMIT_ALL | IORING_SETUP_COOP_TASKRUN |
+    IORING_SETUP_TASKRUN_FLAG | IORING_SETUP_SINGLE_ISSUER;
+constexpr unsigned int kEnterFlags =
+    IORING_ENTER_GETEVENTS | IORING_ENTER_SQ_WAKEUP | IORING_ENTER_SQ_WAIT |
+    IORING_ENTER_EXT_ARG;
+constexpr unsigned int kSQEFlags = IOSQE_FIXED_FILE | IOSQE_IO_DRAIN |
+                                   IOSQE_IO_LINK | IOSQE_IO_HARDLINK |
+                                   IOSQE_ASYNC | IOSQE_CQE_SKIP_SUCCESS;
+constexpr unsigned int kFeatures =
+    IORING_FEAT_SINGLE_MMAP | IORING_FEAT_NODROP | IORING_FEAT_SUBMIT_STABLE |
+    IORING_FEAT_RW_CUR_POS | IORING_FEAT_FAST_POLL | IORING_FEAT_POLL_32BITS |
+    IORING_FEAT_SQPOLL_NONFIXED | IORING_FEAT_EXT_ARG | IORING_FEAT_CQE_SKIP;
+
+// How long an SQPOLL thread keeps polling an idle ring before it sleeps, if
+// the guest doesn't choose (the host kernel's default).
+constexpr Duration kDefaultSQIdle(kSeconds);
+
+// Events that make a read-like or write-like operation worth issuing.
+constexpr unsigned int kReadEvents = kPollIn | kPollHUp | kPollErr | kPollRDHUp;
+constexpr unsigned int kWriteEvents = kPollOut | kPollHUp | kPollErr;
+
+// Returns true if an opcode is implemented.
+constexpr bool OpSupported(unsigned int op) {
+  switch (op) {
+    case IORING_OP_NOP:
+    case IORING_OP_READV:
+    case IORING_OP_WRITEV:
+    case IORING_OP_FSYNC:
+    case IORING_OP_READ_FIXED:
+    case IORING_OP_WRITE_FIXED:
+    case IORING_OP_POLL_ADD:
+    case IORING_OP_POLL_REMOVE:
+    case IORING_OP_SENDMSG:
+    case IORING_OP_TIMEOUT:
+    case IORING_OP_TIMEOUT_REMOVE:
+    case IORING_OP_ACCEPT:
+    case IORING_OP_ASYNC_CANCEL:
+    case IORING_OP_CONNECT:
+    case IORING_OP_CLOSE:
+    case IORING_OP_READ:
+    case IORING_OP_WRITE:
+    case IORING_OP_SEND:
+    case IORING_OP_RECV:
+      return true;
+    default:
+      return false;
+  }
+}
+
+// Returns true if an opcode never blocks and doesn't refer to a file.
+constexpr bool OpIsControl(unsigned int op) {
+  switch (op) {
+    case IORING_OP_NOP:
+    case IORING_OP_POLL_REMOVE:
+    case IORING_OP_TIMEOUT_REMOVE:
+    case IORING_OP_ASYNC_CANCEL:
+    case IORING_OP_CLOSE:
+      return true;
+    default:
+      return false;
+  }
+}
+
+// Returns true if an opcode operates on the SQE's file descriptor.
+constexpr bool OpNeedsFile(unsigned int op) {
+  return !OpIsControl(op) && op != IORING_OP_TIMEOUT;
+}
+
+// Returns the events an opcode waits for on a pollable file before it is
+// issued, or zero if it is issued right away.
+constexpr unsigned int OpReadyEvents(unsigned int op) {
+  switch (op) {
+    case IORING_OP_READ:
+    case IORING_OP_READV:
+    case IORING_OP_READ_FIXED:
+    case IORING_OP_RECV:
+    case IORING_OP_ACCEPT:
+      return kReadEvents;
+    case IORING_OP_WRITE:
+    case IORING_OP_WRITEV:
+    case IORING_OP_WRITE_FIXED:
+    case IORING_OP_SEND:
+    case IORING_OP_SENDMSG:
+      return kWriteEvents;
+    default:
+      return 0;
+  }
+}
+
+// Returns true if an opcode transfers a single buffer of sqe.len bytes.
+constexpr bool OpIsTransfer(unsigned int op) {
+  switch (op) {
+    case IORING_OP_READ:
+    case IORING_OP_WRITE:
+    case IORING_OP_READ_FIXED:
+    case IORING_OP_WRITE_FIXED:
+    case IORING_OP_SEND:
+    case IORING_OP_RECV:
+      return true;
+    default:
+      return false;
+  }
+}
+
+// Returns true if a completion ends a chain of IOSQE_IO_LINK requests.
+bool BreaksLink(const io_uring_sqe &sqe, int32_t res) {
+  if (sqe.opcode == IORING_OP_TIMEOUT && res == -ETIME)
+    return !(sqe.timeout_flags & IORING_TIMEOUT_ETIME_SUCCESS);
+  if (res < 0) return true;
+  return OpIsTransfer(sqe.opcode) && static_cast<uint32_t>(res) < sqe.len;
+}
+
+template <typename T>
+int32_t Result(const Status<T> &ret) {
+  if (!ret) return MakeCError(ret);
+  if constexpr (std::is_void_v<T>)
+    return 0;
+  else
+    return static_cast<int32_t>(*ret);
+}
+
+uint32_t LoadAcquire(uint32_t &v) {
+  return std::atomic_ref(v).load(std::memory_order_acquire);
+}
+
+void StoreRelease(uint32_t &v, uint32_t val) {
+  std::atomic_ref(v).store(val, std::memory_order_release);
+}
+
+// The start of the ring memory shared with the guest. The CQEs follow it,
+// then the SQ index array. Indices written by different sides are kept on
+// separate cache lines.
+struct RingHeader {
+  alignas(kCacheLineSize) uint32_t sq_head;
+  alignas(kCacheLineSize) uint32_t sq_tail;
+  alignas(kCacheLineSize) uint32_t cq_head;
+  alignas(kCacheLineSize) uint32_t cq_tail;
+  alignas(kCacheLineSize) uint32_t sq_ring_mask;
+  uint32_t sq_ring_entries;
+  uint32_t sq_flags;
+  uint32_t sq_dropped;
+  uint32_t cq_ring_mask;
+  uint32_t cq_ring_entries;
+  uint32_t cq_flags;
+  uint32_t cq_overflow;
+};
+static_assert(sizeof(RingHeader) % alignof(io_uring_cqe) == 0);
+
+// A submitted SQE.
+struct Request {
+  // Marks the request as issued, after which it can't be canceled. Returns
+  // false if it was canceled first.
+  bool Start() {
+    rt::SpinGuard g(lock);
+    if (canceled) return false;
+    started = true;
+    return true;
+  }
+
+  io_uring_sqe sqe;
+  std::shared_ptr<File> file;
+  // The submitting process. Requests don't run on its threads, so anything
+  // that depends on the process must come from here, never from myproc().
+  std::weak_ptr<Process> proc;
+  ucred creds;
+  // An error found during submission, reported in the request's CQE.
+  int err{0};
+  // The completion count that fires a counted timeout (protected by the ring
+  // lock).
+  uint64_t timeout_target{0};
+
+  rt::Spin lock;
+  rt::ThreadWaker waker;
+  bool started{false};
+  bool canceled{false};
+  bool fired{false};
+};
+
+// Requests joined by IOSQE_IO_LINK or IOSQE_IO_HARDLINK, run in order.
+using Chain = std::vector<std::unique_ptr<Request>>;
+
+class Ring : public std::enable_shared_from_this<Ring> {
+ public:
+  Ring(KernelFile memfd, void *map, size_t rings_len, size_t sqes_len,
+       const io_uring_params &p, std::weak_ptr<Process> proc) noexcept;
+  ~Ring();
+
+  // Creates a ring for the parameters of io_uring_setup() and fills in the
+  // parameters that are returned to the guest.
+  static Status<std::shared_ptr<Ring>> Create(unsigned int entries,
+                                              io_uring_params &p,
+                                              Process &proc);
+
+  // Maps part of the ring into the guest at one of the IORING_OFF_* offsets.
+  Status<void *> MMap(void *addr, size_t length, int prot, int flags,
+                      off_t off);
+
+  // Implement io_uring_enter() and io_uring_register().
+  long Enter(unsigned int to_submit, unsigned int min_complete,
+             unsigned int flags, const void *argp, size_t argsz);
+  long Register(unsigned int opcode, void *arg, unsigned int nr_args);
+
+  // Sets the poll source that reports available completions.
+  void Attach(PollSource &src) {
+    rt::SpinGuard g(lock_);
+    poll_ = &src;
+  }
+
+  // Called once the guest has released the ring. Cancels requests that
+  // haven't been issued yet and stops the SQPOLL thread.
+  void Shutdown();
+
+ private:
+  [[nodiscard]] uint32_t SQPending() {
+    return LoadAcquire(hdr_->sq_tail) - hdr_->sq_head;
+  }
+  [[nodiscard]] uint32_t CQReadyLocked() {
+    assert(lock_.IsHeld());
+    return hdr_->cq_tail - LoadAcquire(hdr_->cq_head);
+  }
+  void SetSQFlag(uint32_t flag) { std::atomic_ref(hdr_->sq_flags) |= flag; }
+  void ClearSQFlag(uint32_t flag) { std::atomic_ref(hdr_->sq_flags) &= ~flag; }
+
+  unsigned int Submit(Process &proc, unsigned int to_submit);
+  bool Prepare(Process &proc, Request &r);
+  void Dispatch(Chain chain);
+  bool TryInline(Request &r);
+  void RunChain(Chain &chain);
+  int32_t Execute(Request &r);
+  int32_t Issue(Request &r);
+  int32_t DoTimeout(Request &r);
+  int32_t DoCancel(Request &r);
+  int32_t DoAccept(Request &r, Socket &s);
+  std::optional<int32_t> DoSendUnix(Request &r, UnixSocket &u);
+  Status<unsigned int> WaitReady(Request &r, File &f, unsigned int events);
+  int32_t Cancel(const Request &self, uint64_t user_data,
+                 std::optional<uint8_t> op, bool all, bool any);
+  bool InFixedBuffer(const io_uring_sqe &sqe);
+
+  void Complete(Request &r, int32_t res);
+  void PostLocked(uint64_t user_data, int32_t res);
+  bool PushCQELocked(uint64_t user_data, int32_t res);
+  void FlushOverflowLocked();
+
+  void PollerMain();
+  void WakePoller();
+
+  long RegisterProbe(io_uring_probe *probe, unsigned int nr_args);
+  long RegisterFiles(const int *fds, unsigned int nr_args);
+  long RegisterEventFd(int fd);
+
+  KernelFile memfd_;
+  void *map_;
+  const size_t rings_len_;
+  const size_t sqes_len_;
+  RingHeader *hdr_;
+  io_uring_cqe *cqes_;
+  uint32_t *sq_array_;
+  io_uring_sqe *sqes_;
+  const uint32_t sq_entries_;
+  const uint32_t cq_entries_;
+  const bool submit_all_;
+  const bool sqpoll_;
+  const Duration sq_idle_;
+  std::weak_ptr<Process> proc_;
+
+  // Serializes consumers of the submission queue.
+  rt::Mutex submit_lock_;
+
+  rt::Spin lock_;
+  // Requests that haven't completed, keyed by user_data.
+  std::multimap<uint64_t, Request *> pending_;
+  // Timeouts waiting for a completion count.
+  std::vector<Request *> timeouts_;
+  // Completions that didn't fit in the CQ ring.
+  std::deque<io_uring_cqe> overflow_;
+  uint64_t posted_{0};
+  rt::WaitQueue cq_waiters_;
+  rt::ThreadWaker drain_waker_;
+  rt::ThreadWaker poller_;
+  bool poller_kick_{false};
+  bool dead_{false};
+  PollSource *poll_{nullptr};
+  std::shared_ptr<File> eventfd_;
+  std::vector<std::shared_ptr<File>> files_;
+  std::vector<iovec> buffers_;
+};
+
+class IoUringFile : public File {
+ public:
+  explicit IoUringFile(std::shared_ptr<Ring> ring) noexcept
+      : File(FileType::kSpecial, 0, FileMode::kReadWrite),
+        ring_(std::move(ring)) {
+    ring_->Attach(get_poll_source());
+  }
+  ~IoUringFile() override { ring_->Shutdown(); }
+
+  [[nodiscard]] bool has_poll_source() const override { return true; }
+
+  Status<void *> MMap(void *addr, size_t length, int prot, int flags,
+                      off_t off) override {
+    return ring_->MMap(addr, length, prot, flags, off);
+  }
+
+  [[nodiscard]] Ring &get_ring() { return *ring_; }
+
+ private:
+  std::shared_ptr<Ring> ring_;
+};
+
+Ring::Ring(KernelFile memfd, void *map, size_t rings_len, size_t sqes_len,
+           const io_uring_params &p, std::weak_ptr<Process> proc) noexcept
+    : memfd_(std::move(memfd)),
+      map_(map),
+      rings_len_(rings_len),
+      sqes_len_(sqes_len),
+      hdr_(static_cast<RingHeader *>(map)),
+      cqes_(reinterpret_cast<io_uring_cqe *>(static_cast<std::byte *>(map) +
+                                             p.cq_off.cqes)),
+      sq_array_(reinterpret_cast<uint32_t *>(static_cast<std::byte *>(map) +
+                                             p.sq_off.array)),
+      sqes_(reinterpret_cast<io_uring_sqe *>(static_cast<std::byte *>(map) +
+                                             rings_len)),
+      sq_entries_(p.sq_entries),
+      cq_entries_(p.cq_entries),
+      submit_all_(p.flags & IORING_SETUP_SUBMIT_ALL),
+      sqpoll_(p.flags & IORING_SETUP_SQPOLL),
+      sq_idle_(p.sq_thread_idle
+                   ? Duration(p.sq_thread_idle * kMilliseconds)
+                   : kDefaultSQIdle),
+      proc_(std::move(proc)) {
+  hdr_->sq_ring_mask = sq_entries_ - 1;
+  hdr_->sq_ring_entries = sq_entries_;
+  hdr_->cq_ring_mask = cq_entries_ - 1;
+  hdr_->cq_ring_entries = cq_entries_;
+}
+
+Ring::~Ring() { KernelMUnmap(map_, rings_len_ + sqes_len_); }
+
+Status<std::shared_ptr<Ring>> Ring::Create(unsigned int entries,
+                                           io_uring_params &p, Process &proc) {
+  if (p.flags & ~kSetupFlags) return MakeError(EINVAL);
+  if (!entries) return MakeError(EINVAL);
+  if (entries > kMaxEntries) {
+    if (!(p.flags & IORING_SETUP_CLAMP)) return MakeError(EINVAL);
+    entries = kMaxEntries;
+  }
+  const unsigned int sq_entries = std::bit_ceil(entries);
+  unsigned int cq_entries = 2 * sq_entries;
+  if (p.flags & IORING_SETUP_CQSIZE) {
+    if (!p.cq_entries) return MakeError(EINVAL);
+    cq_entries = p.cq_entries;
+    if (cq_entries > kMaxCQEntries) {
+      if (!(p.flags & IORING_SETUP_CLAMP)) return MakeError(EINVAL);
+      cq_entries = kMaxCQEntries;
+    }
+    cq_entries = std::bit_ceil(cq_entries);
+    if (cq_entries < sq_entries) return MakeError(EINVAL);
+  }
+
+  const size_t cqes_off = sizeof(RingHeader);
+  const size_t array_off = cqes_off + cq_entries * sizeof(io_uring_cqe);
+  const size_t rings_len = PageAlign(array_off + sq_entries * sizeof(uint32_t));
+  const size_t sqes_len = PageAlign(sq_entries * sizeof(io_uring_sqe));
+
+  Status<KernelFile> f = KernelFile::MemFDCreate("io_uring", MFD_CLOEXEC);
+  if (!f) return MakeError(f);
+  if (Status<void> ret = f->Truncate(rings_len + sqes_len); !ret)
+    return MakeError(ret);
+  intptr_t map = ksys_mmap(nullptr, rings_len + sqes_len,
+                           PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                           f->GetFd(), 0);
+  if (map < 0) return MakeError(-map);
+
+  p.sq_entries = sq_entries;
+  p.cq_entries = cq_entries;
+  p.features = kFeatures;
+  p.sq_off = {};
+  p.sq_off.head = offsetof(RingHeader, sq_head);
+  p.sq_off.tail = offsetof(RingHeader, sq_tail);
+  p.sq_off.ring_mask = offsetof(RingHeader, sq_ring_mask);
+  p.sq_off.ring_entries = offsetof(RingHeader, sq_ring_entries);
+  p.sq_off.flags = offsetof(RingHeader, sq_flags);
+  p.sq_off.dropped = offsetof(RingHeader, sq_dropped);
+  p.sq_off.array = array_off;
+  p.cq_off = {};
+  p.cq_off.head = offsetof(RingHeader, cq_head);
+  p.cq_off.tail = offsetof(RingHeader, cq_tail);
+  p.cq_off.ring_mask = offsetof(RingHeader, cq_ring_mask);
+  p.cq_off.ring_entries = offsetof(RingHeader, cq_ring_entries);
+  p.cq_off.overflow = offsetof(RingHeader, cq_overflow);
+  p.cq_off.cqes = cqes_off;
+  p.cq_off.flags = offsetof(RingHeader, cq_flags);
+
+  auto ring =
+      std::make_shared<Ring>(std::move(*f), reinterpret_cast<void *>(map),
+                             rings_len, sqes_len, p, proc.weak_from_this());
+  if (ring->sqpoll_) rt::Spawn([ring] { ring->PollerMain(); });
+  return ring;
+}
+
+Status<void *> Ring::MMap(void *addr, size_t length, int prot, int flags,
+                          off_t off) {
+  off_t moff;
+  size_t limit;
+  switch (static_cast<uint64_t>(off)) {
+    case IORING_OFF_SQ_RING:
+    case IORING_OFF_CQ_RING:
+      moff = 0;
+      limit = rings_len_;
+      break;
+    case IORING_OFF_SQES:
+      moff = static_cast<off_t>(rings_len_);
+      limit = sqes_len_;
+      break;
+    default:
+      return MakeError(EINVAL);
+  }
+  if (length > limit) return MakeError(EINVAL);
+
+  intptr_t ret = ksys_mmap(addr, length, prot, flags, memfd_.GetFd(), moff);
+  if (ret < 0) return MakeError(-ret);
+  return reinterpret_cast<void *>(ret);
+}
+
+long Ring::Enter(unsigned int to_submit, unsigned int min_complete,
+                 unsigned int flags, const void *argp, size_t argsz) {
+  if (flags & ~kEnterFlags) return -EINVAL;
+
+  std::optional<k_sigset_t> mask;
+  std::optional<Duration> timeout;
+  if (flags & IORING_ENTER_EXT_ARG) {
+    if (argsz != sizeof(io_uring_getevents_arg)) return -EINVAL;
+    const auto *arg = static_cast<const io_uring_getevents_arg *>(argp);
+    if (arg->sigmask) {
+      if (arg->sigmask_sz != sizeof(k_sigset_t)) return -EINVAL;
+      mask = *reinterpret_cast<const k_sigset_t *>(arg->sigmask);
+    }
+    if (arg->ts)
+      timeout = Duration(*reinterpret_cast<const timespec *>(arg->ts));
+  } else if (argp) {
+    if (argsz != sizeof(k_sigset_t)) return -EINVAL;
+    mask = KernelSigset(static_cast<const sigset_t *>(argp));
+  }
+
+  long submitted = 0;
+  if (sqpoll_) {
+    // The SQPOLL thread does the submitting; just make sure it is awake.
+    if (flags & (IORING_ENTER_SQ_WAKEUP | IORING_ENTER_SQ_WAIT)) WakePoller();
+    if (flags & IORING_ENTER_SQ_WAIT) {
+      while (LoadAcquire(hdr_->sq_tail) - LoadAcquire(hdr_->sq_head) >=
+             sq_entries_)
+        rt::Yield();
+    }
+    submitted = to_submit;
+  } else if (to_submit) {
+    submitted = Submit(myproc(), to_submit);
+  }
+
+  bool ready = true;
+  if (flags & IORING_ENTER_GETEVENTS) {
+    min_complete = std::min(min_complete, cq_entries_);
+    {
+      rt::SpinGuard g(lock_);
+      FlushOverflowLocked();
+      ready = CQReadyLocked() >= min_complete;
+    }
+
+    bool signaled = false;
+    if (!ready && !(timeout && timeout->IsZero())) {
+      rt::WakeOnTimeout timed_out(lock_, cq_waiters_, timeout);
+      SigMaskGuard sig(mask);
+      rt::SpinGuard g(lock_);
+      signaled = !rt::WaitInterruptible(lock_, cq_waiters_, [&] {
+        FlushOverflowLocked();
+        return CQReadyLocked() >= min_complete || timed_out;
+      });
+      ready = CQReadyLocked() >= min_complete;
+    }
+    if (!ready && !submitted) return signaled ? -EINTR : -ETIME;
+  }
+
+  // Let pollers of the ring know that the guest has caught up.
+  rt::SpinGuard g(lock_);
+  if (poll_ && !CQReadyLocked()) poll_->Clear(kPollIn);
+  return submitted;
+}
+
+unsigned int Ring::Submit(Process &proc, unsigned int to_submit) {
+  rt::ScopedLock g(submit_lock_);
+  uint32_t head = hdr_->sq_head;
+  const uint32_t n = std::min(to_submit, SQPending());
+  unsigned int submitted = 0;
+  Chain chain;
+
+  for (uint32_t i = 0; i < n; i++) {
+    const uint32_t idx = read_once(sq_array_[head++ & (sq_entries_ - 1)]);
+    if (unlikely(idx >= sq_entries_)) {
+      std::atomic_ref(hdr_->sq_dropped)++;
+      continue;
+    }
+
+    // Copy the SQE so the guest can reuse its slot as soon as we return.
+    auto r = std::make_unique<Request>();
+    std::memcpy(&r->sqe, &sqes_[idx], sizeof(r->sqe));
+    r->proc = proc.weak_from_this();
+    r->creds = ProcessCreds(proc);
+    const bool ok = Prepare(proc, *r);
+    const bool link = r->sqe.flags & (IOSQE_IO_LINK | IOSQE_IO_HARDLINK);
+    // Like Linux, a bad request only ends the submission if it is not linked;
+    // a failed link is completed with errors instead.
+    const bool stop = !ok && !link && chain.empty() && !submit_all_;
+    submitted++;
+    chain.push_back(std::move(r));
+    if (!link) {
+      Dispatch(std::move(chain));
+      chain.clear();
+    }
+    if (unlikely(stop)) break;
+  }
+
+  // A chain that is still open at the end of a submission ends there.
+  if (!chain.empty()) Dispatch(std::move(chain));
+  StoreRelease(hdr_->sq_head, head);
+  return submitted;
+}
+
+// Checks a request and looks up its file. Errors are reported when the
+// request runs. Returns false if the request is invalid.
+bool Ring::Prepare(Process &proc, Request &r) {
+  const io_uring_sqe &sqe = r.sqe;
+  if ((sqe.flags & ~kSQEFlags) || !OpSupported(sqe.opcode)) {
+    r.err = EINVAL;
+    return false;
+  }
+  if (!OpNeedsFile(sqe.opcode)) return true;
+
+  if (sqe.flags & IOSQE_FIXED_FILE) {
+    rt::SpinGuard g(lock_);
+    if (static_cast<uint32_t>(sqe.fd) < files_.size()) r.file = files_[sqe.fd];
+  } else if (sqe.fd >= 0) {
+    r.file = proc.get_file_table().Dup(sqe.fd);
+  }
+  if (!r.file) {
+    r.err = EBADF;
+    return false;
+  }
+  return true;
+}
+
+void Ring::Dispatch(Chain chain) {
+  {
+    rt::SpinGuard g(lock_);
+
+    // A drained request waits for everything submitted before it. Later
+    // submissions wait behind it, but may start before it completes.
+    if (chain.front()->sqe.flags & IOSQE_IO_DRAIN) {
+      rt::Wait(lock_, drain_waker_,
+               [this] { return pending_.empty() || dead_; });
+    }
+
+    for (std::unique_ptr<Request> &r : chain) {
+      pending_.emplace(r->sqe.user_data, r.get());
+      if (unlikely(dead_)) r->canceled = true;
+    }
+  }
+
+  if (chain.size() == 1 && TryInline(*chain.front())) return;
+  rt::Spawn([ring = shared_from_this(), chain = std::move(chain)]() mutable {
+    ring->RunChain(chain);
+  });
+}
+
+// Runs a request in the submitting thread if it won't block. Returns false if
+// it needs a thread of its own.
+bool Ring::TryInline(Request &r) {
+  const io_uring_sqe &sqe = r.sqe;
+  if (sqe.flags & IOSQE_ASYNC) return false;
+  if (!r.err && !OpIsControl(sqe.opcode)) {
+    unsigned int events = OpReadyEvents(sqe.opcode);
+    if (!events || !r.file->has_poll_source()) return false;
+    if (!(r.file->get_poll_source().get_events() & events)) return false;
+  }
+  Complete(r, Execute(r));
+  return true;
+}
+
+void Ring::RunChain(Chain &chain) {
+  bool failed = false;
+  for (std::unique_ptr<Request> &r : chain) {
+    const int32_t res = failed ? -ECANCELED : Execute(*r);
+    Complete(*r, res);
+    if ((r->sqe.flags & IOSQE_IO_LINK) && BreaksLink(r->sqe, res))
+      failed = true;
+  }
+}
+
+int32_t Ring::Execute(Request &r) {
+  if (r.err) return -r.err;
+  const io_uring_sqe &sqe = r.sqe;
+
+  switch (sqe.opcode) {
+    case IORING_OP_POLL_ADD: {
+      // Multishot polls and poll updates are not supported.
+      if (sqe.len & ~IORING_POLL_ADD_LEVEL) return -EINVAL;
+      if (!r.file->has_poll_source())
+        return static_cast<int32_t>(sqe.poll32_events & (kPollIn | kPollOut));
+      Status<unsigned int> ret =
+          WaitReady(r, *r.file, sqe.poll32_events | kPollErr | kPollHUp);
+      if (!ret) return MakeCError(ret);
+      return static_cast<int32_t>(*ret);
+    }
+    case IORING_OP_TIMEOUT:
+      return DoTimeout(r);
+    case IORING_OP_POLL_REMOVE:
+    case IORING_OP_TIMEOUT_REMOVE:
+    case IORING_OP_ASYNC_CANCEL:
+      return DoCancel(r);
+    default:
+      break;
+  }
+
+  // Like the host kernel, wait for a pollable file to become ready before
+  // issuing an operation on it, so the request stays cancelable until then.
+  unsigned int events = r.file ? OpReadyEvents(sqe.opcode) : 0;
+  if (events && r.file->has_poll_source()) {
+    Status<unsigned int> ret = WaitReady(r, *r.file, events);
+    if (!ret) return MakeCError(ret);
+  }
+
+  if (!r.Start()) return -ECANCELED;
+  return Issue(r);
+}
+
+int32_t Ring::Issue(Request &r) {
+  const io_uring_sqe &sqe = r.sqe;
+  auto *buf = reinterpret_cast<std::byte *>(sqe.addr);
+  auto *iov = reinterpret_cast<iovec *>(sqe.addr);
+
+  // An offset of -1 selects (and advances) the file position.
+  off_t off = static_cast<off_t>(sqe.off);
+  off_t *offp = &off;
+  if (r.file && sqe.off == ~uint64_t{0}) offp = &r.file->get_off_ref();
+
+  if (UnixSocket *u = r.file ? most_derived_cast<UnixSocket>(r.file.get())
+                             : nullptr) {
+    if (std::optional<int32_t> ret = DoSendUnix(r, *u)) return *ret;
+  }
+
+  switch (sqe.opcode) {
+    case IORING_OP_NOP:
+      return 0;
+    case IORING_OP_READ_FIXED:
+      if (!InFixedBuffer(sqe)) return -EFAULT;
+      [[fallthrough]];
+    case IORING_OP_READ:
+      if (!r.file->is_readable()) return -EBADF;
+      return Result(r.file->Read({buf, sqe.len}, offp));
+    case IORING_OP_WRITE_FIXED:
+      if (!InFixedBuffer(sqe)) return -EFAULT;
+      [[fallthrough]];
+    case IORING_OP_WRITE:
+      if (!r.file->is_writeable()) return -EBADF;
+      return Result(r.file->Write({buf, sqe.len}, offp));
+    case IORING_OP_READV:
+      if (!r.file->is_readable()) return -EBADF;
+      return Result(r.file->Readv({iov, sqe.len}, offp));
+    case IORING_OP_WRITEV:
+      if (!r.file->is_writeable()) return -EBADF;
+      return Result(r.file->Writev({iov, sqe.len}, offp));
+    case IORING_OP_FSYNC:
+      if (sqe.fsync_flags & ~IORING_FSYNC_DATASYNC) return -EINVAL;
+      if (sqe.fsync_flags) return Result(r.file->DataSync());
+      return Result(r.file->Sync());
+    case IORING_OP_CLOSE: {
+      if (sqe.file_index) return -EINVAL;
+      std::shared_ptr<Process> proc = r.proc.lock();
+      if (!proc || !proc->get_file_table().Remove(sqe.fd)) return -EBADF;
+      return 0;
+    }
+    default:
+      break;
+  }
+
+  // The rest are socket operations.
+  if (r.file->get_type() != FileType::kSocket) return -ENOTSOCK;
+  Socket &s = static_cast<Socket &>(*r.file);
+  switch (sqe.opcode) {
+    case IORING_OP_SEND:
+      return Result(s.WriteTo({buf, sqe.len}, nullptr));
+    case IORING_OP_RECV:
+      return Result(s.ReadFrom({buf, sqe.len}, nullptr,
+                               sqe.msg_flags & kMsgPeek));
+    case IORING_OP_SENDMSG: {
+      const auto *msg = reinterpret_cast<const msghdr *>(sqe.addr);
+      netaddr addr;
+      if (msg->msg_name) {
+        Status<netaddr> naddr = SockAddrToNetAddr(
+            reinterpret_cast<const sockaddr *>(msg->msg_name),
+            msg->msg_namelen);
+        if (!naddr) return MakeCError(naddr);
+        addr = *naddr;
+      }
+      return Result(s.WritevTo({msg->msg_iov, msg->msg_iovlen},
+                               msg->msg_name ? &addr : nullptr));
+    }
+    case IORING_OP_ACCEPT:
+      return DoAccept(r, s);
+    case IORING_OP_CONNECT: {
+      Status<netaddr> addr =
+          SockAddrToNetAddr(reinterpret_cast<const sockaddr *>(sqe.addr),
+                            static_cast<socklen_t>(sqe.off));
+      if (!addr) return MakeCError(addr);
+      return Result(s.Connect(*addr));
+    }
+    default:
+      return -EINVAL;
+  }
+}
+
+// Handles the operations that send on a UNIX socket, or returns nothing for
+// the rest. Messages carry the sender's credentials, which the socket would
+// otherwise look up from the running thread.
+std::optional<int32_t> Ring::DoSendUnix(Request &r, UnixSocket &u) {
+  const io_uring_sqe &sqe = r.sqe;
+  MsgOptions opts;
+  opts.creds = r.creds;
+  iovec iov{reinterpret_cast<void *>(sqe.addr), sqe.len};
+
+  switch (sqe.opcode) {
+    case IORING_OP_WRITE:
+    case IORING_OP_SEND:
+      return Result(u.SendTo({&iov, 1}, nullptr, opts));
+    case IORING_OP_WRITEV:
+      return Result(u.SendTo(
+          {reinterpret_cast<const iovec *>(sqe.addr), sqe.len}, nullptr, opts));
+    case IORING_OP_SENDMSG: {
+      const auto *msg = reinterpret_cast<const msghdr *>(sqe.addr);
+      std::string name;
+      if (msg->msg_name) {
+        Status<std::string> ret = SockAddrToUnixName(
+            reinterpret_cast<const sockaddr *>(msg->msg_name),
+            msg->msg_namelen);
+        if (!ret) return MakeCError(ret);
+        name = std::move(*ret);
+      }
+      return Result(u.SendTo({msg->msg_iov, msg->msg_iovlen},
+                             msg->msg_name ? &name : nullptr, opts));
+    }
+    default:
+      return std::nullopt;
+  }
+}
+
+int32_t Ring::DoAccept(Request &r, Socket &s) {
+  const io_uring_sqe &sqe = r.sqe;
+  const int flags = static_cast<int>(sqe.accept_flags);
+  if (flags & ~(kFlagNonblock | kFlagCloseExec)) return -EINVAL;
+  if (sqe.file_index) return -EINVAL;
+
+  Status<std::shared_ptr<Socket>> ret = s.Accept(flags);
+  if (!ret) return MakeCError(ret);
+  if (sqe.addr) {
+    Status<netaddr> na = (*ret)->RemoteAddr();
+    if (!na) return MakeCError(na);
+    Status<void> conv =
+        NetAddrToSockAddr(*na, reinterpret_cast<sockaddr *>(sqe.addr),
+                          reinterpret_cast<socklen_t *>(sqe.addr2));
+    if (!conv) return MakeCError(conv);
+  }
+
+  std::shared_ptr<Process> proc = r.proc.lock();
+  if (!proc) return -ECANCELED;
+  return proc->get_file_table().Insert(std::move(*ret),
+                                       (flags & kFlagCloseExec) > 0);
+}
+
+int32_t Ring::DoTimeout(Request &r) {
+  const io_uring_sqe &sqe = r.sqe;
+  constexpr unsigned int kTimeoutFlags = IORING_TIMEOUT_ABS |
+                                         IORING_TIMEOUT_CLOCK_MASK |
+                                         IORING_TIMEOUT_ETIME_SUCCESS;
+  if ((sqe.timeout_flags & ~kTimeoutFlags) || sqe.len != 1) return -EINVAL;
+  const auto &ts = *reinterpret_cast<const timespec *>(sqe.addr);
+  Time deadline = (sqe.timeout_flags & IORING_TIMEOUT_ABS)
+                      ? Time::FromUnixTime(ts)
+                      : Time::Now() + Duration(ts);
+
+  // A nonzero offset also completes the timeout after that many completions.
+  if (sqe.off) {
+    rt::SpinGuard g(lock_);
+    r.timeout_target = posted_ + sqe.off;
+    timeouts_.push_back(&r);
+  }
+
+  {
+    rt::WakeOnTimeout timed_out(r.lock, r.waker, deadline);
+    rt::SpinGuard g(r.lock);
+    rt::Wait(r.lock, r.waker,
+             [&] { return r.canceled || r.fired || timed_out; });
+  }
+
+  if (sqe.off) {
+    rt::SpinGuard g(lock_);
+    std::erase(timeouts_, &r);
+  }
+
+  rt::SpinGuard g(r.lock);
+  if (r.fired) return 0;
+  if (r.canceled) return -ECANCELED;
+  return -ETIME;
+}
+
+int32_t Ring::DoCancel(Request &r) {
+  const io_uring_sqe &sqe = r.sqe;
+  switch (sqe.opcode) {
+    case IORING_OP_POLL_REMOVE:
+      if (sqe.len) return -EINVAL;
+      return Cancel(r, sqe.addr, IORING_OP_POLL_ADD, false, false);
+    case IORING_OP_TIMEOUT_REMOVE:
+      if (sqe.timeout_flags) return -EINVAL;
+      return Cancel(r, sqe.addr, IORING_OP_TIMEOUT, false, false);
+    default:
+      break;
+  }
+
+  constexpr unsigned int kCancelFlags =
+      IORING_ASYNC_CANCEL_ALL | IORING_ASYNC_CANCEL_ANY;
+  if (sqe.cancel_flags & ~kCancelFlags) return -EINVAL;
+  return Cancel(r, sqe.addr, std::nullopt,
+                sqe.cancel_flags & IORING_ASYNC_CANCEL_ALL,
+                sqe.cancel_flags & IORING_ASYNC_CANCEL_ANY);
+}
+
+// Cancels requests matching @user_data (or any request if @any is set) and
+// @op. Only requests that haven't been issued can be canceled. Returns the
+// number canceled if @all is set, otherwise 0, or an error if none were.
+int32_t Ring::Cancel(const Request &self, uint64_t user_data,
+                     std::optional<uint8_t> op, bool all, bool any) {
+  rt::SpinGuard g(lock_);
+  auto [it, end] = any ? std::make_pair(pending_.begin(), pending_.end())
+                       : pending_.equal_range(user_data);
+  int32_t canceled = 0;
+  bool busy = false;
+  for (; it != end; ++it) {
+    Request &r = *it->second;
+    if (&r == &self || (op && r.sqe.opcode != *op)) continue;
+    rt::SpinGuard rg(r.lock);
+    if (r.canceled) continue;
+    if (r.started) {
+      busy = true;
+      continue;
+    }
+    r.canceled = true;
+    r.waker.Wake();
+    canceled++;
+    if (!all) break;
+  }
+
+  if (canceled) return all ? canceled : 0;
+  return busy ? -EALREADY : -ENOENT;
+}
+
+// Parks until @f reports one of @events and returns the events that are set.
+Status<unsigned int> Ring::WaitReady(Request &r, File &f,
+                                     unsigned int events) {
+  unsigned int ready = 0;
+  Poller p([&r, &ready, events](unsigned int pev) {
+    rt::SpinGuard g(r.lock);
+    ready = pev & events;
+    if (ready) r.waker.Wake();
+  });
+  f.get_poll_source().Attach(p);
+  {
+    rt::SpinGuard g(r.lock);
+    rt::Wait(r.lock, r.waker, [&] { return ready || r.canceled; });
+  }
+  p.Detach();
+
+  if (!ready) return MakeError(ECANCELED);
+  return ready;
+}
+
+bool Ring::InFixedBuffer(const io_uring_sqe &sqe) {
+  rt::SpinGuard g(lock_);
+  if (sqe.buf_index >= buffers_.size()) return false;
+  const iovec &iov = buffers_[sqe.buf_index];
+  const uint64_t start = reinterpret_cast<uint64_t>(iov.iov_base);
+  return sqe.addr >= start && sqe.addr + sqe.len <= start + iov.iov_len;
+}
+
+void Ring::Complete(Request &r, int32_t res) {
+  std::shared_ptr<File> efd;
+  {
+    rt::SpinGuard g(lock_);
+    auto it = pending_.lower_bound(r.sqe.user_data);
+    while (it->second != &r) ++it;
+    pending_.erase(it);
+    if (pending_.empty()) drain_waker_.Wake();
+
+    if (res < 0 || !(r.sqe.flags & IOSQE_CQE_SKIP_SUCCESS)) {
+      PostLocked(r.sqe.user_data, res);
+      if (!(read_once(hdr_->cq_flags) & IORING_CQ_EVENTFD_DISABLED))
+        efd = eventfd_;
+    }
+  }
+
+  if (efd) {
+    uint64_t val = 1;
+    off_t off = 0;
+    std::ignore = efd->Write(
+        {reinterpret_cast<const std::byte *>(&val), sizeof(val)}, &off);
+  }
+}
+
+void Ring::PostLocked(uint64_t user_data, int32_t res) {
+  assert(lock_.IsHeld());
+  FlushOverflowLocked();
+  const bool was_empty = !CQReadyLocked();
+  if (!overflow_.empty() || !PushCQELocked(user_data, res)) {
+    overflow_.push_back({user_data, res, 0});
+    SetSQFlag(IORING_SQ_CQ_OVERFLOW);
+  }
+  posted_++;
+
+  for (Request *t : timeouts_) {
+    if (posted_ < t->timeout_target) continue;
+    rt::SpinGuard g(t->lock);
+    t->fired = true;
+    t->waker.Wake();
+  }
+  cq_waiters_.WakeAll();
+
+  // The guest may consume completions without telling us, so generate a
+  // fresh edge whenever the ring goes from empty to non-empty.
+  if (!poll_) return;
+  if (was_empty) poll_->Clear(kPollIn);
+  poll_->Set(kPollIn);
+}
+
+bool Ring::PushCQELocked(uint64_t user_data, int32_t res) {
+  assert(lock_.IsHeld());
+  const uint32_t tail = hdr_->cq_tail;
+  if (tail - LoadAcquire(hdr_->cq_head) >= cq_entries_) return false;
+  io_uring_cqe &cqe = cqes_[tail & (cq_entries_ - 1)];
+  cqe.user_data = user_data;
+  cqe.res = res;
+  cqe.flags = 0;
+  StoreRelease(hdr_->cq_tail, tail + 1);
+  return true;
+}
+
+void Ring::FlushOverflowLocked() {
+  assert(lock_.IsHeld());
+  if (overflow_.empty()) return;
+  while (!overflow_.empty()) {
+    const io_uring_cqe &cqe = overflow_.front();
+    if (!PushCQELocked(cqe.user_data, cqe.res)) return;
+    overflow_.pop_front();
+  }
+  ClearSQFlag(IORING_SQ_CQ_OVERFLOW);
+}
+
+void Ring::PollerMain() {
+  Time last_work = Time::Now();
+  while (true) {
+    {
+      std::shared_ptr<Process> proc = proc_.lock();
+      if (!proc || read_once(dead_)) return;
+      if (uint32_t n = SQPending()) {
+        Submit(*proc, n);
+        last_work = Time::Now();
+        continue;
+      }
+    }
+
+    if (Duration::Since(last_work) < sq_idle_) {
+      rt::Yield();
+      continue;
+    }
+
+    // Idle for too long; sleep until io_uring_enter(IORING_ENTER_SQ_WAKEUP).
+    rt::SpinGuard g(lock_);
+    SetSQFlag(IORING_SQ_NEED_WAKEUP);
+    // Pairs with the guest's barrier between updating the tail and checking
+    // for IORING_SQ_NEED_WAKEUP.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (!SQPending())
+      rt::Wait(lock_, poller_, [this] { return poller_kick_ || dead_; });
+    poller_kick_ = false;
+    ClearSQFlag(IORING_SQ_NEED_WAKEUP);
+    last_work = Time::Now();
+  }
+}
+
+void Ring::WakePoller() {
+  rt::SpinGuard g(lock_);
+  poller_kick_ = true;
+  poller_.Wake();
+}
+
+void Ring::Shutdown() {
+  rt::SpinGuard g(lock_);
+  dead_ = true;
+  poll_ = nullptr;
+  for (auto &[user_data, r] : pending_) {
+    rt::SpinGuard rg(r->lock);
+    if (r->started) continue;
+    r->canceled = true;
+    r->waker.Wake();
+  }
+  drain_waker_.Wake();
+  poller_.Wake();
+  eventfd_.reset();
+  files_.clear();
+  buffers_.clear();
+}
+
+long Ring::Register(unsigned int opcode, void *arg, unsigned int nr_args) {
+  switch (opcode) {
+    case IORING_REGISTER_PROBE:
+      return RegisterProbe(static_cast<io_uring_probe *>(arg), nr_args);
+    case IORING_REGISTER_FILES:
+      return RegisterFiles(static_cast<const int *>(arg), nr_args);
+    case IORING_REGISTER_EVENTFD:
+    case IORING_REGISTER_EVENTFD_ASYNC:
+      if (nr_args != 1) return -EINVAL;
+      return RegisterEventFd(*static_cast<const int *>(arg));
+    case IORING_REGISTER_BUFFERS: {
+      if (!nr_args || nr_args > kMaxFixedBuffers) return -EINVAL;
+      const auto *iov = static_cast<const iovec *>(arg);
+      rt::SpinGuard g(lock_);
+      if (!buffers_.empty()) return -EBUSY;
+      buffers_.assign(iov, iov + nr_args);
+      return 0;
+    }
+    default:
+      break;
+  }
+
+  if (arg || nr_args) return -EINVAL;
+  rt::SpinGuard g(lock_);
+  switch (opcode) {
+    case IORING_UNREGISTER_FILES:
+      if (files_.empty()) return -ENXIO;
+      files_.clear();
+      return 0;
+    case IORING_UNREGISTER_EVENTFD:
+      if (!eventfd_) return -ENXIO;
+      eventfd_.reset();
+      return 0;
+    case IORING_UNREGISTER_BUFFERS:
+      if (buffers_.empty()) return -ENXIO;
+      buffers_.clear();
+      return 0;
+    default:
+      return -EINVAL;
+  }
+}
+
+long Ring::RegisterProbe(io_uring_probe *probe, unsigned int nr_args) {
+  nr_args = std::min<unsigned int>(nr_args, IORING_OP_LAST);
+  std::memset(probe, 0, sizeof(*probe) + nr_args * sizeof(io_uring_probe_op));
+  probe->last_op = IORING_OP_LAST - 1;
+  probe->ops_len = nr_args;
+  for (unsigned int i = 0; i < nr_args; i++) {
+    probe->ops[i].op = i;
+    if (OpSupported(i)) probe->ops[i].flags = IO_URING_OP_SUPPORTED;
+  }
+  return 0;
+}
+
+long Ring::RegisterFiles(const int *fds, unsigned int nr_args) {
+  if (!nr_args || nr_args > kMaxFixedFiles) return -EINVAL;
+  FileTable &ftbl = myproc().get_file_table();
+  std::vector<std::shared_ptr<File>> files(nr_args);
+  for (unsigned int i = 0; i < nr_args; i++) {
+    // Negative descriptors leave a slot empty.
+    if (fds[i] < 0) continue;
+    files[i] = ftbl.Dup(fds[i]);
+    if (!files[i]) return -EBADF;
+    // Rings can't hold references to each other.
+    if (most_derived_cast<IoUringFile>(files[i].get())) return -EBADF;
+  }
+
+  rt::SpinGuard g(lock_);
+  if (!files_.empty()) return -EBUSY;
+  files_ = std::move(files);
+  return 0;
+}
+
+long Ring::RegisterEventFd(int fd) {
+  std::shared_ptr<File> f = myproc().get_file_table().Dup(fd);
+  if (!f || most_derived_cast<IoUringFile>(f.get())) return -EBADF;
+  rt::SpinGuard g(lock_);
+  if (eventfd_) return -EBUSY;
+  eventfd_ = std::move(f);
+  return 0;
+}
+
+Status<std::reference_wrapper<Ring>> FDToRing(int fd) {
+  File *f = myproc().get_file_table().Get(fd);
+  if (unlikely(!f)) return MakeError(EBADF);
+  auto *uf = most_derived_cast<IoUringFile>(f);
+  if (unlikely(!uf)) return MakeError(EOPNOTSUPP);
+  return std::ref(uf->get_ring());
+}
+
+}  // namespace
+
+long usys_io_uring_setup(uint32_t entries, struct io_uring_params *p) {
+  Process &proc = myproc();
+  Status<std::shared_ptr<Ring>> ring = Ring::Create(entries, *p, proc);
+  if (!ring) return MakeCError(ring);
+  auto f = std::make_shared<IoUringFile>(std::move(*ring));
+  return proc.get_file_table().Insert(std::move(f), true);
+}
+
+long usys_io_uring_enter(unsigned int fd, unsigned int to_submit,
+                         unsigned int min_complete, unsigned int flags,
+                         const void *argp, size_t argsz) {
+  Status<std::reference_wrapper<Ring>> ring = FDToRing(fd);
+  if (unlikely(!ring)) return MakeCError(ring);
+  return ring->get().Enter(to_submit, min_complete, flags, argp, argsz);
+}
+
+long usys_io_uring_register(unsigned int fd, unsigned int opcode, void *arg,
+                            unsigned int nr_args) {
+  Status<std::reference_wrapper<Ring>> ring = FDToRing(fd);
+  if (unlikely(!ring)) return MakeCError(ring);
+  return ring->get().Register(opcode, arg, nr_args);
+}
+
+}  // namespace junction
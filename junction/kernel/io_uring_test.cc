@@ -0,0 +1,353 @@
+extern "C" {
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+}
+
+#include <gtest/gtest.h>
+
+#include <cstring>
+#include <vector>
+
+namespace {
+
+// A minimal liburing-style wrapper around the raw system calls.
+class TestRing {
+ public:
+  explicit TestRing(unsigned int entries, unsigned int flags = 0) {
+    io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    p.flags = flags;
+    p.sq_thread_idle = 10;
+    fd_ = syscall(SYS_io_uring_setup, entries, &p);
+    if (fd_ < 0) return;
+
+    sq_len_ = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+    cq_len_ = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+    sqes_len_ = p.sq_entries * sizeof(io_uring_sqe);
+    sq_ = Map(sq_len_, IORING_OFF_SQ_RING);
+    cq_ = Map(cq_len_, IORING_OFF_CQ_RING);
+    sqes_ = static_cast<io_uring_sqe *>(Map(sqes_len_, IORING_OFF_SQES));
+
+    sq_head_ = At<unsigned int>(sq_, p.sq_off.head);
+    sq_tail_ = At<unsigned int>(sq_, p.sq_off.tail);
+    sq_mask_ = *At<unsigned int>(sq_, p.sq_off.ring_mask);
+    sq_flags_ = At<unsigned int>(sq_, p.sq_off.flags);
+    sq_array_ = At<unsigned int>(sq_, p.sq_off.array);
+    cq_head_ = At<unsigned int>(cq_, p.cq_off.head);
+    cq_tail_ = At<unsigned int>(cq_, p.cq_off.tail);
+    cq_mask_ = *At<unsigned int>(cq_, p.cq_off.ring_mask);
+    cqes_ = At<io_uring_cqe>(cq_, p.cq_off.cqes);
+    sqpoll_ = flags & IORING_SETUP_SQPOLL;
+  }
+
+  ~TestRing() {
+    if (fd_ < 0) return;
+    munmap(sq_, sq_len_);
+    munmap(cq_, cq_len_);
+    munmap(sqes_, sqes_len_);
+    close(fd_);
+  }
+
+  [[nodiscard]] int fd() const { return fd_; }
+
+  // Returns a cleared SQE at the tail of the submission queue.
+  io_uring_sqe *GetSQE() {
+    unsigned int tail = *sq_tail_ + pending_;
+    io_uring_sqe *sqe = &sqes_[tail & sq_mask_];
+    memset(sqe, 0, sizeof(*sqe));
+    sq_array_[tail & sq_mask_] = tail & sq_mask_;
+    pending_++;
+    return sqe;
+  }
+
+  // Publishes queued SQEs and waits for @wait completions.
+  int Submit(unsigned int wait = 0) {
+    unsigned int n = pending_;
+    pending_ = 0;
+    Store(sq_tail_, *sq_tail_ + n);
+    unsigned int flags = wait ? IORING_ENTER_GETEVENTS : 0;
+    if (sqpoll_) {
+      if (Load(sq_flags_) & IORING_SQ_NEED_WAKEUP)
+        flags |= IORING_ENTER_SQ_WAKEUP;
+      if (!flags) return n;
+      int ret = syscall(SYS_io_uring_enter, fd_, 0, wait, flags, nullptr, 0);
+      return ret < 0 ? ret : n;
+    }
+    return syscall(SYS_io_uring_enter, fd_, n, wait, flags, nullptr, 0);
+  }
+
+  // Removes the next completion; waits for it if needed.
+  io_uring_cqe Reap() {
+    while (Load(cq_head_) == Load(cq_tail_))
+      syscall(SYS_io_uring_enter, fd_, 0, 1, IORING_ENTER_GETEVENTS, nullptr,
+              0);
+    unsigned int head = *cq_head_;
+    io_uring_cqe cqe = cqes_[head & cq_mask_];
+    Store(cq_head_, head + 1);
+    return cqe;
+  }
+
+  [[nodiscard]] bool CQEmpty() const {
+    return Load(cq_head_) == Load(cq_tail_);
+  }
+
+ private:
+  void *Map(size_t len, off_t off) {
+    return mmap(nullptr, len, PROT_READ | PROT_WRITE,
+                MAP_SHARED | MAP_POPULATE, fd_, off);
+  }
+
+  template <typename T>
+  static T *At(void *base, size_t off) {
+    return reinterpret_cast<T *>(static_cast<char *>(base) + off);
+  }
+
+  static unsigned int Load(const unsigned int *p) {
+    return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+  }
+  static void Store(unsigned int *p, unsigned int v) {
+    __atomic_store_n(p, v, __ATOMIC_RELEASE);
+  }
+
+  int fd_;
+  bool sqpoll_;
+  unsigned int pending_{0};
+  size_t sq_len_, cq_len_, sqes_len_;
+  void *sq_, *cq_;
+  io_uring_sqe *sqes_;
+  unsigned int *sq_head_, *sq_tail_, *sq_flags_, *sq_array_;
+  unsigned int *cq_head_, *cq_tail_;
+  unsigned int sq_mask_, cq_mask_;
+  io_uring_cqe *cqes_;
+};
+
+}  // namespace
+
+class IoUringTest : public ::testing::Test {};
+
+TEST_F(IoUringTest, Probe) {
+  TestRing ring(8);
+  ASSERT_GE(ring.fd(), 0);
+
+  size_t len = sizeof(io_uring_probe) + 256 * sizeof(io_uring_probe_op);
+  std::vector<std::byte> buf(len);
+  auto *probe = reinterpret_cast<io_uring_probe *>(buf.data());
+  ASSERT_EQ(syscall(SYS_io_uring_register, ring.fd(), IORING_REGISTER_PROBE,
+                    probe, 256),
+            0);
+  ASSERT_GT(probe->ops_len, IORING_OP_RECV);
+  for (int op : {IORING_OP_NOP, IORING_OP_READ, IORING_OP_WRITE,
+                 IORING_OP_POLL_ADD, IORING_OP_TIMEOUT})
+    EXPECT_TRUE(probe->ops[op].flags & IO_URING_OP_SUPPORTED);
+}
+
+TEST_F(IoUringTest, ReadWrite) {
+  TestRing ring(8);
+  ASSERT_GE(ring.fd(), 0);
+  int fds[2];
+  ASSERT_EQ(pipe(fds), 0);
+
+  io_uring_sqe *sqe = ring.GetSQE();
+  sqe->opcode = IORING_OP_NOP;
+  sqe->user_data = 1;
+  ASSERT_EQ(ring.Submit(1), 1);
+  io_uring_cqe cqe = ring.Reap();
+  EXPECT_EQ(cqe.user_data, 1);
+  EXPECT_EQ(cqe.res, 0);
+
+  // Queue the read before the data arrives.
+  char in[16] = {};
+  sqe = ring.GetSQE();
+  sqe->opcode = IORING_OP_READ;
+  sqe->fd = fds[0];
+  sqe->addr = reinterpret_cast<uint64_t>(in);
+  sqe->len = sizeof(in);
+  sqe->off = -1;
+  sqe->user_data = 2;
+  ASSERT_EQ(ring.Submit(), 1);
+  EXPECT_TRUE(ring.CQEmpty());
+
+  const char msg[] = "hello";
+  sqe = ring.GetSQE();
+  sqe->opcode = IORING_OP_WRITE;
+  sqe->fd = fds[1];
+  sqe->addr = reinterpret_cast<uint64_t>(msg);
+  sqe->len = sizeof(msg);
+  sqe->off = -1;
+  sqe->user_data = 3;
+  ASSERT_EQ(ring.Submit(), 1);
+
+  int seen = 0;
+  for (int i = 0; i < 2; i++) {
+    cqe = ring.Reap();
+    EXPECT_EQ(cqe.res, static_cast<int>(sizeof(msg)));
+    seen |= 1 << cqe.user_data;
+  }
+  EXPECT_EQ(seen, (1 << 2) | (1 << 3));
+  EXPECT_STREQ(in, msg);
+
+  close(fds[0]);
+  close(fds[1]);
+}
+
+TEST_F(IoUringTest, PollCancel) {
+  TestRing ring(8);
+  ASSERT_GE(ring.fd(), 0);
+  int fds[2];
+  ASSERT_EQ(pipe(fds), 0);
+
+  io_uring_sqe *sqe = ring.GetSQE();
+  sqe->opcode = IORING_OP_POLL_ADD;
+  sqe->fd = fds[0];
+  sqe->poll32_events = POLLIN;
+  sqe->user_data = 1;
+  ASSERT_EQ(ring.Submit(), 1);
+  EXPECT_TRUE(ring.CQEmpty());
+
+  sqe = ring.GetSQE();
+  sqe->opcode = IORING_OP_ASYNC_CANCEL;
+  sqe->addr = 1;
+  sqe->user_data = 2;
+  ASSERT_EQ(ring.Submit(2), 1);
+
+  for (int i = 0; i < 2; i++) {
+    io_uring_cqe cqe = ring.Reap();
+    if (cqe.user_data == 1)
+      EXPECT_EQ(cqe.res, -ECANCELED);
+    else
+      EXPECT_EQ(cqe.res, 0);
+  }
+
+  close(fds[0]);
+  close(fds[1]);
+}
+
+TEST_F(IoUringTest, PollEventFD) {
+  TestRing ring(8);
+  ASSERT_GE(ring.fd(), 0);
+  int efd = eventfd(0, 0);
+  ASSERT_GE(efd, 0);
+
+  // An empty eventfd is not readable, so the poll waits for a write.
+  io_uring_sqe *sqe = ring.GetSQE();
+  sqe->opcode = IORING_OP_POLL_ADD;
+  sqe->fd = efd;
+  sqe->poll32_events = POLLIN;
+  sqe->user_data = 3;
+  ASSERT_EQ(ring.Submit(), 1);
+  EXPECT_TRUE(ring.CQEmpty());
+
+  uint64_t val = 1;
+  ASSERT_EQ(write(efd, &val, sizeof(val)), sizeof(val));
+  io_uring_cqe cqe = ring.Reap();
+  EXPECT_EQ(cqe.user_data, 3);
+  EXPECT_EQ(cqe.res, POLLIN);
+
+  close(efd);
+}
+
+TEST_F(IoUringTest, SendUnixCreds) {
+  TestRing ring(8);
+  ASSERT_GE(ring.fd(), 0);
+  int fds[2];
+  ASSERT_EQ(socketpair(AF_UNIX, SOCK_DGRAM, 0, fds), 0);
+  int on = 1;
+  ASSERT_EQ(setsockopt(fds[1], SOL_SOCKET, SO_PASSCRED, &on, sizeof(on)), 0);
+
+  // An async send runs off the submitting thread, but still carries the
+  // submitter's credentials.
+  char msg[] = "hi";
+  io_uring_sqe *sqe = ring.GetSQE();
+  sqe->opcode = IORING_OP_SEND;
+  sqe->fd = fds[0];
+  sqe->addr = reinterpret_cast<uint64_t>(msg);
+  sqe->len = sizeof(msg);
+  sqe->flags = IOSQE_ASYNC;
+  sqe->user_data = 4;
+  ASSERT_EQ(ring.Submit(1), 1);
+  io_uring_cqe cqe = ring.Reap();
+  EXPECT_EQ(cqe.user_data, 4);
+  EXPECT_EQ(cqe.res, sizeof(msg));
+
+  char buf[sizeof(msg)];
+  alignas(cmsghdr) char control[CMSG_SPACE(sizeof(ucred))];
+  iovec iov = {buf, sizeof(buf)};
+  msghdr mh{};
+  mh.msg_iov = &iov;
+  mh.msg_iovlen = 1;
+  mh.msg_control = control;
+  mh.msg_controllen = sizeof(control);
+  ASSERT_EQ(recvmsg(fds[1], &mh, 0), sizeof(msg));
+  cmsghdr *cm = CMSG_FIRSTHDR(&mh);
+  ASSERT_NE(cm, nullptr);
+  ASSERT_EQ(cm->cmsg_type, SCM_CREDENTIALS);
+  ucred creds;
+  memcpy(&creds, CMSG_DATA(cm), sizeof(creds));
+  EXPECT_EQ(creds.pid, getpid());
+
+  close(fds[0]);
+  close(fds[1]);
+}
+
+TEST_F(IoUringTest, Timeout) {
+  TestRing ring(8);
+  ASSERT_GE(ring.fd(), 0);
+
+  __kernel_timespec ts = {0, 10 * 1000 * 1000};
+  io_uring_sqe *sqe = ring.GetSQE();
+  sqe->opcode = IORING_OP_TIMEOUT;
+  sqe->addr = reinterpret_cast<uint64_t>(&ts);
+  sqe->len = 1;
+  sqe->user_data = 7;
+  ASSERT_EQ(ring.Submit(1), 1);
+  io_uring_cqe cqe = ring.Reap();
+  EXPECT_EQ(cqe.user_data, 7);
+  EXPECT_EQ(cqe.res, -ETIME);
+}
+
+TEST_F(IoUringTest, LinkBreaksOnError) {
+  TestRing ring(8);
+  ASSERT_GE(ring.fd(), 0);
+
+  char buf[8];
+  io_uring_sqe *sqe = ring.GetSQE();
+  sqe->opcode = IORING_OP_READ;
+  sqe->fd = -1;
+  sqe->addr = reinterpret_cast<uint64_t>(buf);
+  sqe->len = sizeof(buf);
+  sqe->flags = IOSQE_IO_LINK;
+  sqe->user_data = 1;
+  sqe = ring.GetSQE();
+  sqe->opcode = IORING_OP_NOP;
+  sqe->user_data = 2;
+  ASSERT_EQ(ring.Submit(2), 2);
+
+  io_uring_cqe cqe = ring.Reap();
+  EXPECT_EQ(cqe.user_data, 1);
+  EXPECT_EQ(cqe.res, -EBADF);
+  cqe = ring.Reap();
+  EXPECT_EQ(cqe.user_data, 2);
+  EXPECT_EQ(cqe.res, -ECANCELED);
+}
+
+TEST_F(IoUringTest, SQPoll) {
+  TestRing ring(32, IORING_SETUP_SQPOLL);
+  ASSERT_GE(ring.fd(), 0);
+
+  constexpr int kRounds = 1000;
+  for (int i = 0; i < kRounds; i++) {
+    io_uring_sqe *sqe = ring.GetSQE();
+    sqe->opcode = IORING_OP_NOP;
+    sqe->user_data = i;
+    ASSERT_GE(ring.Submit(), 0);
+    io_uring_cqe cqe = ring.Reap();
+    ASSERT_EQ(cqe.user_data, static_cast<uint64_t>(i));
+    ASSERT_EQ(cqe.res, 0);
+  }
+}
@@ -0,0 +1,65 @@
+// ksys.cc - KernelFile operations that may be offloaded to the host I/O ring
+
+#include "junction/kernel/ksys.h"
+
+#include "junction/kernel/hostio.h"
+
+namespace junction {
+
+Status<KernelFile> KernelFile::OpenAt(int fd, std::string_view path, int flags,
+                                      FileMode fmode, mode_t mode) {
+  int ret = hostio_openat(fd, path.data(), flags | ToFlags(fmode), mode);
+  if (ret < 0) return MakeError(-ret);
+  return KernelFile(ret);
+}
+
+Status<struct stat> KernelFile::StatAt(std::string_view path) {
+  struct stat buf;
+  int ret = hostio_newfstatat(fd_, path.data(), &buf, AT_SYMLINK_NOFOLLOW);
+  if (ret < 0) return MakeError(-ret);
+  return buf;
+}
+
+Status<void> KernelFile::UnlinkAt(std::string_view path, int flags) {
+  if constexpr (!linux_fs_writeable()) return MakeError(EACCES);
+  int ret = hostio_unlinkat(fd_, path.data(), flags);
+  if (ret < 0) return MakeError(-ret);
+  return {};
+}
+
+Status<void> KernelFile::MkDirAt(std::string_view path, mode_t mode) {
+  if constexpr (!linux_fs_writeable()) return MakeError(EACCES);
+  int ret = hostio_mkdirat(fd_, path.data(), mode);
+  if (ret < 0) return MakeError(-ret);
+  return {};
+}
+
+Status<void> KernelFile::SymLinkAt(std::string_view target,
+                                   std::string_view path) {
+  if constexpr (!linux_fs_writeable()) return MakeError(EACCES);
+  int ret = hostio_symlinkat(target.data(), fd_, path.data());
+  if (ret < 0) return MakeError(-ret);
+  return {};
+}
+
+Status<void> KernelFile::RenameAt(KernelFile &olddir, std::string_view oldpath,
+                                  KernelFile &newdir, std::string_view newpath,
+                                  bool replace) {
+  if constexpr (!linux_fs_writeable()) return MakeError(EACCES);
+  int flags = replace ? 0 : RENAME_NOREPLACE;
+  int ret = hostio_renameat2(olddir.fd_, oldpath.data(), newdir.fd_,
+                             newpath.data(), flags);
+  if (ret < 0) return MakeError(-ret);
+  return {};
+}
+
+Status<void> KernelFile::LinkAt(KernelFile &olddir, std::string_view oldpath,
+                                KernelFile &newdir, std::string_view newpath) {
+  if constexpr (!linux_fs_writeable()) return MakeError(EACCES);
+  int ret = hostio_linkat(olddir.fd_, oldpath.data(), newdir.fd_,
+                          newpath.data(), 0);
+  if (ret < 0) return MakeError(-ret);
+  return {};
+}
+
+}  // namespace junction
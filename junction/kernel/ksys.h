@@ -16,6 +16,8 @@ extern "C" {
 #include "junction/base/io.h"
 #include "junction/fs/file.h"
 
+struct io_uring_params;
+
 namespace junction {
 
 #ifdef WRITEABLE_LINUX_FS
@@ -39,10 +41,25 @@ intptr_t ksys_mmap(void *addr, size_t length, int prot, int flags, int fd,
 int ksys_munmap(void *addr, size_t length);
 int ksys_mprotect(void *addr, size_t len, int prot);
 long ksys_madvise(void *addr, size_t length, int advice);
+long ksys_mincore(void *addr, size_t length, unsigned char *vec);
+intptr_t ksys_mremap(void *old_addr, size_t old_length, size_t new_length,
+                     int flags, void *new_addr);
 int ksys_openat(int fd, const char *pathname, int flags, mode_t mode);
 int ksys_close(int fd);
 ssize_t ksys_readv(int fd, const struct iovec *iov, int iovcnt);
 ssize_t ksys_pread(int fd, void *buf, size_t count, off_t offset);
+int ksys_ftruncate(int fd, off_t length);
+int ksys_fallocate(int fd, int mode, off_t offset, off_t len);
+int ksys_fsync(int fd);
+int ksys_fdatasync(int fd);
+int ksys_memfd_create(const char *name, unsigned int flags);
+int ksys_fcntl(int fd, unsigned int cmd, unsigned long arg);
+int ksys_io_uring_setup(unsigned int entries, struct io_uring_params *p);
+int ksys_io_uring_enter(int fd, unsigned int to_submit,
+                        unsigned int min_complete, unsigned int flags,
+                        const void *arg, size_t argsz);
+int ksys_io_uring_register(int fd, unsigned int opcode, void *arg,
+                           unsigned int nr_args);
 int ksys_tgkill(pid_t tgid, pid_t tid, int sig);
 ssize_t ksys_readlinkat(int dirfd, const char *pathname, char *buf,
                         size_t bufsz);
@@ -137,15 +154,17 @@ class KernelFile : public VectoredWriter {
   }
 
   static Status<KernelFile> OpenAt(int fd, std::string_view path, int flags,
-                                   FileMode fmode, mode_t mode = 0) {
-    int ret = ksys_openat(fd, path.data(), flags | ToFlags(fmode), mode);
-    if (ret < 0) return MakeError(-ret);
-    return KernelFile(ret);
-  }
+                                   FileMode fmode, mode_t mode = 0);
 
   Status<KernelFile> OpenAt(std::string_view path, int flags, FileMode fmode,
                             mode_t mode = 0) {
-    int ret = ksys_openat(fd_, path.data(), flags | ToFlags(fmode), mode);
+    return OpenAt(fd_, path, flags, fmode, mode);
+  }
+
+  // MemFDCreate creates an anonymous file that lives in memory.
+  static Status<KernelFile> MemFDCreate(std::string_view name,
+                                        unsigned int flags) {
+    int ret = ksys_memfd_create(name.data(), flags);
     if (ret < 0) return MakeError(-ret);
     return KernelFile(ret);
   }
@@ -222,19 +241,9 @@ class KernelFile : public VectoredWriter {
     return buf;
   }
 
-  inline Status<struct stat> StatAt(std::string_view path) {
-    struct stat buf;
-    int ret = ksys_newfstatat(fd_, path.data(), &buf, AT_SYMLINK_NOFOLLOW);
-    if (ret < 0) return MakeError(-ret);
-    return buf;
-  }
+  Status<struct stat> StatAt(std::string_view path);
 
-  Status<void> UnlinkAt(std::string_view path, int flags = 0) {
-    if constexpr (!linux_fs_writeable()) return MakeError(EACCES);
-    int ret = ksyscall(__NR_unlinkat, fd_, path.data(), flags);
-    if (ret < 0) return MakeError(-ret);
-    return {};
-  }
+  Status<void> UnlinkAt(std::string_view path, int flags = 0);
 
   Status<std::string_view> ReadLinkAt(std::string_view path,
                                       std::span<char> buf) {
@@ -243,36 +252,48 @@ class KernelFile : public VectoredWriter {
     return {{buf.data(), static_cast<size_t>(wret)}};
   }
 
-  Status<void> MkDirAt(std::string_view path, mode_t mode) {
-    if constexpr (!linux_fs_writeable()) return MakeError(EACCES);
-    int ret = ksyscall(__NR_mkdirat, fd_, path.data(), mode);
+  Status<void> MkDirAt(std::string_view path, mode_t mode);
+
+  Status<void> SymLinkAt(std::string_view target, std::string_view path);
+
+  static Status<void> RenameAt(KernelFile &olddir, std::string_view oldpath,
+                               KernelFile &newdir, std::string_view newpath,
+                               bool replace);
+
+  static Status<void> LinkAt(KernelFile &olddir, std::string_view oldpath,
+                             KernelFile &newdir, std::string_view newpath);
+
+  // Change the size of the file.
+  Status<void> Truncate(off_t length) {
+    int ret = ksys_ftruncate(fd_, length);
     if (ret < 0) return MakeError(-ret);
     return {};
   }
 
-  Status<void> SymLinkAt(std::string_view target, std::string_view path) {
-    if constexpr (!linux_fs_writeable()) return MakeError(EACCES);
-    int ret = ksyscall(__NR_symlinkat, target.data(), fd_, path.data());
+  // Allocate or deallocate space in the file (see fallocate(2)).
+  Status<void> Allocate(int mode, off_t offset, off_t len) {
+    int ret = ksys_fallocate(fd_, mode, offset, len);
     if (ret < 0) return MakeError(-ret);
     return {};
   }
 
-  static Status<void> RenameAt(KernelFile &olddir, std::string_view oldpath,
-                               KernelFile &newdir, std::string_view newpath,
-                               bool replace) {
-    if constexpr (!linux_fs_writeable()) return MakeError(EACCES);
-    int flags = replace ? 0 : RENAME_NOREPLACE;
-    int ret = ksyscall(__NR_renameat2, olddir.fd_, oldpath.data(), newdir.fd_,
-                       newpath.data(), flags);
+  // Add seals to a memfd (see F_ADD_SEALS in fcntl(2)).
+  Status<void> AddSeals(unsigned int seals) {
+    int ret = ksys_fcntl(fd_, F_ADD_SEALS, seals);
     if (ret < 0) return MakeError(-ret);
     return {};
   }
 
-  static Status<void> LinkAt(KernelFile &olddir, std::string_view oldpath,
-                             KernelFile &newdir, std::string_view newpath) {
-    if constexpr (!linux_fs_writeable()) return MakeError(EACCES);
-    int ret = ksyscall(__NR_linkat, olddir.fd_, oldpath.data(), newdir.fd_,
-                       newpath.data(), 0);
+  // Flush written data and metadata to the storage device.
+  Status<void> Sync() {
+    int ret = ksys_fsync(fd_);
+    if (ret < 0) return MakeError(-ret);
+    return {};
+  }
+
+  // Flush written data to the storage device.
+  Status<void> DataSync() {
+    int ret = ksys_fdatasync(fd_);
     if (ret < 0) return MakeError(-ret);
     return {};
   }
@@ -328,6 +349,14 @@ inline Status<void> KernelMAdvise(void *addr, size_t length, int hint) {
   return {};
 }
 
+// Query which pages of a range are resident (one byte per page in @vec).
+inline Status<void> KernelMInCore(void *addr, size_t length,
+                                  unsigned char *vec) {
+  long ret = ksys_mincore(addr, length, vec);
+  if (ret < 0) return MakeError(-ret);
+  return {};
+}
+
 // Get file status.
 inline Status<void> KernelStat(const char *path, struct stat *buf) {
   int ret = ksys_newfstatat(AT_FDCWD, path, buf, 0);
@@ -395,9 +395,9 @@ Status<uintptr_t> MemoryMap::SetBreak(uintptr_t brk_addr) {
 
 Status<void *> MemoryMap::MMap(void *addr, size_t len, int prot, int flags,
                                std::shared_ptr<File> f, off_t off) {
-  // the shared modes are currently unsupported
-  if ((flags & MAP_SHARED) != 0) {
-    LOG_ONCE(ERR) << "mm: shared mmap() mappings are unsupported";
+  // shared anonymous mappings are currently unsupported
+  if ((flags & MAP_SHARED) != 0 && (flags & MAP_ANONYMOUS) != 0) {
+    LOG_ONCE(ERR) << "mm: shared anonymous mmap() mappings are unsupported";
     // FIXME(amb): Java requires us to continue here to run
     // return MakeError(EINVAL);
   }
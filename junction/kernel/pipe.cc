@@ -2,20 +2,15 @@
 //
 // TODO(amb): Support the "packet mode" enabled by O_DIRECT?
 
-extern "C" {
-#include <net/ip.h>
-#include <sys/socket.h>
-}
-
 #include <atomic>
 #include <memory>
 
 #include "junction/base/byte_channel.h"
+#include "junction/base/compiler.h"
 #include "junction/fs/file.h"
 #include "junction/kernel/proc.h"
 #include "junction/kernel/usys.h"
 #include "junction/limits.h"
-#include "junction/net/socket.h"
 #include "junction/snapshot/cereal.h"
 
 namespace junction {
@@ -26,7 +21,6 @@ class Pipe {
  public:
   friend class PipeReaderFile;
   friend class PipeWriterFile;
-  friend class PipeSocketFile;
 
   explicit Pipe(size_t size) noexcept : chan_(size) {}
   ~Pipe() = default;
@@ -34,6 +28,12 @@ class Pipe {
   Status<size_t> Read(std::span<std::byte> buf, bool nonblocking,
                       bool peek = false);
   Status<size_t> Write(std::span<const std::byte> buf, bool nonblocking);
+  // Moves data from the pipe straight into @out (without a bounce buffer).
+  Status<size_t> ReadTo(File &out, off_t *out_off, size_t len,
+                        bool nonblocking, bool peek = false);
+  // Fills the pipe straight from @in (without a bounce buffer).
+  Status<size_t> WriteFrom(File &in, off_t *in_off, size_t len,
+                           bool nonblocking);
   void CloseReader();
   void CloseWriter();
 
@@ -77,6 +77,12 @@ class Pipe {
   [[nodiscard]] bool is_full() const { return chan_.is_full(); }
 
  private:
+  // Helpers that block until @chan_op can make progress on the channel.
+  template <typename F>
+  Status<size_t> DoRead(bool nonblocking, F chan_op);
+  template <typename F>
+  Status<size_t> DoWrite(bool nonblocking, F chan_op);
+
   bool reader_is_closed() const {
     return reader_closed_.load(std::memory_order_acquire);
   }
@@ -94,12 +100,12 @@ class Pipe {
   PollSource *write_poll_{nullptr};
 };
 
-Status<size_t> Pipe::Read(std::span<std::byte> buf, bool nonblocking,
-                          bool peek) {
+template <typename F>
+Status<size_t> Pipe::DoRead(bool nonblocking, F chan_op) {
   size_t n;
   while (true) {
     // Read from the channel (without locking).
-    Status<size_t> ret = chan_.Read(buf, peek);
+    Status<size_t> ret = chan_op();
     if (ret) {
       n = *ret;
       break;
@@ -134,11 +140,12 @@ Status<size_t> Pipe::Read(std::span<std::byte> buf, bool nonblocking,
   return n;
 }
 
-Status<size_t> Pipe::Write(std::span<const std::byte> buf, bool nonblocking) {
+template <typename F>
+Status<size_t> Pipe::DoWrite(bool nonblocking, F chan_op) {
   size_t n;
   while (true) {
     // Write to the channel (without locking).
-    Status<size_t> ret = chan_.Write(buf);
+    Status<size_t> ret = chan_op();
     if (ret) {
       n = *ret;
       break;
@@ -173,6 +180,45 @@ Status<size_t> Pipe::Write(std::span<const std::byte> buf, bool nonblocking) {
   return n;
 }
 
+Status<size_t> Pipe::Read(std::span<std::byte> buf, bool nonblocking,
+                          bool peek) {
+  return DoRead(nonblocking, [&] { return chan_.Read(buf, peek); });
+}
+
+Status<size_t> Pipe::Write(std::span<const std::byte> buf, bool nonblocking) {
+  return DoWrite(nonblocking, [&] { return chan_.Write(buf); });
+}
+
+Status<size_t> Pipe::ReadTo(File &out, off_t *out_off, size_t len,
+                            bool nonblocking, bool peek) {
+  // Errors from @out are kept aside, since the channel only understands EAGAIN.
+  Status<size_t> out_ret(0);
+  Status<size_t> ret = DoRead(nonblocking, [&] {
+    return chan_.ReadFn(
+        len,
+        [&](std::span<const iovec> iov) -> size_t {
+          out_ret = out.Writev(iov, out_off);
+          return out_ret ? *out_ret : 0;
+        },
+        peek);
+  });
+  if (!out_ret) return MakeError(out_ret);
+  return ret;
+}
+
+Status<size_t> Pipe::WriteFrom(File &in, off_t *in_off, size_t len,
+                               bool nonblocking) {
+  Status<size_t> in_ret(0);
+  Status<size_t> ret = DoWrite(nonblocking, [&] {
+    return chan_.WriteFn(len, [&](std::span<iovec> iov) -> size_t {
+      in_ret = in.Readv(iov, in_off);
+      return in_ret ? *in_ret : 0;
+    });
+  });
+  if (!in_ret) return MakeError(in_ret);
+  return ret;
+}
+
 void Pipe::CloseReader() {
   rt::SpinGuard guard(lock_);
   reader_closed_.store(true, std::memory_order_release);
@@ -194,17 +240,34 @@ void Pipe::CloseWriter() {
 class PipeReaderFile : public File {
  public:
   PipeReaderFile(std::shared_ptr<Pipe> pipe, int flags) noexcept
-      : File(FileType::kNormal, flags & kFlagNonblock, FileMode::kRead),
+      : File(FileType::kPipe, flags & kFlagNonblock, FileMode::kRead),
         pipe_(std::move(pipe)) {
     pipe_->AttachReadPoll(&get_poll_source());
   }
   ~PipeReaderFile() override { pipe_->CloseReader(); }
 
+  [[nodiscard]] bool has_poll_source() const override { return true; }
+
   Status<size_t> Read(std::span<std::byte> buf,
                       [[maybe_unused]] off_t *off) override {
     return pipe_->Read(buf, is_nonblocking());
   }
 
+  Status<size_t> SpliceTo(File &out, [[maybe_unused]] off_t *off,
+                          off_t *out_off, size_t len,
+                          bool nonblocking) override {
+    return pipe_->ReadTo(out, out_off, len, nonblocking || is_nonblocking());
+  }
+
+  // Copies data into @out without consuming it (see tee(2)).
+  Status<size_t> Tee(File &out, size_t len, bool nonblocking) {
+    off_t off = 0;
+    return pipe_->ReadTo(out, &off, len, nonblocking || is_nonblocking(),
+                         true);
+  }
+
+  [[nodiscard]] const Pipe *get_pipe() const { return pipe_.get(); }
+
   Status<void> Stat(struct stat *statbuf) const override {
     // TODO(jf): do we need to fill in more fields?
     memset(statbuf, 0, sizeof(*statbuf));
@@ -235,17 +298,27 @@ class PipeReaderFile : public File {
 class PipeWriterFile : public File {
  public:
   PipeWriterFile(std::shared_ptr<Pipe> pipe, int flags) noexcept
-      : File(FileType::kNormal, flags & kFlagNonblock, FileMode::kWrite),
+      : File(FileType::kPipe, flags & kFlagNonblock, FileMode::kWrite),
         pipe_(std::move(pipe)) {
     pipe_->AttachWritePoll(&get_poll_source());
   }
   ~PipeWriterFile() override { pipe_->CloseWriter(); }
 
+  [[nodiscard]] bool has_poll_source() const override { return true; }
+
   Status<size_t> Write(std::span<const std::byte> buf,
                        [[maybe_unused]] off_t *off) override {
     return pipe_->Write(buf, is_nonblocking());
   }
 
+  Status<size_t> SpliceFrom(File &in, off_t *in_off,
+                            [[maybe_unused]] off_t *off, size_t len,
+                            bool nonblocking) override {
+    return pipe_->WriteFrom(in, in_off, len, nonblocking || is_nonblocking());
+  }
+
+  [[nodiscard]] const Pipe *get_pipe() const { return pipe_.get(); }
+
   Status<void> Stat(struct stat *statbuf) const override {
     memset(statbuf, 0, sizeof(*statbuf));
     statbuf->st_mode = S_IFIFO | S_IWUSR;
@@ -290,96 +363,6 @@ std::pair<int, int> CreatePipe(int flags = 0) {
   return std::make_pair(read_fd, write_fd);
 }
 
-class PipeSocketFile : public Socket {
- public:
-  PipeSocketFile(std::shared_ptr<Pipe> rx, std::shared_ptr<Pipe> tx,
-                 int flags = 0)
-      : Socket(flags), rx_(std::move(rx)), tx_(std::move(tx)) {
-    rx_->AttachReadPoll(&get_poll_source());
-    tx_->AttachWritePoll(&get_poll_source());
-  }
-  ~PipeSocketFile() override {
-    rx_->CloseReader();
-    tx_->CloseWriter();
-  }
-
-  Status<void> Shutdown(int how) override {
-    switch (how) {
-      case SHUT_RD:
-        rx_->CloseReader();
-        break;
-      case SHUT_WR:
-        tx_->CloseWriter();
-        break;
-      case SHUT_RDWR:
-        rx_->CloseReader();
-        tx_->CloseWriter();
-        break;
-      default:
-        return MakeError(EINVAL);
-    }
-    return {};
-  }
-
-  Status<size_t> ReadFrom(std::span<std::byte> buf, netaddr *raddr,
-                          bool peek = false) override {
-    if (raddr) *raddr = {MAKE_IP_ADDR(127, 0, 0, 1), 0};
-    return rx_->Read(buf, is_nonblocking(), peek);
-  }
-
-  Status<size_t> WriteTo(std::span<const std::byte> buf,
-                         const netaddr *raddr) override {
-    return tx_->Write(buf, is_nonblocking());
-  }
-
-  Status<size_t> WritevTo(std::span<const iovec> iov,
-                          const netaddr *raddr) override {
-    off_t off;
-    return File::Writev(iov, &off);
-  }
-
-  Status<size_t> Write(std::span<const std::byte> buf, off_t *off) override {
-    return tx_->Write(buf, is_nonblocking());
-  }
-
- private:
-  friend cereal::access;
-  template <class Archive>
-  void save(Archive &ar) const {
-    ar(rx_, tx_, cereal::base_class<Socket>(this));
-  }
-
-  template <class Archive>
-  static void load_and_construct(Archive &ar,
-                                 cereal::construct<PipeSocketFile> &construct) {
-    std::shared_ptr<Pipe> rx;
-    std::shared_ptr<Pipe> tx;
-    ar(rx, tx);
-    construct(std::move(rx), std::move(tx), 0);
-    ar(cereal::base_class<Socket>(construct.ptr()));
-  }
-
-  std::shared_ptr<Pipe> rx_;
-  std::shared_ptr<Pipe> tx_;
-};
-
-std::pair<int, int> CreatePipeSocket(int flags = 0) {
-  auto p1 = std::make_shared<Pipe>(kPipeSize);
-  auto p2 = std::make_shared<Pipe>(kPipeSize);
-
-  // Create the reader file.
-  auto pipe1 = std::make_shared<PipeSocketFile>(p1, p2, flags);
-  auto pipe2 =
-      std::make_shared<PipeSocketFile>(std::move(p2), std::move(p1), flags);
-
-  // Insert both files into the file table.
-  FileTable &ftbl = myproc().get_file_table();
-  bool cloexec = (flags & kFlagCloseExec) > 0;
-  int fd1 = ftbl.Insert(std::move(pipe1), cloexec);
-  int fd2 = ftbl.Insert(std::move(pipe2), cloexec);
-  return std::make_pair(fd1, fd2);
-}
-
 }  // namespace
 
 long usys_pipe(int pipefd[2]) {
@@ -398,14 +381,36 @@ long usys_pipe2(int pipefd[2], int flags) {
   return 0;
 }
 
-long usys_socketpair(int domain, int type, [[maybe_unused]] int protocol,
-                     int sv[2]) {
-  if (domain != AF_UNIX) return -EAFNOSUPPORT;
-  if ((type & kSockTypeMask) != SOCK_STREAM) return -EINVAL;
-  auto [fd1, fd2] = CreatePipeSocket(type & ~kSockTypeMask);
-  sv[0] = fd1;
-  sv[1] = fd2;
-  return 0;
+ssize_t usys_tee(int fd_in, int fd_out, size_t len, unsigned int flags) {
+  FileTable &ftbl = myproc().get_file_table();
+  File *fin = ftbl.Get(fd_in);
+  File *fout = ftbl.Get(fd_out);
+  if (unlikely(!fin || !fout)) return -EBADF;
+  auto *in = most_derived_cast<PipeReaderFile>(fin);
+  auto *out = most_derived_cast<PipeWriterFile>(fout);
+  if (!in || !out || in->get_pipe() == out->get_pipe()) return -EINVAL;
+  Status<size_t> ret = in->Tee(*out, len, flags & SPLICE_F_NONBLOCK);
+  if (!ret) return MakeCError(ret);
+  return static_cast<ssize_t>(*ret);
+}
+
+ssize_t usys_vmsplice(int fd, const struct iovec *iov, size_t nr_segs,
+                      unsigned int flags) {
+  // Pages can't be gifted to a pipe, so the data is always copied.
+  FileTable &ftbl = myproc().get_file_table();
+  File *f = ftbl.Get(fd);
+  if (unlikely(!f)) return -EBADF;
+  off_t off = 0;
+  Status<size_t> ret;
+  if (auto *w = most_derived_cast<PipeWriterFile>(f)) {
+    ret = w->Writev({iov, nr_segs}, &off);
+  } else if (auto *r = most_derived_cast<PipeReaderFile>(f)) {
+    ret = r->Readv({const_cast<iovec *>(iov), nr_segs}, &off);
+  } else {
+    return -EBADF;
+  }
+  if (!ret) return MakeCError(ret);
+  return static_cast<ssize_t>(*ret);
 }
 
 }  // namespace junction
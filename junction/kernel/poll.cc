@@ -4,15 +4,36 @@
 #undef _FORTIFY_SOURCE
 #define _FORTIFY_SOURCE 0
 
+extern "C" {
+#include <sys/ioctl.h>
+}
+
+#include <climits>
+#include <cstring>
 #include <memory>
+#include <unordered_map>
 
 #include "junction/base/compiler.h"
 #include "junction/base/intrusive_list.h"
 #include "junction/fs/file.h"
+#include "junction/kernel/busy_poll.h"
 #include "junction/kernel/proc.h"
 #include "junction/kernel/usys.h"
+#include "junction/net/socket.h"
 #include "junction/snapshot/cereal.h"
 
+#ifndef EPIOCSPARAMS
+// From Linux 6.9's <linux/eventpoll.h>, for glibc versions that predate it.
+struct epoll_params {
+  uint32_t busy_poll_usecs;
+  uint16_t busy_poll_budget;
+  uint8_t prefer_busy_poll;
+  uint8_t __pad;  // must be zero
+};
+#define EPIOCSPARAMS _IOW(0x8A, 0x01, struct epoll_params)
+#define EPIOCGPARAMS _IOR(0x8A, 0x02, struct epoll_params)
+#endif
+
 namespace junction {
 
 namespace {
@@ -21,35 +42,70 @@ constexpr unsigned int kPollInval = POLLNVAL;
 constexpr unsigned int kEPollEdgeTriggered = EPOLLET;
 constexpr unsigned int kEPollOneShot = EPOLLONESHOT;
 constexpr unsigned int kEPollExclusive = EPOLLEXCLUSIVE;
+constexpr unsigned long kEPollSetParams = EPIOCSPARAMS;
+constexpr unsigned long kEPollGetParams = EPIOCGPARAMS;
 
 int DoPoll(pollfd *fds, nfds_t nfds, std::optional<Duration> timeout,
            std::optional<k_sigset_t> mask = std::nullopt) {
-  int nevents = 0;
-
-  // Check each file; if at least one has events, no need to block.
   FileTable &ftbl = myproc().get_file_table();
-  for (nfds_t i = 0; i < nfds; i++) {
-    File *f = ftbl.Get(fds[i].fd);
-    if (unlikely(!f)) {
-      fds[i].revents = static_cast<short>(kPollInval);
-      nevents++;
-      continue;
-    }
+  // The socket with the largest SO_BUSY_POLL budget, if any. Linux uses the
+  // net.core.busy_poll sysctl for poll() instead.
+  std::shared_ptr<File> busy_file;
+  BusyPoll *busy_poll = nullptr;
+
+  // Check each file; if at least one has events, no need to block. The first
+  // scan also picks the socket to busy poll on; later ones (while spinning)
+  // only recheck readiness.
+  auto scan = [&](bool pick_busy) {
+    int n = 0;
+    for (nfds_t i = 0; i < nfds; i++) {
+      File *f = ftbl.Get(fds[i].fd);
+      if (unlikely(!f)) {
+        fds[i].revents = static_cast<short>(kPollInval);
+        n++;
+        continue;
+      }
 
-    PollSource &src = f->get_poll_source();
-    short events = static_cast<short>(src.get_events());
-    fds[i].revents = events & (fds[i].events | kPollErr | kPollHUp);
-    if (fds[i].revents != 0) nevents++;
-  }
+      if (unlikely(pick_busy && f->get_type() == FileType::kSocket)) {
+        BusyPoll &bp = static_cast<Socket *>(f)->get_busy_poll();
+        if (bp.get_budget() > (busy_poll ? busy_poll->get_budget() : 0)) {
+          busy_file = f->shared_from_this();
+          busy_poll = &bp;
+        }
+      }
+
+      PollSource &src = f->get_poll_source();
+      short events = static_cast<short>(src.get_events());
+      fds[i].revents = events & (fds[i].events | kPollErr | kPollHUp);
+      if (fds[i].revents != 0) n++;
+    }
+    return n;
+  };
+  int nevents = scan(true);
 
   // Fast path: Return without blocking.
   if (nevents > 0 || (timeout && timeout->IsZero())) return nevents;
 
+  // The caller's signal mask applies for the rest of the call.
+  SigMaskGuard sig(mask);
+
+  // Busy poll for a while before blocking.
+  std::optional<Time> start;
+  if (busy_poll) {
+    start = Time::Now();
+    BusyPollCounters &c = myproc().get_busy_poll_counters();
+    if (busy_poll->Spin(*start, [&] { return (nevents = scan(false)) > 0; }, c,
+                        timeout)) {
+      busy_poll->Arrived(*start);
+      return nevents;
+    }
+    if (timeout && timeout->IsZero()) return 0;
+  }
+
   // Otherwise, init state to block on the FDs and timeout.
   rt::Spin lock;
   rt::ThreadWaker waker;
   rt::WakeOnTimeout timed_out(lock, waker, timeout);
-  SigMaskGuard sig(mask);
 
   // Pack args to avoid heap allocations.
   struct {
@@ -109,6 +165,7 @@ int DoPoll(pollfd *fds, nfds_t nfds, std::optional<Duration> timeout,
     // fixed before restarting.
     return timeout ? -EINTR : -ERESTARTSYS;
   }
+  if (start && nevents > 0) busy_poll->Arrived(*start);
   return nevents;
 }
 
@@ -279,14 +336,17 @@ class EPollObserver : public PollObserver {
  public:
   friend EPollFile;
 
-  EPollObserver(EPollFile &epollf, File &f, int32_t watched_events,
-                uint64_t user_data, bool one_shot_triggered = false)
+  EPollObserver(EPollFile &epollf, File &f, PollSource &src,
+                int32_t watched_events, uint64_t user_data,
+                bool one_shot_triggered = false)
       : one_shot_triggered_(one_shot_triggered),
         epollf_(&epollf),
         f_(&f),
+        source_(&src),
         watched_events_(watched_events),
         user_data_(user_data) {}
-  ~EPollObserver() override;
+  // Must be unlinked from its epoll set and its source first.
+  ~EPollObserver() override = default;
 
   EPollObserver(const EPollObserver &o) noexcept = delete;
   EPollObserver &operator=(const EPollObserver &o) = delete;
@@ -294,7 +354,9 @@ class EPollObserver : public PollObserver {
   EPollObserver &operator=(EPollObserver &&o) = delete;
 
  private:
-  void Notify(unsigned int event_mask) override;
+  void Notify(unsigned int event_mask) override { Trigger(event_mask); }
+  // Updates the triggered events, returning true if a waiter was woken.
+  bool Trigger(unsigned int event_mask);
 
   friend void junction::EpollObserverSave(cereal::BinaryOutputArchive &ar,
                                           const PollObserver &o);
@@ -304,10 +366,12 @@ class EPollObserver : public PollObserver {
   bool one_shot_triggered_;
   EPollFile *epollf_;
   File *f_;
+  PollSource *source_;
   uint32_t watched_events_;
   uint32_t triggered_events_{0};
   uint64_t user_data_;
-  IntrusiveListNode node_;
+  IntrusiveListNode node_;           // in the epoll set's ready list
+  IntrusiveListNode interest_node_;  // in the epoll set's interest list
 };
 
 class EPollFile : public File {
@@ -315,7 +379,11 @@ class EPollFile : public File {
   EPollFile() : File(FileType::kSpecial, 0, FileMode::kRead) {}
   ~EPollFile();
 
+  [[nodiscard]] bool has_poll_source() const override { return true; }
+
   static void Notify(PollSource &s);
+  // Deletes every observer of a file that is going away.
+  static void DetachAll(PollSource &s);
 
   bool Add(File &f, uint32_t events, uint64_t user_data,
            bool one_shot_triggered = false, uint32_t triggered_events = 0);
@@ -324,11 +392,16 @@ class EPollFile : public File {
   int Wait(std::span<epoll_event> events, std::optional<Duration> timeout,
            std::optional<k_sigset_t> mask);
 
-  void AddEvent(EPollObserver &o) {
+  // Supports EPIOCSPARAMS and EPIOCGPARAMS for busy polling.
+  Status<void> Ioctl(unsigned long request, char *argp) override;
+
+  // Queues a ready observer, waking one waiter to collect it. Returns true if
+  // a waiter was woken.
+  bool AddEvent(EPollObserver &o) {
     rt::SpinGuard g(lock_);
-    if (std::exchange(o.attached_, true)) return;
+    if (std::exchange(o.attached_, true)) return false;
     events_.push_back(o);
-    waker_.Wake();
+    return waiters_.WakeOne();
   }
 
   void RemoveEvent(EPollObserver &o) {
@@ -337,91 +410,162 @@ class EPollFile : public File {
     events_.erase(decltype(events_)::s_iterator_to(o));
   }
 
+  // Removes an observer from this set's interest list, index and ready list.
+  void Unlink(EPollObserver &o) {
+    assert(lock_.IsHeld());
+    index_.erase(o.f_);
+    interest_.erase(decltype(interest_)::s_iterator_to(o));
+    if (std::exchange(o.attached_, false))
+      events_.erase(decltype(events_)::s_iterator_to(o));
+  }
+
  private:
   friend class cereal::access;
 
   template <class Archive>
   void save(Archive &ar) const {
-    ar(cereal::base_class<File>(this));
+    ar(cereal::base_class<File>(this), busy_poll_.get_budget(),
+       busy_poll_packets_, prefer_busy_poll_);
   }
 
   template <class Archive>
   void load(Archive &ar) {
-    ar(cereal::base_class<File>(this));
+    uint32_t busy_poll_us;
+    ar(cereal::base_class<File>(this), busy_poll_us, busy_poll_packets_,
+       prefer_busy_poll_);
+    busy_poll_.set_budget(busy_poll_us);
   }
 
   int DeliverEvents(std::span<epoll_event> events_out);
+  // Looks up the observer for @f in this set (null if not watched).
+  EPollObserver *Find(const File &f);
 
   rt::Spin lock_;
-  rt::ThreadWaker waker_;
+  // Threads blocked in Wait(). Each newly ready event wakes one of them.
+  rt::WaitQueue waiters_;
   IntrusiveList<EPollObserver, &EPollObserver::node_> events_;
+  // Every watched file, so that epoll_ctl() and teardown don't depend on how
+  // many files the process has open or how many sets watch the same file.
+  IntrusiveList<EPollObserver, &EPollObserver::interest_node_> interest_;
+  std::unordered_map<const File *, EPollObserver *> index_;
+  BusyPoll busy_poll_;
+  // Linux's packet budget and NAPI preference mean nothing without a kernel
+  // network stack, but EPIOCGPARAMS reports them back.
+  uint16_t busy_poll_packets_{0};
+  uint8_t prefer_busy_poll_{0};
 };
 
 EPollFile::~EPollFile() {
-  FileTable &ftbl = myproc().get_file_table();
-  ftbl.ForEach([this](File &f) { Delete(f); });
+  // Sources are locked before epoll sets elsewhere, so a source that is busy
+  // (perhaps because its file is being destroyed and is about to unlink the
+  // observer itself) is retried after dropping this set's lock.
+  lock_.Lock();
+  while (!interest_.empty()) {
+    EPollObserver &o = interest_.front();
+    PollSource &src = *o.source_;
+    if (!src.lock_.TryLock()) {
+      lock_.Unlock();
+      // Give the holder a chance to finish before trying again.
+      rt::Yield();
+      lock_.Lock();
+      continue;
+    }
+    src.epoll_observers_.erase(
+        decltype(src.epoll_observers_)::s_iterator_to(o));
+    src.lock_.Unlock();
+    Unlink(o);
+    delete &o;
+  }
+  lock_.Unlock();
 }
 
 void EPollFile::Notify(PollSource &s) {
-  bool exclusive = false;
+  // Like Linux, an event wakes every epoll set that watches the file without
+  // EPOLLEXCLUSIVE, but only the first exclusive one that has a thread to
+  // wake. Losing readiness always reaches every set, so none of them keeps a
+  // stale event.
+  const unsigned int events = s.get_events();
+  bool exclusive_woken = false;
   for (auto &o : s.epoll_observers_) {
     auto &oe = static_cast<EPollObserver &>(o);
+    const bool ready = (events & oe.watched_events_) != 0;
+    if ((oe.watched_events_ & kEPollExclusive) != 0 && ready &&
+        exclusive_woken)
+      continue;
     if ((oe.watched_events_ & kEPollOneShot) != 0) {
       if (std::exchange(oe.one_shot_triggered_, true)) continue;
     }
-    if ((oe.watched_events_ & kEPollExclusive) != 0) {
-      if (std::exchange(exclusive, true)) continue;
-    }
-    oe.Notify(s.get_events());
+    bool woke = oe.Trigger(events);
+    if ((oe.watched_events_ & kEPollExclusive) != 0 && woke)
+      exclusive_woken = true;
   }
 }
 
+void EPollFile::DetachAll(PollSource &s) {
+  rt::SpinGuard guard(s.lock_);
+  s.epoll_observers_.erase_and_dispose(
+      s.epoll_observers_.begin(), s.epoll_observers_.end(),
+      [](PollObserver *o) {
+        auto *oe = static_cast<EPollObserver *>(o);
+        EPollFile &epf = *oe->epollf_;
+        rt::SpinGuard g(epf.lock_);
+        epf.Unlink(*oe);
+        delete oe;
+      });
+}
+
 bool EPollFile::Add(File &f, uint32_t events, uint64_t user_data,
                     bool one_shot_triggered, uint32_t triggered_events) {
   events |= (kPollHUp | kPollErr);  // can't be ignored
-  auto o = std::make_unique<EPollObserver>(*this, f, events, user_data,
-                                           one_shot_triggered);
   PollSource &src = f.get_poll_source();
+  auto o = std::make_unique<EPollObserver>(*this, f, src, events, user_data,
+                                           one_shot_triggered);
   rt::SpinGuard guard(src.lock_);
-  for (const auto &o : src.epoll_observers_)
-    if (unlikely(static_cast<const EPollObserver &>(o).epollf_ == this))
-      return false;
+  {
+    rt::SpinGuard g(lock_);
+    if (unlikely(!index_.try_emplace(&f, o.get()).second)) return false;
+    interest_.push_back(*o);
+  }
   src.epoll_observers_.push_back(*o);
   o->Notify(src.get_events() | triggered_events);
   o.release();
   return true;
 }
 
+EPollObserver *EPollFile::Find(const File &f) {
+  rt::SpinGuard g(lock_);
+  auto it = index_.find(&f);
+  return it != index_.end() ? it->second : nullptr;
+}
+
 bool EPollFile::Modify(File &f, uint32_t events, uint64_t user_data) {
   events |= (kPollHUp | kPollErr);  // can't be ignored
   PollSource &src = f.get_poll_source();
   rt::SpinGuard guard(src.lock_);
-  for (auto &o : src.epoll_observers_) {
-    auto &oe = static_cast<EPollObserver &>(o);
-    if (oe.epollf_ != this) continue;
-    oe.watched_events_ = events;
-    oe.user_data_ = user_data;
-    oe.one_shot_triggered_ = false;
-    oe.Notify(oe.triggered_events_);
-    return true;
-  }
-  return false;
+  EPollObserver *oe = Find(f);
+  if (!oe) return false;
+  oe->watched_events_ = events;
+  oe->user_data_ = user_data;
+  oe->one_shot_triggered_ = false;
+  oe->Notify(oe->triggered_events_);
+  return true;
 }
 
 bool EPollFile::Delete(File &f) {
   PollSource &src = f.get_poll_source();
   rt::SpinGuard guard(src.lock_);
-  auto it = src.epoll_observers_.begin();
-  while (it != src.epoll_observers_.end()) {
-    auto &oe = static_cast<EPollObserver &>(*it);
-    if (oe.epollf_ == this) {
-      src.epoll_observers_.erase_and_dispose(it,
-                                             [](PollObserver *o) { delete o; });
-      return true;
-    }
-    ++it;
+  EPollObserver *oe;
+  {
+    rt::SpinGuard g(lock_);
+    auto it = index_.find(&f);
+    if (it == index_.end()) return false;
+    oe = it->second;
+    Unlink(*oe);
   }
-  return false;
+  src.epoll_observers_.erase(
+      decltype(src.epoll_observers_)::s_iterator_to(*oe));
+  delete oe;
+  return true;
 }
 
 int EPollFile::DeliverEvents(std::span<epoll_event> events_out) {
@@ -442,6 +586,9 @@ int EPollFile::DeliverEvents(std::span<epoll_event> events_out) {
   }
   // Put the events that were delivered at the end for better fairness.
   events_.splice(events_.end(), tmp);
+  // Hand off whatever is left (events that didn't fit, or level-triggered
+  // ones that are still ready) to another waiter.
+  if (!events_.empty()) waiters_.WakeOne();
   return std::distance(events_out.begin(), it);
 }
 
@@ -455,32 +602,81 @@ int EPollFile::Wait(std::span<epoll_event> events_out,
   }
   if (timeout && timeout->IsZero()) return 0;
 
-  // Slow path: Block and wait for events
-  rt::WakeOnTimeout timed_out(lock_, waker_, timeout);
+  // The caller's signal mask applies for the rest of the call.
   SigMaskGuard sig(mask);
+
+  // Busy poll for a while before parking.
+  std::optional<Time> start;
+  if (busy_poll_.enabled()) {
+    start = Time::Now();
+    BusyPollCounters &c = myproc().get_busy_poll_counters();
+    auto ready = [this] {
+      rt::SpinGuard g(lock_);
+      return !events_.empty();
+    };
+    if (busy_poll_.Spin(*start, ready, c, timeout)) {
+      rt::SpinGuard g(lock_);
+      // Another waiter may have taken the events first, in which case this
+      // one parks for what is left of its timeout.
+      if (!events_.empty()) {
+        busy_poll_.Arrived(*start);
+        return DeliverEvents(events_out);
+      }
+    }
+    if (timeout && timeout->IsZero()) return 0;
+  }
+
+  // Slow path: Block and wait for events
+  rt::WakeOnTimeout timed_out(lock_, waiters_, timeout);
   bool signaled;
   {
     rt::SpinGuard g(lock_);
-    signaled = !rt::WaitInterruptible(lock_, waker_, [this, &timed_out] {
+    signaled = !rt::WaitInterruptible(lock_, waiters_, [this, &timed_out] {
       return !events_.empty() || timed_out;
     });
-    if (!events_.empty()) return DeliverEvents(events_out);
+    if (!events_.empty()) {
+      if (start) busy_poll_.Arrived(*start);
+      return DeliverEvents(events_out);
+    }
   }
 
   if (signaled) return timeout ? -EINTR : -ERESTARTSYS;
   return 0;
 }
 
-void EPollObserver::Notify(uint32_t events) {
+Status<void> EPollFile::Ioctl(unsigned long request, char *argp) {
+  epoll_params params;
+  switch (request) {
+    case kEPollSetParams:
+      std::memcpy(&params, argp, sizeof(params));
+      if (unlikely(params.busy_poll_usecs > INT_MAX ||
+                   params.prefer_busy_poll > 1 || params.__pad != 0)) {
+        return MakeError(EINVAL);
+      }
+      busy_poll_.set_budget(params.busy_poll_usecs);
+      busy_poll_packets_ = params.busy_poll_budget;
+      prefer_busy_poll_ = params.prefer_busy_poll;
+      return {};
+    case kEPollGetParams:
+      params = {.busy_poll_usecs = busy_poll_.get_budget(),
+                .busy_poll_budget = busy_poll_packets_,
+                .prefer_busy_poll = prefer_busy_poll_,
+                .__pad = 0};
+      std::memcpy(argp, &params, sizeof(params));
+      return {};
+    default:
+      return File::Ioctl(request, argp);
+  }
+}
+
+bool EPollObserver::Trigger(uint32_t events) {
   triggered_events_ = events;
   if ((triggered_events_ & watched_events_) != 0)
-    epollf_->AddEvent(*this);
-  else
-    epollf_->RemoveEvent(*this);
+    return epollf_->AddEvent(*this);
+  epollf_->RemoveEvent(*this);
+  return false;
 }
 
-EPollObserver::~EPollObserver() { epollf_->RemoveEvent(*this); }
-
 }  // namespace detail
 
 namespace {
@@ -511,11 +707,7 @@ void PollSource::Notify() {
   detail::EPollFile::Notify(*this);
 }
 
-void PollSource::DetachEPollObservers() {
-  epoll_observers_.erase_and_dispose(epoll_observers_.begin(),
-                                     epoll_observers_.end(),
-                                     [](PollObserver *o) { delete o; });
-}
+void PollSource::DetachEPollObservers() { detail::EPollFile::DetachAll(*this); }
 
 void EpollObserverSave(cereal::BinaryOutputArchive &ar, const PollObserver &o) {
   assert(dynamic_cast<const detail::EPollObserver *>(&o) != nullptr);
@@ -200,6 +200,7 @@ void Process::ProcessFinish() {
   for (auto &child : child_procs_) {
     rt::SpinGuard g(child->shared_sig_q_);
     child->parent_ = detail::init_proc;
+    child->ppid_.store(detail::init_proc->get_pid(), std::memory_order_relaxed);
     detail::init_proc->child_procs_.push_back(std::move(child));
   }
 }
@@ -232,6 +233,7 @@ void Process::FinishExec(std::shared_ptr<MemoryMap> &&new_mm) {
 bool Process::ThreadFinish(Thread *th) {
   rt::SpinGuard g(child_thread_lock_);
   accumulated_runtime_ += th->GetRuntime();
+  th->get_io_counters().AddTo(exited_io_);
   thread_map_.erase(th->get_tid());
   size_t remaining_threads = thread_map_.size();
   if (remaining_threads == 1) exec_waker_.Wake();
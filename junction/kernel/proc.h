@@ -10,6 +10,7 @@ extern "C" {
 #include <ucontext.h>
 }
 
+#include <atomic>
 #include <cstring>
 #include <map>
 #include <memory>
@@ -20,6 +21,7 @@ extern "C" {
 #include "junction/fs/fs.h"
 #include "junction/fs/procfs/procfs.h"
 #include "junction/junction.h"
+#include "junction/kernel/busy_poll.h"
 #include "junction/kernel/itimer.h"
 #include "junction/kernel/mm.h"
 #include "junction/kernel/signal.h"
@@ -55,6 +57,48 @@ inline bool SignalIfOwned(struct kthread *k, const thread_t *th) {
 
 class ThreadRef;
 
+// I/O counts reported in /proc/<pid>/io.
+struct IOStats {
+  uint64_t rchar{0};  // bytes returned by read-like calls
+  uint64_t wchar{0};  // bytes accepted by write-like calls
+  uint64_t syscr{0};  // number of read-like calls
+  uint64_t syscw{0};  // number of write-like calls
+};
+
+// A thread's I/O counters. Only the owning thread updates them, so they avoid
+// atomic read-modify-writes on the I/O path, but any thread may read them.
+class IOCounters {
+ public:
+  // Accounts for a read-like system call that returned @bytes.
+  void AccountRead(size_t bytes) {
+    Bump(syscr_, 1);
+    if (bytes) Bump(rchar_, bytes);
+  }
+  // Accounts for a write-like system call that returned @bytes.
+  void AccountWrite(size_t bytes) {
+    Bump(syscw_, 1);
+    if (bytes) Bump(wchar_, bytes);
+  }
+
+  // Adds these counts to @s.
+  void AddTo(IOStats &s) const {
+    s.rchar += rchar_.load(std::memory_order_relaxed);
+    s.wchar += wchar_.load(std::memory_order_relaxed);
+    s.syscr += syscr_.load(std::memory_order_relaxed);
+    s.syscw += syscw_.load(std::memory_order_relaxed);
+  }
+
+ private:
+  static void Bump(std::atomic<uint64_t> &c, uint64_t n) {
+    c.store(c.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+  }
+
+  std::atomic<uint64_t> rchar_{0};
+  std::atomic<uint64_t> wchar_{0};
+  std::atomic<uint64_t> syscr_{0};
+  std::atomic<uint64_t> syscw_{0};
+};
+
 // Thread is a UNIX thread object.
 class Thread {
  public:
@@ -77,6 +121,8 @@ class Thread {
 
   [[nodiscard]] ThreadSignalHandler &get_sighand() { return sighand_; }
   [[nodiscard]] procfs::ProcFSData &get_procfs() { return procfs_data_; }
+  [[nodiscard]] IOCounters &get_io_counters() { return io_; }
+  [[nodiscard]] const IOCounters &get_io_counters() const { return io_; }
 
   void set_child_tid(uint32_t *tid) { child_tid_ = tid; }
   void set_xstate(int xstate) { xstate_ = xstate; }
@@ -325,6 +371,8 @@ class Thread {
 
   // Data for procfs entries for this thread.
   procfs::ProcFSData procfs_data_;
+
+  IOCounters io_;
 };
 
 // Simple shared pointer-like object to allow references to a Thread without
@@ -393,7 +441,8 @@ class Process : public std::enable_shared_from_this<Process> {
         file_tbl_(ftbl),
         fs_(fs),
         mem_map_(std::move(mm)),
-        parent_(std::move(parent)) {
+        parent_(std::move(parent)),
+        ppid_(parent_ ? parent_->get_pid() : 0) {
     RegisterProcess(*this);
   }
   // Constructor for restoring from a snapshot
@@ -411,6 +460,10 @@ class Process : public std::enable_shared_from_this<Process> {
 
   [[nodiscard]] pid_t get_pid() const { return pid_; }
   [[nodiscard]] pid_t get_pgid() const { return pgid_; }
+  // The parent's pid (0 for init). Safe to call without any locks held.
+  [[nodiscard]] pid_t get_ppid() const {
+    return ppid_.load(std::memory_order_relaxed);
+  }
   [[nodiscard]] FileTable &get_file_table() { return file_tbl_; }
   [[nodiscard]] MemoryMap &get_mem_map() { return *mem_map_; }
   [[nodiscard]] SignalTable &get_signal_table() { return signal_tbl_; }
@@ -421,6 +474,9 @@ class Process : public std::enable_shared_from_this<Process> {
   [[nodiscard]] bool is_stopped() const { return stopped_; }
   [[nodiscard]] FSRoot &get_fs() { return fs_; }
   [[nodiscard]] procfs::ProcFSData &get_procfs() { return procfs_data_; }
+  [[nodiscard]] BusyPollCounters &get_busy_poll_counters() {
+    return busy_poll_;
+  }
 
   [[nodiscard]] const std::string_view get_bin_path() const {
     return binary_path_;
@@ -549,6 +605,19 @@ class Process : public std::enable_shared_from_this<Process> {
     return d + accumulated_runtime_;
   }
 
+  // Sums the I/O counters of every thread, past and present.
+  [[nodiscard]] IOStats GetIOStats() {
+    rt::SpinGuard g(child_thread_lock_);
+    IOStats s = exited_io_;
+    for (const auto &[_pid, th] : thread_map_) th->get_io_counters().AddTo(s);
+    return s;
+  }
+
+  [[nodiscard]] size_t get_thread_count() {
+    rt::SpinGuard g(child_thread_lock_);
+    return thread_map_.size();
+  }
+
   // Run a function for each process in the system. The function will be called
   // with a spinlock held and preemption disabled, so the function should not
   // block.
@@ -631,6 +700,7 @@ class Process : public std::enable_shared_from_this<Process> {
     ar(pgid_, parent_, file_tbl_, mem_map_, limit_nofile_, binary_path_,
        signal_tbl_, shared_sig_q_, child_procs_, wait_state_, wait_status_,
        it_real_.get());
+    if (parent_) ppid_ = parent_->get_pid();
 
     detail::AcquirePid(pid_);
     detail::AcquirePid(pgid_);
@@ -764,6 +834,8 @@ class Process : public std::enable_shared_from_this<Process> {
 
   // Protected by parent_'s shared_sig_q_lock_
   std::shared_ptr<Process> parent_;
+  // A copy of parent_'s pid that can be read without the lock.
+  std::atomic<pid_t> ppid_{0};
   unsigned int wait_state_{kNotWaitable};
   int wait_status_;
 
@@ -772,6 +844,8 @@ class Process : public std::enable_shared_from_this<Process> {
 
   // Counters
   Duration accumulated_runtime_{0};  // Time from exited threads.
+  IOStats exited_io_;                // I/O from exited threads.
+  BusyPollCounters busy_poll_;
 
   // Procfs entries.
   procfs::ProcFSData procfs_data_;
@@ -7,6 +7,7 @@ extern "C" {
 
 #include "junction/base/error.h"
 #include "junction/bindings/log.h"
+#include "junction/kernel/hostio.h"
 #include "junction/kernel/ksys.h"
 #include "junction/kernel/stdiofile.h"
 
@@ -19,14 +20,15 @@ StdIOFile::StdIOFile(int fd, FileMode mode)
 StdIOFile::~StdIOFile() {}
 
 Status<size_t> StdIOFile::Read(std::span<std::byte> buf, off_t *off) {
-  long ret = ksys_read(fd_, buf.data(), buf.size_bytes());
+  long ret = hostio_read(fd_, buf.data(), buf.size_bytes(), true);
+  if (ret == -EINTR) return MakeError(ERESTARTSYS);
   if (ret < 0) return MakeError(-ret);
   *off = ret;
   return ret;
 }
 
 Status<size_t> StdIOFile::Write(std::span<const std::byte> buf, off_t *off) {
-  long ret = ksys_write(fd_, buf.data(), buf.size_bytes());
+  long ret = hostio_write(fd_, buf.data(), buf.size_bytes());
   if (ret < 0) return MakeError(-ret);
   *off = ret;
   return ret;
@@ -15,6 +15,7 @@ extern "C" {
 #include <sys/utsname.h>
 #include <time.h>
 struct clone_args;
+struct io_uring_params;
 }
 
 #include <cstdint>
@@ -29,6 +30,8 @@ long usys_openat(int dirfd, const char *pathname, int flags, mode_t mode);
 long usys_truncate(const char *path, off_t length);
 long usys_ftruncate(int fd, off_t length);
 long usys_fallocate(int fd, int mode, off_t offset, off_t len);
+long usys_fadvise64(int fd, off_t offset, off_t len, int advice);
+ssize_t usys_readahead(int fd, off_t offset, size_t count);
 long usys_access(const char *pathname, int mode);
 long usys_faccessat(int dirfd, const char *pathname, int mode);
 long usys_faccessat2(int dirfd, const char *pathname, int mode, int flags);
@@ -54,13 +57,22 @@ ssize_t usys_pwritev(int fd, const iovec *iov, int iovcnt, off_t offset);
 ssize_t usys_pwritev2(int fd, const iovec *iov, int iovcnt, off_t offset,
                       int flags);
 ssize_t usys_sendfile(int out_fd, int in_fd, off_t *offset, size_t count);
+ssize_t usys_splice(int fd_in, off_t *off_in, int fd_out, off_t *off_out,
+                    size_t len, unsigned int flags);
+ssize_t usys_tee(int fd_in, int fd_out, size_t len, unsigned int flags);
+ssize_t usys_vmsplice(int fd, const struct iovec *iov, size_t nr_segs,
+                      unsigned int flags);
+ssize_t usys_copy_file_range(int fd_in, off_t *off_in, int fd_out,
+                             off_t *off_out, size_t len, unsigned int flags);
 off_t usys_lseek(int fd, off_t offset, int whence);
 long usys_fsync(int fd);
+long usys_fdatasync(int fd);
 long usys_dup(int oldfd);
 long usys_dup2(int oldfd, int newfd);
 long usys_dup3(int oldfd, int newfd, int flags);
 long usys_close(int fd);
-long usys_close_range(int first, int last, unsigned int flags);
+long usys_close_range(unsigned int first, unsigned int last,
+                      unsigned int flags);
 long usys_newfstatat(int dirfd, const char *pathname, struct stat *statbuf,
                      int flags);
 long usys_statfs(const char *path, struct statfs *buf);
@@ -73,6 +85,7 @@ long usys_getdents64(unsigned int fd, void *dirp, unsigned int count);
 long usys_pipe(int pipefd[2]);
 long usys_pipe2(int pipefd[2], int flags);
 long usys_fcntl(int fd, unsigned int cmd, unsigned long arg);
+long usys_memfd_create(const char *name, unsigned int flags);
 long usys_mkdir(const char *pathname, mode_t mode);
 long usys_mkdirat(int fd, const char *pathname, mode_t mode);
 long usys_rmdir(const char *pathname);
@@ -110,6 +123,11 @@ ssize_t usys_recvfrom(int sockfd, void *buf, size_t len, int flags,
 ssize_t usys_sendto(int sockfd, const void *buf, size_t len, int flags,
                     const struct sockaddr *dest_addr, socklen_t addrlen);
 ssize_t usys_sendmsg(int sockfd, const struct msghdr *msg, int flags);
+ssize_t usys_recvmsg(int sockfd, struct msghdr *msg, int flags);
+long usys_sendmmsg(int sockfd, struct mmsghdr *msgvec, unsigned int vlen,
+                   int flags);
+long usys_recvmmsg(int sockfd, struct mmsghdr *msgvec, unsigned int vlen,
+                   int flags, struct timespec *timeout);
 long usys_accept(int sockfd, struct sockaddr *addr, socklen_t *addrlen);
 long usys_accept4(int sockfd, struct sockaddr *addr, socklen_t *addrlen,
                   int flags);
@@ -216,6 +234,14 @@ long usys_pause();
 long usys_eventfd2(unsigned int initval, int flags);
 long usys_eventfd(unsigned int initval);
 
+// io_uring
+long usys_io_uring_setup(uint32_t entries, struct io_uring_params *p);
+long usys_io_uring_enter(unsigned int fd, unsigned int to_submit,
+                         unsigned int min_complete, unsigned int flags,
+                         const void *argp, size_t argsz);
+long usys_io_uring_register(unsigned int fd, unsigned int opcode, void *arg,
+                            unsigned int nr_args);
+
 // Exec
 long usys_execve(const char *filename, const char *argv[], const char *envp[]);
 long usys_execveat(int fd, const char *filename, const char *argv[],
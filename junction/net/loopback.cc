@@ -0,0 +1,206 @@
+// loopback.cc - TCP connections within a Junction instance
+
+extern "C" {
+#include <sys/socket.h>
+}
+
+#include "junction/net/loopback.h"
+
+#include <algorithm>
+#include <iterator>
+#include <map>
+#include <tuple>
+
+namespace junction {
+
+namespace {
+
+// All listening sockets, keyed by local address. There can be more than one
+// listener per address with SO_REUSEPORT.
+rt::Mutex registry_lock;
+std::multimap<std::pair<uint32_t, uint16_t>, LoopbackListener *> registry;
+
+// Is @ip an address of this instance?
+bool IsLocal(uint32_t ip) {
+  if ((ip >> 24) == 127) return true;
+  return ip == rt::LocalIP();
+}
+
+}  // namespace
+
+//
+// LoopbackConn
+//
+
+LoopbackConn::~LoopbackConn() { Close(); }
+
+LoopbackConn &LoopbackConn::operator=(LoopbackConn &&c) noexcept {
+  if (this == &c) return *this;
+  Close();
+  rx_ = std::move(c.rx_);
+  tx_ = std::move(c.tx_);
+  laddr_ = c.laddr_;
+  raddr_ = c.raddr_;
+  flow_ = std::move(c.flow_);
+  return *this;
+}
+
+void LoopbackConn::Close() {
+  if (rx_) rx_->CloseReader();
+  if (tx_) tx_->CloseWriter();
+}
+
+void LoopbackConn::Reserve() {
+  Status<rt::TCPReservation> ret =
+      rt::TCPReservation::Reserve({0, laddr_.port}, raddr_);
+  if (ret) flow_ = std::move(*ret);
+}
+
+std::pair<LoopbackConn, LoopbackConn> LoopbackConn::CreatePair(
+    netaddr client, netaddr server, rt::TCPReservation flow) {
+  auto c2s = std::make_shared<UnixChannel>(kSockBufDefault);
+  auto s2c = std::make_shared<UnixChannel>(kSockBufDefault);
+  return {LoopbackConn(s2c, c2s, client, server, std::move(flow)),
+          LoopbackConn(std::move(c2s), std::move(s2c), server, client)};
+}
+
+Status<size_t> LoopbackConn::Readv(std::span<const iovec> iov, bool peek,
+                                   bool nonblocking) {
+  UnixMsg anc;
+  return rx_->Read(iov, anc, true, peek, nonblocking, nullptr);
+}
+
+Status<size_t> LoopbackConn::Writev(std::span<const iovec> iov,
+                                    bool nonblocking) {
+  UnixMsg anc;
+  return tx_->Write(iov, anc, true, nonblocking);
+}
+
+Status<void> LoopbackConn::Shutdown(int how) {
+  if (unlikely(how != SHUT_RD && how != SHUT_WR && how != SHUT_RDWR))
+    return MakeError(EINVAL);
+  if (how != SHUT_WR) rx_->CloseReader();
+  if (how != SHUT_RD) tx_->CloseWriter();
+  return {};
+}
+
+//
+// LoopbackListener
+//
+
+LoopbackListener::LoopbackListener(netaddr laddr, int backlog) noexcept
+    : backlog_(static_cast<size_t>(std::max(backlog, 0)) + 1),
+      laddr_(laddr),
+      stack_poller_([this](unsigned int events) { StackEvents(events); }) {
+  stack_src_.Attach(stack_poller_);
+  rt::ScopedLock g(registry_lock);
+  registry.emplace(std::make_pair(laddr_.ip, laddr_.port), this);
+}
+
+LoopbackListener::~LoopbackListener() {
+  {
+    rt::ScopedLock g(registry_lock);
+    auto [begin, end] = registry.equal_range({laddr_.ip, laddr_.port});
+    for (auto it = begin; it != end; ++it) {
+      if (it->second != this) continue;
+      registry.erase(it);
+      break;
+    }
+  }
+  stack_poller_.Detach();
+}
+
+bool LoopbackListener::Push(LoopbackConn &c) {
+  rt::SpinGuard g(lock_);
+  if (shut_ || conns_.size() >= backlog_) return false;
+  conns_.push_back(std::move(c));
+  UpdatePoll();
+  waiters_.WakeOne();
+  return true;
+}
+
+std::optional<LoopbackConn> LoopbackListener::TryAccept() {
+  rt::SpinGuard g(lock_);
+  if (conns_.empty()) return std::nullopt;
+  LoopbackConn c = std::move(conns_.front());
+  conns_.pop_front();
+  UpdatePoll();
+  return c;
+}
+
+bool LoopbackListener::Wait() {
+  rt::SpinGuard g(lock_);
+  return rt::WaitInterruptible(lock_, waiters_, [this] {
+    return !conns_.empty() || (stack_events_ & kPollIn) || shut_;
+  });
+}
+
+void LoopbackListener::Shutdown() {
+  // Pending connections are closed outside the lock.
+  std::deque<LoopbackConn> conns;
+  rt::SpinGuard g(lock_);
+  shut_ = true;
+  conns.swap(conns_);
+  UpdatePoll();
+  waiters_.WakeAll();
+}
+
+void LoopbackListener::InstallPollSource(PollSource &src) {
+  rt::SpinGuard g(lock_);
+  poll_ = &src;
+  UpdatePoll();
+}
+
+void LoopbackListener::StackEvents(unsigned int events) {
+  rt::SpinGuard g(lock_);
+  stack_events_ = events;
+  UpdatePoll();
+  // Every waiter rechecks, as Caladan only reports the queue becoming ready.
+  if (events & kPollIn) waiters_.WakeAll();
+}
+
+void LoopbackListener::UpdatePoll() {
+  assert(lock_.IsHeld());
+  if (!poll_) return;
+  if (shut_ || (stack_events_ & kPollHUp)) {
+    poll_->Set(kPollIn | kPollRDHUp | kPollHUp);
+  } else if (!conns_.empty() || (stack_events_ & kPollIn)) {
+    poll_->Set(kPollIn);
+  } else {
+    poll_->Clear(kPollIn);
+  }
+}
+
+Status<std::optional<LoopbackConn>> LoopbackConnect(netaddr laddr,
+                                                    netaddr raddr) {
+  rt::ScopedLock g(registry_lock);
+  if (!IsLocal(raddr.ip)) return std::nullopt;
+
+  // Prefer a listener bound to the exact address over a wildcard one.
+  auto [begin, end] = registry.equal_range({raddr.ip, raddr.port});
+  if (begin == end)
+    std::tie(begin, end) = registry.equal_range({0, raddr.port});
+  if (begin == end) return std::nullopt;
+
+  // Claim the client's flow in Caladan (choosing its port if unbound), so
+  // Caladan never uses the same ports for a connection of its own.
+  Status<rt::TCPReservation> flow =
+      rt::TCPReservation::Reserve({0, laddr.port}, raddr);
+  if (unlikely(!flow)) return MakeError(flow);
+  if (!laddr.ip) laddr.ip = raddr.ip;
+  laddr.port = flow->LocalAddr().port;
+  auto [client, server] =
+      LoopbackConn::CreatePair(laddr, raddr, std::move(*flow));
+
+  // Spread connections over SO_REUSEPORT listeners by client port, skipping
+  // any that are full. If none has room, the connection is refused.
+  const size_t n = std::distance(begin, end);
+  for (size_t i = 0; i < n; i++) {
+    auto it = std::next(begin, (laddr.port + i) % n);
+    if (it->second->Push(server))
+      return std::optional<LoopbackConn>(std::move(client));
+  }
+  return MakeError(ECONNREFUSED);
+}
+
+}  // namespace junction
@@ -0,0 +1,170 @@
+// loopback.h - TCP connections within a Junction instance
+
+#pragma once
+
+#include <deque>
+#include <memory>
+#include <optional>
+#include <span>
+#include <utility>
+
+#include "junction/base/error.h"
+#include "junction/bindings/net.h"
+#include "junction/bindings/sync.h"
+#include "junction/kernel/poll.h"
+#include "junction/net/unix_socket.h"
+#include "junction/snapshot/cereal.h"
+
+namespace junction {
+
+// One end of a TCP connection between two sockets in the same Junction
+// instance. Rather than going through Caladan's TCP stack, data is copied
+// through a pair of in-memory stream channels.
+class LoopbackConn {
+ public:
+  LoopbackConn() noexcept = default;
+  LoopbackConn(std::shared_ptr<UnixChannel> rx,
+               std::shared_ptr<UnixChannel> tx, netaddr laddr, netaddr raddr,
+               rt::TCPReservation flow = {}) noexcept
+      : rx_(std::move(rx)),
+        tx_(std::move(tx)),
+        laddr_(laddr),
+        raddr_(raddr),
+        flow_(std::move(flow)) {}
+  ~LoopbackConn();
+
+  LoopbackConn(LoopbackConn &&c) noexcept = default;
+  LoopbackConn &operator=(LoopbackConn &&c) noexcept;
+  LoopbackConn(const LoopbackConn &) = delete;
+  LoopbackConn &operator=(const LoopbackConn &) = delete;
+
+  // Creates both ends of a connection from @client to @server. The client end
+  // holds @flow, the reservation of its address in Caladan.
+  static std::pair<LoopbackConn, LoopbackConn> CreatePair(
+      netaddr client, netaddr server, rt::TCPReservation flow = {});
+
+  Status<size_t> Readv(std::span<const iovec> iov, bool peek,
+                       bool nonblocking);
+  Status<size_t> Writev(std::span<const iovec> iov, bool nonblocking);
+
+  Status<size_t> Read(std::span<std::byte> buf, bool peek, bool nonblocking) {
+    iovec iov = {buf.data(), buf.size()};
+    return Readv({&iov, 1}, peek, nonblocking);
+  }
+  Status<size_t> Write(std::span<const std::byte> buf, bool nonblocking) {
+    iovec iov = {const_cast<std::byte *>(buf.data()), buf.size()};
+    return Writev({&iov, 1}, nonblocking);
+  }
+
+  Status<void> Shutdown(int how);
+
+  [[nodiscard]] netaddr LocalAddr() const { return laddr_; }
+  [[nodiscard]] netaddr RemoteAddr() const { return raddr_; }
+
+  void InstallPollSource(PollSource &src) {
+    rx_->AttachReadPoll(&src);
+    tx_->AttachWritePoll(&src);
+  }
+
+  template <class Archive>
+  void save(Archive &ar) const {
+    ar(rx_, tx_, laddr_, raddr_, flow_.is_valid());
+  }
+
+  template <class Archive>
+  void load(Archive &ar) {
+    bool reserved;
+    ar(rx_, tx_, laddr_, raddr_, reserved);
+    if (reserved) Reserve();
+  }
+
+ private:
+  void Close();
+  // Claims this client end's flow in Caladan again after a restore.
+  void Reserve();
+
+  std::shared_ptr<UnixChannel> rx_;
+  std::shared_ptr<UnixChannel> tx_;
+  netaddr laddr_{0, 0};
+  netaddr raddr_{0, 0};
+  rt::TCPReservation flow_;
+};
+
+// Queues loopback connections for a listening TCP socket. The socket's Caladan
+// listener reports its readiness on stack_source(), so Accept() can wait for a
+// connection from either one in one place, and the socket's poll source sees
+// the union of both.
+class LoopbackListener {
+ public:
+  // Registers a listener for @laddr. Like Linux, the accept queue holds one
+  // more connection than @backlog.
+  LoopbackListener(netaddr laddr, int backlog) noexcept;
+  ~LoopbackListener();
+
+  LoopbackListener(const LoopbackListener &) = delete;
+  LoopbackListener &operator=(const LoopbackListener &) = delete;
+
+  // The poll source the Caladan listener should be installed on.
+  [[nodiscard]] PollSource &stack_source() { return stack_src_; }
+
+  // Takes the next queued loopback connection, if any.
+  std::optional<LoopbackConn> TryAccept();
+
+  // Blocks until a connection might be ready from either source or the
+  // listener is shut down. Returns false if interrupted by a signal.
+  bool Wait();
+
+  // Stops accepting; queued connections are closed.
+  void Shutdown();
+
+  // Reports queued connections as kPollIn on @src.
+  void InstallPollSource(PollSource &src);
+
+  template <class Archive>
+  void save(Archive &ar) const {
+    ar(conns_.size());
+    for (const LoopbackConn &c : conns_) ar(c);
+  }
+
+  template <class Archive>
+  void load(Archive &ar) {
+    size_t n;
+    ar(n);
+    rt::SpinGuard g(lock_);
+    for (size_t i = 0; i < n; i++) {
+      LoopbackConn c;
+      ar(c);
+      conns_.push_back(std::move(c));
+    }
+    UpdatePoll();
+  }
+
+ private:
+  friend Status<std::optional<LoopbackConn>> LoopbackConnect(netaddr laddr,
+                                                             netaddr raddr);
+
+  // Queues a connection unless this listener is full or shut down.
+  bool Push(LoopbackConn &c);
+  void StackEvents(unsigned int events);
+  void UpdatePoll();
+
+  rt::Spin lock_;
+  rt::WaitQueue waiters_;
+  std::deque<LoopbackConn> conns_;
+  size_t backlog_;
+  bool shut_{false};
+  unsigned int stack_events_{0};
+  PollSource *poll_{nullptr};
+  netaddr laddr_;
+  PollSource stack_src_;
+  Poller stack_poller_;
+};
+
+// Connects from @laddr to a listener in this instance, returning the client
+// end of the connection. Returns nullopt if @raddr isn't a local address that
+// some socket in this instance listens on, in which case the caller should
+// dial it through Caladan instead.
+Status<std::optional<LoopbackConn>> LoopbackConnect(netaddr laddr,
+                                                    netaddr raddr);
+
+}  // namespace junction
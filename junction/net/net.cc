@@ -1,19 +1,25 @@
 extern "C" {
 #include <netinet/in.h>
+#include <netinet/udp.h>
 }
 
+#include <algorithm>
 #include <cstring>
 #include <memory>
+#include <optional>
 
 #include "junction/base/io.h"
+#include "junction/base/time.h"
 #include "junction/bindings/log.h"
 #include "junction/bindings/net.h"
+#include "junction/bindings/timer.h"
 #include "junction/fs/file.h"
 #include "junction/kernel/proc.h"
 #include "junction/kernel/usys.h"
 #include "junction/net/socket.h"
 #include "junction/net/tcp_socket.h"
 #include "junction/net/udp_socket.h"
+#include "junction/net/unix_socket.h"
 
 namespace junction {
 
@@ -37,6 +43,230 @@ Status<std::reference_wrapper<Socket>> FDToSocket(int fd) {
   return std::ref(static_cast<Socket &>(*f));
 }
 
+// Returns true if @type is a supported AF_UNIX socket type.
+bool IsUnixType(int type) {
+  return type == SOCK_STREAM || type == SOCK_DGRAM || type == SOCK_SEQPACKET;
+}
+
+Status<std::shared_ptr<Socket>> CreateSocket(int domain, int type) {
+  int flags = type & kFlagNonblock;
+  type &= ~(kFlagCloseExec | kFlagNonblock);
+  if (domain == AF_UNIX) {
+    if (unlikely(!IsUnixType(type))) return MakeError(EINVAL);
+    return std::make_shared<UnixSocket>(type, flags);
+  }
+  if (unlikely(domain != AF_INET)) return MakeError(EINVAL);
+  if (type == SOCK_STREAM)
+    return std::make_shared<TCPSocket>(flags);
+  else if (type == SOCK_DGRAM)
+    return std::make_shared<UDPSocket>(flags);
+  else
+    return MakeError(EINVAL);
+}
+
+long DoAccept(int sockfd, sockaddr *addr, socklen_t *addrlen, int flags = 0) {
+  auto sock_ret = FDToSocket(sockfd);
+  if (unlikely(!sock_ret)) return MakeCError(sock_ret);
+  Socket &s = sock_ret.value().get();
+  Status<std::shared_ptr<Socket>> ret = s.Accept(flags);
+  if (unlikely(!ret)) return MakeCError(ret);
+  if (addr) {
+    Status<void> conv_ret;
+    if (auto *u = most_derived_cast<UnixSocket>(ret->get())) {
+      Status<std::string> name = u->PeerName();
+      if (unlikely(!name)) return MakeCError(name);
+      conv_ret = UnixNameToSockAddr(*name, addr, addrlen);
+    } else {
+      Status<netaddr> na = (*ret)->RemoteAddr();
+      if (!na) return MakeCError(na);
+      conv_ret = NetAddrToSockAddr(*na, addr, addrlen);
+    }
+    if (unlikely(!conv_ret)) return MakeCError(conv_ret);
+  }
+  return myproc().get_file_table().Insert(std::move(*ret),
+                                          (flags & kFlagCloseExec) > 0);
+}
+
+// Reserves room for a control message with @len bytes of data in @msg's
+// control buffer, after the first @used bytes. Returns nullptr if the header
+// doesn't fit.
+cmsghdr *PutControl(msghdr &msg, size_t &used, int level, int type,
+                    size_t len) {
+  if (!msg.msg_control || used + CMSG_LEN(len) > msg.msg_controllen)
+    return nullptr;
+  auto *cmsg = reinterpret_cast<cmsghdr *>(
+      static_cast<std::byte *>(msg.msg_control) + used);
+  cmsg->cmsg_level = level;
+  cmsg->cmsg_type = type;
+  cmsg->cmsg_len = CMSG_LEN(len);
+  used += std::min(CMSG_SPACE(len), msg.msg_controllen - used);
+  return cmsg;
+}
+
+// Fills in @msg's control buffer from @opts. Received files are installed in
+// the file table; those that don't fit are closed.
+void PutControls(msghdr &msg, MsgOptions &opts, bool cloexec) {
+  size_t used = 0;
+  if (opts.segment_size) {
+    int seg = static_cast<int>(opts.segment_size);
+    if (cmsghdr *c = PutControl(msg, used, SOL_UDP, UDP_GRO, sizeof(seg)))
+      std::memcpy(CMSG_DATA(c), &seg, sizeof(seg));
+    else
+      msg.msg_flags |= MSG_CTRUNC;
+  }
+
+  if (opts.creds) {
+    const ucred &creds = *opts.creds;
+    cmsghdr *c = PutControl(msg, used, SOL_SOCKET, SCM_CREDENTIALS,
+                            sizeof(creds));
+    if (c)
+      std::memcpy(CMSG_DATA(c), &creds, sizeof(creds));
+    else
+      msg.msg_flags |= MSG_CTRUNC;
+  }
+
+  if (!opts.files.empty()) {
+    size_t room = 0;
+    if (msg.msg_control && msg.msg_controllen >= used + CMSG_LEN(0))
+      room = (msg.msg_controllen - used - CMSG_LEN(0)) / sizeof(int);
+    const size_t n = std::min(room, opts.files.size());
+    if (n < opts.files.size()) msg.msg_flags |= MSG_CTRUNC;
+    if (n) {
+      cmsghdr *c =
+          PutControl(msg, used, SOL_SOCKET, SCM_RIGHTS, n * sizeof(int));
+      auto *fds = reinterpret_cast<std::byte *>(CMSG_DATA(c));
+      FileTable &ftbl = myproc().get_file_table();
+      for (size_t i = 0; i < n; i++) {
+        int fd = ftbl.Insert(std::move(opts.files[i]), cloexec);
+        std::memcpy(fds + i * sizeof(int), &fd, sizeof(fd));
+      }
+    }
+  }
+  msg.msg_controllen = used;
+}
+
+// Receives one message into @msg. If @nonblocking is set and nothing is ready
+// to read, fails with EAGAIN.
+//
+// Caladan's connections only support blocking or nonblocking mode for all of
+// their callers, so a nonblocking read on a blocking socket checks the poll
+// state first. A concurrent reader can still consume the message in between,
+// in which case the read waits for the next message.
+Status<size_t> DoRecvMsg(Socket &s, msghdr &msg, bool peek, bool nonblocking,
+                         bool cloexec) {
+  std::span<const iovec> iov(msg.msg_iov, msg.msg_iovlen);
+  MsgOptions opts;
+  bool trunc = false;
+  Status<size_t> ret;
+  Status<void> conv_ret;
+  socklen_t len = msg.msg_namelen;
+  if (auto *u = most_derived_cast<UnixSocket>(&s)) {
+    std::string name;
+    ret = u->RecvFrom(iov, msg.msg_name ? &name : nullptr, peek, nonblocking,
+                      &opts, &trunc);
+    if (unlikely(!ret)) return ret;
+    if (msg.msg_name) {
+      conv_ret = UnixNameToSockAddr(name, static_cast<sockaddr *>(msg.msg_name),
+                                    &len);
+    }
+  } else {
+    if (nonblocking && !s.is_nonblocking() && !s.ReadReady())
+      return MakeError(EAGAIN);
+    netaddr addr;
+    ret = s.RecvMsg(iov, msg.msg_name ? &addr : nullptr, peek, &opts);
+    if (unlikely(!ret)) return ret;
+    if (msg.msg_name) {
+      conv_ret =
+          NetAddrToSockAddr(addr, static_cast<sockaddr *>(msg.msg_name), &len);
+    }
+  }
+  if (unlikely(!conv_ret)) return MakeError(conv_ret);
+  if (msg.msg_name) msg.msg_namelen = len;
+
+  msg.msg_flags = trunc ? MSG_TRUNC : 0;
+  PutControls(msg, opts, cloexec);
+  return ret;
+}
+
+// Parses the control messages of @msg into @opts.
+Status<void> ParseControl(const msghdr &msg, MsgOptions &opts) {
+  if (!msg.msg_control || msg.msg_controllen == 0) return {};
+  if (unlikely(msg.msg_controllen < sizeof(cmsghdr))) return MakeError(EINVAL);
+
+  // The CMSG_* macros take a mutable header but only read through it.
+  msghdr &m = const_cast<msghdr &>(msg);
+  for (cmsghdr *cmsg = CMSG_FIRSTHDR(&m); cmsg; cmsg = CMSG_NXTHDR(&m, cmsg)) {
+    if (unlikely(cmsg->cmsg_len < CMSG_LEN(0))) return MakeError(EINVAL);
+    if (cmsg->cmsg_level == SOL_UDP && cmsg->cmsg_type == UDP_SEGMENT) {
+      if (unlikely(cmsg->cmsg_len != CMSG_LEN(sizeof(uint16_t))))
+        return MakeError(EINVAL);
+      uint16_t seg;
+      std::memcpy(&seg, CMSG_DATA(cmsg), sizeof(seg));
+      opts.segment_size = seg;
+      continue;
+    }
+    if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+      const size_t n = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+      if (unlikely(opts.files.size() + n > kMaxPassedFiles))
+        return MakeError(EINVAL);
+      const auto *fds = reinterpret_cast<const std::byte *>(CMSG_DATA(cmsg));
+      FileTable &ftbl = myproc().get_file_table();
+      for (size_t i = 0; i < n; i++) {
+        int fd;
+        std::memcpy(&fd, fds + i * sizeof(int), sizeof(fd));
+        std::shared_ptr<File> f = ftbl.Dup(fd);
+        if (unlikely(!f)) return MakeError(EBADF);
+        opts.files.push_back(std::move(f));
+      }
+      continue;
+    }
+    if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_CREDENTIALS) {
+      if (unlikely(cmsg->cmsg_len != CMSG_LEN(sizeof(ucred))))
+        return MakeError(EINVAL);
+      ucred creds;
+      std::memcpy(&creds, CMSG_DATA(cmsg), sizeof(creds));
+      opts.creds = creds;
+      continue;
+    }
+    LOG_ONCE(WARN) << "sendmsg: ignoring control message (level "
+                   << cmsg->cmsg_level << ", type " << cmsg->cmsg_type << ")";
+  }
+  return {};
+}
+
+// Sends one message from @msg.
+Status<size_t> DoSendMsg(Socket &s, const msghdr &msg) {
+  MsgOptions opts;
+  Status<void> cret = ParseControl(msg, opts);
+  if (unlikely(!cret)) return MakeError(cret);
+  std::span<const iovec> iov(msg.msg_iov, msg.msg_iovlen);
+
+  if (auto *u = most_derived_cast<UnixSocket>(&s)) {
+    std::string name;
+    if (msg.msg_name) {
+      Status<std::string> ret = SockAddrToUnixName(
+          static_cast<const sockaddr *>(msg.msg_name), msg.msg_namelen);
+      if (unlikely(!ret)) return MakeError(ret);
+      name = std::move(*ret);
+    }
+    return u->SendTo(iov, msg.msg_name ? &name : nullptr, opts);
+  }
+  // Only UNIX sockets can pass files and credentials.
+  if (unlikely(!opts.files.empty() || opts.creds)) return MakeError(EINVAL);
+
+  netaddr addr;
+  if (msg.msg_name) {
+    Status<netaddr> naddr = SockAddrToNetAddr(
+        static_cast<const sockaddr *>(msg.msg_name), msg.msg_namelen);
+    if (unlikely(!naddr)) return MakeError(naddr);
+    addr = *naddr;
+  }
+  const netaddr *raddr = msg.msg_name ? &addr : nullptr;
+  return s.SendMsg(iov, raddr, opts);
+}
+
+}  // namespace
+
 Status<netaddr> SockAddrToNetAddr(const sockaddr *addr, socklen_t addrlen) {
   if (unlikely(!addr || addr->sa_family != AF_INET ||
                addrlen < sizeof(sockaddr_in))) {
@@ -60,35 +290,109 @@ Status<void> NetAddrToSockAddr(const netaddr &naddr, sockaddr *saddr,
   return {};
 }
 
-Status<std::shared_ptr<Socket>> CreateSocket(int domain, int type) {
-  if (unlikely(domain != AF_INET)) return MakeError(EINVAL);
-  int flags = type & kFlagNonblock;
-  type &= ~(kFlagCloseExec | kFlagNonblock);
-  if (type == SOCK_STREAM)
-    return std::make_shared<TCPSocket>(flags);
-  else if (type == SOCK_DGRAM)
-    return std::make_shared<UDPSocket>(flags);
-  else
-    return MakeError(EINVAL);
+Status<void> Socket::SetSockOpt(int level, int optname,
+                                std::span<const std::byte> optval) {
+  if (level != SOL_SOCKET) return MakeError(ENOPROTOOPT);
+  switch (optname) {
+    case SO_RCVTIMEO:
+    case SO_SNDTIMEO: {
+      timeval tv;
+      if (unlikely(optval.size() < sizeof(tv))) return MakeError(EINVAL);
+      std::memcpy(&tv, optval.data(), sizeof(tv));
+      if (unlikely(tv.tv_usec < 0 || tv.tv_usec >= 1000000))
+        return MakeError(EDOM);
+      // A negative timeout expires immediately; zero disables the timeout.
+      int64_t us = tv.tv_sec < 0 ? 1 : Duration(tv).Microseconds();
+      if (optname == SO_RCVTIMEO)
+        rcvtimeo_us_ = us;
+      else
+        sndtimeo_us_ = us;
+      return {};
+    }
+    case SO_BUSY_POLL: {
+      Status<int> us = GetIntOpt(optval);
+      if (unlikely(!us)) return MakeError(us);
+      if (unlikely(*us < 0)) return MakeError(EINVAL);
+      busy_poll_.set_budget(*us);
+      return {};
+    }
+    default:
+      return MakeError(ENOPROTOOPT);
+  }
 }
 
-long DoAccept(int sockfd, sockaddr *addr, socklen_t *addrlen, int flags = 0) {
-  auto sock_ret = FDToSocket(sockfd);
-  if (unlikely(!sock_ret)) return MakeCError(sock_ret);
-  Socket &s = sock_ret.value().get();
-  Status<std::shared_ptr<Socket>> ret = s.Accept(flags);
-  if (unlikely(!ret)) return MakeCError(ret);
-  if (addr) {
-    Status<netaddr> na = (*ret)->RemoteAddr();
-    if (!na) return MakeCError(na);
-    auto conv_ret = NetAddrToSockAddr(*na, addr, addrlen);
-    if (unlikely(!conv_ret)) return MakeCError(conv_ret);
+Status<size_t> Socket::GetSockOpt(int level, int optname,
+                                  std::span<std::byte> optval) const {
+  if (level != SOL_SOCKET) return MakeError(ENOPROTOOPT);
+  switch (optname) {
+    case SO_RCVTIMEO:
+    case SO_SNDTIMEO: {
+      if (unlikely(optval.size() < sizeof(timeval))) return MakeError(EINVAL);
+      int64_t us = optname == SO_RCVTIMEO ? rcvtimeo_us_ : sndtimeo_us_;
+      timeval tv = Duration(us).Timeval();
+      std::memcpy(optval.data(), &tv, sizeof(tv));
+      return sizeof(tv);
+    }
+    case SO_BUSY_POLL:
+      return PutIntOpt(optval, static_cast<int>(busy_poll_.get_budget()));
+    case SO_ERROR:
+      return PutIntOpt(optval, 0);
+    default:
+      return MakeError(ENOPROTOOPT);
   }
-  return myproc().get_file_table().Insert(std::move(*ret),
-                                          (flags & kFlagCloseExec) > 0);
 }
 
-}  // namespace
+Status<void> Socket::WaitReadable(std::optional<Duration> timeout) {
+  constexpr unsigned int kReadable = kPollIn | kPollRDHUp | kPollHUp | kPollErr;
+  // Threads outside a process (e.g., io_uring workers) have nobody to charge
+  // the spinning to, so they just wait.
+  if (!busy_poll_.enabled() || !IsJunctionThread())
+    return WaitTimed(kReadable, timeout);
+
+  // Spin first, then park, and learn how long the wait lasted either way.
+  Time start = Time::Now();
+  BusyPollCounters &c = myproc().get_busy_poll_counters();
+  if (busy_poll_.Spin(start, [this] { return ReadReady(); }, c, timeout)) {
+    busy_poll_.Arrived(start);
+    return {};
+  }
+  if (timeout && timeout->IsZero()) return MakeError(EAGAIN);
+  Status<void> ret = WaitTimed(kReadable, timeout);
+  if (ret) busy_poll_.Arrived(start);
+  return ret;
+}
+
+Status<void> Socket::WaitTimed(unsigned int events,
+                               std::optional<Duration> timeout) {
+  PollSource &src = get_poll_source();
+  if (src.get_events() & events) return {};
+
+  rt::Spin lock;
+  rt::ThreadWaker waker;
+  bool ready = false;
+  rt::WakeOnTimeout timed_out(lock, waker, timeout);
+  Poller p([&](unsigned int pev) {
+    if (!(pev & events)) return;
+    rt::SpinGuard g(lock);
+    ready = true;
+    waker.Wake();
+  });
+  src.Attach(p);
+
+  bool signaled;
+  {
+    rt::SpinGuard g(lock);
+    signaled = !rt::WaitInterruptible(
+        lock, waker, [&ready, &timed_out] { return ready || timed_out; });
+  }
+  p.Detach();
+
+  if (ready) return {};
+  // Like Linux, a signal interrupts a timed socket wait without a restart,
+  // while an untimed one (busy polling without SO_RCVTIMEO) restarts.
+  if (signaled) return MakeError(timeout ? EINTR : ERESTARTSYS);
+  return MakeError(EAGAIN);
+}
 
 long usys_socket(int domain, int type, [[maybe_unused]] int protocol) {
   Status<std::shared_ptr<Socket>> ret = CreateSocket(domain, type);
@@ -101,6 +405,13 @@ long usys_bind(int sockfd, const struct sockaddr *addr_in, socklen_t addrlen) {
   auto sock_ret = FDToSocket(sockfd);
   if (unlikely(!sock_ret)) return MakeCError(sock_ret);
   Socket &s = sock_ret.value().get();
+  if (auto *u = most_derived_cast<UnixSocket>(&s)) {
+    Status<std::string> name = SockAddrToUnixName(addr_in, addrlen);
+    if (unlikely(!name)) return MakeCError(name);
+    Status<void> ret = u->BindName(*name);
+    if (unlikely(!ret)) return MakeCError(ret);
+    return 0;
+  }
   Status<netaddr> addr = SockAddrToNetAddr(addr_in, addrlen);
   if (unlikely(!addr)) return MakeCError(addr);
   Status<void> ret = s.Bind(*addr);
@@ -113,6 +424,13 @@ long usys_connect(int sockfd, const struct sockaddr *addr_in,
   auto sock_ret = FDToSocket(sockfd);
   if (unlikely(!sock_ret)) return MakeCError(sock_ret);
   Socket &s = sock_ret.value().get();
+  if (auto *u = most_derived_cast<UnixSocket>(&s)) {
+    Status<std::string> name = SockAddrToUnixName(addr_in, addrlen);
+    if (unlikely(!name)) return MakeCError(name);
+    Status<void> ret = u->ConnectName(*name);
+    if (unlikely(!ret)) return MakeCError(ret);
+    return 0;
+  }
   Status<netaddr> addr = SockAddrToNetAddr(addr_in, addrlen);
   if (unlikely(!addr)) return MakeCError(addr);
   Status<void> ret = s.Connect(*addr);
@@ -120,26 +438,43 @@ long usys_connect(int sockfd, const struct sockaddr *addr_in,
   return 0;
 }
 
-// TODO(girfan): Think about how to properly handle this.
-long usys_setsockopt(int sockfd, [[maybe_unused]] int level,
-                     [[maybe_unused]] int option_name,
-                     [[maybe_unused]] const void *option_value,
-                     [[maybe_unused]] socklen_t option_len) {
+// Options that a socket doesn't implement are accepted and ignored (with a
+// one-time warning), since most of them are tuning hints that applications
+// set unconditionally. SOL_IPV6, SOL_UDP and SOL_TCP options fail with
+// ENOPROTOOPT instead: applications probing for IPv6 or UDP offload features
+// fall back rather than assume they took effect, and TCP sockets refuse the
+// TCP options they can't honour themselves.
+long usys_setsockopt(int sockfd, int level, int option_name,
+                     const void *option_value, socklen_t option_len) {
   auto sock_ret = FDToSocket(sockfd);
   if (unlikely(!sock_ret)) return MakeCError(sock_ret);
-  if (level == SOL_IPV6) {
+  Socket &s = sock_ret.value().get();
+  Status<void> ret = s.SetSockOpt(
+      level, option_name,
+      writable_span(static_cast<const char *>(option_value), option_len));
+  if (ret) return 0;
+  if (ret.error() != ENOPROTOOPT) return MakeCError(ret);
+  if (level == SOL_IPV6 || level == SOL_UDP || level == IPPROTO_TCP)
     return -ENOPROTOOPT;
-  }
   LOG_ONCE(WARN) << "Unsupported: setsockopt";
   return 0;
 }
 
-long usys_getsockopt(int sockfd, [[maybe_unused]] int level,
-                     [[maybe_unused]] int option_name,
-                     [[maybe_unused]] void *option_value,
-                     [[maybe_unused]] socklen_t *option_len) {
+long usys_getsockopt(int sockfd, int level, int option_name,
+                     void *option_value, socklen_t *option_len) {
   auto sock_ret = FDToSocket(sockfd);
   if (unlikely(!sock_ret)) return MakeCError(sock_ret);
+  Socket &s = sock_ret.value().get();
+  if (unlikely(!option_len)) return -EFAULT;
+  Status<size_t> ret = s.GetSockOpt(
+      level, option_name,
+      readable_span(static_cast<char *>(option_value), *option_len));
+  if (ret) {
+    *option_len = *ret;
+    return 0;
+  }
+  if (ret.error() != ENOPROTOOPT) return MakeCError(ret);
+  if (level == SOL_UDP || level == IPPROTO_TCP) return -ENOPROTOOPT;
   LOG_ONCE(WARN) << "Unsupported: getsockopt";
   return 0;
 }
@@ -152,6 +487,18 @@ ssize_t usys_recvfrom(int sockfd, void *buf, size_t len, int flags,
   auto sock_ret = FDToSocket(sockfd);
   if (unlikely(!sock_ret)) return MakeCError(sock_ret);
   Socket &s = sock_ret.value().get();
+  if (auto *u = most_derived_cast<UnixSocket>(&s)) {
+    iovec iov = {buf, len};
+    std::string name;
+    Status<size_t> ret = u->RecvFrom({&iov, 1}, src_addr ? &name : nullptr,
+                                     peek, false, nullptr, nullptr);
+    if (unlikely(!ret)) return MakeCError(ret);
+    if (src_addr) {
+      auto conv_ret = UnixNameToSockAddr(name, src_addr, addrlen);
+      if (unlikely(!conv_ret)) return MakeCError(conv_ret);
+    }
+    return static_cast<ssize_t>(*ret);
+  }
   netaddr addr;
   Status<size_t> ret = s.ReadFrom(readable_span(static_cast<char *>(buf), len),
                                   src_addr ? &addr : nullptr, peek);
@@ -170,6 +517,20 @@ ssize_t usys_sendto(int sockfd, const void *buf, size_t len, int flags,
   auto sock_ret = FDToSocket(sockfd);
   if (unlikely(!sock_ret)) return MakeCError(sock_ret);
   Socket &s = sock_ret.value().get();
+  if (auto *u = most_derived_cast<UnixSocket>(&s)) {
+    iovec iov = {const_cast<void *>(buf), len};
+    std::string name;
+    if (dest_addr) {
+      Status<std::string> ret = SockAddrToUnixName(dest_addr, addrlen);
+      if (unlikely(!ret)) return MakeCError(ret);
+      name = std::move(*ret);
+    }
+    MsgOptions opts;
+    Status<size_t> ret =
+        u->SendTo({&iov, 1}, dest_addr ? &name : nullptr, opts);
+    if (unlikely(!ret)) return MakeCError(ret);
+    return static_cast<ssize_t>(*ret);
+  }
   netaddr addr;
   if (dest_addr) {
     Status<netaddr> naddr = SockAddrToNetAddr(dest_addr, addrlen);
@@ -186,26 +547,94 @@ ssize_t usys_sendto(int sockfd, const void *buf, size_t len, int flags,
 
 ssize_t usys_sendmsg(int sockfd, const struct msghdr *msg, int flags) {
   if (flags) LOG_ONCE(WARN) << "sendmsg ignoring flags " << flags;
-  if (msg->msg_control || msg->msg_controllen)
-    LOG_ONCE(WARN) << "sendmsg: ignoring control message";
   auto sock_ret = FDToSocket(sockfd);
   if (unlikely(!sock_ret)) return MakeCError(sock_ret);
   Socket &s = sock_ret.value().get();
+  Status<size_t> ret = DoSendMsg(s, *msg);
+  if (unlikely(!ret)) return MakeCError(ret);
+  return static_cast<ssize_t>(*ret);
+}
 
-  netaddr addr;
-  if (msg->msg_name) {
-    Status<netaddr> naddr = SockAddrToNetAddr(
-        reinterpret_cast<const sockaddr *>(msg->msg_name), msg->msg_namelen);
-    if (unlikely(!naddr)) return MakeCError(naddr);
-    addr = *naddr;
+long usys_sendmmsg(int sockfd, struct mmsghdr *msgvec, unsigned int vlen,
+                   int flags) {
+  if (flags) LOG_ONCE(WARN) << "sendmmsg ignoring flags " << flags;
+  auto sock_ret = FDToSocket(sockfd);
+  if (unlikely(!sock_ret)) return MakeCError(sock_ret);
+  Socket &s = sock_ret.value().get();
+
+  vlen = std::min(vlen, static_cast<unsigned int>(UIO_MAXIOV));
+  unsigned int i;
+  for (i = 0; i < vlen; i++) {
+    Status<size_t> ret = DoSendMsg(s, msgvec[i].msg_hdr);
+    if (unlikely(!ret)) {
+      // Report the error only if nothing was sent.
+      if (i == 0) return MakeCError(ret);
+      break;
+    }
+    msgvec[i].msg_len = static_cast<unsigned int>(*ret);
   }
+  return i;
+}
 
-  Status<size_t> ret = s.WritevTo({msg->msg_iov, msg->msg_iovlen},
-                                  msg->msg_name ? &addr : nullptr);
+ssize_t usys_recvmsg(int sockfd, struct msghdr *msg, int flags) {
+  bool peek = flags & kMsgPeek;
+  bool nonblocking = flags & kMsgDontWait;
+  bool cloexec = flags & kMsgCmsgCloexec;
+  flags &= ~(kMsgNoSignal | kMsgPeek | kMsgDontWait | kMsgCmsgCloexec);
+  if (unlikely(flags != 0)) return -EINVAL;
+  auto sock_ret = FDToSocket(sockfd);
+  if (unlikely(!sock_ret)) return MakeCError(sock_ret);
+  Socket &s = sock_ret.value().get();
+  Status<size_t> ret = DoRecvMsg(s, *msg, peek, nonblocking, cloexec);
   if (unlikely(!ret)) return MakeCError(ret);
   return static_cast<ssize_t>(*ret);
 }
 
+long usys_recvmmsg(int sockfd, struct mmsghdr *msgvec, unsigned int vlen,
+                   int flags, struct timespec *timeout) {
+  bool peek = flags & kMsgPeek;
+  bool nonblocking = flags & kMsgDontWait;
+  bool wait_for_one = flags & kMsgWaitForOne;
+  bool cloexec = flags & kMsgCmsgCloexec;
+  flags &= ~(kMsgNoSignal | kMsgPeek | kMsgDontWait | kMsgWaitForOne |
+             kMsgCmsgCloexec);
+  if (unlikely(flags != 0)) return -EINVAL;
+  if (timeout && (timeout->tv_sec < 0 || timeout->tv_nsec < 0 ||
+                  timeout->tv_nsec >= 1000000000L))
+    return -EINVAL;
+  auto sock_ret = FDToSocket(sockfd);
+  if (unlikely(!sock_ret)) return MakeCError(sock_ret);
+  Socket &s = sock_ret.value().get();
+
+  // As on Linux, the timeout is only checked after each message arrives.
+  std::optional<Time> deadline;
+  if (timeout) deadline = Time::Now() + Duration(*timeout);
+
+  vlen = std::min(vlen, static_cast<unsigned int>(UIO_MAXIOV));
+  unsigned int i;
+  for (i = 0; i < vlen; i++) {
+    Status<size_t> ret =
+        DoRecvMsg(s, msgvec[i].msg_hdr, peek, nonblocking, cloexec);
+    if (unlikely(!ret)) {
+      // Report the error only if nothing was received.
+      if (i == 0) return MakeCError(ret);
+      break;
+    }
+    msgvec[i].msg_len = static_cast<unsigned int>(*ret);
+    if (wait_for_one) nonblocking = true;
+    if (deadline && Time::Now() >= *deadline) {
+      i++;
+      break;
+    }
+  }
+
+  if (timeout) {
+    Duration left = Duration::Until(*deadline);
+    *timeout = left.Microseconds() > 0 ? left.Timespec() : timespec{};
+  }
+  return i;
+}
+
 long usys_accept(int sockfd, struct sockaddr *addr, socklen_t *addrlen) {
   return DoAccept(sockfd, addr, addrlen);
 }
@@ -238,6 +667,13 @@ long usys_getpeername(int sockfd, struct sockaddr *addr, socklen_t *addrlen) {
   auto sock_ret = FDToSocket(sockfd);
   if (unlikely(!sock_ret)) return MakeCError(sock_ret);
   Socket &s = sock_ret.value().get();
+  if (auto *u = most_derived_cast<UnixSocket>(&s)) {
+    Status<std::string> name = u->PeerName();
+    if (unlikely(!name)) return MakeCError(name);
+    auto conv_ret = UnixNameToSockAddr(*name, addr, addrlen);
+    if (unlikely(!conv_ret)) return MakeCError(conv_ret);
+    return 0;
+  }
   Status<netaddr> ret = s.RemoteAddr();
   if (unlikely(!ret)) return MakeCError(ret);
   auto conv_ret = NetAddrToSockAddr(*ret, addr, addrlen);
@@ -249,6 +685,11 @@ long usys_getsockname(int sockfd, struct sockaddr *addr, socklen_t *addrlen) {
   auto sock_ret = FDToSocket(sockfd);
   if (unlikely(!sock_ret)) return MakeCError(sock_ret);
   Socket &s = sock_ret.value().get();
+  if (auto *u = most_derived_cast<UnixSocket>(&s)) {
+    auto conv_ret = UnixNameToSockAddr(u->name(), addr, addrlen);
+    if (unlikely(!conv_ret)) return MakeCError(conv_ret);
+    return 0;
+  }
   Status<netaddr> ret = s.LocalAddr();
   if (unlikely(!ret)) return MakeCError(ret);
   auto conv_ret = NetAddrToSockAddr(*ret, addr, addrlen);
@@ -256,4 +697,18 @@ long usys_getsockname(int sockfd, struct sockaddr *addr, socklen_t *addrlen) {
   return 0;
 }
 
+long usys_socketpair(int domain, int type, [[maybe_unused]] int protocol,
+                     int sv[2]) {
+  if (domain != AF_UNIX) return -EAFNOSUPPORT;
+  int flags = type & kFlagNonblock;
+  bool cloexec = type & kFlagCloseExec;
+  type &= ~(kFlagCloseExec | kFlagNonblock);
+  if (!IsUnixType(type)) return -EINVAL;
+  auto [a, b] = UnixSocket::CreatePair(type, flags);
+  FileTable &ftbl = myproc().get_file_table();
+  sv[0] = ftbl.Insert(std::move(a), cloexec);
+  sv[1] = ftbl.Insert(std::move(b), cloexec);
+  return 0;
+}
+
 }  // namespace junction
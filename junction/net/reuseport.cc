@@ -0,0 +1,187 @@
+// reuseport.cc - SO_REUSEPORT listener groups
+
+#include "junction/net/reuseport.h"
+
+#include <algorithm>
+#include <map>
+#include <utility>
+
+namespace junction {
+
+namespace {
+
+// All groups, keyed by local address. A group's entry outlives its last
+// reference until its queue has released the port (see ~ReusePortGroup()).
+rt::Mutex registry_lock;
+rt::ConditionVariable registry_cv;
+std::map<std::pair<uint32_t, uint16_t>, std::weak_ptr<ReusePortGroup>>
+    registry;
+
+// Hashes a connection's remote address so that its flow always lands on the
+// same listener while the group doesn't change.
+uint32_t FlowHash(netaddr raddr) {
+  uint64_t h = (static_cast<uint64_t>(raddr.ip) << 16) | raddr.port;
+  h *= 0x9e3779b97f4a7c15ULL;
+  return static_cast<uint32_t>(h >> 32);
+}
+
+}  // namespace
+
+ReusePortGroup::ReusePortGroup(rt::TCPQueue q, netaddr laddr) noexcept
+    : laddr_(laddr), q_(std::move(q)) {
+  q_.InstallPollSource(QueueSet, QueueClear,
+                       reinterpret_cast<unsigned long>(this));
+}
+
+ReusePortGroup::~ReusePortGroup() {
+  assert(members_.empty());
+  // Close the queue before dropping the registry entry, so that a new group
+  // for the address can't find the port still in use.
+  { rt::TCPQueue q = std::move(q_); }
+
+  rt::ScopedLock g(registry_lock);
+  auto it = registry.find({laddr_.ip, laddr_.port});
+  if (it != registry.end() && it->second.expired()) registry.erase(it);
+  registry_cv.NotifyAll();
+}
+
+Status<std::shared_ptr<ReusePortGroup>> ReusePortGroup::Get(netaddr laddr,
+                                                            int backlog) {
+  const std::pair<uint32_t, uint16_t> key(laddr.ip, laddr.port);
+  rt::ScopedLock g(registry_lock);
+  while (true) {
+    auto it = registry.find(key);
+    if (it == registry.end()) break;
+    if (std::shared_ptr<ReusePortGroup> group = it->second.lock())
+      return group;
+    // The last member just left; wait for the old group to close its queue.
+    registry_cv.Wait(registry_lock);
+  }
+
+  Status<rt::TCPQueue> q = rt::TCPQueue::Listen(laddr, backlog);
+  if (unlikely(!q)) return MakeError(q);
+  q->SetNonBlocking(true);
+  auto group = std::make_shared<ReusePortGroup>(std::move(*q), laddr);
+  registry.emplace(key, group);
+  return group;
+}
+
+void ReusePortGroup::Add(ReusePortListener &l) {
+  rt::SpinGuard g(lock_);
+  members_.push_back(&l);
+  l.SetQueued(queued_);
+}
+
+void ReusePortGroup::Remove(ReusePortListener &l) {
+  rt::SpinGuard g(lock_);
+  auto it = std::find(members_.begin(), members_.end(), &l);
+  assert(it != members_.end());
+  members_.erase(it);
+}
+
+Status<rt::TCPConn> ReusePortGroup::Steer(ReusePortListener &l) {
+  while (true) {
+    // No locks are held here, since Caladan reports the queue emptying
+    // through QueueClear().
+    Status<rt::TCPConn> c = q_.Accept();
+    if (!c) return MakeError(c);
+
+    const uint32_t hash = FlowHash(c->RemoteAddr());
+    rt::SpinGuard g(lock_);
+    const size_t n = members_.size();
+    // If the chosen listener is full, try the next ones. @l is a member, so
+    // the connection ends up with it at the latest.
+    for (size_t i = 0; i < n; i++) {
+      ReusePortListener *m = members_[(hash + i) % n];
+      if (m == &l) return std::move(*c);
+      if (m->Push(*c)) break;
+    }
+  }
+}
+
+void ReusePortGroup::QueueSet(unsigned long data, unsigned int events) {
+  if (events & kPollIn)
+    reinterpret_cast<ReusePortGroup *>(data)->SetQueued(true);
+}
+
+void ReusePortGroup::QueueClear(unsigned long data, unsigned int events) {
+  if (events & kPollIn)
+    reinterpret_cast<ReusePortGroup *>(data)->SetQueued(false);
+}
+
+void ReusePortGroup::SetQueued(bool queued) {
+  rt::SpinGuard g(lock_);
+  queued_ = queued;
+  for (ReusePortListener *m : members_) m->SetQueued(queued);
+}
+
+ReusePortListener::~ReusePortListener() {
+  if (group_) group_->Remove(*this);
+}
+
+Status<std::unique_ptr<ReusePortListener>> ReusePortListener::Listen(
+    netaddr laddr, int backlog) {
+  Status<std::shared_ptr<ReusePortGroup>> group =
+      ReusePortGroup::Get(laddr, backlog);
+  if (unlikely(!group)) return MakeError(group);
+  auto l = std::make_unique<ReusePortListener>(backlog);
+  l->group_ = std::move(*group);
+  l->group_->Add(*l);
+  return l;
+}
+
+bool ReusePortListener::Push(rt::TCPConn &c) {
+  rt::SpinGuard g(lock_);
+  if (shut_ || conns_.size() >= backlog_) return false;
+  conns_.push_back(std::move(c));
+  UpdatePoll();
+  return true;
+}
+
+void ReusePortListener::SetQueued(bool queued) {
+  rt::SpinGuard g(lock_);
+  queued_ = queued;
+  UpdatePoll();
+}
+
+void ReusePortListener::UpdatePoll() {
+  assert(lock_.IsHeld());
+  if (!poll_) return;
+  if (shut_)
+    poll_->Set(kPollIn | kPollRDHUp | kPollHUp);
+  else if (!conns_.empty() || queued_)
+    poll_->Set(kPollIn);
+  else
+    poll_->Clear(kPollIn);
+}
+
+Status<rt::TCPConn> ReusePortListener::Accept() {
+  {
+    rt::SpinGuard g(lock_);
+    if (unlikely(shut_)) return MakeError(EINVAL);
+    if (!conns_.empty()) {
+      rt::TCPConn c = std::move(conns_.front());
+      conns_.pop_front();
+      UpdatePoll();
+      return c;
+    }
+  }
+  return group_->Steer(*this);
+}
+
+void ReusePortListener::Shutdown() {
+  // Pending connections are closed outside the lock.
+  std::deque<rt::TCPConn> conns;
+  rt::SpinGuard g(lock_);
+  shut_ = true;
+  conns.swap(conns_);
+  UpdatePoll();
+}
+
+void ReusePortListener::InstallPollSource(PollSource &src) {
+  rt::SpinGuard g(lock_);
+  poll_ = &src;
+  UpdatePoll();
+}
+
+}  // namespace junction
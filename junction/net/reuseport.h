@@ -0,0 +1,106 @@
+// reuseport.h - SO_REUSEPORT listener groups
+
+#pragma once
+
+#include <algorithm>
+#include <deque>
+#include <memory>
+#include <vector>
+
+#include "junction/base/error.h"
+#include "junction/bindings/net.h"
+#include "junction/bindings/sync.h"
+#include "junction/kernel/poll.h"
+
+namespace junction {
+
+class ReusePortListener;
+
+// A group of SO_REUSEPORT listeners bound to the same address. Caladan allows
+// only one listener queue per port, so the group owns it. There is no
+// dispatcher: a member that finds its own queue empty drains the shared queue
+// itself, steering each connection to a member by hashing its remote address,
+// until it finds one of its own. Accepts thus run in parallel on the threads
+// that call them, while a given flow always lands on the same member.
+class ReusePortGroup {
+ public:
+  ReusePortGroup(rt::TCPQueue q, netaddr laddr) noexcept;
+  ~ReusePortGroup();
+
+  ReusePortGroup(const ReusePortGroup &) = delete;
+  ReusePortGroup &operator=(const ReusePortGroup &) = delete;
+
+  // Finds the group for @laddr or creates it.
+  static Status<std::shared_ptr<ReusePortGroup>> Get(netaddr laddr,
+                                                     int backlog);
+
+  [[nodiscard]] netaddr LocalAddr() const { return laddr_; }
+
+  void Add(ReusePortListener &l);
+  void Remove(ReusePortListener &l);
+
+  // Takes connections from the shared queue, queueing those that belong to
+  // other members, until one for @l turns up. Fails with EAGAIN once the
+  // shared queue is empty.
+  Status<rt::TCPConn> Steer(ReusePortListener &l);
+
+ private:
+  // Caladan's poll callbacks for the shared queue.
+  static void QueueSet(unsigned long data, unsigned int events);
+  static void QueueClear(unsigned long data, unsigned int events);
+  void SetQueued(bool queued);
+
+  netaddr laddr_;
+  rt::Spin lock_;
+  std::vector<ReusePortListener *> members_;
+  bool queued_{false};  // the shared queue has connections
+  rt::TCPQueue q_;
+};
+
+// One member of a SO_REUSEPORT group, with its own accept queue.
+class ReusePortListener {
+ public:
+  // Like Linux, the accept queue holds one more connection than @backlog.
+  ReusePortListener(int backlog) noexcept
+      : backlog_(static_cast<size_t>(std::max(backlog, 0)) + 1) {}
+  ~ReusePortListener();
+
+  ReusePortListener(const ReusePortListener &) = delete;
+  ReusePortListener &operator=(const ReusePortListener &) = delete;
+
+  // Joins (or creates) the group for @laddr.
+  static Status<std::unique_ptr<ReusePortListener>> Listen(netaddr laddr,
+                                                           int backlog);
+
+  // Takes the next connection for this listener, failing with EAGAIN if
+  // there is none. Never blocks; callers wait on the installed poll source.
+  Status<rt::TCPConn> Accept();
+
+  // Stops accepting; later calls to Accept() fail.
+  void Shutdown();
+
+  [[nodiscard]] netaddr LocalAddr() const { return group_->LocalAddr(); }
+
+  // Reports connections as kPollIn on @src, including those still in the
+  // group's shared queue.
+  void InstallPollSource(PollSource &src);
+
+ private:
+  friend class ReusePortGroup;
+
+  // Queues a connection unless this listener is full or shut down.
+  bool Push(rt::TCPConn &c);
+  // Records whether the group's shared queue has connections.
+  void SetQueued(bool queued);
+  void UpdatePoll();
+
+  rt::Spin lock_;
+  std::deque<rt::TCPConn> conns_;
+  size_t backlog_;
+  bool queued_{false};
+  bool shut_{false};
+  PollSource *poll_{nullptr};
+  std::shared_ptr<ReusePortGroup> group_;
+};
+
+}  // namespace junction
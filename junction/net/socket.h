@@ -2,12 +2,18 @@
 
 #pragma once
 
+#include <algorithm>
+#include <cstring>
 #include <memory>
 #include <optional>
+#include <vector>
 
 #include "junction/base/error.h"
+#include "junction/base/io.h"
+#include "junction/base/time.h"
 #include "junction/bindings/net.h"
 #include "junction/fs/file.h"
+#include "junction/kernel/busy_poll.h"
 #include "junction/snapshot/cereal.h"
 
 namespace junction {
@@ -17,14 +23,29 @@ static_assert(kFlagCloseExec == SOCK_CLOEXEC);
 
 inline constexpr unsigned int kMsgNoSignal = MSG_NOSIGNAL;
 inline constexpr unsigned int kMsgPeek = MSG_PEEK;
+inline constexpr unsigned int kMsgDontWait = MSG_DONTWAIT;
+inline constexpr unsigned int kMsgWaitForOne = MSG_WAITFORONE;
+inline constexpr unsigned int kMsgCmsgCloexec = MSG_CMSG_CLOEXEC;
 inline constexpr unsigned int kSockTypeMask = 0xf;
 
+// Per-message options carried in control messages (see cmsg(3)).
+struct MsgOptions {
+  // UDP_SEGMENT when sending, UDP_GRO when receiving (zero if unset).
+  size_t segment_size = 0;
+  // SCM_RIGHTS: the files being passed (UNIX sockets only).
+  std::vector<std::shared_ptr<File>> files;
+  // SCM_CREDENTIALS: the sender's credentials (UNIX sockets only).
+  std::optional<ucred> creds;
+};
+
 class Socket : public File {
  public:
   Socket(int flags = 0)
       : File(FileType::kSocket, flags, FileMode::kReadWrite) {}
   ~Socket() override = default;
 
+  [[nodiscard]] bool has_poll_source() const override { return true; }
+
   virtual Status<void> Bind(netaddr addr) { return MakeError(EINVAL); }
   virtual Status<void> Connect(netaddr addr) { return MakeError(EINVAL); }
   virtual Status<size_t> ReadFrom(std::span<std::byte> buf, netaddr *raddr,
@@ -40,6 +61,50 @@ class Socket : public File {
                                   const netaddr *raddr) {
     return MakeError(ENOTCONN);
   }
+  virtual Status<size_t> ReadvFrom(std::span<const iovec> iov, netaddr *raddr,
+                                   bool peek = false) {
+    return MakeError(ENOTCONN);
+  }
+
+  // Sends or receives one message for sendmsg() and recvmsg(). Sockets that
+  // don't support any per-message options ignore them.
+  virtual Status<size_t> SendMsg(std::span<const iovec> iov,
+                                 const netaddr *raddr,
+                                 [[maybe_unused]] const MsgOptions &opts) {
+    if (iov.size() == 1) {
+      return WriteTo(writable_span(static_cast<const char *>(iov[0].iov_base),
+                                   iov[0].iov_len),
+                     raddr);
+    }
+    return WritevTo(iov, raddr);
+  }
+  virtual Status<size_t> RecvMsg(std::span<const iovec> iov, netaddr *raddr,
+                                 bool peek,
+                                 [[maybe_unused]] MsgOptions *opts) {
+    if (iov.size() == 1) {
+      return ReadFrom(
+          readable_span(static_cast<char *>(iov[0].iov_base), iov[0].iov_len),
+          raddr, peek);
+    }
+    return ReadvFrom(iov, raddr, peek);
+  }
+
+  // Sets a socket option (see setsockopt(2)). Subclasses pass options they
+  // don't handle to this one, which handles the options common to all sockets.
+  virtual Status<void> SetSockOpt(int level, int optname,
+                                  std::span<const std::byte> optval);
+  // Gets a socket option, returning the number of bytes stored in @optval.
+  virtual Status<size_t> GetSockOpt(int level, int optname,
+                                    std::span<std::byte> optval) const;
+
+  // Returns true if a read would not block.
+  [[nodiscard]] bool ReadReady() {
+    constexpr unsigned int kReadable =
+        kPollIn | kPollRDHUp | kPollHUp | kPollErr;
+    return (get_poll_source().get_events() & kReadable) != 0;
+  }
+
+  [[nodiscard]] BusyPoll &get_busy_poll() { return busy_poll_; }
 
   virtual Status<std::shared_ptr<Socket>> Accept(int flags = 0) {
     return MakeError(ENOTCONN);
@@ -63,20 +128,141 @@ class Socket : public File {
     return {};
   }
 
+ protected:
+  // Waits until a blocking read won't block if SO_RCVTIMEO or SO_BUSY_POLL
+  // is set, failing with EAGAIN when the timeout expires. A concurrent reader
+  // can still take the data first, in which case the read blocks without a
+  // timeout (sockets that can be made nonblocking use TimedRead() instead).
+  Status<void> WaitForRead() {
+    if (likely(!rcvtimeo_us_ && !busy_poll_.enabled()) || is_nonblocking())
+      return {};
+    std::optional<Duration> timeout;
+    if (rcvtimeo_us_) timeout = Duration(rcvtimeo_us_);
+    return WaitReadable(timeout);
+  }
+
+  // Like WaitForRead(), but for writes and SO_SNDTIMEO.
+  Status<void> WaitForWrite() {
+    if (likely(!sndtimeo_us_) || is_nonblocking()) return {};
+    return WaitTimed(kPollOut | kPollHUp | kPollErr, Duration(sndtimeo_us_));
+  }
+
+  // Whether SO_RCVTIMEO or SO_SNDTIMEO is set.
+  [[nodiscard]] bool has_timeouts() const {
+    return rcvtimeo_us_ || sndtimeo_us_;
+  }
+
+  // Calls @op, which fails with EAGAIN instead of blocking, until it succeeds
+  // or fails otherwise. A blocking socket waits for input in between, so
+  // SO_RCVTIMEO bounds the whole call rather than a wait before it.
+  template <typename F>
+  auto TimedRead(F op) -> decltype(op()) {
+    const std::optional<Time> deadline = Deadline(rcvtimeo_us_);
+    while (true) {
+      auto ret = op();
+      if (ret || ret.error() != EAGAIN || is_nonblocking()) return ret;
+      Status<void> wret = WaitReadable(Remaining(deadline));
+      if (unlikely(!wret)) return MakeError(wret);
+    }
+  }
+
+  // Like TimedRead(), but writes @len bytes under SO_SNDTIMEO. @op is given
+  // the number of bytes written so far. Once some data has been written, a
+  // timeout, signal or error ends the call with a short count.
+  template <typename F>
+  Status<size_t> TimedWrite(size_t len, F op) {
+    const std::optional<Time> deadline = Deadline(sndtimeo_us_);
+    size_t done = 0;
+    while (true) {
+      Status<size_t> ret = op(done);
+      if (ret) {
+        done += *ret;
+        if (done >= len || is_nonblocking()) return done;
+        if (*ret) continue;
+      } else if (ret.error() != EAGAIN || is_nonblocking()) {
+        if (done) return done;
+        return ret;
+      }
+      Status<void> wret =
+          WaitTimed(kPollOut | kPollHUp | kPollErr, Remaining(deadline));
+      if (unlikely(!wret)) {
+        if (done) return done;
+        return MakeError(wret);
+      }
+    }
+  }
+
  private:
+  Status<void> WaitReadable(std::optional<Duration> timeout);
+  Status<void> WaitTimed(unsigned int events, std::optional<Duration> timeout);
+
+  // When a timeout of @us microseconds (zero if unset) that starts now ends.
+  static std::optional<Time> Deadline(int64_t us) {
+    if (!us) return std::nullopt;
+    return Time::Now() + Duration(us);
+  }
+
+  // How much of the time until @deadline is left.
+  static std::optional<Duration> Remaining(std::optional<Time> deadline) {
+    if (!deadline) return std::nullopt;
+    return std::max(Duration::Until(*deadline), Duration(0));
+  }
+
   friend class cereal::access;
 
   template <class Archive>
   void save(Archive &ar) const {
-    ar(cereal::base_class<File>(this));
+    ar(cereal::base_class<File>(this), rcvtimeo_us_, sndtimeo_us_,
+       busy_poll_.get_budget());
   }
 
   template <class Archive>
   void load(Archive &ar) {
-    ar(cereal::base_class<File>(this));
+    uint32_t busy_poll_us;
+    ar(cereal::base_class<File>(this), rcvtimeo_us_, sndtimeo_us_,
+       busy_poll_us);
+    busy_poll_.set_budget(busy_poll_us);
   }
+
+  // SO_RCVTIMEO and SO_SNDTIMEO in microseconds (zero if unset).
+  int64_t rcvtimeo_us_{0};
+  int64_t sndtimeo_us_{0};
+  BusyPoll busy_poll_;  // SO_BUSY_POLL
 };
 
+// Reads an int-sized socket option.
+inline Status<int> GetIntOpt(std::span<const std::byte> optval) {
+  if (unlikely(optval.size() < sizeof(int))) return MakeError(EINVAL);
+  int val;
+  std::memcpy(&val, optval.data(), sizeof(val));
+  return val;
+}
+
+// Stores an int-sized socket option, truncating it to the caller's buffer.
+inline size_t PutIntOpt(std::span<std::byte> optval, int val) {
+  size_t len = std::min(optval.size(), sizeof(val));
+  std::memcpy(optval.data(), &val, len);
+  return len;
+}
+
+// Converts a requested SO_RCVBUF or SO_SNDBUF size into the size reported by
+// getsockopt(). Like Linux, the request is doubled to leave room for
+// bookkeeping overhead and then clamped.
+inline constexpr int kSockBufDefault = 212992;
+inline constexpr int kSockBufMin = 4608;
+inline constexpr int kSockBufMax = 64 << 20;
+inline int SockBufSize(int requested) {
+  return std::clamp(std::clamp(requested, 0, kSockBufMax / 2) * 2,
+                    kSockBufMin, kSockBufMax);
+}
+
+// Converts a user-supplied IPv4 socket address.
+Status<netaddr> SockAddrToNetAddr(const sockaddr *addr, socklen_t addrlen);
+
+// Fills in a user-supplied socket address, truncating it to @addrlen bytes.
+Status<void> NetAddrToSockAddr(const netaddr &naddr, sockaddr *saddr,
+                               socklen_t *addrlen);
+
 }  // namespace junction
 
 CEREAL_REGISTER_TYPE(junction::Socket);
@@ -5,6 +5,8 @@ extern "C" {
 #include <arpa/inet.h>
 #include <fcntl.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
 #include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -20,6 +22,7 @@ extern "C" {
 
 #include <future>
 #include <thread>
+#include <vector>
 
 const int SIZE = 4096;
 const int COUNT = 10000;
@@ -221,3 +224,143 @@ TEST_F(TCPTest, ReadWrite) {
   EXPECT_EQ(0, server.get());
   EXPECT_EQ(0, client.get());
 }
+
+TEST_F(TCPTest, SockOpt) {
+  int lfd = socket(AF_INET, SOCK_STREAM, 0);
+  ASSERT_GE(lfd, 0);
+  struct sockaddr_in in;
+  memset(&in, 0, sizeof(in));
+  in.sin_family = AF_INET;
+  in.sin_port = htons(PORT + 1);
+  ASSERT_EQ(inet_pton(AF_INET, IP, &in.sin_addr), 1);
+  int yes = 1;
+  ASSERT_EQ(setsockopt(lfd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes)), 0);
+  ASSERT_EQ(bind(lfd, (struct sockaddr *)&in, sizeof(in)), 0);
+  ASSERT_EQ(listen(lfd, 8), 0);
+
+  // Receive timeouts apply to accept() and reads.
+  struct timeval tv = {0, 20000};
+  ASSERT_EQ(setsockopt(lfd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)), 0);
+  struct timeval got;
+  socklen_t len = sizeof(got);
+  ASSERT_EQ(getsockopt(lfd, SOL_SOCKET, SO_RCVTIMEO, &got, &len), 0);
+  EXPECT_EQ(len, sizeof(got));
+  EXPECT_EQ(got.tv_sec, tv.tv_sec);
+  EXPECT_EQ(got.tv_usec, tv.tv_usec);
+  EXPECT_EQ(accept(lfd, NULL, NULL), -1);
+  EXPECT_EQ(errno, EAGAIN);
+
+  int cfd = socket(AF_INET, SOCK_STREAM, 0);
+  ASSERT_GE(cfd, 0);
+  ASSERT_EQ(connect(cfd, (struct sockaddr *)&in, sizeof(in)), 0);
+  int afd = accept(lfd, NULL, NULL);
+  ASSERT_GE(afd, 0);
+
+  ASSERT_EQ(setsockopt(afd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)), 0);
+  char c;
+  EXPECT_EQ(read(afd, &c, 1), -1);
+  EXPECT_EQ(errno, EAGAIN);
+  ASSERT_EQ(write(cfd, "x", 1), 1);
+  EXPECT_EQ(read(afd, &c, 1), 1);
+
+  int val;
+  ASSERT_EQ(setsockopt(cfd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes)), 0);
+  len = sizeof(val);
+  ASSERT_EQ(getsockopt(cfd, IPPROTO_TCP, TCP_NODELAY, &val, &len), 0);
+  EXPECT_NE(val, 0);
+
+  // Options that the stack can't honour are refused rather than recorded.
+  int idle = 30;
+  if (setsockopt(cfd, IPPROTO_TCP, TCP_CORK, &yes, sizeof(yes)) == 0) {
+    len = sizeof(val);
+    ASSERT_EQ(getsockopt(cfd, IPPROTO_TCP, TCP_CORK, &val, &len), 0);
+    EXPECT_NE(val, 0);
+  } else {
+    EXPECT_EQ(errno, ENOPROTOOPT);
+  }
+  if (setsockopt(cfd, IPPROTO_TCP, TCP_KEEPIDLE, &idle, sizeof(idle)) == 0) {
+    len = sizeof(val);
+    ASSERT_EQ(getsockopt(cfd, IPPROTO_TCP, TCP_KEEPIDLE, &val, &len), 0);
+    EXPECT_EQ(val, idle);
+  } else {
+    EXPECT_EQ(errno, ENOPROTOOPT);
+  }
+
+  // Keepalive and buffer size requests always succeed, but getsockopt()
+  // reports what is in effect.
+  ASSERT_EQ(setsockopt(cfd, SOL_SOCKET, SO_KEEPALIVE, &yes, sizeof(yes)), 0);
+  len = sizeof(val);
+  ASSERT_EQ(getsockopt(cfd, SOL_SOCKET, SO_KEEPALIVE, &val, &len), 0);
+  int size = 65536;
+  ASSERT_EQ(setsockopt(cfd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size)), 0);
+  len = sizeof(val);
+  ASSERT_EQ(getsockopt(cfd, SOL_SOCKET, SO_RCVBUF, &val, &len), 0);
+  EXPECT_GT(val, 0);
+
+  len = sizeof(val);
+  ASSERT_EQ(getsockopt(cfd, SOL_SOCKET, SO_ERROR, &val, &len), 0);
+  EXPECT_EQ(val, 0);
+  struct tcp_info info;
+  len = sizeof(info);
+  ASSERT_EQ(getsockopt(cfd, IPPROTO_TCP, TCP_INFO, &info, &len), 0);
+  EXPECT_EQ(info.tcpi_state, TCP_ESTABLISHED);
+
+  // A send timeout bounds the whole write, which comes up short once the
+  // unread data fills the buffers.
+  ASSERT_EQ(setsockopt(cfd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv)), 0);
+  std::vector<char> big(64 << 20);
+  ssize_t n = write(cfd, big.data(), big.size());
+  EXPECT_GT(n, 0);
+  EXPECT_LT(static_cast<size_t>(n), big.size());
+
+  close(afd);
+  close(cfd);
+  close(lfd);
+}
+
+TEST_F(TCPTest, ReusePort) {
+  struct sockaddr_in in;
+  memset(&in, 0, sizeof(in));
+  in.sin_family = AF_INET;
+  in.sin_port = htons(PORT + 2);
+  ASSERT_EQ(inet_pton(AF_INET, IP, &in.sin_addr), 1);
+
+  // Both listeners share the port, each with its own accept queue.
+  constexpr int kListeners = 2;
+  struct pollfd pfds[kListeners];
+  for (struct pollfd &p : pfds) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    ASSERT_GE(fd, 0);
+    int yes = 1;
+    ASSERT_EQ(setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &yes, sizeof(yes)), 0);
+    ASSERT_EQ(bind(fd, (struct sockaddr *)&in, sizeof(in)), 0);
+    ASSERT_EQ(listen(fd, 64), 0);
+    p = {fd, POLLIN, 0};
+  }
+
+  constexpr int kConns = 32;
+  std::vector<int> clients;
+  for (int i = 0; i < kConns; i++) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    ASSERT_GE(fd, 0);
+    ASSERT_EQ(connect(fd, (struct sockaddr *)&in, sizeof(in)), 0);
+    clients.push_back(fd);
+  }
+
+  // Every connection is accepted by exactly one of the listeners.
+  int accepted = 0;
+  while (accepted < kConns) {
+    ASSERT_GT(poll(pfds, kListeners, 5000), 0);
+    for (struct pollfd &p : pfds) {
+      if (!(p.revents & POLLIN)) continue;
+      int fd = accept(p.fd, NULL, NULL);
+      ASSERT_GE(fd, 0);
+      close(fd);
+      accepted++;
+    }
+  }
+  EXPECT_EQ(accepted, kConns);
+
+  for (int fd : clients) close(fd);
+  for (struct pollfd &p : pfds) close(p.fd);
+}
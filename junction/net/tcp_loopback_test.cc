@@ -0,0 +1,182 @@
+extern "C" {
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+}
+
+#include <gtest/gtest.h>
+
+#include <thread>
+
+namespace {
+
+constexpr int kPort = 2231;
+
+sockaddr_in MakeAddr(uint32_t ip, int port) {
+  sockaddr_in in;
+  memset(&in, 0, sizeof(in));
+  in.sin_family = AF_INET;
+  in.sin_port = htons(port);
+  in.sin_addr.s_addr = htonl(ip);
+  return in;
+}
+
+// Creates a socket listening on @port on every address.
+int Listen(int port) {
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (fd < 0) return -1;
+  int yes = 1;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+  sockaddr_in in = MakeAddr(INADDR_ANY, port);
+  if (bind(fd, reinterpret_cast<sockaddr *>(&in), sizeof(in)) ||
+      listen(fd, 16)) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+int Connect(int port) {
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (fd < 0) return -1;
+  sockaddr_in in = MakeAddr(INADDR_LOOPBACK, port);
+  if (connect(fd, reinterpret_cast<sockaddr *>(&in), sizeof(in))) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+}  // namespace
+
+TEST(TCPLoopbackTest, Addresses) {
+  int lfd = Listen(kPort);
+  ASSERT_GE(lfd, 0);
+  int cfd = Connect(kPort);
+  ASSERT_GE(cfd, 0);
+  sockaddr_in peer;
+  socklen_t plen = sizeof(peer);
+  int sfd = accept(lfd, reinterpret_cast<sockaddr *>(&peer), &plen);
+  ASSERT_GE(sfd, 0);
+
+  // Each end's local address is the other's remote address.
+  sockaddr_in self;
+  socklen_t slen = sizeof(self);
+  ASSERT_EQ(getsockname(cfd, reinterpret_cast<sockaddr *>(&self), &slen), 0);
+  EXPECT_EQ(self.sin_addr.s_addr, peer.sin_addr.s_addr);
+  EXPECT_EQ(self.sin_port, peer.sin_port);
+
+  ASSERT_EQ(getpeername(cfd, reinterpret_cast<sockaddr *>(&peer), &plen), 0);
+  EXPECT_EQ(ntohl(peer.sin_addr.s_addr), INADDR_LOOPBACK);
+  EXPECT_EQ(ntohs(peer.sin_port), kPort);
+
+  close(sfd);
+  close(cfd);
+  close(lfd);
+}
+
+TEST(TCPLoopbackTest, ShutdownAndPoll) {
+  int lfd = Listen(kPort + 1);
+  ASSERT_GE(lfd, 0);
+
+  // A pending connection makes the listener readable.
+  int cfd = Connect(kPort + 1);
+  ASSERT_GE(cfd, 0);
+  pollfd pfd = {lfd, POLLIN, 0};
+  ASSERT_EQ(poll(&pfd, 1, 1000), 1);
+  EXPECT_TRUE(pfd.revents & POLLIN);
+  int sfd = accept(lfd, nullptr, nullptr);
+  ASSERT_GE(sfd, 0);
+
+  ASSERT_EQ(fcntl(sfd, F_SETFL, O_NONBLOCK), 0);
+  char buf[16];
+  EXPECT_EQ(read(sfd, buf, sizeof(buf)), -1);
+  EXPECT_EQ(errno, EAGAIN);
+
+  ASSERT_EQ(write(cfd, "ping", 4), 4);
+  pfd = {sfd, POLLIN, 0};
+  ASSERT_EQ(poll(&pfd, 1, 1000), 1);
+  EXPECT_EQ(recv(sfd, buf, sizeof(buf), MSG_PEEK), 4);
+  EXPECT_EQ(read(sfd, buf, sizeof(buf)), 4);
+  EXPECT_EQ(memcmp(buf, "ping", 4), 0);
+
+  // Shutting down writes shows up as end of file, but data still flows the
+  // other way.
+  ASSERT_EQ(shutdown(cfd, SHUT_WR), 0);
+  pfd = {sfd, POLLIN | POLLRDHUP, 0};
+  ASSERT_EQ(poll(&pfd, 1, 1000), 1);
+  EXPECT_TRUE(pfd.revents & POLLRDHUP);
+  EXPECT_EQ(read(sfd, buf, sizeof(buf)), 0);
+  ASSERT_EQ(write(sfd, "pong", 4), 4);
+  EXPECT_EQ(read(cfd, buf, sizeof(buf)), 4);
+  EXPECT_EQ(memcmp(buf, "pong", 4), 0);
+
+  close(sfd);
+  EXPECT_EQ(read(cfd, buf, sizeof(buf)), 0);
+  close(cfd);
+  close(lfd);
+}
+
+TEST(TCPLoopbackTest, BlockingAccept) {
+  int lfd = Listen(kPort + 2);
+  ASSERT_GE(lfd, 0);
+
+  // The accept blocks before the connection is made.
+  std::thread client([] {
+    usleep(10000);
+    int fd = Connect(kPort + 2);
+    ASSERT_GE(fd, 0);
+    ASSERT_EQ(write(fd, "hello", 5), 5);
+    close(fd);
+  });
+
+  int sfd = accept(lfd, nullptr, nullptr);
+  ASSERT_GE(sfd, 0);
+  char buf[8];
+  EXPECT_EQ(read(sfd, buf, sizeof(buf)), 5);
+  EXPECT_EQ(memcmp(buf, "hello", 5), 0);
+  client.join();
+
+  close(sfd);
+  close(lfd);
+}
+
+TEST(TCPLoopbackTest, BusyPollRead) {
+  int lfd = Listen(kPort + 3);
+  ASSERT_GE(lfd, 0);
+  int cfd = Connect(kPort + 3);
+  ASSERT_GE(cfd, 0);
+  int sfd = accept(lfd, nullptr, nullptr);
+  ASSERT_GE(sfd, 0);
+
+  // Linux needs CAP_NET_ADMIN to raise the budget above net.core.busy_read.
+  int us = 50;
+  if (setsockopt(sfd, SOL_SOCKET, SO_BUSY_POLL, &us, sizeof(us)) &&
+      errno == EPERM) {
+    GTEST_SKIP() << "SO_BUSY_POLL not permitted";
+  }
+  us = 0;
+  socklen_t len = sizeof(us);
+  ASSERT_EQ(getsockopt(sfd, SOL_SOCKET, SO_BUSY_POLL, &us, &len), 0);
+  EXPECT_EQ(us, 50);
+
+  // Reads succeed whether the data shows up while spinning or after parking.
+  char buf[8];
+  for (int delay_us : {0, 10, 10000}) {
+    std::thread writer([cfd, delay_us] {
+      usleep(delay_us);
+      ASSERT_EQ(write(cfd, "data", 4), 4);
+    });
+    EXPECT_EQ(read(sfd, buf, sizeof(buf)), 4);
+    writer.join();
+  }
+
+  close(sfd);
+  close(cfd);
+  close(lfd);
+}
@@ -0,0 +1,179 @@
+// tcp_socket.cc - TCP socket options
+
+extern "C" {
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+}
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#include "junction/base/io.h"
+#include "junction/bindings/log.h"
+#include "junction/net/tcp_socket.h"
+
+namespace junction {
+
+Status<size_t> TCPSocket::DoWrite(std::span<const std::byte> buf) {
+  auto write = [this](std::span<const std::byte> b, bool nonblocking) {
+    if (is_loopback()) return Loopback().Write(b, nonblocking);
+    return TcpConn().Write(b);
+  };
+  if (!has_timeouts()) return write(buf, is_nonblocking());
+  return TimedWrite(buf.size(), [&](size_t done) {
+    return write(buf.subspan(done), true);
+  });
+}
+
+Status<size_t> TCPSocket::DoWritev(std::span<const iovec> iov) {
+  auto writev = [this](std::span<const iovec> v, bool nonblocking) {
+    if (is_loopback()) return Loopback().Writev(v, nonblocking);
+    return TcpConn().Writev(v);
+  };
+  if (!has_timeouts()) return writev(iov, is_nonblocking());
+
+  // After a short write, the rest is written from a copy of the vector.
+  std::vector<iovec> copy;
+  std::span<iovec> rest;
+  size_t pulled = 0;
+  return TimedWrite(SumIOV(iov), [&](size_t done) {
+    if (!done) return writev(iov, true);
+    if (copy.empty()) {
+      copy.assign(iov.begin(), iov.end());
+      rest = copy;
+    }
+    rest = PullIOV(rest, done - pulled);
+    pulled = done;
+    return writev(rest, true);
+  });
+}
+
+Status<void> TCPSocket::SetSockOpt(int level, int optname,
+                                   std::span<const std::byte> optval) {
+  if (level == SOL_SOCKET) {
+    switch (optname) {
+      case SO_RCVTIMEO:
+      case SO_SNDTIMEO: {
+        Status<void> ret = Socket::SetSockOpt(level, optname, optval);
+        if (ret) UpdateConnMode();
+        return ret;
+      }
+      case SO_RCVBUF:
+      case SO_SNDBUF:
+      case SO_KEEPALIVE:
+      case SO_REUSEPORT:
+        break;
+      default:
+        return Socket::SetSockOpt(level, optname, optval);
+    }
+  } else if (level != IPPROTO_TCP) {
+    return Socket::SetSockOpt(level, optname, optval);
+  }
+
+  // Caladan's TCP stack has no knobs for Nagle's algorithm, corking,
+  // keepalives or window sizes. Only the settings that match what it does
+  // anyway are accepted, except for two that servers commonly treat a
+  // failure of as fatal: keepalive requests and buffer sizes are accepted
+  // with a warning, and getsockopt() reports what is actually in effect.
+  Status<int> val = GetIntOpt(optval);
+  if (unlikely(!val)) return MakeError(val);
+  if (level == SOL_SOCKET) {
+    switch (optname) {
+      case SO_REUSEPORT:
+        opts_.reuseport = *val != 0;
+        break;
+      case SO_KEEPALIVE:
+        if (*val) LOG_ONCE(WARN) << "TCP keepalive probes are not supported";
+        break;
+      default:
+        LOG_ONCE(WARN) << "TCP buffer sizes are fixed; ignoring "
+                       << (optname == SO_RCVBUF ? "SO_RCVBUF" : "SO_SNDBUF");
+        break;
+    }
+    return {};
+  }
+
+  switch (optname) {
+    case TCP_NODELAY:
+      // Caladan sends segments as soon as they are written.
+      if (unlikely(!*val)) return MakeError(ENOPROTOOPT);
+      return {};
+    case TCP_CORK:
+      if (unlikely(*val)) return MakeError(ENOPROTOOPT);
+      return {};
+    default:
+      return MakeError(ENOPROTOOPT);
+  }
+}
+
+Status<size_t> TCPSocket::GetSockOpt(int level, int optname,
+                                     std::span<std::byte> optval) const {
+  if (level == SOL_SOCKET) {
+    switch (optname) {
+      case SO_RCVBUF:
+      case SO_SNDBUF:
+        return PutIntOpt(optval, kSockBufDefault);
+      case SO_KEEPALIVE:
+        return PutIntOpt(optval, 0);
+      case SO_REUSEPORT:
+        return PutIntOpt(optval, opts_.reuseport);
+      case SO_ERROR: {
+        // Reports the outcome of a nonblocking connect().
+        int err = 0;
+        if (state_ == SocketState::kSockConnected && !is_loopback()) {
+          Status<void> ret = TcpConn().GetStatus();
+          if (!ret && ret.error() != EINPROGRESS && ret.error() != EALREADY)
+            err = ret.error().code();
+        }
+        return PutIntOpt(optval, err);
+      }
+      default:
+        return Socket::GetSockOpt(level, optname, optval);
+    }
+  }
+  if (level != IPPROTO_TCP) return Socket::GetSockOpt(level, optname, optval);
+
+  switch (optname) {
+    case TCP_NODELAY:
+      return PutIntOpt(optval, 1);
+    case TCP_CORK:
+      return PutIntOpt(optval, 0);
+    case TCP_INFO: {
+      // Caladan doesn't export its congestion control state, so only the
+      // connection state is filled in.
+      tcp_info info;
+      std::memset(&info, 0, sizeof(info));
+      switch (state_) {
+        case SocketState::kSockListening:
+          info.tcpi_state = TCP_LISTEN;
+          break;
+        case SocketState::kSockConnected: {
+          // Loopback connections are established as soon as they are made.
+          if (is_loopback()) {
+            info.tcpi_state = TCP_ESTABLISHED;
+            break;
+          }
+          Status<void> ret = TcpConn().GetStatus();
+          if (ret)
+            info.tcpi_state = TCP_ESTABLISHED;
+          else if (ret.error() == EINPROGRESS || ret.error() == EALREADY)
+            info.tcpi_state = TCP_SYN_SENT;
+          else
+            info.tcpi_state = TCP_CLOSE;
+          break;
+        }
+        default:
+          info.tcpi_state = TCP_CLOSE;
+          break;
+      }
+      size_t len = std::min(optval.size(), sizeof(info));
+      std::memcpy(optval.data(), &info, len);
+      return len;
+    }
+    default:
+      return MakeError(ENOPROTOOPT);
+  }
+}
+
+}  // namespace junction
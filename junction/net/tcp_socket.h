@@ -11,6 +11,8 @@ extern "C" {
 #include "junction/base/error.h"
 #include "junction/bindings/net.h"
 #include "junction/net/caladan_poll.h"
+#include "junction/net/loopback.h"
+#include "junction/net/reuseport.h"
 #include "junction/net/socket.h"
 #include "junction/snapshot/cereal.h"
 
@@ -24,6 +26,10 @@ class TCPSocket : public Socket {
       : Socket(flags),
         state_(SocketState::kSockConnected),
         v_(std::move(conn)) {}
+  TCPSocket(LoopbackConn conn, int flags = 0) noexcept
+      : Socket(flags),
+        state_(SocketState::kSockConnected),
+        v_(std::move(conn)) {}
 
   ~TCPSocket() override = default;
 
@@ -36,10 +42,8 @@ class TCPSocket : public Socket {
   }
 
   Status<void> Listen(int backlog) override {
-    Status<rt::TCPQueue> ret = rt::TCPQueue::Listen(addr_, backlog);
-    if (unlikely(!ret)) return MakeError(ret);
-    if (is_nonblocking()) ret->SetNonBlocking(true);
-    v_ = std::move(*ret);
+    Status<void> ret = DoListen(backlog);
+    if (unlikely(!ret)) return ret;
     state_ = SocketState::kSockListening;
     backlog_ = backlog;
     if (IsPollSourceSetup()) SetupPollSource();
@@ -50,41 +54,61 @@ class TCPSocket : public Socket {
     // Some applications probe the nonblocking socket by calling connect()
     if (state_ == SocketState::kSockConnected) {
       if (!is_nonblocking()) return MakeError(EISCONN);
+      if (is_loopback()) return {};
       return TcpConn().GetStatus();
     }
 
     if (unlikely(state_ != SocketState::kSockUnbound &&
                  state_ != SocketState::kSockBound))
       return MakeError(EINVAL);
-    Status<rt::TCPConn> ret;
-    if (is_nonblocking())
-      ret = rt::TCPConn::DialNonBlocking(addr_, addr);
-    else
-      ret = rt::TCPConn::Dial(addr_, addr);
-    if (unlikely(!ret)) return MakeError(ret);
-    v_ = std::move(*ret);
+
+    // A listener in this instance is connected to directly, bypassing
+    // Caladan's TCP stack. Such a connection is established at once.
+    Status<std::optional<LoopbackConn>> lc = LoopbackConnect(addr_, addr);
+    if (unlikely(!lc)) return MakeError(lc);
+    if (*lc) {
+      v_ = std::move(**lc);
+    } else {
+      Status<rt::TCPConn> ret;
+      if (is_nonblocking())
+        ret = rt::TCPConn::DialNonBlocking(addr_, addr);
+      else
+        ret = rt::TCPConn::Dial(addr_, addr);
+      if (unlikely(!ret)) return MakeError(ret);
+      v_ = std::move(*ret);
+    }
     state_ = SocketState::kSockConnected;
+    UpdateConnMode();
     if (IsPollSourceSetup()) SetupPollSource();
-    if (is_nonblocking()) return TcpConn().GetStatus();
+    if (is_nonblocking() && !is_loopback()) return TcpConn().GetStatus();
     return {};
   }
 
   Status<std::shared_ptr<Socket>> Accept(int flags) override {
     if (unlikely(state_ != SocketState::kSockListening))
       return MakeError(EINVAL);
-    Status<rt::TCPConn> ret = TcpQueue().Accept();
-    if (unlikely(!ret)) return MakeError(ret);
-    if (flags & kFlagNonblock) ret->SetNonBlocking(true);
-    return std::make_shared<TCPSocket>(std::move(*ret), flags);
+    if (has_timeouts()) return TimedRead([&] { return TryAccept(flags); });
+    if (Status<void> ret = WaitForRead(); unlikely(!ret))
+      return MakeError(ret);
+
+    // The Caladan queue never blocks; instead, the loopback listener waits
+    // for a connection from either source.
+    while (true) {
+      Status<std::shared_ptr<Socket>> ret = TryAccept(flags);
+      if (ret || ret.error() != EAGAIN || is_nonblocking()) return ret;
+      if (!loopback_->Wait()) return MakeError(EINTR);
+    }
   }
 
   Status<void> Shutdown(int how) override {
-    if (state_ == SocketState::kSockConnected) return TcpConn().Shutdown(how);
+    if (state_ == SocketState::kSockConnected) {
+      if (is_loopback()) return Loopback().Shutdown(how);
+      return TcpConn().Shutdown(how);
+    }
 
     if (state_ == SocketState::kSockListening) {
       bool shutdown = false;
-      if (is_shut_.compare_exchange_strong(shutdown, true))
-        TcpQueue().Shutdown();
+      if (is_shut_.compare_exchange_strong(shutdown, true)) ShutdownListener();
       return {};
     }
 
@@ -94,6 +118,7 @@ class TCPSocket : public Socket {
   Status<netaddr> RemoteAddr() const override {
     if (unlikely(state_ != SocketState::kSockConnected))
       return MakeError(ENOTCONN);
+    if (is_loopback()) return Loopback().RemoteAddr();
     return TcpConn().RemoteAddr();
   }
 
@@ -103,9 +128,10 @@ class TCPSocket : public Socket {
       case SocketState::kSockBound:
         return addr_;
       case SocketState::kSockConnected:
+        if (is_loopback()) return Loopback().LocalAddr();
         return TcpConn().LocalAddr();
       case SocketState::kSockListening:
-        return TcpQueue().LocalAddr();
+        return ListenerAddr();
       default:
         std::unreachable();
     }
@@ -115,23 +141,30 @@ class TCPSocket : public Socket {
                       [[maybe_unused]] off_t *off = nullptr) override {
     if (unlikely(state_ != SocketState::kSockConnected))
       return MakeError(EINVAL);
-    return TcpConn().Read(buf);
+    return DoRead([this, buf](bool nonblocking) {
+      if (is_loopback()) return Loopback().Read(buf, false, nonblocking);
+      return TcpConn().Read(buf);
+    });
   }
 
   Status<size_t> Write(std::span<const std::byte> buf,
                        [[maybe_unused]] off_t *off = nullptr) override {
     if (unlikely(state_ != SocketState::kSockConnected))
       return MakeError(EINVAL);
-    return TcpConn().Write(buf);
+    return DoWrite(buf);
   }
 
   virtual Status<size_t> ReadFrom(std::span<std::byte> buf, netaddr *raddr,
                                   bool peek) override {
     if (unlikely(state_ != SocketState::kSockConnected))
       return MakeError(EINVAL);
-    if (raddr) *raddr = TcpConn().RemoteAddr();
-    if (peek) return TcpConn().ReadPeek(buf);
-    return TcpConn().Read(buf);
+    if (raddr)
+      *raddr = is_loopback() ? Loopback().RemoteAddr() : TcpConn().RemoteAddr();
+    return DoRead([this, buf, peek](bool nonblocking) {
+      if (is_loopback()) return Loopback().Read(buf, peek, nonblocking);
+      if (peek) return TcpConn().ReadPeek(buf);
+      return TcpConn().Read(buf);
+    });
   }
 
   virtual Status<size_t> WriteTo(std::span<const std::byte> buf,
@@ -139,7 +172,7 @@ class TCPSocket : public Socket {
     if (unlikely(state_ != SocketState::kSockConnected))
       return MakeError(EINVAL);
     if (raddr) return MakeError(EISCONN);
-    return TcpConn().Write(buf);
+    return DoWrite(buf);
   }
 
   Status<size_t> WritevTo(std::span<const iovec> iov,
@@ -147,21 +180,46 @@ class TCPSocket : public Socket {
     if (unlikely(state_ != SocketState::kSockConnected))
       return MakeError(EINVAL);
     if (raddr) return MakeError(EISCONN);
-    return TcpConn().Writev(iov);
+    return DoWritev(iov);
+  }
+
+  Status<size_t> ReadvFrom(std::span<const iovec> iov, netaddr *raddr,
+                           bool peek) override {
+    if (unlikely(state_ != SocketState::kSockConnected))
+      return MakeError(EINVAL);
+    if (raddr)
+      *raddr = is_loopback() ? Loopback().RemoteAddr() : TcpConn().RemoteAddr();
+    return DoRead([this, iov, peek](bool nonblocking) -> Status<size_t> {
+      if (is_loopback()) return Loopback().Readv(iov, peek, nonblocking);
+      if (!peek) return TcpConn().Readv(iov);
+      // A stream may return fewer bytes than asked, so only peek into the
+      // first buffer.
+      if (iov.empty()) return 0;
+      return TcpConn().ReadPeek(
+          readable_span(static_cast<char *>(iov[0].iov_base), iov[0].iov_len));
+    });
   }
 
   Status<size_t> Writev(std::span<const iovec> iov,
                         [[maybe_unused]] off_t *off = nullptr) override {
     if (unlikely(state_ != SocketState::kSockConnected))
       return MakeError(EINVAL);
-    return TcpConn().Writev(iov);
+    return DoWritev(iov);
   }
 
+  Status<void> SetSockOpt(int level, int optname,
+                          std::span<const std::byte> optval) override;
+  Status<size_t> GetSockOpt(int level, int optname,
+                            std::span<std::byte> optval) const override;
+
   Status<size_t> Readv(std::span<iovec> iov,
                        [[maybe_unused]] off_t *off) override {
     if (unlikely(state_ != SocketState::kSockConnected))
       return MakeError(EINVAL);
-    return TcpConn().Readv(iov);
+    return DoRead([this, iov](bool nonblocking) {
+      if (is_loopback()) return Loopback().Readv(iov, false, nonblocking);
+      return TcpConn().Readv(iov);
+    });
   }
 
  private:
@@ -172,11 +230,107 @@ class TCPSocket : public Socket {
     kSockConnected
   };
 
+  // Socket options that Junction implements itself. Caladan's TCP stack
+  // has no knobs, so the other TCP tunables aren't kept (see SetSockOpt()).
+  struct Options {
+    bool reuseport{false};
+
+    template <class Archive>
+    void serialize(Archive &ar) {
+      ar(reuseport);
+    }
+  };
+
+  // Reads with @op, which is told whether it must not block. While a timeout
+  // is set, the Caladan connection is nonblocking (see UpdateConnMode()) and
+  // TimedRead() does the waiting, so the timeout bounds the whole call.
+  template <typename F>
+  Status<size_t> DoRead(F op) {
+    if (has_timeouts()) return TimedRead([&op] { return op(true); });
+    if (Status<void> ret = WaitForRead(); unlikely(!ret))
+      return MakeError(ret);
+    return op(is_nonblocking());
+  }
+
+  Status<size_t> DoWrite(std::span<const std::byte> buf);
+  Status<size_t> DoWritev(std::span<const iovec> iov);
+
+  // Keeps the Caladan connection nonblocking whenever the application asked
+  // for it (@nonblocking) or a timeout is set, in which case the socket does
+  // the waiting itself.
+  void UpdateConnMode(bool nonblocking) {
+    if (state_ == SocketState::kSockConnected && !is_loopback())
+      TcpConn().SetNonBlocking(nonblocking || has_timeouts());
+  }
+  void UpdateConnMode() { UpdateConnMode(is_nonblocking()); }
+
+  // Takes a pending connection from either source, failing with EAGAIN if
+  // there is none.
+  Status<std::shared_ptr<Socket>> TryAccept(int flags) {
+    if (unlikely(is_shut_)) return MakeError(EINVAL);
+    if (std::optional<LoopbackConn> c = loopback_->TryAccept())
+      return Accepted(std::move(*c), flags);
+
+    Status<rt::TCPConn> ret =
+        is_reuseport() ? ReusePort().Accept() : TcpQueue().Accept();
+    if (unlikely(!ret)) return MakeError(ret);
+    if (flags & kFlagNonblock) ret->SetNonBlocking(true);
+    return Accepted(std::move(*ret), flags);
+  }
+
+  // Creates the listener queue, joining a SO_REUSEPORT group if enabled, and
+  // registers for loopback connections.
+  Status<void> DoListen(int backlog) {
+    if (opts_.reuseport && addr_.port) {
+      Status<std::unique_ptr<ReusePortListener>> ret =
+          ReusePortListener::Listen(addr_, backlog);
+      if (unlikely(!ret)) return MakeError(ret);
+      v_ = std::move(*ret);
+    } else {
+      Status<rt::TCPQueue> ret = rt::TCPQueue::Listen(addr_, backlog);
+      if (unlikely(!ret)) return MakeError(ret);
+      ret->SetNonBlocking(true);
+      v_ = std::move(*ret);
+    }
+
+    loopback_ = std::make_unique<LoopbackListener>(ListenerAddr(), backlog);
+    PollSource &s = loopback_->stack_source();
+    if (is_reuseport())
+      ReusePort().InstallPollSource(s);
+    else
+      TcpQueue().InstallPollSource(PollSourceSet, PollSourceClear,
+                                   reinterpret_cast<unsigned long>(&s));
+    return {};
+  }
+
+  void ShutdownListener() {
+    if (is_reuseport())
+      ReusePort().Shutdown();
+    else
+      TcpQueue().Shutdown();
+    loopback_->Shutdown();
+  }
+
+  // Wraps an accepted connection. Like Linux, accepted sockets inherit the
+  // listener's TCP options.
+  template <typename Conn>
+  std::shared_ptr<Socket> Accepted(Conn conn, int flags) {
+    auto sock = std::make_shared<TCPSocket>(std::move(conn), flags);
+    sock->opts_ = opts_;
+    return sock;
+  }
+
+  [[nodiscard]] netaddr ListenerAddr() const {
+    if (is_reuseport()) return ReusePort().LocalAddr();
+    return TcpQueue().LocalAddr();
+  }
+
   void SetupPollSource() override {
     PollSource &s = get_poll_source();
     if (state_ == SocketState::kSockListening)
-      TcpQueue().InstallPollSource(PollSourceSet, PollSourceClear,
-                                   reinterpret_cast<unsigned long>(&s));
+      loopback_->InstallPollSource(s);
+    else if (state_ == SocketState::kSockConnected && is_loopback())
+      Loopback().InstallPollSource(s);
     else if (state_ == SocketState::kSockConnected)
       TcpConn().InstallPollSource(PollSourceSet, PollSourceClear,
                                   reinterpret_cast<unsigned long>(&s));
@@ -185,11 +339,8 @@ class TCPSocket : public Socket {
   void NotifyFlagsChanging(unsigned int oldflags,
                            unsigned int newflags) override {
     if ((oldflags & kFlagNonblock) == (newflags & kFlagNonblock)) return;
-    bool nonblocking = (newflags & kFlagNonblock) > 0;
-    if (state_ == SocketState::kSockListening)
-      TcpQueue().SetNonBlocking(nonblocking);
-    else if (state_ == SocketState::kSockConnected)
-      TcpConn().SetNonBlocking(nonblocking);
+    // Accepts and loopback connections check the flag on each call.
+    UpdateConnMode((newflags & kFlagNonblock) > 0);
   }
 
   [[nodiscard]] rt::TCPConn &TcpConn() { return std::get<rt::TCPConn>(v_); }
@@ -200,22 +351,40 @@ class TCPSocket : public Socket {
   [[nodiscard]] const rt::TCPQueue &TcpQueue() const {
     return std::get<rt::TCPQueue>(v_);
   }
+  [[nodiscard]] bool is_reuseport() const {
+    return std::holds_alternative<std::unique_ptr<ReusePortListener>>(v_);
+  }
+  [[nodiscard]] ReusePortListener &ReusePort() const {
+    return *std::get<std::unique_ptr<ReusePortListener>>(v_);
+  }
+  [[nodiscard]] bool is_loopback() const {
+    return std::holds_alternative<LoopbackConn>(v_);
+  }
+  [[nodiscard]] LoopbackConn &Loopback() { return std::get<LoopbackConn>(v_); }
+  [[nodiscard]] const LoopbackConn &Loopback() const {
+    return std::get<LoopbackConn>(v_);
+  }
 
   friend class cereal::access;
 
   template <class Archive>
   void save(Archive &ar) const {
-    ar(cereal::base_class<Socket>(this), state_);
+    ar(cereal::base_class<Socket>(this), state_, opts_);
 
     switch (state_) {
       case SocketState::kSockBound:
         ar(addr_);
         break;
       case SocketState::kSockConnected:
-        ar(TcpConn().LocalAddr(), TcpConn().RemoteAddr());
+        ar(is_loopback());
+        if (is_loopback())
+          ar(Loopback());
+        else
+          ar(TcpConn().LocalAddr(), TcpConn().RemoteAddr());
         break;
       case SocketState::kSockListening:
-        ar(TcpQueue().LocalAddr(), is_shut_, backlog_);
+        ar(ListenerAddr(), is_shut_, backlog_);
+        loopback_->save(ar);
         break;
       default:
         break;
@@ -224,7 +393,7 @@ class TCPSocket : public Socket {
 
   template <class Archive>
   void load(Archive &ar) {
-    ar(cereal::base_class<Socket>(this), state_);
+    ar(cereal::base_class<Socket>(this), state_, opts_);
 
     if (state_ == SocketState::kSockUnbound) return;
     if (state_ == SocketState::kSockBound) {
@@ -232,7 +401,14 @@ class TCPSocket : public Socket {
       return;
     }
 
-    if (state_ == SocketState::kSockConnected) {
+    bool loopback = false;
+    if (state_ == SocketState::kSockConnected) ar(loopback);
+
+    if (loopback) {
+      LoopbackConn c;
+      ar(c);
+      v_ = std::move(c);
+    } else if (state_ == SocketState::kSockConnected) {
       netaddr laddr, raddr;
       ar(laddr, raddr);
       Status<rt::TCPConn> c;
@@ -249,18 +425,17 @@ class TCPSocket : public Socket {
         BUG();
       }
       v_ = std::move(*c);
+      UpdateConnMode();
     } else {
       assert(state_ == SocketState::kSockListening);
       ar(addr_, is_shut_, backlog_);
-      Status<rt::TCPQueue> q = rt::TCPQueue::Listen(addr_, backlog_);
-      if (unlikely(!q)) {
+      if (unlikely(!DoListen(backlog_))) {
         LOG(ERR) << "failed to restore TCP listen socket @ " << addr_.ip << ":"
                  << addr_.port;
         BUG();
       }
-      if (is_nonblocking()) q->SetNonBlocking(true);
-      if (is_shut_) q->Shutdown();
-      v_ = std::move(*q);
+      loopback_->load(ar);
+      if (is_shut_) ShutdownListener();
     }
 
     if (IsPollSourceSetup()) SetupPollSource();
@@ -270,7 +445,12 @@ class TCPSocket : public Socket {
   netaddr addr_{0, 0};
   int backlog_;
   std::atomic_bool is_shut_{false};
-  std::variant<rt::TCPConn, rt::TCPQueue> v_;
+  Options opts_;
+  // Listening sockets only; outlives v_, which reports to it.
+  std::unique_ptr<LoopbackListener> loopback_;
+  std::variant<rt::TCPConn, rt::TCPQueue, std::unique_ptr<ReusePortListener>,
+               LoopbackConn>
+      v_;
 };
 
 }  // namespace junction
@@ -5,6 +5,7 @@ extern "C" {
 #include <arpa/inet.h>
 #include <fcntl.h>
 #include <netinet/in.h>
+#include <netinet/udp.h>
 #include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -13,6 +14,7 @@ extern "C" {
 #include <sys/stat.h>
 #include <sys/time.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 #include <unistd.h>
 }
 
@@ -20,6 +22,7 @@ extern "C" {
 
 #include <future>
 #include <thread>
+#include <vector>
 
 const int SIZE = 1024;
 const int COUNT = 5000;
@@ -161,3 +164,322 @@ TEST_F(UDPTest, ReadWrite) {
   EXPECT_EQ(0, server.get());
   EXPECT_EQ(0, client.get());
 }
+
+// Echoes batches of datagrams with recvmmsg()/sendmmsg().
+int BatchServer(int port, size_t size, int batch) {
+  int fd = socket(AF_INET, SOCK_DGRAM, 0);
+  if (fd == -1) {
+    perror("socket");
+    return 1;
+  }
+
+  struct sockaddr_in in;
+  memset(&in, 0, sizeof(in));
+  in.sin_family = AF_INET;
+  in.sin_port = htons(port);
+  if (bind(fd, (struct sockaddr *)&in, sizeof(in)) == -1) {
+    perror("bind");
+    close(fd);
+    return 1;
+  }
+
+  std::vector<unsigned char> bufs(size * batch);
+  std::vector<iovec> iov(batch);
+  std::vector<sockaddr_in> addrs(batch);
+  std::vector<mmsghdr> msgs(batch);
+  int total = 0;
+  while (total < COUNT) {
+    for (int i = 0; i < batch; i++) {
+      iov[i] = {&bufs[i * size], size};
+      memset(&msgs[i], 0, sizeof(msgs[i]));
+      msgs[i].msg_hdr.msg_iov = &iov[i];
+      msgs[i].msg_hdr.msg_iovlen = 1;
+      msgs[i].msg_hdr.msg_name = &addrs[i];
+      msgs[i].msg_hdr.msg_namelen = sizeof(addrs[i]);
+    }
+    int n = recvmmsg(fd, msgs.data(), batch, MSG_WAITFORONE, nullptr);
+    if (n <= 0) {
+      perror("recvmmsg");
+      EXPECT_GT(n, 0);
+      break;
+    }
+    for (int i = 0; i < n; i++) {
+      EXPECT_EQ(msgs[i].msg_len, size);
+      iov[i].iov_len = msgs[i].msg_len;
+    }
+    int wret = sendmmsg(fd, msgs.data(), n, 0);
+    if (wret != n) {
+      perror("sendmmsg");
+      EXPECT_EQ(wret, n);
+    }
+    total += n;
+  }
+
+  close(fd);
+  return 0;
+}
+
+int BatchClient(int port, size_t size, int batch) {
+  sleep(1);
+
+  int fd = socket(AF_INET, SOCK_DGRAM, 0);
+  if (fd == -1) {
+    perror("socket");
+    return 1;
+  }
+
+  struct sockaddr_in in;
+  memset(&in, 0, sizeof(in));
+  in.sin_family = AF_INET;
+  in.sin_port = htons(port);
+  if (inet_pton(AF_INET, IP, &in.sin_addr) != 1) {
+    close(fd);
+    return 1;
+  }
+  if (connect(fd, (struct sockaddr *)&in, sizeof(in)) == -1) {
+    perror("connect");
+    close(fd);
+    return 1;
+  }
+
+  std::vector<unsigned char> bufs(size * batch);
+  std::vector<iovec> iov(batch);
+  std::vector<mmsghdr> msgs(batch);
+  for (int i = 0; i < batch; i++) {
+    iov[i] = {&bufs[i * size], size};
+    memset(&msgs[i], 0, sizeof(msgs[i]));
+    msgs[i].msg_hdr.msg_iov = &iov[i];
+    msgs[i].msg_hdr.msg_iovlen = 1;
+  }
+
+  struct timeval begin, end;
+  gettimeofday(&begin, NULL);
+
+  for (int sent = 0; sent < COUNT; sent += batch) {
+    int wret = sendmmsg(fd, msgs.data(), batch, 0);
+    if (wret != batch) {
+      perror("sendmmsg");
+      EXPECT_EQ(wret, batch);
+      break;
+    }
+
+    int received = 0;
+    while (received < batch) {
+      int n = recvmmsg(fd, msgs.data(), batch - received, MSG_WAITFORONE,
+                       nullptr);
+      if (n <= 0) {
+        perror("recvmmsg");
+        EXPECT_GT(n, 0);
+        break;
+      }
+      for (int i = 0; i < n; i++) EXPECT_EQ(msgs[i].msg_len, size);
+      received += n;
+    }
+  }
+
+  gettimeofday(&end, NULL);
+
+  double tm = GetElapsed(&begin, &end);
+  printf("%.0fMB/s %.0fmsg/s\n", COUNT * size * 1.0 / (tm * 1024 * 1024),
+         COUNT * 1.0 / tm);
+
+  close(fd);
+  return 0;
+}
+
+void RunBatch(int port, size_t size) {
+  constexpr int kBatch = 40;
+  static_assert(COUNT % kBatch == 0);
+  printf("UDP batched (size: %zu, batch: %d, count: %d)\n", size, kBatch,
+         COUNT);
+
+  auto server = std::async(std::launch::async, BatchServer, port, size, kBatch);
+  auto client = std::async(std::launch::async, BatchClient, port, size, kBatch);
+  EXPECT_EQ(0, server.get());
+  EXPECT_EQ(0, client.get());
+}
+
+TEST_F(UDPTest, BatchReadWriteSmall) { RunBatch(PORT + 1, 64); }
+
+TEST_F(UDPTest, BatchReadWriteLarge) { RunBatch(PORT + 2, 1400); }
+
+TEST_F(UDPTest, RecvMsgPeekDontWait) {
+  int rfd = socket(AF_INET, SOCK_DGRAM, 0);
+  ASSERT_GE(rfd, 0);
+  struct sockaddr_in in;
+  memset(&in, 0, sizeof(in));
+  in.sin_family = AF_INET;
+  in.sin_port = htons(PORT + 3);
+  ASSERT_EQ(inet_pton(AF_INET, IP, &in.sin_addr), 1);
+  ASSERT_EQ(bind(rfd, (struct sockaddr *)&in, sizeof(in)), 0);
+
+  char buf[16];
+  iovec iov = {buf, sizeof(buf)};
+  msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  EXPECT_EQ(recvmsg(rfd, &msg, MSG_DONTWAIT), -1);
+  EXPECT_EQ(errno, EAGAIN);
+
+  int sfd = socket(AF_INET, SOCK_DGRAM, 0);
+  ASSERT_GE(sfd, 0);
+  ASSERT_EQ(sendto(sfd, "ping", 4, 0, (struct sockaddr *)&in, sizeof(in)), 4);
+
+  sockaddr_in from;
+  msg.msg_name = &from;
+  msg.msg_namelen = sizeof(from);
+  EXPECT_EQ(recvmsg(rfd, &msg, MSG_PEEK), 4);
+  EXPECT_EQ(recvmsg(rfd, &msg, 0), 4);
+  EXPECT_EQ(memcmp(buf, "ping", 4), 0);
+  EXPECT_EQ(msg.msg_namelen, sizeof(from));
+  EXPECT_EQ(from.sin_addr.s_addr, in.sin_addr.s_addr);
+
+  // A timeout ends the batch once it expires, without waiting for all of it.
+  ASSERT_EQ(sendto(sfd, "pong", 4, 0, (struct sockaddr *)&in, sizeof(in)), 4);
+  mmsghdr msgs[2];
+  memset(msgs, 0, sizeof(msgs));
+  msgs[0].msg_hdr.msg_iov = &iov;
+  msgs[0].msg_hdr.msg_iovlen = 1;
+  msgs[1] = msgs[0];
+  timespec ts = {0, 0};
+  EXPECT_EQ(recvmmsg(rfd, msgs, 2, 0, &ts), 1);
+  EXPECT_EQ(msgs[0].msg_len, 4u);
+
+  close(sfd);
+  close(rfd);
+}
+
+TEST_F(UDPTest, VectoredIO) {
+  int rfd = socket(AF_INET, SOCK_DGRAM, 0);
+  ASSERT_GE(rfd, 0);
+  struct sockaddr_in in;
+  memset(&in, 0, sizeof(in));
+  in.sin_family = AF_INET;
+  in.sin_port = htons(PORT + 4);
+  ASSERT_EQ(inet_pton(AF_INET, IP, &in.sin_addr), 1);
+  ASSERT_EQ(bind(rfd, (struct sockaddr *)&in, sizeof(in)), 0);
+
+  int sfd = socket(AF_INET, SOCK_DGRAM, 0);
+  ASSERT_GE(sfd, 0);
+  ASSERT_EQ(connect(sfd, (struct sockaddr *)&in, sizeof(in)), 0);
+
+  // A gathered send is one datagram.
+  char hello[] = "hello, ";
+  char world[] = "world";
+  iovec out[] = {{hello, 7}, {world, 5}};
+  ASSERT_EQ(writev(sfd, out, 2), 12);
+  msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = out;
+  msg.msg_iovlen = 2;
+  ASSERT_EQ(sendmsg(sfd, &msg, 0), 12);
+
+  // A scattered receive fills the buffers in order from one datagram.
+  char a[4], b[16];
+  iovec in_iov[] = {{a, sizeof(a)}, {b, sizeof(b)}};
+  ASSERT_EQ(readv(rfd, in_iov, 2), 12);
+  EXPECT_EQ(memcmp(a, "hell", 4), 0);
+  EXPECT_EQ(memcmp(b, "o, world", 8), 0);
+
+  // Datagrams that don't fit are truncated.
+  in_iov[1].iov_len = 2;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = in_iov;
+  msg.msg_iovlen = 2;
+  ASSERT_EQ(recvmsg(rfd, &msg, 0), 6);
+  EXPECT_EQ(memcmp(b, "o,", 2), 0);
+
+  close(sfd);
+  close(rfd);
+}
+
+TEST_F(UDPTest, SegmentationOffload) {
+  int rfd = socket(AF_INET, SOCK_DGRAM, 0);
+  ASSERT_GE(rfd, 0);
+  struct sockaddr_in in;
+  memset(&in, 0, sizeof(in));
+  in.sin_family = AF_INET;
+  in.sin_port = htons(PORT + 5);
+  ASSERT_EQ(inet_pton(AF_INET, IP, &in.sin_addr), 1);
+  ASSERT_EQ(bind(rfd, (struct sockaddr *)&in, sizeof(in)), 0);
+
+  int sfd = socket(AF_INET, SOCK_DGRAM, 0);
+  ASSERT_GE(sfd, 0);
+  ASSERT_EQ(connect(sfd, (struct sockaddr *)&in, sizeof(in)), 0);
+
+  // A socket-wide segment size splits one send into several datagrams.
+  int seg = 100;
+  ASSERT_EQ(setsockopt(sfd, SOL_UDP, UDP_SEGMENT, &seg, sizeof(seg)), 0);
+  int val = 0;
+  socklen_t len = sizeof(val);
+  ASSERT_EQ(getsockopt(sfd, SOL_UDP, UDP_SEGMENT, &val, &len), 0);
+  EXPECT_EQ(val, seg);
+  std::vector<char> out(250);
+  for (size_t i = 0; i < out.size(); i++) out[i] = static_cast<char>(i);
+  ASSERT_EQ(send(sfd, out.data(), out.size(), 0), 250);
+  char buf[512];
+  for (size_t want : {100, 100, 50}) {
+    ASSERT_EQ(recv(rfd, buf, sizeof(buf), 0), static_cast<ssize_t>(want));
+  }
+  EXPECT_EQ(memcmp(buf, out.data() + 200, 50), 0);
+
+  // A control message overrides the segment size for one send.
+  seg = 0;
+  ASSERT_EQ(setsockopt(sfd, SOL_UDP, UDP_SEGMENT, &seg, sizeof(seg)), 0);
+  char control[CMSG_SPACE(sizeof(uint16_t))] = {};
+  iovec iov = {out.data(), 120};
+  msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control;
+  msg.msg_controllen = sizeof(control);
+  cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+  cmsg->cmsg_level = SOL_UDP;
+  cmsg->cmsg_type = UDP_SEGMENT;
+  cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+  uint16_t seg16 = 60;
+  memcpy(CMSG_DATA(cmsg), &seg16, sizeof(seg16));
+  ASSERT_EQ(sendmsg(sfd, &msg, 0), 120);
+  for (int i = 0; i < 2; i++) ASSERT_EQ(recv(rfd, buf, sizeof(buf), 0), 60);
+
+  // With UDP_GRO, datagrams of the same size may come back as one read. The
+  // segment size is reported in a control message whenever that happens.
+  int on = 1;
+  ASSERT_EQ(setsockopt(rfd, SOL_UDP, UDP_GRO, &on, sizeof(on)), 0);
+  len = sizeof(val);
+  ASSERT_EQ(getsockopt(rfd, SOL_UDP, UDP_GRO, &val, &len), 0);
+  EXPECT_EQ(val, 1);
+  seg = 100;
+  ASSERT_EQ(setsockopt(sfd, SOL_UDP, UDP_SEGMENT, &seg, sizeof(seg)), 0);
+  ASSERT_EQ(send(sfd, out.data(), 250, 0), 250);
+
+  size_t total = 0;
+  while (total < 250) {
+    char rcontrol[CMSG_SPACE(sizeof(int))];
+    iov = {buf + total, sizeof(buf) - total};
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = rcontrol;
+    msg.msg_controllen = sizeof(rcontrol);
+    ssize_t ret = recvmsg(rfd, &msg, 0);
+    ASSERT_GT(ret, 0);
+    cmsg = CMSG_FIRSTHDR(&msg);
+    if (cmsg) {
+      EXPECT_EQ(cmsg->cmsg_level, SOL_UDP);
+      EXPECT_EQ(cmsg->cmsg_type, UDP_GRO);
+      memcpy(&val, CMSG_DATA(cmsg), sizeof(val));
+      EXPECT_EQ(val, 100);
+    } else {
+      EXPECT_LE(ret, 100);
+    }
+    total += ret;
+  }
+  EXPECT_EQ(total, 250u);
+  EXPECT_EQ(memcmp(buf, out.data(), 250), 0);
+
+  close(sfd);
+  close(rfd);
+}
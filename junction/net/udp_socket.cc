@@ -0,0 +1,215 @@
+// udp_socket.cc - UDP socket segmentation, coalescing and options
+
+extern "C" {
+#include <netinet/in.h>
+#include <netinet/udp.h>
+}
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+#include "junction/base/bits.h"
+#include "junction/bindings/log.h"
+#include "junction/net/udp_socket.h"
+
+namespace junction {
+
+namespace {
+
+// The most datagrams that one UDP_SEGMENT send or UDP_GRO read covers (the
+// same as Linux's UDP_MAX_SEGMENTS).
+constexpr size_t kMaxSegments = 64;
+
+// Caladan queues whole mbufs, so socket buffer sizes are converted to queue
+// lengths in units of its default mbuf size.
+constexpr int kMbufSize = 2048;
+
+// Caladan's default queue lengths (UDP_IN_DEFAULT_CAP and UDP_OUT_DEFAULT_CAP),
+// used for whichever of SO_RCVBUF and SO_SNDBUF is unset.
+constexpr int kDefaultReadMbufs = 512;
+constexpr int kDefaultWriteMbufs = 2048;
+
+// Copies @buf into @iov, starting @off bytes in.
+void ScatterAt(std::span<const iovec> iov, size_t off,
+               std::span<const std::byte> buf) {
+  for (const iovec &v : iov) {
+    if (buf.empty()) break;
+    if (off >= v.iov_len) {
+      off -= v.iov_len;
+      continue;
+    }
+    size_t n = std::min(v.iov_len - off, buf.size());
+    std::memcpy(static_cast<std::byte *>(v.iov_base) + off, buf.data(), n);
+    buf = buf.subspan(n);
+    off = 0;
+  }
+}
+
+}  // namespace
+
+Status<size_t> UDPSocket::WriteSegmented(std::span<const iovec> iov,
+                                         const netaddr *raddr, size_t seg) {
+  size_t total = 0;
+  for (const iovec &v : iov) total += v.iov_len;
+  if (total <= seg) return conn_.WritevTo(iov, raddr);
+  if (unlikely(seg > rt::UDPConn::PayloadSize() ||
+               DivideUp(total, seg) > kMaxSegments)) {
+    return MakeError(EINVAL);
+  }
+
+  std::byte buf[rt::UDPConn::kMaxPayloadSize];
+  size_t sent = 0, i = 0, off = 0;
+  while (sent < total) {
+    const size_t len = std::min(seg, total - sent);
+    while (off == iov[i].iov_len) {
+      i++;
+      off = 0;
+    }
+
+    std::span<const std::byte> dgram;
+    if (iov[i].iov_len - off >= len) {
+      // The segment is contiguous in the caller's buffer; send it in place.
+      dgram = {static_cast<const std::byte *>(iov[i].iov_base) + off, len};
+      off += len;
+    } else {
+      for (size_t n = 0; n < len;) {
+        while (off == iov[i].iov_len) {
+          i++;
+          off = 0;
+        }
+        size_t chunk = std::min(len - n, iov[i].iov_len - off);
+        std::memcpy(buf + n,
+                    static_cast<const std::byte *>(iov[i].iov_base) + off,
+                    chunk);
+        n += chunk;
+        off += chunk;
+      }
+      dgram = {buf, len};
+    }
+
+    // Like Linux, only report an error if nothing was sent.
+    Status<size_t> ret = conn_.WriteTo(dgram, raddr);
+    if (unlikely(!ret)) {
+      if (sent) return sent;
+      return ret;
+    }
+    sent += len;
+  }
+  return sent;
+}
+
+Status<size_t> UDPSocket::ReadCoalesced(std::span<const iovec> iov,
+                                        netaddr *raddr, size_t *seg) {
+  size_t cap = 0;
+  for (const iovec &v : iov) cap += v.iov_len;
+
+  // Readers take turns so that coalesced datagrams aren't interleaved. A
+  // blocked reader holds the lock, but the others would wait for data anyway.
+  rt::ScopedLock g(gro_lock_);
+  netaddr src;
+  Status<size_t> ret = conn_.ReadvFrom(iov, &src, false);
+  if (!ret) return ret;
+  if (raddr) *raddr = src;
+  const size_t len = *ret;
+  if (len == 0) return 0;
+
+  // Append datagrams that are already queued, as long as they come from the
+  // same sender and have the same size (only the last one may be shorter).
+  std::byte buf[rt::UDPConn::kMaxPayloadSize];
+  size_t total = len, count = 1;
+  while (count < kMaxSegments && cap - total >= len && ReadReady()) {
+    netaddr next;
+    // Peek one extra byte to detect a longer datagram.
+    const size_t peek_len = std::min(len + 1, sizeof(buf));
+    Status<size_t> n = conn_.ReadFrom({buf, peek_len}, &next, true);
+    if (!n || *n == 0 || *n > len) break;
+    if (next.ip != src.ip || next.port != src.port) break;
+    n = conn_.ReadFrom({}, nullptr, false);
+    if (unlikely(!n)) break;
+
+    ScatterAt(iov, total, {buf, *n});
+    total += *n;
+    count++;
+    if (*n < len) break;
+  }
+
+  if (seg) *seg = count > 1 ? len : 0;
+  return total;
+}
+
+Status<size_t> UDPSocket::SendMsg(std::span<const iovec> iov,
+                                  const netaddr *raddr,
+                                  const MsgOptions &opts) {
+  size_t seg = opts.segment_size ? opts.segment_size : gso_size();
+  if (!seg) return Socket::SendMsg(iov, raddr, opts);
+  if (!conn_.is_valid() && !raddr) return MakeError(EDESTADDRREQ);
+  Status<void> ret = ListenIfUnbound();
+  if (unlikely(!ret)) return MakeError(ret);
+  return WriteSegmented(iov, raddr, seg);
+}
+
+Status<size_t> UDPSocket::RecvMsg(std::span<const iovec> iov, netaddr *raddr,
+                                  bool peek, MsgOptions *opts) {
+  if (unlikely(!conn_.is_valid())) return MakeError(EINVAL);
+  if (Status<void> ret = WaitForRead(); unlikely(!ret)) return MakeError(ret);
+  if (!gro_enabled() || peek) return conn_.ReadvFrom(iov, raddr, peek);
+  return ReadCoalesced(iov, raddr, opts ? &opts->segment_size : nullptr);
+}
+
+void UDPSocket::ApplyBuffers() {
+  int rmbufs = rcvbuf_ ? std::max(1, rcvbuf_ / kMbufSize) : kDefaultReadMbufs;
+  int wmbufs = sndbuf_ ? std::max(1, sndbuf_ / kMbufSize) : kDefaultWriteMbufs;
+  Status<void> ret = conn_.SetBuffers(rmbufs, wmbufs);
+  if (unlikely(!ret))
+    LOG(WARN) << "udp: failed to resize socket buffers: " << ret.error();
+}
+
+Status<void> UDPSocket::SetSockOpt(int level, int optname,
+                                   std::span<const std::byte> optval) {
+  if (level == SOL_SOCKET && (optname == SO_RCVBUF || optname == SO_SNDBUF)) {
+    Status<int> val = GetIntOpt(optval);
+    if (unlikely(!val)) return MakeError(val);
+    (optname == SO_RCVBUF ? rcvbuf_ : sndbuf_) = SockBufSize(*val);
+    if (conn_.is_valid()) ApplyBuffers();
+    return {};
+  }
+  if (level != SOL_UDP) return Socket::SetSockOpt(level, optname, optval);
+  switch (optname) {
+    case UDP_SEGMENT: {
+      Status<int> val = GetIntOpt(optval);
+      if (unlikely(!val)) return MakeError(val);
+      if (unlikely(*val < 0 || *val > std::numeric_limits<uint16_t>::max()))
+        return MakeError(EINVAL);
+      gso_size_ = *val;
+      return {};
+    }
+    case UDP_GRO: {
+      Status<int> val = GetIntOpt(optval);
+      if (unlikely(!val)) return MakeError(val);
+      gro_ = *val != 0;
+      return {};
+    }
+    default:
+      return MakeError(ENOPROTOOPT);
+  }
+}
+
+Status<size_t> UDPSocket::GetSockOpt(int level, int optname,
+                                     std::span<std::byte> optval) const {
+  if (level == SOL_SOCKET && optname == SO_RCVBUF)
+    return PutIntOpt(optval, rcvbuf_ ? rcvbuf_ : kSockBufDefault);
+  if (level == SOL_SOCKET && optname == SO_SNDBUF)
+    return PutIntOpt(optval, sndbuf_ ? sndbuf_ : kSockBufDefault);
+  if (level != SOL_UDP) return Socket::GetSockOpt(level, optname, optval);
+  switch (optname) {
+    case UDP_SEGMENT:
+      return PutIntOpt(optval, static_cast<int>(gso_size()));
+    case UDP_GRO:
+      return PutIntOpt(optval, gro_enabled());
+    default:
+      return MakeError(ENOPROTOOPT);
+  }
+}
+
+}  // namespace junction
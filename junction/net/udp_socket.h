@@ -7,6 +7,7 @@
 
 #include "junction/base/error.h"
 #include "junction/bindings/net.h"
+#include "junction/bindings/sync.h"
 #include "junction/net/caladan_poll.h"
 #include "junction/net/socket.h"
 #include "junction/snapshot/cereal.h"
@@ -22,9 +23,7 @@ class UDPSocket : public Socket {
     if (unlikely(conn_.is_valid())) return MakeError(EINVAL);
     Status<rt::UDPConn> ret = rt::UDPConn::Listen(addr);
     if (unlikely(!ret)) return MakeError(ret);
-    conn_ = std::move(*ret);
-    if (is_nonblocking()) conn_.SetNonBlocking(true);
-    if (IsPollSourceSetup()) SetupPollSource();
+    ReplaceConn(std::move(*ret));
     return {};
   }
 
@@ -46,27 +45,44 @@ class UDPSocket : public Socket {
   Status<size_t> Read(std::span<std::byte> buf,
                       [[maybe_unused]] off_t *off) override {
     if (unlikely(!conn_.is_valid())) return MakeError(EINVAL);
+    if (Status<void> ret = WaitForRead(); unlikely(!ret))
+      return MakeError(ret);
+    if (unlikely(gro_enabled())) {
+      iovec v = {buf.data(), buf.size()};
+      return ReadCoalesced({&v, 1}, nullptr, nullptr);
+    }
     return conn_.Read(buf);
   }
 
   Status<size_t> Write(std::span<const std::byte> buf,
                        [[maybe_unused]] off_t *off) override {
     if (unlikely(!conn_.is_valid())) return MakeError(EDESTADDRREQ);
+    if (size_t seg = gso_size(); unlikely(seg)) {
+      iovec v = {const_cast<std::byte *>(buf.data()), buf.size()};
+      return WriteSegmented({&v, 1}, nullptr, seg);
+    }
     return conn_.Write(buf);
   }
 
   Status<size_t> ReadFrom(std::span<std::byte> buf, netaddr *raddr,
                           bool peek) override {
     if (unlikely(!conn_.is_valid())) return MakeError(EINVAL);
+    if (Status<void> ret = WaitForRead(); unlikely(!ret))
+      return MakeError(ret);
+    if (unlikely(gro_enabled() && !peek)) {
+      iovec v = {buf.data(), buf.size()};
+      return ReadCoalesced({&v, 1}, raddr, nullptr);
+    }
     return conn_.ReadFrom(buf, raddr, peek);
   }
 
   Status<size_t> WriteTo(std::span<const std::byte> buf,
                          const netaddr *raddr) override {
-    if (!conn_.is_valid()) {
-      Status<rt::UDPConn> ret = rt::UDPConn::Listen({0, 0});
-      if (unlikely(!ret)) return MakeError(ret);
-      ReplaceConn(std::move(*ret));
+    Status<void> ret = ListenIfUnbound();
+    if (unlikely(!ret)) return MakeError(ret);
+    if (size_t seg = gso_size(); unlikely(seg)) {
+      iovec v = {const_cast<std::byte *>(buf.data()), buf.size()};
+      return WriteSegmented({&v, 1}, raddr, seg);
     }
     return conn_.WriteTo(buf, raddr);
   }
@@ -88,7 +104,53 @@ class UDPSocket : public Socket {
     return conn_.LocalAddr();
   }
 
-  // TODO(jsf): Writev, WritevTo, Readv
+  // Vectored I/O sends or receives exactly one datagram per call, unless
+  // segmentation (UDP_SEGMENT) or coalescing (UDP_GRO) is enabled.
+  Status<size_t> ReadvFrom(std::span<const iovec> iov, netaddr *raddr,
+                           bool peek) override {
+    if (unlikely(!conn_.is_valid())) return MakeError(EINVAL);
+    if (Status<void> ret = WaitForRead(); unlikely(!ret))
+      return MakeError(ret);
+    if (unlikely(gro_enabled() && !peek))
+      return ReadCoalesced(iov, raddr, nullptr);
+    return conn_.ReadvFrom(iov, raddr, peek);
+  }
+
+  Status<size_t> WritevTo(std::span<const iovec> iov,
+                          const netaddr *raddr) override {
+    if (!conn_.is_valid() && !raddr) return MakeError(EDESTADDRREQ);
+    Status<void> ret = ListenIfUnbound();
+    if (unlikely(!ret)) return MakeError(ret);
+    if (size_t seg = gso_size(); unlikely(seg))
+      return WriteSegmented(iov, raddr, seg);
+    return conn_.WritevTo(iov, raddr);
+  }
+
+  Status<size_t> Readv(std::span<iovec> iov,
+                       [[maybe_unused]] off_t *off) override {
+    if (unlikely(!conn_.is_valid())) return MakeError(EINVAL);
+    if (Status<void> ret = WaitForRead(); unlikely(!ret))
+      return MakeError(ret);
+    if (unlikely(gro_enabled())) return ReadCoalesced(iov, nullptr, nullptr);
+    return conn_.ReadvFrom(iov, nullptr);
+  }
+
+  Status<size_t> Writev(std::span<const iovec> iov,
+                        [[maybe_unused]] off_t *off) override {
+    if (unlikely(!conn_.is_valid())) return MakeError(EDESTADDRREQ);
+    if (size_t seg = gso_size(); unlikely(seg))
+      return WriteSegmented(iov, nullptr, seg);
+    return conn_.WritevTo(iov, nullptr);
+  }
+
+  Status<size_t> SendMsg(std::span<const iovec> iov, const netaddr *raddr,
+                         const MsgOptions &opts) override;
+  Status<size_t> RecvMsg(std::span<const iovec> iov, netaddr *raddr,
+                         bool peek, MsgOptions *opts) override;
+  Status<void> SetSockOpt(int level, int optname,
+                          std::span<const std::byte> optval) override;
+  Status<size_t> GetSockOpt(int level, int optname,
+                            std::span<std::byte> optval) const override;
 
  private:
   void SetupPollSource() override {
@@ -105,26 +167,61 @@ class UDPSocket : public Socket {
     conn_.SetNonBlocking((newflags & kFlagNonblock) > 0);
   }
 
+  [[nodiscard]] size_t gso_size() const {
+    return gso_size_.load(std::memory_order_relaxed);
+  }
+  [[nodiscard]] bool gro_enabled() const {
+    return gro_.load(std::memory_order_relaxed);
+  }
+
+  // Creates an unbound connection for sockets that send before binding.
+  Status<void> ListenIfUnbound() {
+    if (conn_.is_valid()) return {};
+    Status<rt::UDPConn> ret = rt::UDPConn::Listen({0, 0});
+    if (unlikely(!ret)) return MakeError(ret);
+    ReplaceConn(std::move(*ret));
+    return {};
+  }
+
+  // Splits @iov into datagrams of @seg bytes (the last one may be shorter).
+  Status<size_t> WriteSegmented(std::span<const iovec> iov,
+                                const netaddr *raddr, size_t seg);
+
+  // Receives a datagram and appends any queued datagrams from the same sender
+  // that have the same size. Stores the segment size in @seg if more than one
+  // datagram was read.
+  Status<size_t> ReadCoalesced(std::span<const iovec> iov, netaddr *raddr,
+                               size_t *seg);
+
   inline void ReplaceConn(rt::UDPConn &&new_conn) {
     if (conn_.is_valid() && IsPollSourceSetup())
       conn_.InstallPollSource(nullptr, nullptr, 0);
     conn_ = std::move(new_conn);
     if (is_nonblocking()) conn_.SetNonBlocking(true);
+    if (rcvbuf_ || sndbuf_) ApplyBuffers();
     if (IsPollSourceSetup()) SetupPollSource();
   }
 
+  // Sizes Caladan's queues according to SO_RCVBUF and SO_SNDBUF.
+  void ApplyBuffers();
+
   friend class cereal::access;
 
   template <class Archive>
   void save(Archive &ar) const {
-    ar(cereal::base_class<Socket>(this), conn_.is_valid());
+    ar(cereal::base_class<Socket>(this), gso_size(), gro_enabled(), rcvbuf_,
+       sndbuf_, conn_.is_valid());
     if (conn_.is_valid()) ar(conn_.LocalAddr(), conn_.RemoteAddr(), is_shut_);
   }
 
   template <class Archive>
   void load(Archive &ar) {
-    bool is_valid;
-    ar(cereal::base_class<Socket>(this), is_valid);
+    size_t gso;
+    bool gro, is_valid;
+    ar(cereal::base_class<Socket>(this), gso, gro, rcvbuf_, sndbuf_,
+       is_valid);
+    gso_size_ = gso;
+    gro_ = gro;
     if (!is_valid) return;
 
     netaddr laddr;
@@ -159,6 +256,15 @@ class UDPSocket : public Socket {
   // stored here (as a result of Bind/Connect calls).
   rt::UDPConn conn_;
   std::atomic_bool is_shut_{false};
+  // Segment size for UDP_SEGMENT (zero if disabled).
+  std::atomic_size_t gso_size_{0};
+  // Set by UDP_GRO.
+  std::atomic_bool gro_{false};
+  // SO_RCVBUF and SO_SNDBUF as reported by getsockopt() (zero if unset).
+  int rcvbuf_{0};
+  int sndbuf_{0};
+  // Serializes coalescing readers so that they don't interleave datagrams.
+  rt::Mutex gro_lock_;
 };
 
 }  // namespace junction
@@ -0,0 +1,676 @@
+// unix_socket.cc - UNIX domain sockets
+
+extern "C" {
+#include <sys/socket.h>
+#include <sys/un.h>
+}
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <map>
+
+#include "junction/fs/fs.h"
+#include "junction/kernel/proc.h"
+#include "junction/net/unix_socket.h"
+
+namespace junction {
+
+namespace {
+
+// Each queued message is charged this much on top of its data, so that a
+// flood of empty datagrams still fills a channel.
+constexpr size_t kMsgOverhead = 256;
+
+// Stream writes only append to a message smaller than this. A message is freed
+// once it has been read, so this bounds the memory held by a busy stream.
+constexpr size_t kStreamChunk = 64 * 1024;
+
+// Autobound names are a NUL byte followed by five hex digits, like on Linux.
+constexpr size_t kAutobindDigits = 5;
+constexpr unsigned int kAutobindNames = 1 << (4 * kAutobindDigits);
+
+// All bound sockets, keyed by name. A socket removes itself when destroyed,
+// so lookups must check that the socket is still alive.
+rt::Mutex registry_lock;
+std::map<std::string, UnixSocket *> registry;
+unsigned int autobind_next;
+
+// Copies @len bytes from @iov, starting @off bytes in, into @dst.
+void GatherAt(std::span<const iovec> iov, size_t off, std::byte *dst,
+              size_t len) {
+  for (const iovec &v : iov) {
+    if (!len) break;
+    if (off >= v.iov_len) {
+      off -= v.iov_len;
+      continue;
+    }
+    size_t n = std::min(v.iov_len - off, len);
+    std::memcpy(dst, static_cast<const std::byte *>(v.iov_base) + off, n);
+    dst += n;
+    len -= n;
+    off = 0;
+  }
+}
+
+// Copies @buf into @iov, starting @off bytes in.
+void ScatterAt(std::span<const iovec> iov, size_t off,
+               std::span<const std::byte> buf) {
+  for (const iovec &v : iov) {
+    if (buf.empty()) break;
+    if (off >= v.iov_len) {
+      off -= v.iov_len;
+      continue;
+    }
+    size_t n = std::min(v.iov_len - off, buf.size());
+    std::memcpy(static_cast<std::byte *>(v.iov_base) + off, buf.data(), n);
+    buf = buf.subspan(n);
+    off = 0;
+  }
+}
+
+bool SameCreds(const ucred &a, const ucred &b) {
+  return a.pid == b.pid && a.uid == b.uid && a.gid == b.gid;
+}
+
+// The calling process's credentials.
+ucred MyCreds() { return ProcessCreds(myproc()); }
+
+std::string AutobindName(unsigned int n) {
+  std::string name(1 + kAutobindDigits, '\0');
+  for (size_t i = kAutobindDigits; i > 0; i--, n >>= 4)
+    name[i] = "0123456789abcdef"[n & 0xf];
+  return name;
+}
+
+// Returns the registry key for @name. Abstract names are used as is, while
+// paths are made absolute so that every spelling of a path finds the same
+// socket.
+Status<std::string> NameToKey(std::string_view name) {
+  if (name[0] == '\0') return std::string(name);
+
+  const size_t pos = name.rfind('/');
+  std::string_view dir = ".";
+  if (pos == 0)
+    dir = "/";
+  else if (pos != std::string_view::npos)
+    dir = name.substr(0, pos);
+  std::string_view base =
+      pos == std::string_view::npos ? name : name.substr(pos + 1);
+  if (unlikely(base.empty())) return MakeError(EINVAL);
+
+  FSRoot &fs = myproc().get_fs();
+  Status<std::shared_ptr<Inode>> ino = LookupInode(fs, dir);
+  if (unlikely(!ino)) return MakeError(ino);
+  if (unlikely(!(*ino)->is_dir())) return MakeError(ENOTDIR);
+  char buf[PATH_MAX];
+  Status<std::span<char>> path =
+      static_cast<IDir &>(**ino).GetFullPath(fs, {buf, sizeof(buf)});
+  if (unlikely(!path)) return MakeError(path);
+
+  std::string key(path->data(), path->size());
+  if (key.back() != '/') key += '/';
+  key += base;
+  return key;
+}
+
+}  // namespace
+
+Status<std::string> SockAddrToUnixName(const sockaddr *addr,
+                                       socklen_t addrlen) {
+  if (unlikely(!addr || addrlen < sizeof(sa_family_t) ||
+               addrlen > sizeof(sockaddr_un) || addr->sa_family != AF_UNIX)) {
+    return MakeError(EINVAL);
+  }
+  const char *path = reinterpret_cast<const sockaddr_un *>(addr)->sun_path;
+  size_t len = addrlen - offsetof(sockaddr_un, sun_path);
+  // Paths end at the first NUL byte; abstract names use the whole length.
+  if (len && path[0] != '\0') len = strnlen(path, len);
+  return std::string(path, len);
+}
+
+Status<void> UnixNameToSockAddr(std::string_view name, sockaddr *saddr,
+                                socklen_t *addrlen) {
+  if (unlikely(!saddr || !addrlen)) return MakeError(EINVAL);
+
+  // Leaves room for the NUL byte after a path of the maximum length.
+  char buf[sizeof(sockaddr_un) + 1];
+  const sa_family_t family = AF_UNIX;
+  std::memcpy(buf, &family, sizeof(family));
+  size_t len = offsetof(sockaddr_un, sun_path);
+  std::memcpy(buf + len, name.data(), name.size());
+  len += name.size();
+  // Like Linux, a path's length includes its terminating NUL byte.
+  if (!name.empty() && name[0] != '\0') buf[len++] = '\0';
+  std::memcpy(saddr, buf, std::min(len, static_cast<size_t>(*addrlen)));
+  *addrlen = len;
+  return {};
+}
+
+// Junction runs everything as root.
+ucred ProcessCreds(const Process &p) { return {p.get_pid(), 0, 0}; }
+
+//
+// UnixChannel
+//
+
+bool UnixChannel::writable() const { return space() > kMsgOverhead; }
+
+Status<size_t> UnixChannel::Write(std::span<const iovec> iov, UnixMsg &anc,
+                                  bool stream, bool nonblocking) {
+  size_t total = 0;
+  for (const iovec &v : iov) total += v.iov_len;
+  if (stream && total == 0) return 0;
+  if (!stream && unlikely(total + kMsgOverhead > capacity_))
+    return MakeError(EMSGSIZE);
+
+  // Streams wait for room for some data, other sockets for the whole message.
+  const size_t need = (stream ? 1 : total) + kMsgOverhead;
+  auto ready = [this, need] {
+    return reader_closed_ || writer_closed_ || space() >= need;
+  };
+
+  rt::SpinGuard g(lock_);
+  size_t sent = 0;
+  while (true) {
+    if (writer_closed_ || reader_closed_) break;
+    if (!ready()) {
+      if (nonblocking) break;
+      if (!rt::WaitInterruptible(lock_, write_waiters_, ready)) {
+        if (sent) return sent;
+        return MakeError(EINTR);
+      }
+      continue;
+    }
+
+    const size_t n =
+        stream ? std::min(total - sent, space() - kMsgOverhead) : total;
+    UnixMsg *tail = msgs_.empty() ? nullptr : &msgs_.back();
+    if (stream && tail && tail->data.size() < kStreamChunk &&
+        tail->files.empty() && anc.files.empty() &&
+        SameCreds(tail->creds, anc.creds)) {
+      // Append to the last message, as it carries the same ancillary data.
+      const size_t old = tail->data.size();
+      tail->data.resize(old + n);
+      GatherAt(iov, sent, tail->data.data() + old, n);
+      used_ += n;
+    } else {
+      UnixMsg m;
+      m.data.resize(n);
+      GatherAt(iov, sent, m.data.data(), n);
+      m.from = anc.from;
+      m.creds = anc.creds;
+      m.files = std::move(anc.files);
+      anc.files.clear();
+      msgs_.push_back(std::move(m));
+      used_ += n + kMsgOverhead;
+    }
+    sent += n;
+
+    if (read_poll_) read_poll_->Set(kPollIn);
+    read_waiters_.WakeOne();
+    if (!writable() && write_poll_) write_poll_->Clear(kPollOut);
+    if (sent == total) return sent;
+  }
+
+  if (sent) return sent;
+  if (writer_closed_ || reader_closed_) return MakeError(EPIPE);
+  return MakeError(EAGAIN);
+}
+
+Status<size_t> UnixChannel::Read(std::span<const iovec> iov, UnixMsg &anc,
+                                 bool stream, bool peek, bool nonblocking,
+                                 bool *trunc) {
+  size_t cap = 0;
+  for (const iovec &v : iov) cap += v.iov_len;
+
+  rt::SpinGuard g(lock_);
+  auto ready = [this] {
+    return !msgs_.empty() || writer_closed_ || reader_closed_;
+  };
+  if (!ready()) {
+    if (nonblocking) return MakeError(EAGAIN);
+    if (!rt::WaitInterruptible(lock_, read_waiters_, ready))
+      return MakeError(EINTR);
+  }
+  if (msgs_.empty() || reader_closed_) return 0;
+
+  if (!stream) {
+    UnixMsg &m = msgs_.front();
+    const size_t n = std::min(cap, m.len());
+    ScatterAt(iov, 0, {m.data.data() + m.off, n});
+    if (trunc) *trunc = n < m.len();
+    anc.from = m.from;
+    anc.creds = m.creds;
+    if (peek) {
+      anc.files = m.files;
+      return n;
+    }
+    anc.files = std::move(m.files);
+    used_ -= m.data.size() + kMsgOverhead;
+    msgs_.pop_front();
+    Consumed();
+    return n;
+  }
+
+  size_t copied = 0;
+  for (auto it = msgs_.begin(); it != msgs_.end() && copied < cap;) {
+    UnixMsg &m = *it;
+    if (copied && (!m.files.empty() || !SameCreds(m.creds, anc.creds))) break;
+    if (!copied) {
+      anc.from = m.from;
+      anc.creds = m.creds;
+    }
+
+    // Like Linux, a read that receives files stops at the end of their data.
+    const bool has_files = !m.files.empty();
+    if (has_files) {
+      anc.files = peek ? m.files : std::move(m.files);
+      if (!peek) m.files.clear();
+    }
+
+    const size_t n = std::min(cap - copied, m.len());
+    ScatterAt(iov, copied, {m.data.data() + m.off, n});
+    copied += n;
+    if (peek) {
+      ++it;
+    } else {
+      m.off += n;
+      used_ -= n;
+      if (!m.len()) {
+        used_ -= kMsgOverhead;
+        msgs_.pop_front();
+        it = msgs_.begin();
+      }
+    }
+    if (has_files) break;
+  }
+  if (!peek) Consumed();
+  return copied;
+}
+
+void UnixChannel::Consumed() {
+  assert(lock_.IsHeld());
+  if (msgs_.empty() && !writer_closed_ && read_poll_)
+    read_poll_->Clear(kPollIn);
+  if (writable()) {
+    if (write_poll_) write_poll_->Set(kPollOut);
+    write_waiters_.WakeAll();
+  }
+}
+
+void UnixChannel::CloseReader() {
+  // Queued messages may hold files, which are closed outside the lock.
+  std::deque<UnixMsg> msgs;
+  rt::SpinGuard g(lock_);
+  reader_closed_ = true;
+  read_poll_ = nullptr;
+  msgs.swap(msgs_);
+  used_ = 0;
+  if (write_poll_) write_poll_->Set(kPollOut | kPollHUp);
+  read_waiters_.WakeAll();
+  write_waiters_.WakeAll();
+}
+
+void UnixChannel::CloseWriter() {
+  rt::SpinGuard g(lock_);
+  writer_closed_ = true;
+  write_poll_ = nullptr;
+  if (read_poll_) read_poll_->Set(kPollIn | kPollRDHUp);
+  read_waiters_.WakeAll();
+  write_waiters_.WakeAll();
+}
+
+void UnixChannel::AttachReadPoll(PollSource *p) {
+  rt::SpinGuard g(lock_);
+  if (reader_closed_) return;
+  read_poll_ = p;
+  if (!msgs_.empty()) p->Set(kPollIn);
+  if (writer_closed_) p->Set(kPollIn | kPollRDHUp);
+}
+
+void UnixChannel::AttachWritePoll(PollSource *p) {
+  rt::SpinGuard g(lock_);
+  if (writer_closed_) return;
+  write_poll_ = p;
+  if (reader_closed_)
+    p->Set(kPollOut | kPollHUp);
+  else if (writable())
+    p->Set(kPollOut);
+}
+
+//
+// UnixSocket
+//
+
+UnixSocket::UnixSocket(int type, int flags) noexcept
+    : Socket(flags), type_(type) {
+  if (!is_dgram()) return;
+  rx_ = std::make_shared<UnixChannel>(kSockBufDefault);
+  AttachChannels();
+}
+
+UnixSocket::UnixSocket(int type, std::shared_ptr<UnixChannel> rx,
+                       std::shared_ptr<UnixChannel> tx, int flags) noexcept
+    : Socket(flags), type_(type), rx_(std::move(rx)), tx_(std::move(tx)) {
+  if (!rx_) return;
+  state_ = State::kConnected;
+  AttachChannels();
+}
+
+UnixSocket::~UnixSocket() {
+  {
+    rt::SpinGuard g(listen_->lock);
+    listen_->closed = true;
+    listen_->connect_waiters.WakeAll();
+  }
+  if (rx_) rx_->CloseReader();
+  // A datagram socket shares its peer's receive channel with other senders.
+  if (tx_ && !is_dgram()) tx_->CloseWriter();
+  Unregister();
+}
+
+void UnixSocket::AttachChannels() {
+  PollSource &src = get_poll_source();
+  if (rx_) rx_->AttachReadPoll(&src);
+  // Datagram sends only block while the receiver is full.
+  if (is_dgram())
+    src.Set(kPollOut);
+  else if (tx_)
+    tx_->AttachWritePoll(&src);
+}
+
+void UnixSocket::Unregister() {
+  if (key_.empty()) return;
+  rt::ScopedLock g(registry_lock);
+  auto it = registry.find(key_);
+  if (it != registry.end() && it->second == this) registry.erase(it);
+}
+
+void UnixSocket::Restore() {
+  AttachChannels();
+  if (state_ == State::kListening && !pending_.empty())
+    get_poll_source().Set(kPollIn);
+  if (key_.empty()) return;
+  rt::ScopedLock g(registry_lock);
+  registry[key_] = this;
+}
+
+std::pair<std::shared_ptr<UnixSocket>, std::shared_ptr<UnixSocket>>
+UnixSocket::CreatePair(int type, int flags) {
+  std::shared_ptr<UnixSocket> a, b;
+  if (type == SOCK_DGRAM) {
+    a = std::make_shared<UnixSocket>(type, flags);
+    b = std::make_shared<UnixSocket>(type, flags);
+    a->tx_ = b->rx_;
+    b->tx_ = a->rx_;
+    a->state_ = b->state_ = State::kConnected;
+  } else {
+    auto a2b = std::make_shared<UnixChannel>(kSockBufDefault);
+    auto b2a = std::make_shared<UnixChannel>(kSockBufDefault);
+    a = std::make_shared<UnixSocket>(type, b2a, a2b, flags);
+    b = std::make_shared<UnixSocket>(type, std::move(a2b), std::move(b2a),
+                                     flags);
+  }
+  a->peer_creds_ = b->peer_creds_ = MyCreds();
+  return {std::move(a), std::move(b)};
+}
+
+Status<std::shared_ptr<UnixSocket>> UnixSocket::Find(std::string_view name) {
+  if (unlikely(name.empty())) return MakeError(EINVAL);
+  Status<std::string> key = NameToKey(name);
+  if (unlikely(!key)) return MakeError(key);
+  {
+    rt::ScopedLock g(registry_lock);
+    auto it = registry.find(*key);
+    if (it != registry.end()) {
+      if (std::shared_ptr<File> f = it->second->weak_from_this().lock())
+        return std::static_pointer_cast<UnixSocket>(std::move(f));
+    }
+  }
+
+  // Like Linux, fail with ENOENT if nothing exists at a path.
+  if (name[0] != '\0' && !LookupInode(myproc().get_fs(), name))
+    return MakeError(ENOENT);
+  return MakeError(ECONNREFUSED);
+}
+
+Status<void> UnixSocket::BindName(std::string_view name) {
+  if (unlikely(!name_.empty())) return MakeError(EINVAL);
+
+  std::string key;
+  if (!name.empty()) {
+    Status<std::string> ret = NameToKey(name);
+    if (unlikely(!ret)) return MakeError(ret);
+    key = std::move(*ret);
+    // Bound paths aren't created in the filesystem, but existing files at
+    // them are respected.
+    if (name[0] != '\0' && LookupInode(myproc().get_fs(), name, false))
+      return MakeError(EADDRINUSE);
+  }
+
+  rt::ScopedLock g(registry_lock);
+  auto is_free = [](const std::string &k) {
+    auto it = registry.find(k);
+    return it == registry.end() || it->second->weak_from_this().expired();
+  };
+  if (name.empty()) {
+    unsigned int i;
+    for (i = 0; i < kAutobindNames; i++) {
+      key = AutobindName(autobind_next++ % kAutobindNames);
+      if (is_free(key)) break;
+    }
+    if (unlikely(i == kAutobindNames)) return MakeError(ENOSPC);
+    name = key;
+  } else if (!is_free(key)) {
+    return MakeError(EADDRINUSE);
+  }
+
+  registry[key] = this;
+  name_ = name;
+  key_ = std::move(key);
+  return {};
+}
+
+Status<void> UnixSocket::ConnectName(std::string_view name) {
+  Status<std::shared_ptr<UnixSocket>> peer = Find(name);
+  if (unlikely(!peer)) return MakeError(peer);
+  UnixSocket &p = **peer;
+  if (unlikely(p.type_ != type_)) return MakeError(EPROTOTYPE);
+
+  // Connecting a datagram socket only sets its default destination.
+  if (is_dgram()) {
+    tx_ = p.rx_;
+    peer_name_ = p.name_;
+    state_ = State::kConnected;
+    return {};
+  }
+
+  if (unlikely(state_ == State::kConnected)) return MakeError(EISCONN);
+  if (unlikely(state_ == State::kListening)) return MakeError(EINVAL);
+  return Enqueue(std::move(*peer), *this);
+}
+
+Status<void> UnixSocket::Enqueue(std::shared_ptr<UnixSocket> listener,
+                                 UnixSocket &client) {
+  UnixSocket &l = *listener;
+  auto c2s = std::make_shared<UnixChannel>(kSockBufDefault);
+  auto s2c = std::make_shared<UnixChannel>(kSockBufDefault);
+  auto server = std::make_shared<UnixSocket>(l.type_, c2s, s2c);
+  server->name_ = l.name_;
+  server->peer_name_ = client.name_;
+  server->peer_creds_ = MyCreds();
+
+  std::shared_ptr<ListenLock> ll = l.listen_;
+  {
+    rt::UniqueLock<rt::Spin> g(ll->lock);
+    // @l may be gone once closed is set, so that must be checked first.
+    auto ready = [&] {
+      return ll->closed || l.state_ != State::kListening ||
+             l.pending_.size() < l.backlog_;
+    };
+    if (!ready()) {
+      if (client.is_nonblocking()) return MakeError(EAGAIN);
+      // Wait without a reference, so that closing the listener wakes us.
+      g.Unlock();
+      listener.reset();
+      g.Lock();
+      if (!rt::WaitInterruptible(ll->lock, ll->connect_waiters, ready))
+        return MakeError(EINTR);
+    }
+    if (unlikely(ll->closed || l.state_ != State::kListening))
+      return MakeError(ECONNREFUSED);
+    l.pending_.push_back(server);
+    l.get_poll_source().Set(kPollIn);
+    l.accept_waiters_.WakeOne();
+    client.peer_creds_ = l.listen_creds_;
+  }
+
+  client.rx_ = std::move(s2c);
+  client.tx_ = std::move(c2s);
+  client.peer_name_ = server->name_;
+  client.state_ = State::kConnected;
+  client.AttachChannels();
+  return {};
+}
+
+Status<void> UnixSocket::Listen(int backlog) {
+  if (unlikely(is_dgram())) return MakeError(EOPNOTSUPP);
+  if (unlikely(state_ == State::kConnected || name_.empty()))
+    return MakeError(EINVAL);
+
+  // Like Linux, the accept queue holds one more connection than @backlog.
+  rt::SpinGuard g(listen_->lock);
+  backlog_ = static_cast<size_t>(std::max(backlog, 0)) + 1;
+  if (state_ != State::kListening) {
+    state_ = State::kListening;
+    listen_creds_ = MyCreds();
+  }
+  listen_->connect_waiters.WakeAll();
+  return {};
+}
+
+Status<std::shared_ptr<Socket>> UnixSocket::Accept(int flags) {
+  if (unlikely(state_ != State::kListening)) return MakeError(EINVAL);
+  if (Status<void> ret = WaitForRead(); unlikely(!ret)) return MakeError(ret);
+
+  std::shared_ptr<UnixSocket> s;
+  {
+    rt::SpinGuard g(listen_->lock);
+    auto ready = [this] { return !pending_.empty(); };
+    if (!ready()) {
+      if (is_nonblocking()) return MakeError(EAGAIN);
+      if (!rt::WaitInterruptible(listen_->lock, accept_waiters_, ready))
+        return MakeError(EINTR);
+    }
+    s = std::move(pending_.front());
+    pending_.pop_front();
+    if (pending_.empty()) get_poll_source().Clear(kPollIn);
+    listen_->connect_waiters.WakeOne();
+  }
+
+  if (flags & kFlagNonblock) s->set_flag(kFlagNonblock);
+  return s;
+}
+
+Status<void> UnixSocket::Shutdown(int how) {
+  if (unlikely(how != SHUT_RD && how != SHUT_WR && how != SHUT_RDWR))
+    return MakeError(EINVAL);
+  if (unlikely(state_ != State::kConnected)) return MakeError(ENOTCONN);
+  if (how != SHUT_WR) rx_->CloseReader();
+  if (how == SHUT_RD) return {};
+  if (is_dgram())
+    shut_wr_ = true;
+  else
+    tx_->CloseWriter();
+  return {};
+}
+
+Status<std::string> UnixSocket::PeerName() const {
+  if (unlikely(state_ != State::kConnected)) return MakeError(ENOTCONN);
+  return peer_name_;
+}
+
+Status<size_t> UnixSocket::SendTo(std::span<const iovec> iov,
+                                  const std::string *name, MsgOptions &opts) {
+  if (Status<void> ret = WaitForWrite(); unlikely(!ret)) return MakeError(ret);
+
+  UnixMsg anc;
+  anc.from = name_;
+  anc.creds = opts.creds ? *opts.creds : MyCreds();
+  anc.files = std::move(opts.files);
+
+  if (!is_dgram()) {
+    if (unlikely(name))
+      return MakeError(state_ == State::kConnected ? EISCONN : EOPNOTSUPP);
+    if (unlikely(state_ != State::kConnected)) return MakeError(ENOTCONN);
+    return tx_->Write(iov, anc, is_stream(), is_nonblocking());
+  }
+
+  if (unlikely(shut_wr_)) return MakeError(EPIPE);
+  std::shared_ptr<UnixChannel> dst;
+  if (name) {
+    Status<std::shared_ptr<UnixSocket>> peer = Find(*name);
+    if (unlikely(!peer)) return MakeError(peer);
+    if (unlikely((*peer)->type_ != type_)) return MakeError(EPROTOTYPE);
+    dst = (*peer)->rx_;
+  } else {
+    if (unlikely(!tx_)) return MakeError(ENOTCONN);
+    dst = tx_;
+  }
+
+  Status<size_t> ret = dst->Write(iov, anc, false, is_nonblocking());
+  // The receiver was closed.
+  if (unlikely(!ret && ret.error() == EPIPE)) return MakeError(ECONNREFUSED);
+  return ret;
+}
+
+Status<size_t> UnixSocket::RecvFrom(std::span<const iovec> iov,
+                                    std::string *name, bool peek,
+                                    bool nonblocking, MsgOptions *opts,
+                                    bool *trunc) {
+  if (unlikely(!rx_)) return MakeError(is_stream() ? EINVAL : ENOTCONN);
+  nonblocking |= is_nonblocking();
+  if (!nonblocking) {
+    if (Status<void> ret = WaitForRead(); unlikely(!ret)) return MakeError(ret);
+  }
+
+  UnixMsg anc;
+  Status<size_t> ret =
+      rx_->Read(iov, anc, is_stream(), peek, nonblocking, trunc);
+  if (unlikely(!ret)) return ret;
+  if (name) *name = std::move(anc.from);
+  if (opts) {
+    opts->files = std::move(anc.files);
+    if (passcred_) opts->creds = anc.creds;
+  }
+  return ret;
+}
+
+Status<void> UnixSocket::SetSockOpt(int level, int optname,
+                                    std::span<const std::byte> optval) {
+  if (level != SOL_SOCKET || optname != SO_PASSCRED)
+    return Socket::SetSockOpt(level, optname, optval);
+  Status<int> val = GetIntOpt(optval);
+  if (unlikely(!val)) return MakeError(val);
+  passcred_ = *val != 0;
+  return {};
+}
+
+Status<size_t> UnixSocket::GetSockOpt(int level, int optname,
+                                      std::span<std::byte> optval) const {
+  if (level != SOL_SOCKET) return Socket::GetSockOpt(level, optname, optval);
+  switch (optname) {
+    case SO_PASSCRED:
+      return PutIntOpt(optval, passcred_);
+    case SO_PEERCRED: {
+      size_t len = std::min(optval.size(), sizeof(peer_creds_));
+      std::memcpy(optval.data(), &peer_creds_, len);
+      return len;
+    }
+    default:
+      return Socket::GetSockOpt(level, optname, optval);
+  }
+}
+
+}  // namespace junction
@@ -0,0 +1,299 @@
+// unix_socket.h - UNIX domain sockets
+#pragma once
+
+extern "C" {
+#include <sys/socket.h>
+}
+
+#include <deque>
+#include <memory>
+#include <span>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "junction/base/error.h"
+#include "junction/bindings/sync.h"
+#include "junction/kernel/poll.h"
+#include "junction/net/socket.h"
+#include "junction/snapshot/cereal.h"
+
+namespace junction {
+
+class Process;
+
+// The most files that one SCM_RIGHTS message can carry (Linux's SCM_MAX_FD).
+inline constexpr size_t kMaxPassedFiles = 253;
+
+// A message queued on a UNIX socket, along with its ancillary data.
+struct UnixMsg {
+  std::vector<std::byte> data;
+  size_t off{0};     // bytes already read (stream sockets only)
+  std::string from;  // the sender's name
+  std::vector<std::shared_ptr<File>> files;  // SCM_RIGHTS
+  ucred creds{};                             // SCM_CREDENTIALS
+
+  [[nodiscard]] size_t len() const { return data.size() - off; }
+
+  template <class Archive>
+  void save(Archive &ar) const {
+    ar(data.size());
+    ar(cereal::binary_data(data.data(), data.size()));
+    ar(off, from, files);
+    ar(cereal::binary_data(&creds, sizeof(creds)));
+  }
+
+  template <class Archive>
+  void load(Archive &ar) {
+    size_t size;
+    ar(size);
+    data.resize(size);
+    ar(cereal::binary_data(data.data(), data.size()));
+    ar(off, from, files);
+    ar(cereal::binary_data(&creds, sizeof(creds)));
+  }
+};
+
+// One direction of a connection, or a datagram socket's receive queue. It
+// holds up to @capacity bytes of messages. Stream writes are appended to the
+// last message when their ancillary data matches, so a stream channel behaves
+// like a ByteChannel, while datagram and seqpacket writes keep their message
+// boundaries.
+class UnixChannel {
+ public:
+  explicit UnixChannel(size_t capacity) noexcept : capacity_(capacity) {}
+  ~UnixChannel() = default;
+
+  UnixChannel(const UnixChannel &) = delete;
+  UnixChannel &operator=(const UnixChannel &) = delete;
+
+  // Queues the data in @iov along with @anc's ancillary data (which is moved
+  // into the channel). A stream write blocks until all of the data is queued,
+  // unless it is interrupted or @nonblocking is set, in which case it returns
+  // how much was queued. Other writes queue one message or nothing.
+  Status<size_t> Write(std::span<const iovec> iov, UnixMsg &anc, bool stream,
+                       bool nonblocking);
+
+  // Dequeues data into @iov, storing the ancillary data of the first message
+  // read in @anc. A stream read takes data from consecutive messages, but
+  // stops at passed files or a change of sender credentials. Other reads take
+  // one message, discarding what doesn't fit and setting @trunc. Returns 0 at
+  // end of file.
+  Status<size_t> Read(std::span<const iovec> iov, UnixMsg &anc, bool stream,
+                      bool peek, bool nonblocking, bool *trunc);
+
+  // Stops reading; queued messages are dropped and writers fail with EPIPE.
+  void CloseReader();
+  // Stops writing; readers see end of file once the queue is empty.
+  void CloseWriter();
+
+  void AttachReadPoll(PollSource *p);
+  void AttachWritePoll(PollSource *p);
+
+  template <class Archive>
+  void save(Archive &ar) const {
+    std::vector<UnixMsg> msgs(msgs_.begin(), msgs_.end());
+    ar(capacity_, msgs, used_, reader_closed_, writer_closed_);
+  }
+
+  template <class Archive>
+  static void load_and_construct(Archive &ar,
+                                 cereal::construct<UnixChannel> &construct) {
+    size_t capacity;
+    ar(capacity);
+    construct(capacity);
+
+    UnixChannel &c = *construct.ptr();
+    std::vector<UnixMsg> msgs;
+    ar(msgs, c.used_, c.reader_closed_, c.writer_closed_);
+    for (UnixMsg &m : msgs) c.msgs_.push_back(std::move(m));
+  }
+
+ private:
+  [[nodiscard]] size_t space() const {
+    return used_ < capacity_ ? capacity_ - used_ : 0;
+  }
+  [[nodiscard]] bool writable() const;
+
+  // Updates pollers and wakes writers after data was dequeued.
+  void Consumed();
+
+  rt::Spin lock_;
+  rt::WaitQueue read_waiters_;
+  rt::WaitQueue write_waiters_;
+  std::deque<UnixMsg> msgs_;
+  size_t used_{0};
+  size_t capacity_;
+  bool reader_closed_{false};
+  bool writer_closed_{false};
+  PollSource *read_poll_{nullptr};
+  PollSource *write_poll_{nullptr};
+};
+
+// An AF_UNIX socket of type SOCK_STREAM, SOCK_DGRAM or SOCK_SEQPACKET. Peers
+// are always in the same Junction instance, so data moves through in-memory
+// channels.
+class UnixSocket : public Socket {
+ public:
+  UnixSocket(int type, int flags = 0) noexcept;
+  // A connected socket that reads from @rx and writes to @tx.
+  UnixSocket(int type, std::shared_ptr<UnixChannel> rx,
+             std::shared_ptr<UnixChannel> tx, int flags = 0) noexcept;
+  ~UnixSocket() override;
+
+  // Creates a pair of connected sockets (see socketpair(2)).
+  static std::pair<std::shared_ptr<UnixSocket>, std::shared_ptr<UnixSocket>>
+  CreatePair(int type, int flags = 0);
+
+  // Binds to @name; an empty name picks an unused abstract name.
+  Status<void> BindName(std::string_view name);
+  Status<void> ConnectName(std::string_view name);
+
+  // Sends @iov to @name, or to the connected peer if @name is null.
+  Status<size_t> SendTo(std::span<const iovec> iov, const std::string *name,
+                        MsgOptions &opts);
+  // Receives into @iov, storing the sender's name in @name (if not null). If
+  // @opts is null, any passed files are closed.
+  Status<size_t> RecvFrom(std::span<const iovec> iov, std::string *name,
+                          bool peek, bool nonblocking, MsgOptions *opts,
+                          bool *trunc);
+
+  // The name this socket is bound to (empty if unnamed).
+  [[nodiscard]] const std::string &name() const { return name_; }
+  Status<std::string> PeerName() const;
+
+  Status<void> Listen(int backlog) override;
+  Status<std::shared_ptr<Socket>> Accept(int flags = 0) override;
+  Status<void> Shutdown(int how) override;
+
+  Status<size_t> ReadFrom(std::span<std::byte> buf,
+                          [[maybe_unused]] netaddr *raddr,
+                          bool peek = false) override {
+    iovec iov = {buf.data(), buf.size()};
+    return RecvFrom({&iov, 1}, nullptr, peek, false, nullptr, nullptr);
+  }
+  Status<size_t> WriteTo(std::span<const std::byte> buf,
+                         [[maybe_unused]] const netaddr *raddr) override {
+    iovec iov = {const_cast<std::byte *>(buf.data()), buf.size()};
+    MsgOptions opts;
+    return SendTo({&iov, 1}, nullptr, opts);
+  }
+  Status<size_t> ReadvFrom(std::span<const iovec> iov,
+                           [[maybe_unused]] netaddr *raddr,
+                           bool peek = false) override {
+    return RecvFrom(iov, nullptr, peek, false, nullptr, nullptr);
+  }
+  Status<size_t> WritevTo(std::span<const iovec> iov,
+                          [[maybe_unused]] const netaddr *raddr) override {
+    MsgOptions opts;
+    return SendTo(iov, nullptr, opts);
+  }
+
+  // readv() and writev() must not split a message.
+  Status<size_t> Readv(std::span<iovec> iov,
+                       [[maybe_unused]] off_t *off) override {
+    return RecvFrom(iov, nullptr, false, false, nullptr, nullptr);
+  }
+  Status<size_t> Writev(std::span<const iovec> iov,
+                        [[maybe_unused]] off_t *off) override {
+    MsgOptions opts;
+    return SendTo(iov, nullptr, opts);
+  }
+
+  Status<void> SetSockOpt(int level, int optname,
+                          std::span<const std::byte> optval) override;
+  Status<size_t> GetSockOpt(int level, int optname,
+                            std::span<std::byte> optval) const override;
+
+ private:
+  enum class State { kUnconnected, kListening, kConnected };
+
+  [[nodiscard]] bool is_stream() const { return type_ == SOCK_STREAM; }
+  [[nodiscard]] bool is_dgram() const { return type_ == SOCK_DGRAM; }
+
+  // Finds the socket bound to @name.
+  static Status<std::shared_ptr<UnixSocket>> Find(std::string_view name);
+  // Queues a new connection from @client on the listening socket @listener.
+  static Status<void> Enqueue(std::shared_ptr<UnixSocket> listener,
+                              UnixSocket &client);
+  // Ties the socket's poll source to its channels.
+  void AttachChannels();
+  void Unregister();
+
+  friend class cereal::access;
+
+  template <class Archive>
+  void save(Archive &ar) const {
+    std::vector<std::shared_ptr<UnixSocket>> pending(pending_.begin(),
+                                                     pending_.end());
+    ar(type_, cereal::base_class<Socket>(this), state_, name_, key_,
+       peer_name_, passcred_, shut_wr_, backlog_, rx_, tx_, pending);
+    ar(cereal::binary_data(&peer_creds_, sizeof(peer_creds_)));
+    ar(cereal::binary_data(&listen_creds_, sizeof(listen_creds_)));
+  }
+
+  template <class Archive>
+  static void load_and_construct(Archive &ar,
+                                 cereal::construct<UnixSocket> &construct) {
+    int type;
+    ar(type);
+    construct(type, nullptr, nullptr, 0);
+
+    UnixSocket &s = *construct.ptr();
+    std::vector<std::shared_ptr<UnixSocket>> pending;
+    ar(cereal::base_class<Socket>(&s), s.state_, s.name_, s.key_,
+       s.peer_name_, s.passcred_, s.shut_wr_, s.backlog_, s.rx_, s.tx_,
+       pending);
+    ar(cereal::binary_data(&s.peer_creds_, sizeof(s.peer_creds_)));
+    ar(cereal::binary_data(&s.listen_creds_, sizeof(s.listen_creds_)));
+    for (auto &p : pending) s.pending_.push_back(std::move(p));
+    s.Restore();
+  }
+
+  // Re-registers the socket's name and channels after a restore.
+  void Restore();
+
+  const int type_;
+  State state_{State::kUnconnected};
+  std::string name_;       // the bound name, as given by the user
+  std::string key_;        // the registry key for name_ (empty if unnamed)
+  std::string peer_name_;  // the connected peer's name
+  ucred peer_creds_{0, static_cast<uid_t>(-1), static_cast<gid_t>(-1)};
+  ucred listen_creds_{};
+  bool passcred_{false};
+  bool shut_wr_{false};
+  std::shared_ptr<UnixChannel> rx_;
+  // For datagram sockets, the connected peer's receive channel.
+  std::shared_ptr<UnixChannel> tx_;
+
+  // Protects the accept queue. It is shared with connect() callers blocked on
+  // a full queue, which wait without a reference so that closing the listener
+  // fails them.
+  struct ListenLock {
+    rt::Spin lock;
+    rt::WaitQueue connect_waiters;
+    bool closed{false};  // the listener is being destroyed
+  };
+
+  // Listening sockets only.
+  std::shared_ptr<ListenLock> listen_{std::make_shared<ListenLock>()};
+  rt::WaitQueue accept_waiters_;
+  std::deque<std::shared_ptr<UnixSocket>> pending_;
+  size_t backlog_{0};
+};
+
+// Converts a user-supplied sockaddr_un into a name: a path, or an abstract
+// name starting with a NUL byte. An address with no name gives an empty name.
+Status<std::string> SockAddrToUnixName(const sockaddr *addr, socklen_t addrlen);
+
+// Fills in a user-supplied sockaddr_un, truncating it to @addrlen bytes.
+Status<void> UnixNameToSockAddr(std::string_view name, sockaddr *saddr,
+                                socklen_t *addrlen);
+
+// Returns the credentials that messages sent by @p carry.
+ucred ProcessCreds(const Process &p);
+
+}  // namespace junction
+
+CEREAL_REGISTER_TYPE(junction::UnixSocket);
@@ -0,0 +1,268 @@
+extern "C" {
+#include <stddef.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <unistd.h>
+}
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <string>
+#include <thread>
+
+namespace {
+
+socklen_t MakeAddr(const std::string &name, sockaddr_un *sun) {
+  memset(sun, 0, sizeof(*sun));
+  sun->sun_family = AF_UNIX;
+  memcpy(sun->sun_path, name.data(), name.size());
+  return offsetof(sockaddr_un, sun_path) + name.size();
+}
+
+// Sends @fd with one byte of data over @sock.
+void SendFd(int sock, int fd) {
+  char byte = 'x';
+  iovec iov = {&byte, 1};
+  alignas(cmsghdr) char ctrl[CMSG_SPACE(sizeof(int))];
+  msghdr msg = {};
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = ctrl;
+  msg.msg_controllen = sizeof(ctrl);
+  cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+  memcpy(CMSG_DATA(cmsg), &fd, sizeof(fd));
+  ASSERT_EQ(sendmsg(sock, &msg, 0), 1);
+}
+
+// Receives a file descriptor sent by SendFd().
+int RecvFd(int sock) {
+  char byte;
+  iovec iov = {&byte, 1};
+  alignas(cmsghdr) char ctrl[CMSG_SPACE(sizeof(int))];
+  msghdr msg = {};
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = ctrl;
+  msg.msg_controllen = sizeof(ctrl);
+  if (recvmsg(sock, &msg, MSG_CMSG_CLOEXEC) != 1) return -1;
+  cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+  if (!cmsg || cmsg->cmsg_level != SOL_SOCKET ||
+      cmsg->cmsg_type != SCM_RIGHTS) {
+    return -1;
+  }
+  int fd;
+  memcpy(&fd, CMSG_DATA(cmsg), sizeof(fd));
+  return fd;
+}
+
+}  // namespace
+
+TEST(UnixSocketTest, StreamPath) {
+  std::string path = "/tmp/unix_socket_test." + std::to_string(getpid());
+  unlink(path.c_str());
+  sockaddr_un sun;
+  socklen_t len = MakeAddr(path, &sun);
+
+  int lfd = socket(AF_UNIX, SOCK_STREAM, 0);
+  ASSERT_GE(lfd, 0);
+  ASSERT_EQ(bind(lfd, reinterpret_cast<sockaddr *>(&sun), len), 0);
+  ASSERT_EQ(listen(lfd, 4), 0);
+
+  int again = socket(AF_UNIX, SOCK_STREAM, 0);
+  ASSERT_GE(again, 0);
+  EXPECT_EQ(bind(again, reinterpret_cast<sockaddr *>(&sun), len), -1);
+  EXPECT_EQ(errno, EADDRINUSE);
+  close(again);
+
+  std::thread client([&] {
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    ASSERT_GE(fd, 0);
+    ASSERT_EQ(connect(fd, reinterpret_cast<sockaddr *>(&sun), len), 0);
+    sockaddr_un peer;
+    socklen_t plen = sizeof(peer);
+    ASSERT_EQ(getpeername(fd, reinterpret_cast<sockaddr *>(&peer), &plen), 0);
+    EXPECT_STREQ(peer.sun_path, path.c_str());
+    ASSERT_EQ(write(fd, "hello", 5), 5);
+    char buf[5];
+    ASSERT_EQ(read(fd, buf, sizeof(buf)), 5);
+    EXPECT_EQ(memcmp(buf, "world", 5), 0);
+    close(fd);
+  });
+
+  int fd = accept(lfd, nullptr, nullptr);
+  ASSERT_GE(fd, 0);
+  char buf[5];
+  ASSERT_EQ(read(fd, buf, sizeof(buf)), 5);
+  EXPECT_EQ(memcmp(buf, "hello", 5), 0);
+  ASSERT_EQ(write(fd, "world", 5), 5);
+  client.join();
+  EXPECT_EQ(read(fd, buf, sizeof(buf)), 0);
+
+  close(fd);
+  close(lfd);
+  unlink(path.c_str());
+}
+
+TEST(UnixSocketTest, CloseFailsBlockedConnect) {
+  std::string name = std::string(1, '\0') + "unix_socket_test.refused." +
+                     std::to_string(getpid());
+  sockaddr_un sun;
+  socklen_t len = MakeAddr(name, &sun);
+
+  // The accept queue holds one connection more than the backlog.
+  int lfd = socket(AF_UNIX, SOCK_STREAM, 0);
+  ASSERT_GE(lfd, 0);
+  ASSERT_EQ(bind(lfd, reinterpret_cast<sockaddr *>(&sun), len), 0);
+  ASSERT_EQ(listen(lfd, 0), 0);
+  int queued = socket(AF_UNIX, SOCK_STREAM, 0);
+  ASSERT_GE(queued, 0);
+  ASSERT_EQ(connect(queued, reinterpret_cast<sockaddr *>(&sun), len), 0);
+
+  int ret, err;
+  std::thread client([&] {
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    ret = connect(fd, reinterpret_cast<sockaddr *>(&sun), len);
+    err = errno;
+    close(fd);
+  });
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  close(lfd);
+  client.join();
+  EXPECT_EQ(ret, -1);
+  EXPECT_EQ(err, ECONNREFUSED);
+  close(queued);
+}
+
+TEST(UnixSocketTest, AbstractDatagram) {
+  std::string name(1, '\0');
+  name += "unix_socket_test." + std::to_string(getpid());
+  sockaddr_un sun;
+  socklen_t len = MakeAddr(name, &sun);
+
+  int rfd = socket(AF_UNIX, SOCK_DGRAM, 0);
+  ASSERT_GE(rfd, 0);
+  ASSERT_EQ(bind(rfd, reinterpret_cast<sockaddr *>(&sun), len), 0);
+
+  // An empty address autobinds to an abstract name.
+  int sfd = socket(AF_UNIX, SOCK_DGRAM, 0);
+  ASSERT_GE(sfd, 0);
+  sockaddr_un any = {};
+  any.sun_family = AF_UNIX;
+  ASSERT_EQ(bind(sfd, reinterpret_cast<sockaddr *>(&any), sizeof(sa_family_t)),
+            0);
+  sockaddr_un self;
+  socklen_t slen = sizeof(self);
+  ASSERT_EQ(getsockname(sfd, reinterpret_cast<sockaddr *>(&self), &slen), 0);
+  EXPECT_EQ(slen, offsetof(sockaddr_un, sun_path) + 6);
+  EXPECT_EQ(self.sun_path[0], '\0');
+
+  ASSERT_EQ(sendto(sfd, "first", 5, 0, reinterpret_cast<sockaddr *>(&sun), len),
+            5);
+  ASSERT_EQ(sendto(sfd, "second", 6, 0, reinterpret_cast<sockaddr *>(&sun),
+                   len),
+            6);
+
+  char buf[16];
+  sockaddr_un from;
+  socklen_t flen = sizeof(from);
+  ASSERT_EQ(recvfrom(rfd, buf, sizeof(buf), 0,
+                     reinterpret_cast<sockaddr *>(&from), &flen),
+            5);
+  EXPECT_EQ(memcmp(buf, "first", 5), 0);
+  EXPECT_EQ(flen, slen);
+  EXPECT_EQ(memcmp(&from, &self, slen), 0);
+
+  // A datagram that doesn't fit is truncated.
+  iovec iov = {buf, 3};
+  msghdr msg = {};
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  ASSERT_EQ(recvmsg(rfd, &msg, 0), 3);
+  EXPECT_TRUE(msg.msg_flags & MSG_TRUNC);
+  EXPECT_EQ(memcmp(buf, "sec", 3), 0);
+
+  close(sfd);
+  close(rfd);
+}
+
+TEST(UnixSocketTest, SeqPacket) {
+  int sv[2];
+  ASSERT_EQ(socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sv), 0);
+  ASSERT_EQ(write(sv[0], "abc", 3), 3);
+  ASSERT_EQ(write(sv[0], "defg", 4), 4);
+
+  char buf[16];
+  EXPECT_EQ(read(sv[1], buf, sizeof(buf)), 3);
+  EXPECT_EQ(read(sv[1], buf, sizeof(buf)), 4);
+  EXPECT_EQ(memcmp(buf, "defg", 4), 0);
+
+  close(sv[0]);
+  EXPECT_EQ(read(sv[1], buf, sizeof(buf)), 0);
+  close(sv[1]);
+}
+
+TEST(UnixSocketTest, PassFd) {
+  int sv[2];
+  ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM, 0, sv), 0);
+  int pfd[2];
+  ASSERT_EQ(pipe(pfd), 0);
+
+  SendFd(sv[0], pfd[1]);
+  close(pfd[1]);
+  int wfd = RecvFd(sv[1]);
+  ASSERT_GE(wfd, 0);
+
+  ASSERT_EQ(write(wfd, "fd", 2), 2);
+  close(wfd);
+  char buf[4];
+  EXPECT_EQ(read(pfd[0], buf, sizeof(buf)), 2);
+  EXPECT_EQ(memcmp(buf, "fd", 2), 0);
+  // The received descriptor was the last writer.
+  EXPECT_EQ(read(pfd[0], buf, sizeof(buf)), 0);
+
+  close(pfd[0]);
+  close(sv[0]);
+  close(sv[1]);
+}
+
+TEST(UnixSocketTest, Credentials) {
+  int sv[2];
+  ASSERT_EQ(socketpair(AF_UNIX, SOCK_DGRAM, 0, sv), 0);
+
+  ucred peer;
+  socklen_t len = sizeof(peer);
+  ASSERT_EQ(getsockopt(sv[0], SOL_SOCKET, SO_PEERCRED, &peer, &len), 0);
+  EXPECT_EQ(len, sizeof(peer));
+  EXPECT_EQ(peer.pid, getpid());
+
+  int one = 1;
+  ASSERT_EQ(setsockopt(sv[1], SOL_SOCKET, SO_PASSCRED, &one, sizeof(one)), 0);
+  ASSERT_EQ(write(sv[0], "c", 1), 1);
+
+  char byte;
+  iovec iov = {&byte, 1};
+  alignas(cmsghdr) char ctrl[CMSG_SPACE(sizeof(ucred))];
+  msghdr msg = {};
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = ctrl;
+  msg.msg_controllen = sizeof(ctrl);
+  ASSERT_EQ(recvmsg(sv[1], &msg, 0), 1);
+  cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+  ASSERT_NE(cmsg, nullptr);
+  EXPECT_EQ(cmsg->cmsg_level, SOL_SOCKET);
+  EXPECT_EQ(cmsg->cmsg_type, SCM_CREDENTIALS);
+  ucred creds;
+  memcpy(&creds, CMSG_DATA(cmsg), sizeof(creds));
+  EXPECT_EQ(creds.pid, getpid());
+
+  close(sv[0]);
+  close(sv[1]);
+}
@@ -117,6 +117,14 @@ void ServerWorker(int c) {
   }
 }
 
+// Returns the SO_BUSY_POLL budget to set on connections, in microseconds.
+// Under Junction, /proc/<pid>/busy_poll reports how often spinning paid off.
+static int BusyPollBudget() {
+  static char *env = getenv("BUSY_POLL_US");
+  if (!env) return 0;
+  return atoi(env);
+}
+
 void RunServer() {
   int q = socket(AF_INET, SOCK_STREAM, 0);
   if (q == -1) {
@@ -156,6 +164,10 @@ void RunServer() {
       close(q);
       exit(1);
     }
+    if (int us = BusyPollBudget();
+        us > 0 && setsockopt(c, SOL_SOCKET, SO_BUSY_POLL, &us, sizeof(us))) {
+      perror("setsockopt");
+    }
     std::thread([=] { ServerWorker(c); }).detach();
   }
 }
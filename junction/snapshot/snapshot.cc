@@ -10,6 +10,7 @@ extern "C" {
 
 #include "junction/base/error.h"
 #include "junction/fs/file.h"
+#include "junction/fs/linuxfs/writeback.h"
 #include "junction/kernel/elf.h"
 #include "junction/kernel/ksys.h"
 #include "junction/kernel/proc.h"
@@ -153,6 +154,12 @@ Status<void> SnapshotPid(pid_t pid, std::string_view metadata_path,
   p->Signal(SIGSTOP);
   p->WaitForFullStop();
 
+  // Buffered writes to linux files are not part of the snapshot.
+  if (Status<void> ret = linuxfs::WriteBack::FlushAll(); !ret) {
+    p->Signal(SIGCONT);
+    return ret;
+  }
+
   LOG(INFO) << "snapshotting proc " << pid << " into " << metadata_path
             << " and " << elf_path;
   SnapshotMetadata(*p.get(), metadata_path);
@@ -39,7 +39,8 @@ static struct sock_filter caladan_filter[] = {
 static struct sock_filter writeable_linux_fs[] = {
     ALLOW_JUNCTION_SYSCALL(mkdirat),   ALLOW_JUNCTION_SYSCALL(linkat),
     ALLOW_JUNCTION_SYSCALL(unlinkat),  ALLOW_JUNCTION_SYSCALL(renameat2),
-    ALLOW_JUNCTION_SYSCALL(symlinkat), ALLOW_JUNCTION_SYSCALL(truncate)};
+    ALLOW_JUNCTION_SYSCALL(symlinkat), ALLOW_JUNCTION_SYSCALL(truncate),
+    ALLOW_JUNCTION_SYSCALL(copy_file_range)};
 
 // Syscalls needed to query dents/inodes in the host fs at runtime.
 static struct sock_filter uncached_linux_fs[] = {
@@ -61,7 +62,13 @@ static struct sock_filter junction_core[] = {
     ALLOW_JUNCTION_SYSCALL(mprotect),   ALLOW_JUNCTION_SYSCALL(madvise),
     ALLOW_JUNCTION_SYSCALL(openat),     ALLOW_JUNCTION_SYSCALL(close),
     ALLOW_JUNCTION_SYSCALL(preadv2),    ALLOW_JUNCTION_SYSCALL(pread64),
-    ALLOW_JUNCTION_SYSCALL(exit_group),
+    ALLOW_JUNCTION_SYSCALL(exit_group), ALLOW_JUNCTION_SYSCALL(mremap),
+    ALLOW_JUNCTION_SYSCALL(ftruncate),  ALLOW_JUNCTION_SYSCALL(fallocate),
+    ALLOW_JUNCTION_SYSCALL(memfd_create), ALLOW_JUNCTION_SYSCALL(mincore),
+    ALLOW_JUNCTION_SYSCALL(fsync),      ALLOW_JUNCTION_SYSCALL(fdatasync),
+    ALLOW_JUNCTION_SYSCALL(io_uring_enter),
+    ALLOW_JUNCTION_SYSCALL(fadvise64),
+    ALLOW_JUNCTION_SYSCALL(fcntl),
 };
 
 constexpr size_t filterMax =